@@ -9,6 +9,8 @@
 #include "types.h"
 
 #define NEB_EVDP_DEFAULT_BATCH_SIZE 10
+#define NEB_EVDP_ADAPTIVE_BATCH_SIZE_MAX 1024
+#define NEB_EVDP_TIMER_WHEEL_DEFAULT_TICK_USEC 1000
 
 /*
  * Queue Functions
@@ -16,11 +18,103 @@
 
 typedef neb_evdp_cb_ret_t (*neb_evdp_queue_handler_t)(void *udata);
 
+/*
+ * source priority classes, events got in a round are dispatched from the
+ * highest class to the lowest, and in kernel order within the same class
+ */
+enum {
+	NEB_EVDP_PRIO_HIGH = 0, // control plane sources, e.g. health checks and admin commands
+	NEB_EVDP_PRIO_NORMAL,   // the default
+	NEB_EVDP_PRIO_LOW,      // bulk data sources
+	NEB_EVDP_PRIO_MAX,
+};
+
+/*
+ * queue conf, 0 means default for all fields
+ *  the io_uring fields are ignored by other drivers
+ */
+struct neb_evdp_queue_conf {
+	int batch_size; // the minimal one if adaptive_batch is set
+	int batch_size_max; // valid if adaptive_batch is set, default to NEB_EVDP_ADAPTIVE_BATCH_SIZE_MAX
+	unsigned int busy_poll_usec; // spin with nonblocking waits before blocking, also set to epoll busy poll params
+	int prio_budget[NEB_EVDP_PRIO_MAX]; // max ro_fd events of each priority class handled in a round,
+	                                    // the rest are deferred to later rounds
+	/* round budget, at least one event and one timer callback are run in a round */
+	int round_events; // max events handled in a round, the rest are handled in the next round without waiting
+	int round_timers; // max timer callbacks run in a round, the rest are run in the next round
+	unsigned int round_budget_usec; // max time spent in event and timer callbacks in a round
+	/* io_uring */
+	unsigned int sq_entries;
+	unsigned int cq_entries;
+	unsigned int sqpoll_idle_msec; // valid if sqpoll is set
+	uint32_t sqpoll:1;
+	uint32_t coop_taskrun:1;
+	uint32_t single_issuer:1;
+	uint32_t defer_taskrun:1; // imply single_issuer, conflict with sqpoll
+	/* epoll */
+	uint32_t ctl_coalesce:1; // coalesce os_fd changes in a round, and use level triggered mode
+	/* all */
+	uint32_t adaptive_batch:1; // double batch size on full batch, and halve it when idle
+	uint32_t instrument:1; // record histograms, see neb_evdp_queue_get_hist
+	uint32_t cache_time:1; // read time only once after each wakeup, timers may be late by the time spent in a round
+};
+
+struct neb_evdp_queue_stats {
+	uint64_t rounds;
+	uint64_t events;
+	int pending;
+	int running;
+	uint64_t ctl_calls; // syscalls to update the kernel event set, epoll only
+	uint64_t ctl_saved; // syscalls saved by ctl_coalesce
+	uint64_t full_batches; // rounds that got a full batch of events
+	int batch_size; // current batch size
+	uint64_t spin_hits; // waits that got events while spinning, see busy_poll_usec
+	uint64_t sleeps; // blocking waits
+	uint64_t prio_deferred; // ro_fd events deferred by prio_budget
+	uint64_t carried_events; // events carried over to the next round by the round budget
+};
+
+/*
+ * queue histograms, durations are in ns
+ */
+enum {
+	NEB_EVDP_HIST_WAIT = 0,      // time blocked waiting for events
+	NEB_EVDP_HIST_FLUSH,         // time to flush pending sources
+	NEB_EVDP_HIST_EVENTS,        // events per wakeup, not a duration
+	NEB_EVDP_HIST_TIMER_LAG,     // actual minus scheduled fire time of timer points, by neb_time_gettime_fast
+	NEB_EVDP_HIST_FOREACH,       // time of each neb_evdp_queue_foreach_next
+	NEB_EVDP_HIST_CB_TIMER,      // callback of timer points
+	NEB_EVDP_HIST_CB_SYS_TIMER,  // callback of itimer and abstimer sources
+	NEB_EVDP_HIST_CB_RO_FD,
+	NEB_EVDP_HIST_CB_OS_FD,
+	NEB_EVDP_HIST_CB_ET_FD,
+	NEB_EVDP_HIST_CB_NOTIFY,
+	NEB_EVDP_HIST_CB_CIO,
+	NEB_EVDP_HIST_MAX,
+};
+
+#define NEB_EVDP_HIST_SUB_BITS 4  // relative error within 1/16
+#define NEB_EVDP_HIST_MAX_BITS 40 // values larger than 2^40 are counted in the last bucket
+#define NEB_EVDP_HIST_BUCKETS ((NEB_EVDP_HIST_MAX_BITS - NEB_EVDP_HIST_SUB_BITS + 1) << NEB_EVDP_HIST_SUB_BITS)
+
+/*
+ * log-linear histogram, values below 2^NEB_EVDP_HIST_SUB_BITS are exact, and
+ * each power of 2 range above is split into 2^NEB_EVDP_HIST_SUB_BITS buckets
+ */
+struct neb_evdp_hist {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[NEB_EVDP_HIST_BUCKETS];
+};
+
 /**
  * \param[in] batch_size default to NEB_EVDP_DEFAULT_BATCH_SIZE
  */
 extern neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 	_nattr_warn_unused_result;
+extern neb_evdp_queue_t neb_evdp_queue_create_ex(const struct neb_evdp_queue_conf *conf)
+	_nattr_warn_unused_result _nattr_nonnull((1));
 extern void neb_evdp_queue_destroy(neb_evdp_queue_t q)
  	_nattr_nonnull((1));
 
@@ -52,6 +146,12 @@ static inline void neb_evdp_queue_get_abs_timeout_ms(neb_evdp_queue_t q, int mse
 	struct timespec dur_ts = { .tv_sec = 0, .tv_nsec = msec * 1000000 };
 	neb_evdp_queue_get_abs_timeout(q, &dur_ts, abs_ts);
 }
+/**
+ * \brief get the cached time, which is updated after each wakeup, or by
+ *        neb_evdp_queue_update_cur_ts
+ */
+extern void neb_evdp_queue_get_cur_ts(neb_evdp_queue_t q, struct timespec *ts)
+	_nattr_nonnull((1, 2));
 /**
  * \note use this function only when really needed, i.e. timeout msec < 10
  */
@@ -73,6 +173,22 @@ extern int neb_evdp_queue_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to
 extern int neb_evdp_queue_run(neb_evdp_queue_t q)
 	_nattr_nonnull((1));
 
+extern void neb_evdp_queue_get_stats(neb_evdp_queue_t q, struct neb_evdp_queue_stats *stats)
+	_nattr_nonnull((1, 2));
+/**
+ * \brief get a snapshot of the histogram, requires instrument set in queue conf
+ * \param[in] id NEB_EVDP_HIST_*
+ * \note it is lock free and can be called in any thread
+ */
+extern int neb_evdp_queue_get_hist(neb_evdp_queue_t q, int id, struct neb_evdp_hist *h)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3));
+/**
+ * \param[in] percentile 0 - 100
+ * \return the highest value in the bucket at the percentile, or 0 if empty
+ */
+extern uint64_t neb_evdp_hist_percentile(const struct neb_evdp_hist *h, double percentile)
+	_nattr_nonnull((1));
+
 /**
  * \return NEB_EVDP_CB_CONTINUE or NEB_EVDP_CB_REMOVE or NEB_EVDP_CB_END_FOREACH
  * \note for NEB_EVDP_CB_REMOVE, there may be a later batch remove after all sources checked
@@ -114,6 +230,14 @@ typedef neb_evdp_timeout_ret_t (*neb_evdp_timeout_handler_t)(void *udata);
  *                        the same rbtree node may have multi cblist nodes
  */
 extern neb_evdp_timer_t neb_evdp_timer_create(int tcache_size, int lcache_size);
+/**
+ * \brief create a timer based on hierarchical timing wheel
+ * \param[in] tick_usec tick granularity, default to NEB_EVDP_TIMER_WHEEL_DEFAULT_TICK_USEC if <= 0
+ * \param[in] ncache_size point node cache number
+ * \note add/reset/del of points are O(1), but points may be fired at most one
+ *       tick later than the requested time
+ */
+extern neb_evdp_timer_t neb_evdp_timer_create_wheel(int tick_usec, int ncache_size);
 /**
  * \brief destroy the timer, all pending and kept points will also be freed
  */
@@ -138,6 +262,14 @@ typedef int (*neb_evdp_source_handler_t)(neb_evdp_source_t s);
 
 extern int neb_evdp_source_del(neb_evdp_source_t s)
 	_nattr_nonnull((1));
+/**
+ * \brief pre-allocate memory for count sources in the current thread
+ * \note sources are allocated from per-thread slab caches, which are moved to
+ *       a shared pool at thread exit, so it is better to reserve in the thread
+ *       which creates the sources
+ */
+extern int neb_evdp_source_reserve(int count)
+	_nattr_warn_unused_result;
 /**
  * \brief set utype for foreach call
  * \param[in] utype a user set value for use in foreach callback.
@@ -151,6 +283,12 @@ extern void *neb_evdp_source_get_udata(neb_evdp_source_t s)
 	_nattr_nonnull((1));
 extern neb_evdp_queue_t neb_evdp_source_get_queue(neb_evdp_source_t s)
 	_nattr_nonnull((1));
+/**
+ * \param[in] prio NEB_EVDP_PRIO_*, default to NEB_EVDP_PRIO_NORMAL
+ * \note it takes effect from the next round if already attached
+ */
+extern int neb_evdp_source_set_priority(neb_evdp_source_t s, int prio)
+	_nattr_warn_unused_result _nattr_nonnull((1));
 /**
  * \brief set cb that is called when source is removed from queue
  * \note the source is not auto deleted after on_remove, but you can always call
@@ -0,0 +1,36 @@
+
+#ifndef NEB_EVDP_DEFER_H
+#define NEB_EVDP_DEFER_H 1
+
+#include <nebase/cdefs.h>
+
+#include "types.h"
+
+/*
+ * defer and idle source
+ *  callbacks run at the end of a round, after events and timers, without any
+ *  syscall. A defer source runs once in the round it is activated, e.g. to
+ *  flush output buffers once per round. An idle source runs in every round,
+ *  and the queue will not block while any is attached.
+ */
+
+/**
+ * \return NEB_EVDP_CB_REMOVE or NEB_EVDP_CB_CLOSE to detach the source
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_defer_handler_t)(void *udata);
+
+extern neb_evdp_source_t neb_evdp_source_new_defer(neb_evdp_defer_handler_t df)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern neb_evdp_source_t neb_evdp_source_new_idle(neb_evdp_defer_handler_t df)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+/**
+ * \brief run the defer source at the end of the current round
+ * \note it should be attached, and activations before it runs are coalesced,
+ *       activating in its own or other defer callbacks will run it in the next
+ *       round, without blocking
+ */
+extern int neb_evdp_source_defer_activate(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+#endif
@@ -0,0 +1,94 @@
+
+#ifndef NEB_EVDP_GROUP_H
+#define NEB_EVDP_GROUP_H 1
+
+#include <nebase/cdefs.h>
+
+#include <stdbool.h>
+
+#include "types.h"
+
+/*
+ * Queue Group
+ *  one queue per thread, which is created by neb_thread_create, so
+ *  neb_thread_init should be called before start the group
+ */
+
+struct neb_evdp_group;
+typedef struct neb_evdp_group* neb_evdp_group_t;
+
+/**
+ * \brief called in the queue thread after the queue is created
+ * \param[in] index index of the queue in the group, from 0
+ * \return 0 if ok, or the thread will exit and the group start will fail
+ * \note create SO_REUSEPORT sockets and attach them to q here
+ */
+typedef int (*neb_evdp_group_setup_t)(neb_evdp_queue_t q, int index, void *udata);
+/**
+ * \brief called in the queue thread after the queue stopped running
+ * \note all sources attached in setup should be detached and deleted here
+ */
+typedef void (*neb_evdp_group_cleanup_t)(neb_evdp_queue_t q, int index, void *udata);
+/**
+ * \brief called in the queue thread for fd dispatched by neb_evdp_group_dispatch_fd
+ * \return 0 if the fd is taken over, or it will be closed
+ */
+typedef int (*neb_evdp_group_fd_handler_t)(neb_evdp_queue_t q, int index, int fd, void *udata);
+
+/**
+ * \param[in] nqueues number of queues, default to the number of online cpus if <= 0
+ * \param[in] batch_size batch size of each queue, see neb_evdp_queue_create
+ */
+extern neb_evdp_group_t neb_evdp_group_create(int nqueues, int batch_size)
+	_nattr_warn_unused_result;
+/**
+ * \brief destroy the group, neb_evdp_group_stop will be called if still running
+ */
+extern void neb_evdp_group_destroy(neb_evdp_group_t g)
+	_nattr_nonnull((1));
+
+extern int neb_evdp_group_get_size(neb_evdp_group_t g)
+	_nattr_nonnull((1));
+/**
+ * \brief pin the nth queue thread to the nth allowed cpu, default off
+ * \note only supported on Linux and FreeBSD, ignored on others
+ */
+extern void neb_evdp_group_set_cpu_affinity(neb_evdp_group_t g, bool enable)
+	_nattr_nonnull((1));
+extern void neb_evdp_group_set_udata(neb_evdp_group_t g, void *udata)
+	_nattr_nonnull((1));
+/**
+ * \param[in] cleanup could be NULL
+ */
+extern void neb_evdp_group_set_setup(neb_evdp_group_t g, neb_evdp_group_setup_t setup, neb_evdp_group_cleanup_t cleanup)
+	_nattr_nonnull((1, 2));
+extern void neb_evdp_group_set_fd_handler(neb_evdp_group_t g, neb_evdp_group_fd_handler_t fh)
+	_nattr_nonnull((1, 2));
+
+/**
+ * \brief start all queue threads, and wait for them to be ready
+ * \note should be called in the main thread
+ */
+extern int neb_evdp_group_start(neb_evdp_group_t g)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief ask all queues to quit and wait for the threads to exit
+ * \return 0 if all threads exit normally
+ */
+extern int neb_evdp_group_stop(neb_evdp_group_t g)
+	_nattr_nonnull((1));
+
+/**
+ * \brief hand off fd to the next queue in round-robin order
+ * \note thread safe, and the fd is owned by the group if success
+ * \return the index of the selected queue, or -1 if failed
+ */
+extern int neb_evdp_group_dispatch_fd(neb_evdp_group_t g, int fd)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief hand off fd to the queue with the given index
+ */
+extern int neb_evdp_group_dispatch_fd_to(neb_evdp_group_t g, int index, int fd)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+#endif
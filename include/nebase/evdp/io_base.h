@@ -42,6 +42,28 @@ extern neb_evdp_source_t neb_evdp_source_new_ro_fd(int fd, neb_evdp_io_handler_t
 extern neb_evdp_source_t neb_evdp_source_new_os_fd(int fd, neb_evdp_io_handler_t hf)
 	_nattr_warn_unused_result _nattr_nonnull((2));
 
+/*
+ * edge triggered fd source
+ *  the handlers are called only when the fd becomes ready again, so rf should
+ *  read until EAGAIN, or the remaining data will not be notified. Write
+ *  interest is oneshot: wf is called once after attach, then
+ *  neb_evdp_source_et_fd_want_write should be called after write got EAGAIN.
+ *  There is no control syscall after attach for drivers with native edge
+ *  triggered support (epoll, kevent, io_uring).
+ */
+
+/**
+ * \param[in] rf NULL if read is not needed
+ * \param[in] wf NULL if write is not needed
+ */
+extern neb_evdp_source_t neb_evdp_source_new_et_fd(int fd, neb_evdp_io_handler_t rf, neb_evdp_io_handler_t wf, neb_evdp_io_handler_t hf)
+	_nattr_warn_unused_result _nattr_nonnull((4));
+/**
+ * \brief ask for the next write event, should be called after write got EAGAIN
+ */
+extern int neb_evdp_source_et_fd_want_write(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
 extern int neb_evdp_source_os_fd_reset(neb_evdp_source_t s, int fd)
 	_nattr_warn_unused_result _nattr_nonnull((1));
 /**
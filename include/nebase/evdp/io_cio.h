@@ -0,0 +1,89 @@
+
+#ifndef NEB_EVDP_IO_CIO_H
+#define NEB_EVDP_IO_CIO_H 1
+
+#include <nebase/cdefs.h>
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "types.h"
+#include "io_base.h"
+
+/*
+ * completion based socket I/O source
+ *  the I/O is done by the kernel, and the handlers get the results, so there
+ *  is no extra syscall per message. Only supported by the io_uring driver.
+ *  - recv: multishot recv with a provided buffer ring
+ *  - accept: multishot accept, for listen sockets
+ *  - send: send/sendmsg, sends queued in the same round are linked in order
+ *  no handler will be called after the source is detached, but the send buffers
+ *  may still be used by the kernel, see neb_evdp_source_cio_set_send_release.
+ */
+
+/**
+ * \param[in] buf valid only within the handler, NULL if peer closed
+ * \param[in] len 0 if peer closed
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_cio_recv_handler_t)(int fd, void *udata, const void *buf, size_t len);
+/**
+ * \param[in] res bytes sent, or -errno, -ECANCELED if a previous linked send failed
+ * \param[in] sdata the one passed to send functions, the buffer can be released now
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_cio_send_handler_t)(int fd, void *udata, ssize_t res, void *sdata);
+/**
+ * \param[in] res bytes sent, or -errno, -ECANCELED if cancelled
+ * \param[in] sdata the one passed to send functions, the buffer can be released now
+ */
+typedef void (*neb_evdp_cio_send_release_t)(ssize_t res, void *sdata);
+/**
+ * \param[in] new_fd the accepted nonblock and cloexec fd, which should be closed by user
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_cio_accept_handler_t)(int fd, void *udata, int new_fd);
+
+/**
+ * \brief whether completion based sources are supported by the current driver
+ */
+extern bool neb_evdp_cio_is_supported(void);
+
+/**
+ * \param[in] hf called if recv failed, sockerr can be got by neb_evdp_sock_get_sockerr
+ */
+extern neb_evdp_source_t neb_evdp_source_new_cio_sock(int fd, neb_evdp_io_handler_t hf)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+extern neb_evdp_source_t neb_evdp_source_new_cio_listen(int fd, neb_evdp_cio_accept_handler_t af, neb_evdp_io_handler_t hf)
+	_nattr_warn_unused_result _nattr_nonnull((2, 3));
+
+/**
+ * \brief enable multishot recv, should be called before attach
+ * \param[in] buf_count number of provided buffers, should be power of 2
+ * \param[in] buf_size size of each buffer
+ */
+extern int neb_evdp_source_cio_set_recv(neb_evdp_source_t s, neb_evdp_cio_recv_handler_t rf, int buf_count, int buf_size)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern void neb_evdp_source_cio_set_send_handler(neb_evdp_source_t s, neb_evdp_cio_send_handler_t sf)
+	_nattr_nonnull((1, 2));
+/**
+ * \brief set the release callback for sends whose send handler is not called,
+ *        i.e. sends in flight when detached, or not submitted when the source
+ *        or the queue is deleted. It is called once the kernel is done with the
+ *        buffer, may be after the source is deleted, should be set before send
+ */
+extern void neb_evdp_source_cio_set_send_release(neb_evdp_source_t s, neb_evdp_cio_send_release_t rf)
+	_nattr_nonnull((1, 2));
+
+/**
+ * \brief queue a send, which will be submitted at the start of the next round
+ * \note buf should be valid until the send handler or the send release called
+ */
+extern int neb_evdp_source_cio_send(neb_evdp_source_t s, const void *buf, size_t len, void *sdata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \note msg will be copied, but the iov and the data should be valid until the
+ *       send handler or the send release called
+ */
+extern int neb_evdp_source_cio_sendmsg(neb_evdp_source_t s, const struct msghdr *msg, void *sdata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
+#endif
@@ -0,0 +1,42 @@
+
+#ifndef NEB_EVDP_NOTIFY_H
+#define NEB_EVDP_NOTIFY_H 1
+
+#include <nebase/cdefs.h>
+
+#include "types.h"
+
+/*
+ * notify source
+ *  other threads can wake up the queue or post tasks to it, all tasks posted
+ *  before the wakeup are run in batch in the queue thread, and signals during
+ *  the same burst will be coalesced into one wakeup.
+ */
+
+typedef void (*neb_evdp_notify_task_t)(void *arg);
+/**
+ * \brief called in the queue thread after all posted tasks run
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_notify_handler_t)(void *udata);
+
+/**
+ * \param[in] nf could be NULL if only tasks are used
+ */
+extern neb_evdp_source_t neb_evdp_source_new_notify(neb_evdp_notify_handler_t nf)
+	_nattr_warn_unused_result;
+
+/**
+ * \brief wake up the queue, thread safe
+ * \note it is allowed to signal before attach, but not after the source deleted
+ */
+extern int neb_evdp_source_notify_signal(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief post a task to run in the queue thread, thread safe and lock-free
+ * \note tasks that are not run will be dropped without calling when the
+ *       source is deleted
+ */
+extern int neb_evdp_source_notify_post(neb_evdp_source_t s, neb_evdp_notify_task_t fn, void *arg)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+
+#endif
@@ -0,0 +1,98 @@
+
+#ifndef NEB_EVDP_STREAM_H
+#define NEB_EVDP_STREAM_H 1
+
+#include <nebase/cdefs.h>
+
+#include "types.h"
+
+#include <nebase/iobuf.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * buffered stream writer
+ *  bound to an os_fd source, small writes are copied into a chained iobuf,
+ *  iobufs are queued without copy, and all are flushed by writev (or sendmsg
+ *  for sockets) once at the end of the round, or when the fd becomes writable
+ *  again after EAGAIN. The write handler of the source is owned by the writer
+ *  while it is bound.
+ */
+
+#define NEB_EVDP_STREAM_DEFAULT_CHUNK_SIZE 4096
+
+struct neb_evdp_stream;
+typedef struct neb_evdp_stream* neb_evdp_stream_t;
+
+/**
+ * \return NEB_EVDP_CB_REMOVE or NEB_EVDP_CB_CLOSE to detach the bound source
+ */
+typedef neb_evdp_cb_ret_t (*neb_evdp_stream_handler_t)(neb_evdp_stream_t st, void *udata);
+
+struct neb_evdp_stream_conf {
+	neb_iobuf_pool_t pool; // NULL to use a pool owned by the writer
+	size_t chunk_size;     // block size of the owned pool, 0 for NEB_EVDP_STREAM_DEFAULT_CHUNK_SIZE
+	size_t high_watermark; // 0 for no limit
+	size_t low_watermark;  // should be less than high_watermark
+	/**
+	 * called when queued bytes drop to low_watermark after high_watermark reached
+	 */
+	neb_evdp_stream_handler_t on_drain;
+	/**
+	 * called when write failed, queued data is dropped, and the errno could be
+	 * get by neb_evdp_stream_get_error. Could be NULL
+	 */
+	neb_evdp_stream_handler_t on_error;
+};
+
+struct neb_evdp_stream_stats {
+	size_t queued;          // bytes not written yet
+	size_t queued_max;      // peak of queued
+	uint64_t bytes_queued;  // total bytes accepted
+	uint64_t bytes_written; // total bytes written to fd
+	uint64_t flushes;       // writev or sendmsg calls
+	uint64_t blocked;       // times got EAGAIN
+	uint64_t high_reached;  // times high_watermark reached
+};
+
+/**
+ * \param[in] s os_fd source, it should not be deleted before the writer
+ * \param[in] conf NULL for default
+ */
+extern neb_evdp_stream_t neb_evdp_stream_create(neb_evdp_source_t s, const struct neb_evdp_stream_conf *conf, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \note queued data is dropped, it should not be called in stream handlers
+ */
+extern void neb_evdp_stream_destroy(neb_evdp_stream_t st)
+	_nattr_nonnull((1));
+
+/**
+ * \return 0 if ok, 1 if high_watermark reached and the caller should stop
+ *         writing until on_drain, -1 if error
+ */
+extern int neb_evdp_stream_write(neb_evdp_stream_t st, const void *buf, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \brief move all data of b to the writer without copy, b will be empty
+ * \return the same as neb_evdp_stream_write
+ */
+extern int neb_evdp_stream_write_iobuf(neb_evdp_stream_t st, neb_iobuf_t b)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \brief flush now instead of at the end of the round
+ * \return 0 if ok, including the case data left for the next writable event
+ * \note handlers are not called in it, on_drain is delayed to the end of round
+ */
+extern int neb_evdp_stream_flush(neb_evdp_stream_t st)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+extern size_t neb_evdp_stream_get_queued(neb_evdp_stream_t st)
+	_nattr_nonnull((1));
+extern int neb_evdp_stream_get_error(neb_evdp_stream_t st)
+	_nattr_nonnull((1));
+extern void neb_evdp_stream_get_stats(neb_evdp_stream_t st, struct neb_evdp_stream_stats *stats)
+	_nattr_nonnull((1, 2));
+
+#endif
@@ -0,0 +1,133 @@
+
+#ifndef NEB_IOBUF_H
+#define NEB_IOBUF_H 1
+
+#include "cdefs.h"
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+/*
+ * chained I/O buffer
+ *  data is kept in refcounted fixed size blocks, which are allocated in
+ *  arenas by a block pool. A buffer is a chain of slices of blocks, so
+ *  moving, splitting and slicing buffers need no memcpy. Blocks shared by
+ *  more than one slice are read only. Pools and buffers are not thread safe,
+ *  so all buffers of a pool should be used in the same thread.
+ */
+
+#define NEB_IOBUF_DEFAULT_BLOCK_SIZE 4096
+#define NEB_IOBUF_DEFAULT_ARENA_BLOCKS 64
+
+struct neb_iobuf_pool;
+typedef struct neb_iobuf_pool* neb_iobuf_pool_t;
+
+struct neb_iobuf;
+typedef struct neb_iobuf* neb_iobuf_t;
+
+struct neb_iobuf_pool_stats {
+	int arenas;
+	int blocks;      // total blocks in arenas
+	int blocks_used; // blocks referenced by buffers
+};
+
+/**
+ * \param[in] block_size 0 for NEB_IOBUF_DEFAULT_BLOCK_SIZE
+ * \param[in] arena_blocks blocks allocated at a time, 0 for default
+ */
+extern neb_iobuf_pool_t neb_iobuf_pool_create(size_t block_size, int arena_blocks)
+	_nattr_warn_unused_result;
+/**
+ * \note blocks still used by buffers are valid until they are released
+ */
+extern void neb_iobuf_pool_destroy(neb_iobuf_pool_t p)
+	_nattr_nonnull((1));
+extern size_t neb_iobuf_pool_block_size(neb_iobuf_pool_t p)
+	_nattr_nonnull((1)) _nattr_pure;
+extern void neb_iobuf_pool_get_stats(neb_iobuf_pool_t p, struct neb_iobuf_pool_stats *stats)
+	_nattr_nonnull((1, 2));
+
+extern neb_iobuf_t neb_iobuf_new(neb_iobuf_pool_t p)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern void neb_iobuf_del(neb_iobuf_t b)
+	_nattr_nonnull((1));
+/**
+ * \brief release all data
+ */
+extern void neb_iobuf_clear(neb_iobuf_t b)
+	_nattr_nonnull((1));
+
+extern size_t neb_iobuf_len(neb_iobuf_t b)
+	_nattr_nonnull((1)) _nattr_pure;
+
+/**
+ * \brief copy data in, into the free room of the last block if not shared
+ */
+extern int neb_iobuf_append(neb_iobuf_t b, const void *data, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \brief copy data in, into the head room of the first block if not shared
+ */
+extern int neb_iobuf_prepend(neb_iobuf_t b, const void *data, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \brief move all data of src to the end of dst, src will be empty
+ */
+extern int neb_iobuf_append_buf(neb_iobuf_t dst, neb_iobuf_t src)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \brief move all data of src to the head of dst, src will be empty
+ */
+extern int neb_iobuf_prepend_buf(neb_iobuf_t dst, neb_iobuf_t src)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+/**
+ * \brief get a new buffer sharing [off, off + len) of b
+ */
+extern neb_iobuf_t neb_iobuf_slice(neb_iobuf_t b, size_t off, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief move [off, end) of b to a new buffer
+ */
+extern neb_iobuf_t neb_iobuf_split(neb_iobuf_t b, size_t off)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+/**
+ * \brief drop len bytes from the head
+ */
+extern void neb_iobuf_consume(neb_iobuf_t b, size_t len)
+	_nattr_nonnull((1));
+/**
+ * \brief keep only the first len bytes
+ */
+extern void neb_iobuf_truncate(neb_iobuf_t b, size_t len)
+	_nattr_nonnull((1));
+
+/**
+ * \brief export data from the head as iovec, for writev and sendmsg
+ * \return the number of iovec filled
+ */
+extern int neb_iobuf_export_iov(neb_iobuf_t b, struct iovec *iov, int iovcnt)
+	_nattr_nonnull((1, 2));
+/**
+ * \brief export free room of at least size bytes at the end as iovec, for
+ *        readv and recvmsg, neb_iobuf_commit should be called before any
+ *        other operation on the buffer
+ * \return the number of iovec filled, -1 if error
+ */
+extern int neb_iobuf_reserve(neb_iobuf_t b, size_t size, struct iovec *iov, int iovcnt)
+	_nattr_warn_unused_result _nattr_nonnull((1, 3));
+/**
+ * \brief mark len bytes in the reserved room as data, and release the rest
+ */
+extern void neb_iobuf_commit(neb_iobuf_t b, size_t len)
+	_nattr_nonnull((1));
+
+extern size_t neb_iobuf_copyout(neb_iobuf_t b, size_t off, void *data, size_t len)
+	_nattr_nonnull((1, 3));
+/**
+ * \brief make the first len bytes contiguous, e.g. for header parsing
+ * \return NULL if there is not enough data or len is larger than block size
+ */
+extern void *neb_iobuf_pullup(neb_iobuf_t b, size_t len)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
+#endif
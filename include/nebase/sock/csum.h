@@ -4,18 +4,76 @@
 
 #include <nebase/cdefs.h>
 
+#include <stdint.h>
+
 struct ip;
 struct ip6_hdr;
 struct icmp;
+struct icmp6_hdr;
 struct tcphdr;
+struct udphdr;
+struct in6_addr;
 
 extern void neb_sock_csum_tcp4_fill(const struct ip *ipheader, struct tcphdr *tcpheader, int l4len)
 	_nattr_nonnull((1, 2));
 extern void neb_sock_csum_tcp6_fill(const struct ip6_hdr *ipheader, struct tcphdr *tcpheader, int l4len)
 	_nattr_nonnull((1, 2));
+extern void neb_sock_csum_udp4_fill(const struct ip *ipheader, struct udphdr *udpheader, int l4len)
+	_nattr_nonnull((1, 2));
+extern void neb_sock_csum_udp6_fill(const struct ip6_hdr *ipheader, struct udphdr *udpheader, int l4len)
+	_nattr_nonnull((1, 2));
+extern void neb_sock_csum_icmp6_fill(const struct ip6_hdr *ipheader, struct icmp6_hdr *icmpheader, int l4len)
+	_nattr_nonnull((1, 2));
 extern void neb_sock_csum_icmp4_fill(struct icmp *icmpheader, int l4len)
 	_nattr_nonnull((1));
 extern void neb_sock_csum_ip4_fill(struct ip *ipheader)
 	_nattr_nonnull((1));
 
+/*
+ * Incremental update (RFC 1624)
+ *  update the checksum field after a field covered by it is changed, at
+ *  constant cost. All values are as they are in the packet, i.e. in network
+ *  byte order. The changed field should be at an even offset, so for 8-bit
+ *  fields like TTL, use the 16-bit word containing it.
+ * \note for UDP, 0 in the packet means no checksum and should not be updated,
+ *       and a result of 0 should be sent as 0xffff
+ */
+
+extern uint16_t neb_sock_csum_update16(uint16_t csum, uint16_t from, uint16_t to)
+	_nattr_const;
+extern uint16_t neb_sock_csum_update32(uint16_t csum, uint32_t from, uint32_t to)
+	_nattr_const;
+extern uint16_t neb_sock_csum_update_in6(uint16_t csum, const struct in6_addr *from, const struct in6_addr *to)
+	_nattr_pure _nattr_nonnull((2, 3));
+
+/*
+ * Checksum implementations
+ *  the best one supported by the cpu is selected at library init
+ */
+
+enum {
+	NEB_SOCK_CSUM_IMPL_GENERIC = 0,
+	NEB_SOCK_CSUM_IMPL_SSE2,
+	NEB_SOCK_CSUM_IMPL_AVX2,
+	NEB_SOCK_CSUM_IMPL_NEON,
+	NEB_SOCK_CSUM_IMPL_MAX,
+};
+
+extern int neb_sock_csum_get_impl(void);
+/**
+ * \return 0 if ok, -1 if not supported by the build or the cpu
+ * \note not thread safe, mainly for test and benchmark
+ */
+extern int neb_sock_csum_set_impl(int impl);
+/**
+ * \return NULL if not built in
+ */
+extern const char *neb_sock_csum_impl_name(int impl);
+
+/**
+ * \brief internet checksum (RFC 1071) of data, in network byte order
+ */
+extern uint16_t neb_sock_csum(const void *data, int len)
+	_nattr_nonnull((1));
+
 #endif
@@ -3,6 +3,7 @@
 #define NEB_SOCK_INET_H 1
 
 #include <nebase/cdefs.h>
+#include <nebase/iobuf.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
@@ -33,6 +34,49 @@ struct neb_sock_msghdr {
 
 extern ssize_t neb_sock_inet_recvmsg(int fd, struct neb_sock_msghdr *msg)
 	_nattr_warn_unused_result _nattr_nonnull((2));
+/**
+ * \brief recvmsg into the free room at the end of b, without extra copy
+ * \param[in] msg msg_iov and msg_iovlen in it are not used
+ * \param[in] size max bytes to receive
+ */
+extern ssize_t neb_sock_inet_recvmsg_iobuf(int fd, struct neb_sock_msghdr *msg, neb_iobuf_t b, size_t size)
+	_nattr_warn_unused_result _nattr_nonnull((2, 3));
+
+/*
+ * batched recv
+ *  up to vlen datagrams are received by one recvmmsg call if supported, or
+ *  by recvmsg in loop. Control buffers are preallocated in the context, and
+ *  timestamp and ifindex cmsgs are parsed into each msg.
+ */
+
+struct neb_sock_mmsghdr {
+	struct sockaddr_storage  msg_peer;    // out
+	struct iovec            *msg_iov;     // in
+	size_t                   msg_iovlen;  // in
+	size_t                   msg_len;     // out, bytes received
+	int                      msg_flags;   // out, MSG_TRUNC and MSG_CTRUNC may be set
+	unsigned int             msg_ifindex; // out, from IP_PKTINFO/IP_RECVIF or IPV6_PKTINFO, 0 if not available
+	struct timespec          msg_ts;      // out, zero if not available
+};
+
+struct neb_sock_mmsg_ctx;
+typedef struct neb_sock_mmsg_ctx* neb_sock_mmsg_ctx_t;
+
+/**
+ * \param[in] vlen max msgs in one batch
+ * \param[in] cmsg_size control buffer size for each msg, 0 for default
+ */
+extern neb_sock_mmsg_ctx_t neb_sock_inet_mmsg_ctx_create(int vlen, size_t cmsg_size)
+	_nattr_warn_unused_result;
+extern void neb_sock_inet_mmsg_ctx_destroy(neb_sock_mmsg_ctx_t ctx)
+	_nattr_nonnull((1));
+
+/**
+ * \param[in] vlen should not be larger than the one of ctx
+ * \return the number of msgs received, 0 if no msg available, -1 if error
+ */
+extern int neb_sock_inet_recvmmsg(int fd, neb_sock_mmsg_ctx_t ctx, struct neb_sock_mmsghdr *msgs, int vlen)
+	_nattr_warn_unused_result _nattr_nonnull((2, 3));
 
 /**
  * \brief get a new nonblock and cloexec socket, which can be closed by close()
@@ -40,6 +84,14 @@ extern ssize_t neb_sock_inet_recvmsg(int fd, struct neb_sock_msghdr *msg)
 extern int neb_sock_inet_new(int domain, int type, int protocol)
 	_nattr_warn_unused_result;
 
+/**
+ * \brief allow multiple sockets to bind to the same address and port,
+ *        and the kernel will balance incoming connections or datagrams
+ * \note SO_REUSEPORT_LB will be used if available
+ */
+extern int neb_sock_inet_enable_reuseport(int fd)
+	_nattr_warn_unused_result;
+
 /**
  * \brief enable recv of timestamp for dgram and raw sockets
  */
@@ -9,6 +9,18 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 
+/*
+ * Batch send
+ *  packets are sent by sendmmsg if supported, or by sendmsg in loop. The
+ *  result of each packet is set, and the failed one is skipped. Sending stops
+ *  at EAGAIN or ENOBUFS, and the packets left should be sent later.
+ */
+
+struct neb_sock_send_result {
+	ssize_t len; // bytes sent, -1 if failed
+	int err;     // errno if failed
+};
+
 /*
  * IPv4 General Raw Sockets (Transparent)
  */
@@ -23,6 +35,17 @@ extern int neb_sock_raw4_new(int protocol)
 extern ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
 	_nattr_warn_unused_result _nattr_nonnull((2));
 
+struct neb_sock_raw4_pkt {
+	const u_char *data; // contains the ip header
+	size_t len;
+	struct neb_sock_send_result result;
+};
+/**
+ * \return the number of packets handled, with result set
+ */
+extern int neb_sock_raw4_send_batch(int fd, struct neb_sock_raw4_pkt *pkts, int count)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+
 /**
  * \brief get the real ip total_len getting from raw hdrincl sockets
  * \note it's needed at least on MacOS
@@ -46,6 +69,19 @@ extern ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
                                        const struct in_addr *src)
 	_nattr_warn_unused_result _nattr_nonnull((2, 4));
 
+struct neb_sock_icmp4_pkt {
+	const u_char *data;
+	size_t len;
+	struct in_addr dst;
+	struct in_addr src; // INADDR_ANY if not set
+	struct neb_sock_send_result result;
+};
+/**
+ * \return the number of packets handled, with result set
+ */
+extern int neb_sock_raw_icmp4_send_batch(int fd, struct neb_sock_icmp4_pkt *pkts, int count)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+
 /*
  * ICMPv6 Raw Sockets (Local)
  */
@@ -57,4 +93,18 @@ extern ssize_t neb_sock_raw_icmp6_send(int fd, const u_char *data, size_t len,
                                        unsigned int ifindex)
 	_nattr_warn_unused_result _nattr_nonnull((2, 4));
 
+struct neb_sock_icmp6_pkt {
+	const u_char *data;
+	size_t len;
+	struct in6_addr dst;
+	struct in6_addr src; // unspecified if not set
+	unsigned int ifindex;
+	struct neb_sock_send_result result;
+};
+/**
+ * \return the number of packets handled, with result set
+ */
+extern int neb_sock_raw_icmp6_send_batch(int fd, struct neb_sock_icmp6_pkt *pkts, int count)
+	_nattr_warn_unused_result _nattr_nonnull((2));
+
 #endif
@@ -0,0 +1,74 @@
+
+#ifndef NEB_STR_AC_H
+#define NEB_STR_AC_H 1
+
+/*
+ * Aho-Corasick multiple string search algorithm
+ *  patterns are added and compiled into a compact automaton, all matches of
+ *  all patterns are reported in one pass. Dense rows are used for the root and
+ *  states with many edges, sorted sparse edges for others. When the automaton
+ *  is at the root, text is skipped to the next byte which could start a
+ *  pattern, by SIMD compare if there are only a few such bytes.
+ */
+
+#include <nebase/cdefs.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+
+struct neb_str_ac;
+typedef struct neb_str_ac* neb_str_ac_t;
+
+/**
+ * \param[in] id the id of the pattern given in neb_str_ac_add
+ * \param[in] offset the start offset of the match, from the start of the text
+ *                   or the stream
+ * \return non-zero to stop the search
+ */
+typedef int (*neb_str_ac_match_cb)(int id, int64_t offset, void *udata);
+
+/**
+ * search state carried between chunks of a stream
+ */
+struct neb_str_ac_stream {
+	uint32_t state;
+	int64_t offset;
+};
+
+extern neb_str_ac_t neb_str_ac_create(void)
+	_nattr_warn_unused_result;
+extern void neb_str_ac_destroy(neb_str_ac_t a)
+	_nattr_nonnull((1));
+
+/**
+ * \param[in] p the pattern is copied, empty pattern is not allowed
+ * \note neb_str_ac_compile should be called again after add
+ */
+extern int neb_str_ac_add(neb_str_ac_t a, const u_char *p, int pl, int id)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
+extern int neb_str_ac_compile(neb_str_ac_t a)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern int neb_str_ac_pattern_count(neb_str_ac_t a)
+	_nattr_nonnull((1));
+
+/**
+ * \brief report all matches in t, overlapped ones included
+ * \return 1 if stopped by cb, 0 if not, -1 if not compiled
+ */
+extern int neb_str_ac_search(neb_str_ac_t a, const u_char *t, int64_t tl, neb_str_ac_match_cb cb, void *udata)
+	_nattr_nonnull((1, 2, 4));
+
+extern void neb_str_ac_stream_init(struct neb_str_ac_stream *s)
+	_nattr_nonnull((1));
+/**
+ * \brief the same as neb_str_ac_search, but matches crossing chunks are
+ *        reported, with offsets from the start of the stream
+ * \note if stopped by cb, offset in s is at the end of the match, and the rest
+ *       of the chunk could be searched by another call. The stream should be
+ *       inited again if the automaton is recompiled
+ */
+extern int neb_str_ac_stream_search(neb_str_ac_t a, struct neb_str_ac_stream *s,
+                                    const u_char *t, int64_t tl, neb_str_ac_match_cb cb, void *udata)
+	_nattr_nonnull((1, 2, 3, 5));
+
+#endif
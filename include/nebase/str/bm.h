@@ -13,14 +13,58 @@
 struct neb_str_bm_ctx;
 typedef struct neb_str_bm_ctx* neb_str_bm_ctx_t;
 
+struct neb_str_bm_stream;
+typedef struct neb_str_bm_stream* neb_str_bm_stream_t;
+
+/**
+ * \brief one shot search, short patterns are searched by SIMD compare without
+ *        tables, and contexts of others are cached in a thread local LRU
+ */
 extern const u_char *neb_str_bm_search(const u_char *p, int plen, const u_char *t, int64_t tlen)
 	_nattr_nonnull((1, 3));
 
+/**
+ * \param[in] p the pattern is not copied, and should be kept valid
+ */
 extern neb_str_bm_ctx_t neb_str_bm_ctx_create(const u_char *p, int pl)
 	_nattr_warn_unused_result _nattr_nonnull((1));
 extern void neb_str_bm_ctx_destroy(neb_str_bm_ctx_t c)
 	_nattr_nonnull((1));
+/**
+ * \note candidates are scanned by SIMD compare of the two rarest bytes of the
+ *       pattern first if supported, and then by Boyer-Moore skip if the rare
+ *       bytes are not rare in t
+ */
 extern const u_char *neb_str_bm_ctx_search(neb_str_bm_ctx_t c, const u_char *t, int64_t tl)
 	_nattr_nonnull((1, 2));
 
+/*
+ * Streaming search
+ *  the last pattern_len - 1 bytes are kept, so matches crossing chunks are
+ *  found. Matches are not overlapped.
+ */
+
+/**
+ * \param[in] c should be kept valid until the stream destroyed
+ */
+extern neb_str_bm_stream_t neb_str_bm_stream_create(neb_str_bm_ctx_t c)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+extern void neb_str_bm_stream_destroy(neb_str_bm_stream_t s)
+	_nattr_nonnull((1));
+extern void neb_str_bm_stream_reset(neb_str_bm_stream_t s)
+	_nattr_nonnull((1));
+/**
+ * \return bytes consumed from the start of the stream
+ */
+extern int64_t neb_str_bm_stream_offset(neb_str_bm_stream_t s)
+	_nattr_nonnull((1));
+/**
+ * \param[out] consumed bytes of t consumed, the rest should be passed in again
+ *                      to find the next match
+ * \return the offset of the match from the start of the stream, or -1 if not
+ *         found and all of t consumed
+ */
+extern int64_t neb_str_bm_stream_search(neb_str_bm_stream_t s, const u_char *t, int64_t tl, int64_t *consumed)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2, 4));
+
 #endif
@@ -1,4 +1,6 @@
 
+#include "options.h"
+
 #include <nebase/syslog.h>
 #include <nebase/evdp/core.h>
 #include <nebase/time.h>
@@ -8,6 +10,11 @@
 #include "timer.h"
 #include "sys_timer.h"
 #include "io_base.h"
+#include "notify.h"
+#include "defer.h"
+#include "io_cio.h"
+#include "slab.h"
+#include "instr.h"
 
 #include <stdlib.h>
 
@@ -16,14 +23,52 @@
  *      only kevent & io_uring support this kind of batch operation
  */
 
-static neb_evdp_source_t evdp_source_new_empty(neb_evdp_queue_t q)
+neb_evdp_source_t evdp_source_new(int type, size_t conf_size)
 {
-	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
-	if (!s) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	size_t used = EVDP_SLAB_ALIGN_UP(sizeof(struct neb_evdp_source));
+	size_t size = used + conf_size;
+	if (size < EVDP_SOURCE_BLOCK_SIZE)
+		size = EVDP_SOURCE_BLOCK_SIZE;
+	neb_evdp_source_t s = evdp_slab_alloc(size);
+	if (!s)
 		return NULL;
+	s->type = type;
+	s->prio = NEB_EVDP_PRIO_NORMAL;
+	if (conf_size) {
+		s->conf = (char *)s + used;
+		used += EVDP_SLAB_ALIGN_UP(conf_size);
 	}
-	s->type = EVDP_SOURCE_NONE;
+	s->block_used = used;
+	return s;
+}
+
+void *evdp_source_context_alloc(neb_evdp_source_t s, size_t size)
+{
+	size_t block_size = evdp_slab_block_size(s);
+	if (block_size <= EVDP_SLAB_MAX_BLOCK_SIZE && s->block_used + size <= block_size) {
+		void *c = (char *)s + s->block_used; // already zeroed
+		s->block_used += EVDP_SLAB_ALIGN_UP(size);
+		return c;
+	}
+	return evdp_slab_alloc(size);
+}
+
+void evdp_source_context_free(void *context)
+{
+	if (evdp_slab_is_block(context)) // or it is inside the source block
+		evdp_slab_free(context);
+}
+
+int neb_evdp_source_reserve(int count)
+{
+	return evdp_slab_reserve(EVDP_SOURCE_BLOCK_SIZE, count);
+}
+
+static neb_evdp_source_t evdp_source_new_empty(neb_evdp_queue_t q)
+{
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_NONE, 0);
+	if (!s)
+		return NULL;
 	s->q_in_use = q;
 	s->on_remove = neb_evdp_source_del;
 	return s;
@@ -31,15 +76,52 @@ static neb_evdp_source_t evdp_source_new_empty(neb_evdp_queue_t q)
 
 neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 {
-	if (batch_size <= 0)
-		batch_size = NEB_EVDP_DEFAULT_BATCH_SIZE;
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.batch_size = batch_size;
+	return neb_evdp_queue_create_ex(&conf);
+}
+
+static int queue_enable_prio(neb_evdp_queue_t q)
+{
+	if (q->prio_order)
+		return 0;
+	// the second half is used to save priorities while sorting
+	q->prio_order = malloc(sizeof(int) * q->conf.batch_size_max * 2);
+	if (!q->prio_order) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		return -1;
+	}
+	return 0;
+}
 
+neb_evdp_queue_t neb_evdp_queue_create_ex(const struct neb_evdp_queue_conf *conf)
+{
 	neb_evdp_queue_t q = calloc(1, sizeof(struct neb_evdp_queue));
 	if (!q) {
 		neb_syslogl(LOG_ERR, "calloc: %m");
 		return NULL;
 	}
-	q->batch_size = batch_size;
+	q->conf = *conf;
+	if (q->conf.batch_size <= 0)
+		q->conf.batch_size = NEB_EVDP_DEFAULT_BATCH_SIZE;
+	if (q->conf.batch_size_max <= 0)
+		q->conf.batch_size_max = NEB_EVDP_ADAPTIVE_BATCH_SIZE_MAX;
+	if (q->conf.batch_size_max < q->conf.batch_size)
+		q->conf.batch_size_max = q->conf.batch_size;
+	q->batch_size = q->conf.batch_size;
+	if (neb_time_gettime_fast(&q->cur_ts) != 0) {
+		neb_syslog(LOG_ERR, "Failed to get current timespec");
+		free(q);
+		return NULL;
+	}
+
+	if (q->conf.instrument) {
+		q->instr = evdp_queue_instr_create();
+		if (!q->instr) {
+			free(q);
+			return NULL;
+		}
+	}
 
 	q->running_qs = evdp_source_new_empty(q);
 	if (!q->running_qs) {
@@ -54,6 +136,8 @@ neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 	}
 	q->stats.pending = 1;
 	q->foreach_s = NULL;
+	TAILQ_INIT(&q->defers);
+	TAILQ_INIT(&q->idles);
 
 	q->context = evdp_create_queue_context(q);
 	if (!q->context) {
@@ -61,12 +145,24 @@ neb_evdp_queue_t neb_evdp_queue_create(int batch_size)
 		return NULL;
 	}
 
+	for (int i = 0; i < NEB_EVDP_PRIO_MAX; i++) {
+		if (q->conf.prio_budget[i] > 0 && queue_enable_prio(q) != 0) {
+			neb_evdp_queue_destroy(q);
+			return NULL;
+		}
+	}
+
 	return q;
 }
 
 static void do_detach_from_queue(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
 {
-	evdp_queue_rm_pending_events(q, s);
+	if (q->dispatching && !s->q_tomb) {
+		// mark it instead of removing its events from the rest of the batch
+		s->q_tomb = q;
+		s->tomb_next = q->tombs;
+		q->tombs = s;
+	}
 
 	switch (s->type) {
 	case EVDP_SOURCE_NONE:
@@ -84,6 +180,21 @@ static void do_detach_from_queue(neb_evdp_queue_t q, neb_evdp_source_t s, int to
 	case EVDP_SOURCE_OS_FD:
 		evdp_source_os_fd_detach(q, s, to_close);
 		break;
+	case EVDP_SOURCE_ET_FD:
+		evdp_source_et_fd_detach(q, s, to_close);
+		break;
+	case EVDP_SOURCE_NOTIFY:
+		evdp_source_notify_detach(q, s);
+		break;
+	case EVDP_SOURCE_DEFER:
+	case EVDP_SOURCE_IDLE:
+		evdp_source_defer_detach(q, s);
+		break;
+#ifdef USE_IO_URING
+	case EVDP_SOURCE_CIO_FD:
+		evdp_source_cio_detach(q, s, to_close);
+		break;
+#endif
 	default:
 		neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", s->type);
 		break;
@@ -136,6 +247,16 @@ void neb_evdp_queue_destroy(neb_evdp_queue_t q)
 		q->context = NULL;
 	}
 
+	if (q->instr) {
+		evdp_queue_instr_destroy(q->instr);
+		q->instr = NULL;
+	}
+
+	if (q->prio_order) {
+		free(q->prio_order);
+		q->prio_order = NULL;
+	}
+
 	free(q);
 }
 
@@ -154,11 +275,32 @@ void neb_evdp_queue_set_user_data(neb_evdp_queue_t q, void *udata)
 	q->running_udata = udata;
 }
 
+void neb_evdp_queue_get_stats(neb_evdp_queue_t q, struct neb_evdp_queue_stats *stats)
+{
+	stats->rounds = q->stats.rounds;
+	stats->events = q->stats.events;
+	stats->pending = q->stats.pending - 1; // the list head is counted
+	stats->running = q->stats.running - 1;
+	stats->ctl_calls = q->stats.ctl_calls;
+	stats->ctl_saved = q->stats.ctl_saved;
+	stats->full_batches = q->stats.full_batches;
+	stats->batch_size = q->batch_size;
+	stats->spin_hits = q->stats.spin_hits;
+	stats->sleeps = q->stats.sleeps;
+	stats->prio_deferred = q->stats.prio_deferred;
+	stats->carried_events = q->stats.carried_events;
+}
+
 void neb_evdp_queue_get_abs_timeout(neb_evdp_queue_t q, struct timespec* dur_ts, struct timespec* abs_ts)
 {
 	neb_timespecadd(&q->cur_ts, dur_ts, abs_ts);
 }
 
+void neb_evdp_queue_get_cur_ts(neb_evdp_queue_t q, struct timespec *ts)
+{
+	*ts = q->cur_ts;
+}
+
 void neb_evdp_queue_update_cur_ts(neb_evdp_queue_t q)
 {
 	if (neb_time_gettime_fast(&q->cur_ts) != 0) {
@@ -188,6 +330,9 @@ int neb_evdp_queue_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 		return -1;
 	}
 
+	if (s->prio != NEB_EVDP_PRIO_NORMAL && queue_enable_prio(q) != 0)
+		return -1;
+
 	s->foreach_id = q->foreach_id; // skip ongoing foreach
 
 	// s may be in running_q or in pending_q, it depends
@@ -210,6 +355,21 @@ int neb_evdp_queue_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	case EVDP_SOURCE_OS_FD:
 		ret = evdp_source_os_fd_attach(q, s);
 		break;
+	case EVDP_SOURCE_ET_FD:
+		ret = evdp_source_et_fd_attach(q, s);
+		break;
+	case EVDP_SOURCE_NOTIFY:
+		ret = evdp_source_notify_attach(q, s);
+		break;
+	case EVDP_SOURCE_DEFER:
+	case EVDP_SOURCE_IDLE:
+		ret = evdp_source_defer_attach(q, s);
+		break;
+#ifdef USE_IO_URING
+	case EVDP_SOURCE_CIO_FD:
+		ret = evdp_source_cio_attach(q, s);
+		break;
+#endif
 	default:
 		neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", s->type);
 		ret = -1;
@@ -350,11 +510,15 @@ int neb_evdp_queue_foreach_next(neb_evdp_queue_t q, int batch_size)
 	if (!q->in_foreach)
 		return 0;
 
-	// TODO record time stats
+	uint64_t start_ns = q->instr ? evdp_instr_now_ns() : 0;
+	int ret;
 	if (batch_size)
-		return evdp_queue_foreach_next_batched(q, batch_size);
+		ret = evdp_queue_foreach_next_batched(q, batch_size);
 	else
-		return evdp_queue_foreach_next_all(q);
+		ret = evdp_queue_foreach_next_all(q);
+	if (q->instr)
+		evdp_instr_record_since(q->instr, NEB_EVDP_HIST_FOREACH, start_ns);
+	return ret;
 }
 
 static neb_evdp_cb_ret_t handle_event(neb_evdp_queue_t q)
@@ -363,12 +527,24 @@ static neb_evdp_cb_ret_t handle_event(neb_evdp_queue_t q)
 	if (evdp_queue_fetch_event(q, &ne) != 0)
 		return NEB_EVDP_CB_BREAK_ERR;
 
-	if (!ne.source) { // source detached
+	if (!ne.source || ne.source->q_tomb == q) { // source detached
 		evdp_queue_finish_event(q, &ne);
 		return NEB_EVDP_CB_CONTINUE;
 	}
 
+	if (ne.source->type == EVDP_SOURCE_RO_FD && q->conf.prio_budget[ne.source->prio] > 0) {
+		if (q->prio_handled[ne.source->prio] >= q->conf.prio_budget[ne.source->prio]) {
+			q->stats.prio_deferred++;
+			int ret = evdp_source_ro_fd_defer(&ne);
+			evdp_queue_finish_event(q, &ne);
+			return ret == 0 ? NEB_EVDP_CB_CONTINUE : NEB_EVDP_CB_BREAK_ERR;
+		}
+		q->prio_handled[ne.source->prio]++;
+	}
+
 	int ret = NEB_EVDP_CB_CONTINUE;
+	int hist_id = -1;
+	uint64_t start_ns = q->instr ? evdp_instr_now_ns() : 0;
 	ne.source->no_detach = 1;
 	switch (ne.source->type) {
 	case EVDP_SOURCE_NONE:
@@ -376,21 +552,41 @@ static neb_evdp_cb_ret_t handle_event(neb_evdp_queue_t q)
 	case EVDP_SOURCE_ITIMER_SEC:
 	case EVDP_SOURCE_ITIMER_MSEC:
 		ret = evdp_source_itimer_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_SYS_TIMER;
 		break;
 	case EVDP_SOURCE_ABSTIMER:
 		ret = evdp_source_abstimer_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_SYS_TIMER;
 		break;
 	case EVDP_SOURCE_RO_FD:
 		ret = evdp_source_ro_fd_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_RO_FD;
 		break;
 	case EVDP_SOURCE_OS_FD:
 		ret = evdp_source_os_fd_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_OS_FD;
+		break;
+	case EVDP_SOURCE_ET_FD:
+		ret = evdp_source_et_fd_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_ET_FD;
+		break;
+	case EVDP_SOURCE_NOTIFY:
+		ret = evdp_source_notify_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_NOTIFY;
 		break;
+#ifdef USE_IO_URING
+	case EVDP_SOURCE_CIO_FD:
+		ret = evdp_source_cio_handle(&ne);
+		hist_id = NEB_EVDP_HIST_CB_CIO;
+		break;
+#endif
 	default:
 		neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", ne.source->type);
 		break;
 	}
 	ne.source->no_detach = 0;
+	if (q->instr && hist_id >= 0)
+		evdp_instr_record_since(q->instr, hist_id, start_ns);
 
 	switch (ret) {
 	case NEB_EVDP_CB_REMOVE:
@@ -409,6 +605,180 @@ static neb_evdp_cb_ret_t handle_event(neb_evdp_queue_t q)
 	return ret;
 }
 
+/**
+ * \brief sort events got in this round by the priority of their sources
+ */
+static void queue_sort_events_by_prio(neb_evdp_queue_t q)
+{
+	int *prio_of = q->prio_order + q->conf.batch_size_max;
+	int offset[NEB_EVDP_PRIO_MAX] = NEB_STRUCT_INITIALIZER;
+	for (int i = 0; i < q->nevents; i++) {
+		int prio = NEB_EVDP_PRIO_NORMAL; // errors will be reported at dispatch
+		neb_evdp_source_t s = evdp_queue_peek_event_source(q, i);
+		if (s)
+			prio = s->prio;
+		prio_of[i] = prio;
+		if (prio + 1 < NEB_EVDP_PRIO_MAX)
+			offset[prio + 1]++;
+	}
+	for (int prio = 1; prio < NEB_EVDP_PRIO_MAX; prio++)
+		offset[prio] += offset[prio - 1];
+	for (int i = 0; i < q->nevents; i++)
+		q->prio_order[offset[prio_of[i]]++] = i;
+}
+
+/**
+ * \param[in] gen the generation of this round, sources with it are not run
+ */
+static neb_evdp_cb_ret_t queue_run_defer_list(neb_evdp_queue_t q, struct evdp_defer_list *list, uint64_t gen, int keep)
+{
+	struct evdp_conf_defer *conf;
+	while ((conf = TAILQ_FIRST(list)) != NULL && conf->gen != gen) {
+		TAILQ_REMOVE(list, conf, list);
+		if (keep) {
+			conf->gen = gen;
+			TAILQ_INSERT_TAIL(list, conf, list);
+		} else {
+			conf->linked = 0;
+		}
+
+		neb_evdp_source_t s = conf->s;
+		s->no_detach = 1;
+		neb_evdp_cb_ret_t ret = conf->do_call(s->udata);
+		s->no_detach = 0;
+		switch (ret) {
+		case NEB_EVDP_CB_REMOVE:
+			do_detach_from_queue(q, s, 0);
+			break;
+		case NEB_EVDP_CB_CLOSE:
+			do_detach_from_queue(q, s, 1);
+			break;
+		case NEB_EVDP_CB_BREAK_ERR:
+		case NEB_EVDP_CB_BREAK_EXP:
+			return ret;
+			break;
+		default:
+			break;
+		}
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+/**
+ * \brief run activated defer sources and then idle sources
+ * \note sources activated or attached in these callbacks are run in the next round
+ */
+static neb_evdp_cb_ret_t queue_run_defers(neb_evdp_queue_t q)
+{
+	uint64_t gen = ++q->defer_gen; // for both lists
+	if (!TAILQ_EMPTY(&q->defers)) {
+		neb_evdp_cb_ret_t ret = queue_run_defer_list(q, &q->defers, gen, 0);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
+	if (!TAILQ_EMPTY(&q->idles))
+		return queue_run_defer_list(q, &q->idles, gen, 1);
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+/**
+ * \brief release the tombstones left by the current batch
+ */
+static void queue_end_dispatch(neb_evdp_queue_t q)
+{
+	// events left by a break are dropped
+	q->nevents = 0;
+	q->current_event = 0;
+	q->dispatched = 0;
+	q->dispatching = 0;
+
+	neb_evdp_source_t s = q->tombs;
+	q->tombs = NULL;
+	while (s) {
+		neb_evdp_source_t next = s->tomb_next;
+		s->q_tomb = NULL;
+		s->tomb_next = NULL;
+		if (s->tomb_del)
+			neb_evdp_source_del(s);
+		s = next;
+	}
+}
+
+/**
+ * \brief spin with nonblocking waits until got events or busy_poll_usec passed
+ * \param[in,out] timeout will be reduced by the time spent
+ * \return 0 if should go on with a blocking wait, 1 if not, or -1 if error
+ */
+static int queue_busy_poll(neb_evdp_queue_t q, struct timespec *timeout)
+{
+	struct timespec zero_ts = {.tv_sec = 0, .tv_nsec = 0};
+	uint64_t budget_ns = (uint64_t)q->conf.busy_poll_usec * 1000;
+	uint64_t timeout_ns = UINT64_MAX;
+	if (timeout)
+		timeout_ns = (uint64_t)timeout->tv_sec * 1000000000 + timeout->tv_nsec;
+	if (budget_ns > timeout_ns)
+		budget_ns = timeout_ns;
+
+	uint64_t start_ns = evdp_instr_now_ns();
+	uint64_t spent_ns = 0;
+	do {
+		if (evdp_queue_wait_events(q, &zero_ts) != 0)
+			return -1;
+		if (q->nevents) {
+			q->stats.spin_hits++;
+			return 1;
+		}
+		if (thread_events)
+			return 1;
+		spent_ns = evdp_instr_now_ns() - start_ns;
+	} while (spent_ns < budget_ns);
+
+	if (spent_ns >= timeout_ns) // timer is due
+		return 1;
+	if (timeout) {
+		timeout_ns -= spent_ns;
+		timeout->tv_sec = timeout_ns / 1000000000;
+		timeout->tv_nsec = timeout_ns % 1000000000;
+	}
+	return 0;
+}
+
+/**
+ * \brief grow the batch size if got a full batch, and shrink it if idle for a while
+ */
+static void queue_adapt_batch_size(neb_evdp_queue_t q, int nevents)
+{
+	int size = q->batch_size;
+	if (nevents == q->batch_size) {
+		q->stats.full_batches++;
+		q->idle_rounds = 0;
+		if (!q->conf.adaptive_batch || q->batch_size >= q->conf.batch_size_max)
+			return;
+		size = q->batch_size * 2;
+		if (size > q->conf.batch_size_max)
+			size = q->conf.batch_size_max;
+	} else {
+		if (!q->conf.adaptive_batch || q->batch_size <= q->conf.batch_size)
+			return;
+		if (nevents > q->batch_size / 4) {
+			q->idle_rounds = 0;
+			return;
+		}
+		if (++q->idle_rounds < EVDP_ADAPTIVE_BATCH_SHRINK_ROUNDS)
+			return;
+		q->idle_rounds = 0;
+		size = q->batch_size / 2;
+		if (size < q->conf.batch_size)
+			size = q->conf.batch_size;
+	}
+
+	if (evdp_queue_resize_events(q, size) != 0) {
+		neb_syslog(LOG_ERR, "Failed to resize event array to %d", size);
+		return; // just keep the old one
+	}
+	q->batch_size = size;
+}
+
 int neb_evdp_queue_run(neb_evdp_queue_t q)
 {
 	for (;;) {
@@ -438,29 +808,55 @@ int neb_evdp_queue_run(neb_evdp_queue_t q)
 			}
 		}
 
-		if (evdp_queue_flush_pending_sources(q) != 0) {
-			neb_syslog(LOG_ERR, "Failed to add pending sources");
-			goto exit_err;
-		}
-
-		if (neb_time_gettime_fast(&q->cur_ts) != 0) {
-			neb_syslog(LOG_ERR, "Failed to get current timespec");
-			goto exit_err;
-		}
-
-		struct timespec ts;
-		struct timespec *timeout = NULL;
-		if (q->timer != NULL) {
-			if (neb_time_gettime_fast(&ts) != 0) {
-				neb_syslog(LOG_ERR, "Failed to get current timespec");
+		// events carried over from the last round are handled without waiting
+		int carried = q->dispatched < q->nevents;
+		if (!carried) {
+			uint64_t start_ns = q->instr ? evdp_instr_now_ns() : 0;
+			if (evdp_queue_flush_pending_sources(q) != 0) {
+				neb_syslog(LOG_ERR, "Failed to add pending sources");
 				goto exit_err;
 			}
-			timeout = evdp_timer_fetch_neareast_ts(q->timer, &ts);
-		}
+			if (q->instr)
+				evdp_instr_record_since(q->instr, NEB_EVDP_HIST_FLUSH, start_ns);
+
+			struct timespec ts;
+			struct timespec *timeout = NULL;
+			if (q->timer != NULL) {
+				// the cached one is old by the time spent in this round
+				if (!q->conf.cache_time && neb_time_gettime_fast(&q->cur_ts) != 0) {
+					neb_syslog(LOG_ERR, "Failed to get current timespec");
+					goto exit_err;
+				}
+				ts = q->cur_ts;
+				timeout = evdp_timer_fetch_neareast_ts(q->timer, &ts);
+			}
+			if (!TAILQ_EMPTY(&q->defers) || !TAILQ_EMPTY(&q->idles)) { // run them in the next round without blocking
+				neb_timespecclear(&ts);
+				timeout = &ts;
+			}
 
-		if (evdp_queue_wait_events(q, timeout) != 0) {
-			neb_syslog(LOG_ERR, "Error occured while getting evdp events");
-			goto exit_err;
+			if (q->instr)
+				start_ns = evdp_instr_now_ns();
+			int waited = 0;
+			if (q->conf.busy_poll_usec && !(timeout && !neb_timespecisset(timeout))) {
+				waited = queue_busy_poll(q, timeout);
+				if (waited < 0) {
+					neb_syslog(LOG_ERR, "Error occured while busy polling evdp events");
+					goto exit_err;
+				}
+			}
+			if (!waited) {
+				if (!timeout || neb_timespecisset(timeout))
+					q->stats.sleeps++;
+				if (evdp_queue_wait_events(q, timeout) != 0) {
+					neb_syslog(LOG_ERR, "Error occured while getting evdp events");
+					goto exit_err;
+				}
+			}
+			if (q->instr) {
+				evdp_instr_record_since(q->instr, NEB_EVDP_HIST_WAIT, start_ns);
+				evdp_hist_record(&q->instr->hists[NEB_EVDP_HIST_EVENTS], q->nevents);
+			}
 		}
 
 		if (neb_time_gettime_fast(&q->cur_ts) != 0) {
@@ -469,11 +865,28 @@ int neb_evdp_queue_run(neb_evdp_queue_t q)
 		}
 
 		q->stats.rounds++;
+		for (int i = 0; i < NEB_EVDP_PRIO_MAX; i++)
+			q->prio_handled[i] = 0;
+		uint64_t deadline_ns = 0;
+		if (q->conf.round_budget_usec)
+			deadline_ns = evdp_instr_now_ns() + (uint64_t)q->conf.round_budget_usec * 1000;
+
 		int nevents = q->nevents;
 		if (q->nevents) { /* handle normal events first */
-			q->stats.events += q->nevents;
-			for (int i = 0; i < q->nevents; i++) {
-				q->current_event = i;
+			if (!carried) {
+				q->stats.events += q->nevents;
+				q->dispatching = 1;
+				if (q->prio_order)
+					queue_sort_events_by_prio(q);
+			}
+			for (int handled = 0; q->dispatched < q->nevents; handled++) {
+				// at least one event is handled in each round
+				if (handled && evdp_round_budget_exhausted(handled, q->conf.round_events, deadline_ns)) {
+					q->stats.carried_events += q->nevents - q->dispatched;
+					break;
+				}
+				q->current_event = q->prio_order ? q->prio_order[q->dispatched] : q->dispatched;
+				q->dispatched++;
 				switch (handle_event(q)) {
 				case NEB_EVDP_CB_BREAK_ERR:
 					goto exit_err;
@@ -485,12 +898,27 @@ int neb_evdp_queue_run(neb_evdp_queue_t q)
 					break;
 				}
 			}
-			q->nevents = 0;
-			q->current_event = 0;
+			if (q->dispatched == q->nevents) {
+				queue_end_dispatch(q);
+				queue_adapt_batch_size(q, nevents);
+			}
+		} else {
+			queue_adapt_batch_size(q, nevents);
 		}
 
 		if (q->timer) /* handle timeouts after we handle normal events */
-			evdp_timer_run_until(q->timer, &q->cur_ts);
+			evdp_timer_run_until(q->timer, &q->cur_ts, q->instr, q->conf.round_timers, deadline_ns);
+
+		switch (queue_run_defers(q)) {
+		case NEB_EVDP_CB_BREAK_ERR:
+			goto exit_err;
+			break;
+		case NEB_EVDP_CB_BREAK_EXP:
+			goto exit_ok;
+			break;
+		default:
+			break;
+		}
 
 		if (q->batch_call && nevents) {
 			switch (q->batch_call(q->running_udata)) {
@@ -507,9 +935,11 @@ int neb_evdp_queue_run(neb_evdp_queue_t q)
 	}
 
 exit_ok:
+	queue_end_dispatch(q);
 	return 0;
 
 exit_err:
+	queue_end_dispatch(q);
 	return -1;
 }
 
@@ -519,6 +949,10 @@ int neb_evdp_source_del(neb_evdp_source_t s)
 		neb_syslog(LOG_ERR, "It is currently attached to queue %p, detach it first", s->q_in_use);
 		return -1;
 	}
+	if (s->q_tomb) { // there may be events for it in the current batch
+		s->tomb_del = 1;
+		return 0;
+	}
 
 	if (s->context) {
 		switch (s->type) {
@@ -539,15 +973,28 @@ int neb_evdp_source_del(neb_evdp_source_t s)
 			evdp_destroy_source_os_fd_context(s->context);
 			s->context = NULL;
 			break;
+		case EVDP_SOURCE_ET_FD:
+			evdp_destroy_source_et_fd_context(s->context);
+			s->context = NULL;
+			break;
+		case EVDP_SOURCE_NOTIFY:
+			evdp_destroy_source_notify_context(s->context);
+			s->context = NULL;
+			evdp_source_notify_drop_tasks(s);
+			break;
+#ifdef USE_IO_URING
+		case EVDP_SOURCE_CIO_FD:
+			evdp_destroy_source_cio_context(s->context);
+			s->context = NULL;
+			break;
+#endif
 		default:
 			neb_syslog(LOG_ERR, "Unsupported evdp_source type %d", s->type);
 			break;
 		}
 	}
 
-	if (s->conf)
-		free(s->conf);
-	free(s);
+	evdp_slab_free(s); // conf is in the same block
 	return 0;
 }
 
@@ -571,6 +1018,18 @@ neb_evdp_queue_t neb_evdp_source_get_queue(neb_evdp_source_t s)
 	return s->q_in_use;
 }
 
+int neb_evdp_source_set_priority(neb_evdp_source_t s, int prio)
+{
+	if (prio < 0 || prio >= NEB_EVDP_PRIO_MAX) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source priority %d", prio);
+		return -1;
+	}
+	if (prio != NEB_EVDP_PRIO_NORMAL && s->q_in_use && queue_enable_prio(s->q_in_use) != 0)
+		return -1;
+	s->prio = prio;
+	return 0;
+}
+
 void neb_evdp_source_set_on_remove(neb_evdp_source_t s, neb_evdp_source_handler_t on_remove)
 {
 	s->on_remove = on_remove;
@@ -5,6 +5,7 @@
 #include <nebase/cdefs.h>
 #include <nebase/evdp/core.h>
 
+#include <sys/queue.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -15,26 +16,44 @@ enum {
 	EVDP_SOURCE_ABSTIMER,
 	EVDP_SOURCE_RO_FD,    /* read-only fd */
 	EVDP_SOURCE_OS_FD,    /* oneshot fd */
+	EVDP_SOURCE_NOTIFY,   /* cross thread wakeup */
+	EVDP_SOURCE_CIO_FD,   /* completion based socket I/O */
+	EVDP_SOURCE_ET_FD,    /* edge triggered fd */
+	EVDP_SOURCE_DEFER,    /* run at the end of the round once activated */
+	EVDP_SOURCE_IDLE,     /* run at the end of every round */
 };
 
 #define TOTAL_DAY_SECONDS (24 * 3600)
+#define EVDP_ADAPTIVE_BATCH_SHRINK_ROUNDS 64 // consecutive rounds with <= 1/4 batch
 
 extern void *evdp_create_queue_context(neb_evdp_queue_t q)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
 extern void evdp_destroy_queue_context(void *context)
 	_nattr_nonnull((1)) _nattr_hidden;
 
+struct evdp_conf_defer;
+TAILQ_HEAD(evdp_defer_list, evdp_conf_defer);
+
 struct neb_evdp_queue {
 	void *context;
+	struct neb_evdp_queue_conf conf;
+	struct evdp_queue_instr *instr; // NULL if not instrumented
 	int batch_size;
 	int nevents;
 	int current_event;
+	int dispatched; // events handled in the current batch, the rest may be carried over by the round budget
+	int idle_rounds; // rounds with few events, for adaptive_batch
+	int *prio_order; // event indexes sorted by priority, NULL if priority is not in use
+	int prio_handled[NEB_EVDP_PRIO_MAX]; // ro_fd events handled in this round
 
 	uint32_t foreach_id; // if one source is not reached during the previous
 	                     // 2^32 times of loop, we consider it meaningless to
 	                     // reach it during the next loop
 	uint32_t destroying:1;
 	uint32_t in_foreach:1;
+	uint32_t dispatching:1; // handling the events got by the last wait
+
+	neb_evdp_source_t tombs; // sources detached while dispatching, linked by tomb_next
 
 	neb_evdp_source_t pending_qs;
 	neb_evdp_source_t running_qs;
@@ -49,11 +68,22 @@ struct neb_evdp_queue {
 	neb_evdp_source_t foreach_s;
 	neb_evdp_queue_foreach_t each_call;
 
+	struct evdp_defer_list defers; // activated defer sources
+	struct evdp_defer_list idles;
+	uint64_t defer_gen; // increased for each round of defers and idles
+
 	struct {
 		uint64_t rounds;
 		uint64_t events;
 		int pending;
 		int running;
+		uint64_t ctl_calls;
+		uint64_t ctl_saved;
+		uint64_t full_batches;
+		uint64_t spin_hits;
+		uint64_t sleeps;
+		uint64_t prio_deferred;
+		uint64_t carried_events;
 	} stats;
 };
 
@@ -62,11 +92,20 @@ struct neb_evdp_source {
 	neb_evdp_source_t next;
 
 	neb_evdp_queue_t q_in_use;
+	/*
+	 * set if detached from this queue while it is dispatching, events of the
+	 * current batch for it are skipped, and it is kept until the batch ends
+	 */
+	neb_evdp_queue_t q_tomb;
+	neb_evdp_source_t tomb_next;
 
 	int type;
+	int prio;
 	uint32_t foreach_id;
 	uint32_t pending:1;   /* whether is in pending q */
 	uint32_t no_detach:1; /* detach protected */
+	uint32_t tomb_del:1;  /* deleted while being a tombstone, free it at batch end */
+	uint32_t block_used;  /* used size of the slab block, conf and context included */
 
 	int utype;
 	void *udata;
@@ -120,8 +159,27 @@ _Static_assert(sizeof(((struct neb_evdp_queue *)NULL)->foreach_id) == sizeof(((s
     q->stats.running++;                       \
 } while(0)
 
-extern void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
-	_nattr_nonnull((1, 2)) _nattr_hidden;
+/*
+ * the source, its conf and its driver context are allocated as one slab block
+ * if they fit in EVDP_SOURCE_BLOCK_SIZE
+ */
+#define EVDP_SOURCE_BLOCK_SIZE 512
+
+/**
+ * \brief allocate a source with conf in the same block
+ * \param[in] conf_size 0 if no conf
+ */
+extern neb_evdp_source_t evdp_source_new(int type, size_t conf_size)
+	_nattr_warn_unused_result _nattr_hidden;
+/**
+ * \brief allocate zeroed driver context, in the tail of the source block if possible
+ * \note should be freed by evdp_source_context_free
+ */
+extern void *evdp_source_context_alloc(neb_evdp_source_t s, size_t size)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+extern void evdp_source_context_free(void *context)
+	_nattr_nonnull((1)) _nattr_hidden;
+
 /**
  * \brief waiting for events
  * \param[in] timeout NULL if should block forever
@@ -131,6 +189,11 @@ extern int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
 
 extern int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief resize the event array, called only when there is no event left
+ */
+extern int evdp_queue_resize_events(neb_evdp_queue_t q, int size)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
 
 struct neb_evdp_event {
 	void *event;
@@ -143,5 +206,11 @@ extern int evdp_queue_fetch_event(neb_evdp_queue_t q, struct neb_evdp_event *nee
 	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
 extern void evdp_queue_finish_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
 	_nattr_nonnull((1, 2)) _nattr_hidden;
+/**
+ * \brief get the source of event i without any side effect, unlike fetch_event
+ * \return NULL if it is an error event
+ */
+extern neb_evdp_source_t evdp_queue_peek_event_source(neb_evdp_queue_t q, int i)
+	_nattr_nonnull((1)) _nattr_hidden;
 
 #endif
@@ -0,0 +1,74 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "defer.h"
+
+static neb_evdp_source_t evdp_source_new_defer(int type, neb_evdp_defer_handler_t df)
+{
+	neb_evdp_source_t s = evdp_source_new(type, sizeof(struct evdp_conf_defer));
+	if (!s)
+		return NULL;
+
+	struct evdp_conf_defer *conf = s->conf;
+	conf->s = s;
+	conf->do_call = df;
+
+	return s;
+}
+
+neb_evdp_source_t neb_evdp_source_new_defer(neb_evdp_defer_handler_t df)
+{
+	return evdp_source_new_defer(EVDP_SOURCE_DEFER, df);
+}
+
+neb_evdp_source_t neb_evdp_source_new_idle(neb_evdp_defer_handler_t df)
+{
+	return evdp_source_new_defer(EVDP_SOURCE_IDLE, df);
+}
+
+int neb_evdp_source_defer_activate(neb_evdp_source_t s)
+{
+	if (s->type != EVDP_SOURCE_DEFER) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to activate", s->type);
+		return -1;
+	}
+	neb_evdp_queue_t q = s->q_in_use;
+	if (!q) {
+		neb_syslog(LOG_ERR, "defer source %p should be attached before activate", s);
+		return -1;
+	}
+
+	struct evdp_conf_defer *conf = s->conf;
+	if (conf->linked)
+		return 0;
+	conf->gen = q->defer_gen;
+	TAILQ_INSERT_TAIL(&q->defers, conf, list);
+	conf->linked = 1;
+	return 0;
+}
+
+int evdp_source_defer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_conf_defer *conf = s->conf;
+	if (s->type == EVDP_SOURCE_IDLE) {
+		conf->gen = q->defer_gen; // start from the next round
+		TAILQ_INSERT_TAIL(&q->idles, conf, list);
+		conf->linked = 1;
+	}
+
+	EVDP_SLIST_RUNNING_INSERT(q, s);
+	return 0;
+}
+
+void evdp_source_defer_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_conf_defer *conf = s->conf;
+	if (!conf->linked)
+		return;
+	if (s->type == EVDP_SOURCE_IDLE)
+		TAILQ_REMOVE(&q->idles, conf, list);
+	else
+		TAILQ_REMOVE(&q->defers, conf, list);
+	conf->linked = 0;
+}
@@ -0,0 +1,23 @@
+
+#ifndef NEB_SRC_EVDP_DEFER_H
+#define NEB_SRC_EVDP_DEFER_H 1
+
+#include <nebase/evdp/defer.h>
+
+#include <sys/queue.h>
+#include <stdint.h>
+
+struct evdp_conf_defer {
+	TAILQ_ENTRY(evdp_conf_defer) list; // in queue defers or idles
+	neb_evdp_source_t s;
+	neb_evdp_defer_handler_t do_call;
+	uint64_t gen; // not run in the pass of the same gen
+	int linked;
+};
+
+extern int evdp_source_defer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+extern void evdp_source_defer_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
+
+#endif
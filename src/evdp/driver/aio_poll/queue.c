@@ -30,7 +30,7 @@ void *evdp_create_queue_context(neb_evdp_queue_t q)
 		return NULL;
 	}
 
-	if (neb_aio_poll_create(q->batch_size, &c->id) == -1) {
+	if (neb_aio_poll_create(q->conf.adaptive_batch ? q->conf.batch_size_max : q->batch_size, &c->id) == -1) {
 		neb_syslogl(LOG_ERR, "aio_poll_create: %m");
 		evdp_destroy_queue_context(c);
 		return NULL;
@@ -52,18 +52,25 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+int evdp_queue_resize_events(neb_evdp_queue_t q, int size)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->ee)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct io_event *e = c->ee + i;
-		s_got = (neb_evdp_source_t)e->data;
-		if (s_got == s_to_rm)
-			e->data = 0;
+	struct evdp_queue_context *c = q->context;
+
+	struct io_event *ee = realloc(c->ee, size * sizeof(struct io_event));
+	if (!ee) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
 	}
+	c->ee = ee;
+
+	struct iocb **iocbv = realloc(c->iocbv, size * sizeof(struct iocb *));
+	if (!iocbv) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
+	}
+	c->iocbv = iocbv;
+
+	return 0;
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
@@ -100,6 +107,14 @@ void evdp_queue_finish_event(neb_evdp_queue_t q _nattr_unused, struct neb_evdp_e
 	return;
 }
 
+neb_evdp_source_t evdp_queue_peek_event_source(neb_evdp_queue_t q, int i)
+{
+	const struct evdp_queue_context *c = q->context;
+
+	const struct io_event *e = c->ee + i;
+	return (neb_evdp_source_t)e->data;
+}
+
 static int do_batch_flush(neb_evdp_queue_t q, int nr)
 {
 	const struct evdp_queue_context *qc = q->context;
@@ -0,0 +1,131 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_base.h"
+#include "types.h"
+
+#include <stdlib.h>
+#include <poll.h>
+
+/*
+ * aio poll is oneshot, so edge triggered is emulated: read is re-armed after
+ * each event, and write is armed by a separate iocb only when wanted
+ */
+
+void *evdp_create_source_et_fd_context(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_et_fd_context));
+	if (!c)
+		return NULL;
+
+	c->submitted = 0;
+	c->wr_submitted = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_et_fd_context(void *context)
+{
+	struct evdp_source_et_fd_context *c = context;
+
+	evdp_source_context_free(c);
+}
+
+static int do_submit_et_fd_wr(const struct evdp_queue_context *qc, struct evdp_source_et_fd_context *sc)
+{
+	struct iocb *iocbv[1] = {&sc->wr_ctl_event};
+	if (neb_aio_poll_submit(qc->id, 1, iocbv) == -1) {
+		neb_syslogl(LOG_ERR, "aio_poll_submit: %m");
+		return -1;
+	}
+	sc->wr_submitted = 1;
+	return 0;
+}
+
+int evdp_source_et_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+
+	sc->ctl_event.aio_lio_opcode = IOCB_CMD_POLL;
+	sc->ctl_event.aio_fildes = conf->fd;
+	sc->ctl_event.aio_data = (uint64_t)s;
+	sc->ctl_event.aio_buf = POLLIN;
+	sc->wr_ctl_event.aio_lio_opcode = IOCB_CMD_POLL;
+	sc->wr_ctl_event.aio_fildes = conf->fd;
+	sc->wr_ctl_event.aio_data = (uint64_t)s;
+	sc->wr_ctl_event.aio_buf = POLLOUT;
+
+	if (conf->want_write && do_submit_et_fd_wr(qc, sc) != 0)
+		return -1;
+
+	if (conf->do_read) {
+		EVDP_SLIST_PENDING_INSERT(q, s);
+	} else {
+		EVDP_SLIST_RUNNING_INSERT(q, s);
+	}
+
+	return 0;
+}
+
+void evdp_source_et_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_et_fd_context *sc = s->context;
+
+	if (to_close) {
+		sc->submitted = 0;
+		sc->wr_submitted = 0;
+		return;
+	}
+
+	struct io_event e;
+	if (sc->submitted) {
+		if (neb_aio_poll_cancel(qc->id, &sc->ctl_event, &e) == -1)
+			neb_syslogl(LOG_ERR, "aio_poll_cancel: %m");
+		sc->submitted = 0;
+	}
+	if (sc->wr_submitted) {
+		if (neb_aio_poll_cancel(qc->id, &sc->wr_ctl_event, &e) == -1)
+			neb_syslogl(LOG_ERR, "aio_poll_cancel: %m");
+		sc->wr_submitted = 0;
+	}
+}
+
+int evdp_source_et_fd_rearm_write(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *sc = s->context;
+	if (sc->wr_submitted)
+		return 0;
+	return do_submit_et_fd_wr(s->q_in_use->context, sc);
+}
+
+neb_evdp_cb_ret_t evdp_source_et_fd_handle(const struct neb_evdp_event *ne)
+{
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+
+	const struct io_event *e = ne->event;
+	const int is_wr = (struct iocb *)e->obj == &sc->wr_ctl_event;
+	if (is_wr)
+		sc->wr_submitted = 0;
+	else
+		sc->submitted = 0;
+
+	ret = evdp_source_et_fd_dispatch(s, e->res & POLLIN, e->res & POLLOUT,
+	                                 e->res & (POLLHUP | POLLERR), &conf->fd);
+	if (!is_wr && ret == NEB_EVDP_CB_CONTINUE) { // rearm read
+		neb_evdp_queue_t q = s->q_in_use;
+		EVDP_SLIST_REMOVE(s);
+		q->stats.running--;
+		EVDP_SLIST_PENDING_INSERT(q, s);
+	}
+
+	return ret;
+}
@@ -10,11 +10,9 @@
 
 void *evdp_create_source_ro_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_ro_fd_context *c = calloc(1, sizeof(struct evdp_source_ro_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_ro_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_ro_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	c->submitted = 0;
 	s->pending = 0;
@@ -26,7 +24,7 @@ void evdp_destroy_source_ro_fd_context(void *context)
 {
 	struct evdp_source_ro_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -101,3 +99,18 @@ neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
 
 	return ret;
 }
+
+int evdp_source_ro_fd_defer(const struct neb_evdp_event *ne)
+{
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_ro_fd_context *sc = s->context;
+	sc->submitted = 0;
+
+	// the oneshot poll is consumed, poll it again in the next round
+	neb_evdp_queue_t q = s->q_in_use;
+	EVDP_SLIST_REMOVE(s);
+	q->stats.running--;
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
@@ -26,11 +26,24 @@ struct evdp_source_timer_context {
 	struct itimerspec its;
 };
 
+struct evdp_source_notify_context {
+	struct iocb ctl_event;
+	int submitted;
+	int fd;
+};
+
 struct evdp_source_ro_fd_context {
 	struct iocb ctl_event;
 	int submitted;
 };
 
+struct evdp_source_et_fd_context {
+	struct iocb ctl_event; // read
+	int submitted;
+	struct iocb wr_ctl_event;
+	int wr_submitted;
+};
+
 struct evdp_source_os_fd_context {
 	struct iocb ctl_event;
 	int submitted;
@@ -4,13 +4,28 @@
 #include "core.h"
 #include "io_base.h"
 #include "types.h"
+#include "source_os_fd.h"
 
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
 
 #include <linux/version.h>
 
+#ifndef EPIOCSPARAMS // since linux 6.9
+struct epoll_params {
+	uint32_t busy_poll_usecs;
+	uint16_t busy_poll_budget;
+	uint8_t prefer_busy_poll;
+	uint8_t __pad;
+};
+# define EPOLL_IOC_TYPE 0x8A
+# define EPIOCSPARAMS _IOW(EPOLL_IOC_TYPE, 0x01, struct epoll_params)
+#endif
+#define EVDP_EPOLL_BUSY_POLL_BUDGET 8
+
 #if __GLIBC_PREREQ(2, 35)
 # define USE_EPOLL_WAIT2
 static inline int epoll_wait2(int epfd, struct epoll_event *events,
@@ -61,6 +76,16 @@ void *evdp_create_queue_context(neb_evdp_queue_t q)
 		return NULL;
 	}
 
+	if (q->conf.busy_poll_usec) { // kernel busy poll of napi ids of the sockets, not fatal if failed
+		struct epoll_params params = {
+			.busy_poll_usecs = q->conf.busy_poll_usec,
+			.busy_poll_budget = EVDP_EPOLL_BUSY_POLL_BUDGET,
+			.prefer_busy_poll = 1,
+		};
+		if (ioctl(c->fd, EPIOCSPARAMS, &params) == -1)
+			neb_syslogl(LOG_NOTICE, "ioctl(EPIOCSPARAMS): %m");
+	}
+
 	return c;
 }
 
@@ -75,18 +100,18 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+int evdp_queue_resize_events(neb_evdp_queue_t q, int size)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->ee)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct epoll_event *e = c->ee + i;
-		s_got = e->data.ptr;
-		if (s_got == s_to_rm)
-			e->data.ptr = NULL;
+	struct evdp_queue_context *c = q->context;
+
+	struct epoll_event *ee = realloc(c->ee, size * sizeof(struct epoll_event));
+	if (!ee) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
 	}
+	c->ee = ee;
+
+	return 0;
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
@@ -128,6 +153,14 @@ void evdp_queue_finish_event(neb_evdp_queue_t q _nattr_unused, struct neb_evdp_e
 	return;
 }
 
+neb_evdp_source_t evdp_queue_peek_event_source(neb_evdp_queue_t q, int i)
+{
+	const struct evdp_queue_context *c = q->context;
+
+	const struct epoll_event *e = c->ee + i;
+	return e->data.ptr;
+}
+
 int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 {
 	struct evdp_queue_context *qc = q->context;
@@ -145,13 +178,28 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 			fd = ((struct evdp_conf_ro_fd *)s->conf)->fd;
 			break;
 		case EVDP_SOURCE_OS_FD:
+			if (q->conf.ctl_coalesce) {
+				if (evdp_source_os_fd_flush_coalesced(q, s) != 0)
+					return -1;
+				EVDP_SLIST_REMOVE(s);
+				EVDP_SLIST_RUNNING_INSERT_NO_STATS(q, s);
+				count++;
+				continue;
+			}
 			fd = ((struct evdp_conf_fd *)s->conf)->fd;
 			break;
+		case EVDP_SOURCE_NOTIFY:
+			fd = ((struct evdp_source_notify_context *)s->context)->fd;
+			break;
+		case EVDP_SOURCE_ET_FD:
+			fd = ((struct evdp_conf_et_fd *)s->conf)->fd;
+			break;
 		default:
 			neb_syslog(LOG_ERR, "Unsupported epoll(ADD/MOD) source type %d", s->type);
 			return -1;
 			break;
 		}
+		q->stats.ctl_calls++;
 		if (epoll_ctl(qc->fd, sc->ctl_op, fd, &sc->ctl_event) == -1) {
 			neb_syslogl(LOG_ERR, "epoll_ctl(op:%d): %m", sc->ctl_op);
 			return -1;
@@ -0,0 +1,78 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_base.h"
+#include "types.h"
+
+#include <stdlib.h>
+
+void *evdp_create_source_et_fd_context(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_et_fd_context));
+	if (!c)
+		return NULL;
+
+	c->added = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_et_fd_context(void *context)
+{
+	struct evdp_source_et_fd_context *c = context;
+
+	evdp_source_context_free(c);
+}
+
+int evdp_source_et_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+
+	sc->ctl_op = EPOLL_CTL_ADD;
+	sc->ctl_event.data.ptr = s;
+	sc->ctl_event.events = EPOLLET;
+	if (conf->do_read)
+		sc->ctl_event.events |= EPOLLIN;
+	if (conf->do_write) // always registered, want_write is checked in handler
+		sc->ctl_event.events |= EPOLLOUT;
+
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_et_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+
+	if (to_close) {
+		sc->added = 0;
+		return;
+	}
+
+	if (sc->added) {
+		q->stats.ctl_calls++;
+		if (epoll_ctl(qc->fd, EPOLL_CTL_DEL, conf->fd, NULL) == -1)
+			neb_syslogl(LOG_ERR, "epoll_ctl: %m");
+		sc->added = 0;
+	}
+}
+
+int evdp_source_et_fd_rearm_write(neb_evdp_source_t s _nattr_unused)
+{
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_et_fd_handle(const struct neb_evdp_event *ne)
+{
+	const struct epoll_event *e = ne->event;
+	const struct evdp_conf_et_fd *conf = ne->source->conf;
+
+	return evdp_source_et_fd_dispatch(ne->source, e->events & EPOLLIN, e->events & EPOLLOUT,
+	                                  e->events & (EPOLLHUP | EPOLLERR), &conf->fd);
+}
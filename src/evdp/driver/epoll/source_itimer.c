@@ -11,11 +11,9 @@
 
 void *evdp_create_source_itimer_context(neb_evdp_source_t s)
 {
-	struct evdp_source_timer_context *c = calloc(1, sizeof(struct evdp_source_timer_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_timer_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_timer_context));
+	if (!c)
 		return NULL;
-	}
 
 	struct evdp_conf_itimer *conf = s->conf;
 	switch (s->type) {
@@ -54,7 +52,7 @@ void evdp_destroy_source_itimer_context(void *context)
 
 	if (c->fd >= 0)
 		close(c->fd);
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_itimer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -91,6 +89,7 @@ void evdp_source_itimer_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
 		sc->in_action = 0;
 	}
 	if (sc->added) {
+		q->stats.ctl_calls++;
 		if (epoll_ctl(qc->fd, EPOLL_CTL_DEL, sc->fd, NULL) == -1)
 			neb_syslogl(LOG_ERR, "epoll_ctl(EPOLL_CTL_DEL): %m");
 		sc->added = 0;
@@ -4,17 +4,16 @@
 #include "core.h"
 #include "io_base.h"
 #include "types.h"
+#include "source_os_fd.h"
 
 #include <stdlib.h>
 #include <errno.h>
 
 void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_os_fd_context *c = calloc(1, sizeof(struct evdp_source_os_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_os_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_os_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	c->added = 0;
 	s->pending = 0;
@@ -27,6 +26,7 @@ void evdp_reset_source_os_fd_context(neb_evdp_source_t s)
 	struct evdp_source_os_fd_context *c = s->context;
 
 	c->added = 0;
+	c->armed_events = 0;
 	s->pending = 0;
 	c->ctl_event.events = 0;
 }
@@ -35,7 +35,7 @@ void evdp_destroy_source_os_fd_context(void *context)
 {
 	struct evdp_source_os_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -44,7 +44,12 @@ int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 
 	sc->ctl_op = EPOLL_CTL_ADD;
 	sc->ctl_event.data.ptr = s;
-	sc->ctl_event.events |= EPOLLONESHOT; // the real event is dynamic
+	if (q->conf.ctl_coalesce) { // level triggered, so no need to rearm after each event
+		sc->ctl_event.events &= ~EPOLLONESHOT;
+		sc->armed_events = 0;
+	} else {
+		sc->ctl_event.events |= EPOLLONESHOT; // the real event is dynamic
+	}
 
 	if (sc->ctl_event.events & (EPOLLIN | EPOLLOUT)) {
 		EVDP_SLIST_PENDING_INSERT(q, s);
@@ -59,6 +64,7 @@ static int do_ctl_os_fd(const struct evdp_queue_context *qc, neb_evdp_source_t s
 {
 	struct evdp_source_os_fd_context *sc = s->context;
 	const struct evdp_conf_fd *conf = s->conf;
+	s->q_in_use->stats.ctl_calls++;
 	if (epoll_ctl(qc->fd, sc->ctl_op, conf->fd, &sc->ctl_event) == -1) {
 		neb_syslogl(LOG_ERR, "epoll_ctl(op:%d): %m", sc->ctl_op);
 		return -1;
@@ -71,6 +77,7 @@ static int do_del_os_fd(const struct evdp_queue_context *qc, neb_evdp_source_t s
 {
 	struct evdp_source_os_fd_context *sc = s->context;
 	const struct evdp_conf_fd *conf = s->conf;
+	s->q_in_use->stats.ctl_calls++;
 	if (epoll_ctl(qc->fd, EPOLL_CTL_DEL, conf->fd, NULL) == -1) {
 		if (errno == ENOENT)
 			sc->added = 0;
@@ -78,10 +85,64 @@ static int do_del_os_fd(const struct evdp_queue_context *qc, neb_evdp_source_t s
 		return -1;
 	}
 	sc->added = 0;
+	sc->armed_events = 0;
 	sc->ctl_op = EPOLL_CTL_ADD;
 	return 0;
 }
 
+int evdp_source_os_fd_flush_coalesced(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_os_fd_context *sc = s->context;
+	const struct evdp_conf_fd *conf = s->conf;
+
+	uint32_t want = sc->ctl_event.events & (EPOLLIN | EPOLLOUT);
+	if (want == sc->armed_events) { // changed back in the same round
+		q->stats.ctl_saved++;
+		return 0;
+	}
+
+	int op;
+	if (!want)
+		op = EPOLL_CTL_DEL;
+	else if (sc->armed_events)
+		op = EPOLL_CTL_MOD;
+	else
+		op = EPOLL_CTL_ADD;
+	q->stats.ctl_calls++;
+	if (epoll_ctl(qc->fd, op, conf->fd, op == EPOLL_CTL_DEL ? NULL : &sc->ctl_event) == -1) {
+		neb_syslogl(LOG_ERR, "epoll_ctl(op:%d): %m", op);
+		return -1;
+	}
+	sc->armed_events = want;
+	sc->added = want ? 1 : 0;
+	return 0;
+}
+
+/**
+ * \brief queue the change to pending, so all changes in this round will be
+ *        done by one epoll_ctl in flush
+ */
+static int os_fd_coalesce_update(neb_evdp_source_t s)
+{
+	struct evdp_source_os_fd_context *sc = s->context;
+	neb_evdp_queue_t q = s->q_in_use;
+
+	if (sc->in_callback) // will be checked after the callback
+		return 0;
+	if (s->pending) {
+		if (sc->armed_events) // it would be an immediate epoll_ctl
+			q->stats.ctl_saved++;
+		return 0;
+	}
+	if ((sc->ctl_event.events & (EPOLLIN | EPOLLOUT)) == sc->armed_events)
+		return 0;
+	EVDP_SLIST_REMOVE(s);
+	q->stats.running--;
+	EVDP_SLIST_PENDING_INSERT(q, s);
+	return 0;
+}
+
 void evdp_source_os_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
 {
 	const struct evdp_queue_context *qc = q->context;
@@ -96,19 +157,13 @@ void evdp_source_os_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_cl
 		do_del_os_fd(qc, s);
 }
 
-neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
+static neb_evdp_cb_ret_t os_fd_handle_events(neb_evdp_source_t s, const struct epoll_event *e)
 {
 	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
 
-	neb_evdp_source_t s = ne->source;
 	struct evdp_source_os_fd_context *sc = s->context;
-	sc->added = 0;
-	sc->ctl_op = EPOLL_CTL_MOD;
-
-	const struct epoll_event *e = ne->event;
-
 	const struct evdp_conf_fd *conf = s->conf;
-	if ((e->events & EPOLLIN) && conf->do_read) {
+	if ((e->events & EPOLLIN) && (sc->ctl_event.events & EPOLLIN) && conf->do_read) {
 		sc->ctl_event.events &= ~EPOLLIN;
 		sc->in_callback = 1;
 		ret = conf->do_read(conf->fd, s->udata, &conf->fd);
@@ -131,17 +186,53 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 			break;
 		}
 	}
-	if ((e->events & EPOLLOUT) && conf->do_write) {
+	if ((e->events & EPOLLOUT) && (sc->ctl_event.events & EPOLLOUT) && conf->do_write) {
 		sc->ctl_event.events &= ~EPOLLOUT;
 		sc->in_callback = 1;
-		ret = conf->do_write(conf->fd, s->udata, &conf->fd);
+		ret = evdp_source_os_fd_call_write(s, conf->fd, &conf->fd);
 		sc->in_callback = 0;
 		if (ret != NEB_EVDP_CB_CONTINUE)
 			return ret;
 	}
 
+	return ret;
+}
+
+neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
+{
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_os_fd_context *sc = s->context;
+	neb_evdp_queue_t q = s->q_in_use;
+
+	if (q->conf.ctl_coalesce) {
+		neb_evdp_cb_ret_t ret = os_fd_handle_events(s, ne->event);
+		switch (ret) {
+		case NEB_EVDP_CB_REMOVE:
+		case NEB_EVDP_CB_CLOSE:
+			break;
+		default: // still registered, only update if the events changed
+			if ((sc->ctl_event.events & (EPOLLIN | EPOLLOUT)) != sc->armed_events) {
+				if (!s->pending) {
+					EVDP_SLIST_REMOVE(s);
+					q->stats.running--;
+					EVDP_SLIST_PENDING_INSERT(q, s);
+				}
+			} else {
+				q->stats.ctl_saved++; // no rearm
+			}
+			break;
+		}
+		return ret;
+	}
+
+	sc->added = 0;
+	sc->ctl_op = EPOLL_CTL_MOD;
+
+	neb_evdp_cb_ret_t ret = os_fd_handle_events(s, ne->event);
+	if (ret != NEB_EVDP_CB_CONTINUE)
+		return ret;
+
 	if (sc->ctl_event.events & (EPOLLIN | EPOLLOUT)) { // do pending if only handled one of them
-		neb_evdp_queue_t q = s->q_in_use;
 		EVDP_SLIST_REMOVE(s);
 		q->stats.running--;
 		EVDP_SLIST_PENDING_INSERT(q, s);
@@ -171,6 +262,10 @@ void evdp_source_os_fd_init_write(neb_evdp_source_t s, neb_evdp_io_handler_t rf)
 int evdp_source_os_fd_reset_read(neb_evdp_source_t s)
 {
 	struct evdp_source_os_fd_context *sc = s->context;
+	if (s->q_in_use->conf.ctl_coalesce) {
+		sc->ctl_event.events |= EPOLLIN;
+		return os_fd_coalesce_update(s);
+	}
 	if (sc->added) {
 		if (sc->ctl_event.events & EPOLLIN)
 			return 0;
@@ -191,6 +286,10 @@ int evdp_source_os_fd_reset_read(neb_evdp_source_t s)
 int evdp_source_os_fd_reset_write(neb_evdp_source_t s)
 {
 	struct evdp_source_os_fd_context *sc = s->context;
+	if (s->q_in_use->conf.ctl_coalesce) {
+		sc->ctl_event.events |= EPOLLOUT;
+		return os_fd_coalesce_update(s);
+	}
 	if (sc->added) {
 		if (sc->ctl_event.events & EPOLLOUT)
 			return 0;
@@ -211,6 +310,10 @@ int evdp_source_os_fd_reset_write(neb_evdp_source_t s)
 int evdp_source_os_fd_unset_read(neb_evdp_source_t s)
 {
 	struct evdp_source_os_fd_context *sc = s->context;
+	if (s->q_in_use->conf.ctl_coalesce) {
+		sc->ctl_event.events &= ~EPOLLIN;
+		return os_fd_coalesce_update(s);
+	}
 	if (sc->added) {
 		if (!(sc->ctl_event.events & EPOLLIN))
 			return 0;
@@ -235,6 +338,10 @@ int evdp_source_os_fd_unset_read(neb_evdp_source_t s)
 int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 {
 	struct evdp_source_os_fd_context *sc = s->context;
+	if (s->q_in_use->conf.ctl_coalesce) {
+		sc->ctl_event.events &= ~EPOLLOUT;
+		return os_fd_coalesce_update(s);
+	}
 	if (sc->added) {
 		if (!(sc->ctl_event.events & EPOLLOUT))
 			return 0;
@@ -0,0 +1,15 @@
+
+#ifndef NEB_SRC_EVDP_DRIVER_EPOLL_SOURCE_OS_FD_H
+#define NEB_SRC_EVDP_DRIVER_EPOLL_SOURCE_OS_FD_H 1
+
+#include <nebase/cdefs.h>
+
+#include "core.h"
+
+/**
+ * \brief sync the wanted events to kernel in ctl_coalesce mode
+ */
+extern int evdp_source_os_fd_flush_coalesced(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+
+#endif
@@ -9,11 +9,9 @@
 
 void *evdp_create_source_ro_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_ro_fd_context *c = calloc(1, sizeof(struct evdp_source_ro_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_ro_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_ro_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	c->added = 0;
 	s->pending = 0;
@@ -25,7 +23,7 @@ void evdp_destroy_source_ro_fd_context(void *context)
 {
 	struct evdp_source_ro_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -53,6 +51,7 @@ void evdp_source_ro_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_cl
 	}
 
 	if (sc->added) {
+		q->stats.ctl_calls++;
 		if (epoll_ctl(qc->fd, EPOLL_CTL_DEL, conf->fd, NULL) == -1)
 			neb_syslogl(LOG_ERR, "epoll_ctl: %m");
 		sc->added = 0;
@@ -87,3 +86,8 @@ neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
 
 	return ret;
 }
+
+int evdp_source_ro_fd_defer(const struct neb_evdp_event *ne _nattr_unused)
+{
+	return 0; // level triggered, it will be reported again by the next wait
+}
@@ -25,17 +25,31 @@ struct evdp_source_timer_context {
 	struct itimerspec its;
 };
 
+struct evdp_source_notify_context {
+	struct epoll_event ctl_event;
+	int ctl_op;
+	int added;
+	int fd;
+};
+
 struct evdp_source_ro_fd_context {
 	struct epoll_event ctl_event;
 	int ctl_op;
 	int added;
 };
 
+struct evdp_source_et_fd_context {
+	struct epoll_event ctl_event;
+	int ctl_op;
+	int added;
+};
+
 struct evdp_source_os_fd_context {
 	struct epoll_event ctl_event;
 	int ctl_op;
 	int added;
 	int in_callback;
+	uint32_t armed_events; // in kernel, for ctl_coalesce mode
 };
 
 #endif
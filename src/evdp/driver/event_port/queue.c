@@ -6,6 +6,8 @@
 
 #include "source_ro_fd.h"
 #include "source_os_fd.h"
+#include "source_et_fd.h"
+#include "source_notify.h"
 
 #include <stdlib.h>
 #include <unistd.h>
@@ -48,18 +50,18 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+int evdp_queue_resize_events(neb_evdp_queue_t q, int size)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->ee)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		port_event_t *e = c->ee + i;
-		s_got = e->portev_user;
-		if (s_got == s_to_rm)
-			e->portev_user = NULL;
+	struct evdp_queue_context *c = q->context;
+
+	port_event_t *ee = realloc(c->ee, size * sizeof(port_event_t));
+	if (!ee) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
 	}
+	c->ee = ee;
+
+	return 0;
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
@@ -100,6 +102,14 @@ void evdp_queue_finish_event(neb_evdp_queue_t q _nattr_unused, struct neb_evdp_e
 	return;
 }
 
+neb_evdp_source_t evdp_queue_peek_event_source(neb_evdp_queue_t q, int i)
+{
+	const struct evdp_queue_context *c = q->context;
+
+	const port_event_t *e = c->ee + i;
+	return e->portev_user;
+}
+
 int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 {
 	const struct evdp_queue_context *qc = q->context;
@@ -113,6 +123,12 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 		case EVDP_SOURCE_OS_FD:
 			ret = do_associate_os_fd(qc, s);
 			break;
+		case EVDP_SOURCE_ET_FD:
+			ret = do_associate_et_fd(qc, s);
+			break;
+		case EVDP_SOURCE_NOTIFY:
+			ret = do_associate_notify(qc, s);
+			break;
 		// TODO add other source type here
 		default:
 			neb_syslog(LOG_ERR, "Unsupported associate source type %d", s->type);
@@ -12,11 +12,9 @@
 
 void *evdp_create_source_abstimer_context(neb_evdp_source_t s)
 {
-	struct evdp_source_timer_context *c = calloc(1, sizeof(struct evdp_source_timer_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_timer_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_timer_context));
+	if (!c)
 		return NULL;
-	}
 
 	c->its.it_interval.tv_sec = TOTAL_DAY_SECONDS;
 	c->its.it_interval.tv_nsec = 0;
@@ -32,7 +30,7 @@ void evdp_destroy_source_abstimer_context(void *context)
 {
 	struct evdp_source_timer_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_abstimer_regulate(neb_evdp_source_t s)
@@ -0,0 +1,123 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_base.h"
+#include "types.h"
+#include "source_et_fd.h"
+
+#include <stdlib.h>
+#include <poll.h>
+
+/*
+ * port association is oneshot, so edge triggered is emulated by associating
+ * again after each event, with write only if wanted
+ */
+
+static int et_fd_events(const struct evdp_conf_et_fd *conf)
+{
+	int events = 0;
+	if (conf->do_read)
+		events |= POLLIN;
+	if (conf->want_write)
+		events |= POLLOUT;
+	return events;
+}
+
+int do_associate_et_fd(const struct evdp_queue_context *qc, neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+	if (port_associate(qc->fd, PORT_SOURCE_FD, conf->fd, et_fd_events(conf), s) == -1) {
+		neb_syslogl(LOG_ERR, "port_associate: %m");
+		return -1;
+	}
+	sc->associated = 1;
+	return 0;
+}
+
+void *evdp_create_source_et_fd_context(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_et_fd_context));
+	if (!c)
+		return NULL;
+
+	c->associated = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_et_fd_context(void *context)
+{
+	struct evdp_source_et_fd_context *c = context;
+
+	evdp_source_context_free(c);
+}
+
+int evdp_source_et_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	if (et_fd_events(s->conf)) {
+		EVDP_SLIST_PENDING_INSERT(q, s);
+	} else {
+		EVDP_SLIST_RUNNING_INSERT(q, s);
+	}
+
+	return 0;
+}
+
+void evdp_source_et_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	const struct evdp_queue_context *qc = q->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+	struct evdp_source_et_fd_context *sc = s->context;
+
+	if (to_close) {
+		sc->associated = 0;
+		return;
+	}
+
+	if (sc->associated) {
+		if (port_dissociate(qc->fd, PORT_SOURCE_FD, conf->fd) == -1)
+			neb_syslogl(LOG_ERR, "port_dissociate: %m");
+		sc->associated = 0;
+	}
+}
+
+int evdp_source_et_fd_rearm_write(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *sc = s->context;
+	if (sc->in_callback || s->pending) // will be associated with the new events
+		return 0;
+	if (sc->associated) // update the events
+		return do_associate_et_fd(s->q_in_use->context, s);
+
+	neb_evdp_queue_t q = s->q_in_use;
+	EVDP_SLIST_REMOVE(s);
+	q->stats.running--;
+	EVDP_SLIST_PENDING_INSERT(q, s);
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_et_fd_handle(const struct neb_evdp_event *ne)
+{
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_et_fd_context *sc = s->context;
+	sc->associated = 0;
+
+	const port_event_t *e = ne->event;
+
+	const int fd = e->portev_object;
+	sc->in_callback = 1;
+	neb_evdp_cb_ret_t ret = evdp_source_et_fd_dispatch(s, e->portev_events & POLLIN, e->portev_events & POLLOUT,
+	                                                   e->portev_events & (POLLHUP | POLLERR), &fd);
+	sc->in_callback = 0;
+	if (ret == NEB_EVDP_CB_CONTINUE && et_fd_events(s->conf)) {
+		neb_evdp_queue_t q = s->q_in_use;
+		EVDP_SLIST_REMOVE(s);
+		q->stats.running--;
+		EVDP_SLIST_PENDING_INSERT(q, s);
+	}
+
+	return ret;
+}
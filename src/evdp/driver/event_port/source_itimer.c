@@ -11,11 +11,9 @@
 
 void *evdp_create_source_itimer_context(neb_evdp_source_t s)
 {
-	struct evdp_source_timer_context *c = calloc(1, sizeof(struct evdp_source_timer_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_timer_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_timer_context));
+	if (!c)
 		return NULL;
-	}
 
 	const struct evdp_conf_itimer *conf = s->conf;
 	switch (s->type) {
@@ -45,7 +43,7 @@ void evdp_destroy_source_itimer_context(void *context)
 {
 	struct evdp_source_timer_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_itimer_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -0,0 +1,111 @@
+
+#include <nebase/syslog.h>
+#include <nebase/pipe.h>
+
+#include "core.h"
+#include "notify.h"
+#include "types.h"
+#include "source_notify.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+/*
+ * port_send events can not be removed after sent, so use a pipe instead,
+ * and pending events will be removed by port_dissociate
+ */
+
+int do_associate_notify(const struct evdp_queue_context *qc, neb_evdp_source_t s)
+{
+	struct evdp_source_notify_context *sc = s->context;
+	if (port_associate(qc->fd, PORT_SOURCE_FD, sc->pipefd[0], POLLIN, s) == -1) {
+		neb_syslogl(LOG_ERR, "port_associate: %m");
+		return -1;
+	}
+	sc->associated = 1;
+	return 0;
+}
+
+void *evdp_create_source_notify_context(neb_evdp_source_t s)
+{
+	struct evdp_source_notify_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_notify_context));
+	if (!c)
+		return NULL;
+	c->pipefd[0] = -1;
+	c->pipefd[1] = -1;
+
+	if (neb_pipe_new(c->pipefd) != 0) {
+		neb_syslog(LOG_ERR, "Failed to create pipe for notify source");
+		evdp_destroy_source_notify_context(c);
+		return NULL;
+	}
+
+	c->associated = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_notify_context(void *context)
+{
+	struct evdp_source_notify_context *c = context;
+
+	if (c->pipefd[0] >= 0)
+		close(c->pipefd[0]);
+	if (c->pipefd[1] >= 0)
+		close(c->pipefd[1]);
+	evdp_source_context_free(c);
+}
+
+int evdp_source_notify_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_notify_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_notify_context *sc = s->context;
+
+	if (sc->associated) {
+		if (port_dissociate(qc->fd, PORT_SOURCE_FD, sc->pipefd[0]) == -1)
+			neb_syslogl(LOG_ERR, "port_dissociate: %m");
+		sc->associated = 0;
+	}
+}
+
+int evdp_source_notify_wakeup(neb_evdp_source_t s)
+{
+	const struct evdp_source_notify_context *sc = s->context;
+
+	char c = 0;
+	if (write(sc->pipefd[1], &c, sizeof(c)) == -1 && errno != EAGAIN) {
+		neb_syslogl(LOG_ERR, "write: %m");
+		return -1;
+	}
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_notify_handle(const struct neb_evdp_event *ne)
+{
+	struct evdp_source_notify_context *sc = ne->source->context;
+	sc->associated = 0;
+
+	char buf[64];
+	while (read(sc->pipefd[0], buf, sizeof(buf)) > 0)
+		;
+
+	neb_evdp_cb_ret_t ret = evdp_source_notify_dispatch(ne->source);
+	if (ret == NEB_EVDP_CB_CONTINUE) {
+		neb_evdp_queue_t q = ne->source->q_in_use;
+		EVDP_SLIST_REMOVE(ne->source);
+		q->stats.running--;
+		EVDP_SLIST_PENDING_INSERT(q, ne->source);
+	}
+
+	return ret;
+}
@@ -38,11 +38,9 @@ static int do_disassociate_os_fd(const struct evdp_queue_context *qc, neb_evdp_s
 
 void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_os_fd_context *c = calloc(1, sizeof(struct evdp_source_os_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_os_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_os_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	c->associated = 0;
 	s->pending = 0;
@@ -63,7 +61,7 @@ void evdp_destroy_source_os_fd_context(void *context)
 {
 	struct evdp_source_os_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -131,7 +129,7 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 	if ((e->portev_events & POLLOUT) && conf->do_write) {
 		sc->events &= ~POLLOUT;
 		sc->in_callback = 1;
-		ret = conf->do_write(fd, s->udata, &fd);
+		ret = evdp_source_os_fd_call_write(s, fd, &fd);
 		sc->in_callback = 0;
 		if (ret != NEB_EVDP_CB_CONTINUE)
 			return ret;
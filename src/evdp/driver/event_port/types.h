@@ -17,10 +17,20 @@ struct evdp_source_timer_context {
 	struct itimerspec its;
 };
 
+struct evdp_source_notify_context {
+	int associated;
+	int pipefd[2];
+};
+
 struct evdp_source_ro_fd_context {
 	int associated;
 };
 
+struct evdp_source_et_fd_context {
+	int associated;
+	int in_callback;
+};
+
 struct evdp_source_os_fd_context {
 	int associated;
 	int events;
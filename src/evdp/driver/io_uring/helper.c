@@ -5,36 +5,50 @@
 
 #include <liburing.h>
 
-int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
+struct io_uring_sqe *neb_io_uring_get_sqe(struct evdp_queue_context *qc)
 {
-	struct evdp_source_context *sc = s->context;
 	struct io_uring_sqe *sqe = io_uring_get_sqe(&qc->ring);
-	if (!sqe) {
+	if (sqe)
+		return sqe;
+
+	// sq is full, flush it and try again
+	int ret = io_uring_submit(&qc->ring);
+	if (ret < 0) {
+		neb_syslogl_en(-ret, LOG_ERR, "io_uring_submit: %m");
+		return NULL;
+	}
+	sqe = io_uring_get_sqe(&qc->ring);
+	if (!sqe && (qc->ring.flags & IORING_SETUP_SQPOLL)) {
+		// the sq thread may be not able to consume sqes in time
+		ret = io_uring_sqring_wait(&qc->ring);
+		if (ret < 0) {
+			neb_syslogl_en(-ret, LOG_ERR, "io_uring_sqring_wait: %m");
+			return NULL;
+		}
+		sqe = io_uring_get_sqe(&qc->ring);
+	}
+	if (!sqe)
 		neb_syslog(LOG_CRIT, "no sqe left");
+	return sqe;
+}
+
+int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
+{
+	struct evdp_source_context *sc = s->context;
+	struct io_uring_sqe *sqe = neb_io_uring_get_sqe(qc);
+	if (!sqe)
 		return -1;
-	}
 	io_uring_prep_poll_add(sqe, sc->fd, sc->ctl_event);
 	io_uring_sqe_set_data(sqe, s);
-	int ret = io_uring_submit(&qc->ring);
-	if (ret < 0) {
-		neb_syslogl(LOG_ERR, "io_uring_submit: %m");
-		return -1;
-	}
 	return 0;
 }
 
 int neb_io_uring_cancel_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
 {
-	struct io_uring_sqe *sqe = io_uring_get_sqe(&qc->ring);
-	if (!sqe) {
-		neb_syslog(LOG_CRIT, "no sqe left");
+	struct io_uring_sqe *sqe = neb_io_uring_get_sqe(qc);
+	if (!sqe)
 		return -1;
-	}
 	io_uring_prep_poll_remove(sqe, s);
-	int ret = io_uring_submit(&qc->ring);
-	if (ret < 0) {
-		neb_syslogl(LOG_ERR, "io_uring_submit: %m");
-		return -1;
-	}
+	io_uring_sqe_set_data(sqe, NULL);
 	return 0;
 }
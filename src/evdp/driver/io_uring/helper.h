@@ -7,10 +7,17 @@
 #include "core.h"
 #include "types.h"
 
+/**
+ * \brief get a sqe, the sq will be flushed if full
+ * \note all sqes will be submitted in the next wait
+ */
+extern struct io_uring_sqe *neb_io_uring_get_sqe(struct evdp_queue_context *qc)
+	_nattr_warn_unused_result _nattr_nonnull((1));
+
 extern int neb_io_uring_submit_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1, 2));
 
 extern int neb_io_uring_cancel_fd(struct evdp_queue_context *qc, neb_evdp_source_t s)
-	_nattr_warn_unused_result _nattr_nonnull((1, 2));;
+	_nattr_warn_unused_result _nattr_nonnull((1, 2));
 
 #endif
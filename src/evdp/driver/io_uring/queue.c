@@ -1,14 +1,19 @@
 
 #include <nebase/syslog.h>
+#include <nebase/time.h>
 
 #include "core.h"
 #include "types.h"
+#include "source_cio.h"
+#include "helper.h"
 
 #include <stdlib.h>
 #include <errno.h>
 
 #include <liburing.h>
 
+#define EVDP_IO_URING_DEFAULT_ENTRIES 4096
+
 void *evdp_create_queue_context(neb_evdp_queue_t q)
 {
 	struct evdp_queue_context *c = calloc(1, sizeof(struct evdp_queue_context));
@@ -16,11 +21,34 @@ void *evdp_create_queue_context(neb_evdp_queue_t q)
 		neb_syslogl(LOG_ERR, "calloc: %m");
 		return NULL;
 	}
-
-	// TODO use custom params, i.e. CQ size
-	int ret = io_uring_queue_init(4096, &c->ring, 0);
+	LIST_INIT(&c->orphan_ops);
+
+	const struct neb_evdp_queue_conf *conf = &q->conf;
+	struct io_uring_params p = NEB_STRUCT_INITIALIZER;
+	unsigned int entries = conf->sq_entries ? conf->sq_entries : EVDP_IO_URING_DEFAULT_ENTRIES;
+	if (conf->cq_entries) {
+		p.flags |= IORING_SETUP_CQSIZE;
+		p.cq_entries = conf->cq_entries;
+	}
+	if (conf->sqpoll) {
+		if (conf->defer_taskrun) {
+			neb_syslog(LOG_ERR, "defer_taskrun is not compatible with sqpoll");
+			evdp_destroy_queue_context(c);
+			return NULL;
+		}
+		p.flags |= IORING_SETUP_SQPOLL;
+		p.sq_thread_idle = conf->sqpoll_idle_msec;
+	}
+	if (conf->coop_taskrun)
+		p.flags |= IORING_SETUP_COOP_TASKRUN;
+	if (conf->single_issuer || conf->defer_taskrun)
+		p.flags |= IORING_SETUP_SINGLE_ISSUER;
+	if (conf->defer_taskrun)
+		p.flags |= IORING_SETUP_DEFER_TASKRUN;
+
+	int ret = io_uring_queue_init_params(entries, &c->ring, &p);
 	if (ret < 0) {
-		neb_syslogl_en(-ret, LOG_ERR, "io_uring_queue_init: %m");
+		neb_syslogl_en(-ret, LOG_ERR, "io_uring_queue_init_params: %m");
 		evdp_destroy_queue_context(c);
 		return NULL;
 	}
@@ -42,23 +70,26 @@ void evdp_destroy_queue_context(void *context)
 
 	if (c->cqe)
 		free(c->cqe);
-	if (c->ring_ok)
+	if (c->ring_ok) {
+		evdp_cio_free_orphan_ops(c);
 		io_uring_queue_exit(&c->ring);
+		evdp_cio_release_orphan_ops(c);
+	}
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+int evdp_queue_resize_events(neb_evdp_queue_t q, int size)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->cqe)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct io_uring_cqe *e = c->cqe[i];
-		s_got = (neb_evdp_source_t)e->user_data;
-		if (s_got == s_to_rm)
-			e->user_data = 0;
+	struct evdp_queue_context *c = q->context;
+
+	struct io_uring_cqe **cqe = realloc(c->cqe, size * sizeof(struct io_uring_cqe *));
+	if (!cqe) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
 	}
+	c->cqe = cqe;
+
+	return 0;
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
@@ -67,10 +98,23 @@ int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
 
 	// try batch first
 	q->nevents = io_uring_peek_batch_cqe(&c->ring, c->cqe, q->batch_size);
-	if (q->nevents > 0)
+	if (q->nevents > 0) {
+		if (io_uring_sq_ready(&c->ring)) { // no wait, but sqes should not be delayed
+			int ret = io_uring_submit(&c->ring);
+			if (ret < 0) {
+				neb_syslogl_en(-ret, LOG_ERR, "io_uring_submit: %m");
+				return -1;
+			}
+		}
 		return 0;
+	}
 
-	// no event yet, wait till timeout
+	// spinning, no need to enter the ring if nothing to submit, except that
+	// task work is deferred to the time we wait for completions
+	if (timeout && !neb_timespecisset(timeout) && !io_uring_sq_ready(&c->ring) && !q->conf.defer_taskrun)
+		return 0;
+
+	// no event yet, submit all sqes in this round and wait till timeout
 	struct __kernel_timespec ts;
 	struct __kernel_timespec *timeout_k = NULL;
 	if (timeout != NULL) {
@@ -80,7 +124,7 @@ int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
 	}
 
 	struct io_uring_cqe *cqe = NULL;
-	int ret = io_uring_wait_cqe_timeout(&c->ring, &cqe, timeout_k);
+	int ret = io_uring_submit_and_wait_timeout(&c->ring, &cqe, 1, timeout_k, NULL);
 	if (ret < 0) {
 		switch (-ret) {
 		case EAGAIN:
@@ -88,7 +132,7 @@ int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
 		case ETIME:
 			return 0;
 		default:
-			neb_syslogl_en(-ret, LOG_ERR, "io_uring_wait_cqe_timeout: %m");
+			neb_syslogl_en(-ret, LOG_ERR, "io_uring_submit_and_wait_timeout: %m");
 			return -1;
 			break;
 		}
@@ -106,27 +150,50 @@ int evdp_queue_fetch_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
 
 	struct io_uring_cqe *e = c->cqe[q->current_event];
 	nee->event = e;
-	nee->source = (neb_evdp_source_t)e->user_data;
+	if (EVDP_CIO_OP_IS_TAGGED(e->user_data))
+		nee->source = EVDP_CIO_OP_FROM_DATA(e->user_data)->s;
+	else
+		nee->source = (neb_evdp_source_t)e->user_data;
 	return 0;
 }
 
 void evdp_queue_finish_event(neb_evdp_queue_t q, struct neb_evdp_event *nee)
 {
 	struct evdp_queue_context *qc = q->context;
+	const struct io_uring_cqe *e = nee->event;
+	if (EVDP_CIO_OP_IS_TAGGED(e->user_data))
+		evdp_cio_op_finish(qc, EVDP_CIO_OP_FROM_DATA(e->user_data), e);
 	io_uring_cqe_seen(&qc->ring, nee->event);
 }
 
+neb_evdp_source_t evdp_queue_peek_event_source(neb_evdp_queue_t q, int i)
+{
+	const struct evdp_queue_context *c = q->context;
+
+	const struct io_uring_cqe *e = c->cqe[i];
+	if (EVDP_CIO_OP_IS_TAGGED(e->user_data))
+		return EVDP_CIO_OP_FROM_DATA(e->user_data)->s;
+	return (neb_evdp_source_t)e->user_data;
+}
+
 int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 {
 	struct evdp_queue_context *qc = q->context;
 	int count = 0;
 	for (neb_evdp_source_t s = q->pending_qs->next; s; s = q->pending_qs->next) {
+		if (s->type == EVDP_SOURCE_CIO_FD) {
+			if (evdp_source_cio_prep(qc, s) != 0)
+				return -1;
+			EVDP_SLIST_REMOVE(s);
+			EVDP_SLIST_RUNNING_INSERT_NO_STATS(q, s);
+			count++;
+			continue;
+		}
+
 		struct evdp_source_context *sc = s->context;
-		struct io_uring_sqe *sqe = io_uring_get_sqe(&qc->ring);
-		if (!sqe) { // FIXME
-			neb_syslog(LOG_CRIT, "no sqe available");
+		struct io_uring_sqe *sqe = neb_io_uring_get_sqe(qc);
+		if (!sqe)
 			return -1;
-		}
 
 		// FIXME we may want to prep for other events
 		if (sc->multishot) {
@@ -135,21 +202,15 @@ int evdp_queue_flush_pending_sources(neb_evdp_queue_t q)
 			io_uring_prep_poll_add(sqe, sc->fd, sc->ctl_event);
 		}
 		io_uring_sqe_set_data(sqe, s);
+		sc->submitted = 1;
 
 		EVDP_SLIST_REMOVE(s);
 		EVDP_SLIST_RUNNING_INSERT_NO_STATS(q, s);
 		count++;
 	}
-	if (count) {
-		int ret = io_uring_submit(&qc->ring);
-		if (ret < 0) {
-			neb_syslogl_en(-ret, LOG_ERR, "io_uring_submit: %m");
-			return -1;
-		}
-
-		q->stats.pending -= count;
-		q->stats.running += count;
-	}
+	// sqes will be submitted in wait_events
+	q->stats.pending -= count;
+	q->stats.running += count;
 
 	return 0;
 }
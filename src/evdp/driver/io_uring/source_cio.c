@@ -0,0 +1,409 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_cio.h"
+#include "types.h"
+#include "source_cio.h"
+#include "helper.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+
+#include <liburing.h>
+
+#define EVDP_CIO_BGID_RETRY 16
+
+static struct evdp_cio_op *cio_op_new(neb_evdp_source_t s, int type)
+{
+	struct evdp_cio_op *op = calloc(1, sizeof(struct evdp_cio_op));
+	if (!op) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	op->s = s;
+	op->type = type;
+	op->bgid = -1;
+	return op;
+}
+
+static void cio_op_free(struct evdp_cio_op *op)
+{
+	if (op->br) {
+		int ret = io_uring_free_buf_ring(&op->qc->ring, op->br, op->buf_count, op->bgid);
+		if (ret < 0)
+			neb_syslogl_en(-ret, LOG_ERR, "io_uring_free_buf_ring: %m");
+	}
+	if (op->bufs)
+		free(op->bufs);
+	free(op);
+}
+
+static void cio_op_orphan(struct evdp_queue_context *qc, struct evdp_cio_op *op)
+{
+	op->s = NULL;
+	LIST_INSERT_HEAD(&qc->orphan_ops, op, list);
+}
+
+/**
+ * \brief cancel by user_data, so it doesn't matter if fd is closed before submit
+ */
+static void cio_op_cancel(struct evdp_queue_context *qc, struct evdp_cio_op *op)
+{
+	struct io_uring_sqe *sqe = neb_io_uring_get_sqe(qc);
+	if (!sqe) {
+		neb_syslog(LOG_ERR, "failed to cancel cio op %p", op);
+		return;
+	}
+	io_uring_prep_cancel64(sqe, (uintptr_t)op | EVDP_CIO_OP_TAG, 0);
+	io_uring_sqe_set_data(sqe, NULL);
+}
+
+static void cio_recv_add_buf(struct evdp_cio_op *op, int bid)
+{
+	io_uring_buf_ring_add(op->br, op->bufs + (size_t)bid * op->buf_size, op->buf_size, bid,
+	                      io_uring_buf_ring_mask(op->buf_count), 0);
+	io_uring_buf_ring_advance(op->br, 1);
+}
+
+static int cio_recv_setup_buf_ring(struct evdp_queue_context *qc, struct evdp_cio_op *op, const struct evdp_conf_cio *conf)
+{
+	op->buf_count = conf->buf_count;
+	op->buf_size = conf->buf_size;
+	op->bufs = malloc((size_t)op->buf_count * op->buf_size);
+	if (!op->bufs) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		return -1;
+	}
+
+	int ret = 0;
+	for (int i = 0; i < EVDP_CIO_BGID_RETRY; i++) {
+		int bgid = qc->next_bgid;
+		qc->next_bgid = (qc->next_bgid + 1) & 0xFFFF;
+		op->br = io_uring_setup_buf_ring(&qc->ring, op->buf_count, bgid, 0, &ret);
+		if (op->br) {
+			op->bgid = bgid;
+			break;
+		}
+		if (ret != -EEXIST)
+			break;
+	}
+	if (!op->br) {
+		neb_syslogl_en(-ret, LOG_ERR, "io_uring_setup_buf_ring: %m");
+		return -1;
+	}
+	op->qc = qc;
+
+	for (int i = 0; i < op->buf_count; i++)
+		io_uring_buf_ring_add(op->br, op->bufs + (size_t)i * op->buf_size, op->buf_size, i,
+		                      io_uring_buf_ring_mask(op->buf_count), i);
+	io_uring_buf_ring_advance(op->br, op->buf_count);
+
+	return 0;
+}
+
+void *evdp_create_source_cio_context(neb_evdp_source_t s)
+{
+	struct evdp_source_cio_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_cio_context));
+	if (!c)
+		return NULL;
+
+	c->rop = NULL;
+	STAILQ_INIT(&c->sendq);
+	LIST_INIT(&c->sending);
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_cio_context(void *context)
+{
+	struct evdp_source_cio_context *c = context;
+
+	// armed or submitted ops are already orphaned when detach
+	if (c->rop)
+		cio_op_free(c->rop);
+	struct evdp_cio_op *op;
+	while ((op = STAILQ_FIRST(&c->sendq)) != NULL) {
+		STAILQ_REMOVE_HEAD(&c->sendq, sendq);
+		if (op->release)
+			op->release(-ECANCELED, op->sdata);
+		free(op);
+	}
+	evdp_source_context_free(c);
+}
+
+int evdp_source_cio_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_cio_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close _nattr_unused)
+{
+	struct evdp_queue_context *qc = q->context;
+	struct evdp_source_cio_context *sc = s->context;
+
+	// the kernel holds the file ref for ops, so we need to cancel them even if closing
+	if (sc->rop) {
+		if (sc->rop->armed) {
+			cio_op_cancel(qc, sc->rop);
+			cio_op_orphan(qc, sc->rop);
+		} else {
+			cio_op_free(sc->rop); // the buf ring is registered to this queue
+		}
+		sc->rop = NULL;
+	}
+	struct evdp_cio_op *op;
+	while ((op = LIST_FIRST(&sc->sending)) != NULL) {
+		LIST_REMOVE(op, list);
+		cio_op_cancel(qc, op);
+		cio_op_orphan(qc, op);
+	}
+	// queued sends are kept, and will be submitted if attached again
+}
+
+static void cio_source_to_pending(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	EVDP_SLIST_REMOVE(s);
+	q->stats.running--;
+	EVDP_SLIST_PENDING_INSERT(q, s);
+}
+
+int evdp_source_cio_queue_send(neb_evdp_source_t s, const void *buf, size_t len, const struct msghdr *msg, void *sdata)
+{
+	struct evdp_source_cio_context *sc = s->context;
+
+	struct evdp_cio_op *op = cio_op_new(s, EVDP_CIO_OP_SEND);
+	if (!op)
+		return -1;
+	if (msg) {
+		memcpy(&op->msg, msg, sizeof(struct msghdr));
+		op->use_msg = 1;
+	} else {
+		op->buf = buf;
+		op->len = len;
+	}
+	op->sdata = sdata;
+	op->release = ((const struct evdp_conf_cio *)s->conf)->do_release;
+	STAILQ_INSERT_TAIL(&sc->sendq, op, sendq);
+
+	neb_evdp_queue_t q = s->q_in_use;
+	if (q && !s->pending && LIST_EMPTY(&sc->sending))
+		cio_source_to_pending(q, s);
+
+	return 0;
+}
+
+static int cio_prep_rop(struct evdp_queue_context *qc, neb_evdp_source_t s, struct evdp_source_cio_context *sc)
+{
+	const struct evdp_conf_cio *conf = s->conf;
+
+	if (!sc->rop) {
+		sc->rop = cio_op_new(s, conf->is_listen ? EVDP_CIO_OP_ACCEPT : EVDP_CIO_OP_RECV);
+		if (!sc->rop)
+			return -1;
+		if (!conf->is_listen && cio_recv_setup_buf_ring(qc, sc->rop, conf) != 0) {
+			cio_op_free(sc->rop);
+			sc->rop = NULL;
+			return -1;
+		}
+	}
+
+	struct io_uring_sqe *sqe = neb_io_uring_get_sqe(qc);
+	if (!sqe)
+		return -1;
+	if (conf->is_listen) {
+		io_uring_prep_multishot_accept(sqe, conf->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+	} else {
+		io_uring_prep_recv_multishot(sqe, conf->fd, NULL, 0, 0);
+		io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+		sqe->buf_group = sc->rop->bgid;
+	}
+	io_uring_sqe_set_data64(sqe, (uintptr_t)sc->rop | EVDP_CIO_OP_TAG);
+	sc->rop->armed = 1;
+
+	return 0;
+}
+
+static int cio_prep_sends(struct evdp_queue_context *qc, neb_evdp_source_t s, struct evdp_source_cio_context *sc)
+{
+	const struct evdp_conf_cio *conf = s->conf;
+
+	struct evdp_cio_op *op;
+	while ((op = STAILQ_FIRST(&sc->sendq)) != NULL) {
+		struct io_uring_sqe *sqe = neb_io_uring_get_sqe(qc);
+		if (!sqe)
+			return -1;
+		if (op->use_msg)
+			io_uring_prep_sendmsg(sqe, conf->fd, &op->msg, MSG_NOSIGNAL | MSG_WAITALL);
+		else
+			io_uring_prep_send(sqe, conf->fd, op->buf, op->len, MSG_NOSIGNAL | MSG_WAITALL);
+		io_uring_sqe_set_data64(sqe, (uintptr_t)op | EVDP_CIO_OP_TAG);
+		STAILQ_REMOVE_HEAD(&sc->sendq, sendq);
+		// link to keep the order, the last one ends the chain
+		if (!STAILQ_EMPTY(&sc->sendq))
+			io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+		LIST_INSERT_HEAD(&sc->sending, op, list);
+		op->armed = 1;
+	}
+
+	return 0;
+}
+
+int evdp_source_cio_prep(struct evdp_queue_context *qc, neb_evdp_source_t s)
+{
+	struct evdp_source_cio_context *sc = s->context;
+	const struct evdp_conf_cio *conf = s->conf;
+
+	if ((conf->is_listen || conf->do_recv) && !(sc->rop && sc->rop->armed)) {
+		if (cio_prep_rop(qc, s, sc) != 0)
+			return -1;
+	}
+	// sends in different rounds can not be linked, so wait for the previous chain
+	if (LIST_EMPTY(&sc->sending)) {
+		if (cio_prep_sends(qc, s, sc) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+void evdp_cio_op_finish(struct evdp_queue_context *qc _nattr_unused, struct evdp_cio_op *op, const struct io_uring_cqe *e)
+{
+	if (e->flags & IORING_CQE_F_MORE)
+		return;
+	if (op->s) { // recv or accept terminated, may be re-armed
+		op->armed = 0;
+		return;
+	}
+	LIST_REMOVE(op, list);
+	if (op->release) // the final cqe, the kernel won't use the buffer any more
+		op->release(e->res, op->sdata);
+	cio_op_free(op);
+}
+
+void evdp_cio_free_orphan_ops(struct evdp_queue_context *qc)
+{
+	struct evdp_cio_op *op, *next;
+	for (op = LIST_FIRST(&qc->orphan_ops); op; op = next) {
+		next = LIST_NEXT(op, list);
+		if (op->release) // may still be in use until the ring exit
+			continue;
+		LIST_REMOVE(op, list);
+		cio_op_free(op);
+	}
+}
+
+void evdp_cio_release_orphan_ops(struct evdp_queue_context *qc)
+{
+	struct evdp_cio_op *op;
+	while ((op = LIST_FIRST(&qc->orphan_ops)) != NULL) {
+		LIST_REMOVE(op, list);
+		op->release(-ECANCELED, op->sdata);
+		cio_op_free(op);
+	}
+}
+
+static neb_evdp_cb_ret_t cio_ret_on_error(neb_evdp_cb_ret_t ret)
+{
+	switch (ret) {
+	case NEB_EVDP_CB_BREAK_ERR:
+	case NEB_EVDP_CB_BREAK_EXP:
+	case NEB_EVDP_CB_CLOSE:
+		return ret;
+		break;
+	default:
+		return NEB_EVDP_CB_REMOVE;
+		break;
+	}
+}
+
+static neb_evdp_cb_ret_t cio_handle_recv(neb_evdp_source_t s, struct evdp_cio_op *op, const struct io_uring_cqe *e, int *rearm)
+{
+	const struct evdp_conf_cio *conf = s->conf;
+	const int fd = conf->fd;
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+
+	if (e->res > 0) {
+		int bid = e->flags >> IORING_CQE_BUFFER_SHIFT;
+		ret = conf->do_recv(fd, s->udata, op->bufs + (size_t)bid * op->buf_size, e->res);
+		cio_recv_add_buf(op, bid);
+	} else if (e->res == 0) {
+		*rearm = 0;
+		ret = conf->do_recv(fd, s->udata, NULL, 0);
+	} else {
+		switch (-e->res) {
+		case ENOBUFS: // all bufs are in use, rearm
+		case ECANCELED:
+			break;
+		default:
+			*rearm = 0;
+			errno = -e->res;
+			ret = cio_ret_on_error(conf->do_hup(fd, s->udata, &fd));
+			break;
+		}
+	}
+
+	return ret;
+}
+
+static neb_evdp_cb_ret_t cio_handle_accept(neb_evdp_source_t s, const struct io_uring_cqe *e, int *rearm)
+{
+	const struct evdp_conf_cio *conf = s->conf;
+	const int fd = conf->fd;
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+
+	if (e->res >= 0) {
+		ret = conf->do_accept(fd, s->udata, e->res);
+	} else if (e->res != -ECANCELED) {
+		*rearm = 0;
+		errno = -e->res;
+		neb_syslogl(LOG_ERR, "accept on fd %d: %m", fd);
+		ret = cio_ret_on_error(conf->do_hup(fd, s->udata, &fd));
+	}
+
+	return ret;
+}
+
+neb_evdp_cb_ret_t evdp_source_cio_handle(const struct neb_evdp_event *ne)
+{
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_cio_context *sc = s->context;
+	const struct evdp_conf_cio *conf = s->conf;
+	const struct io_uring_cqe *e = ne->event;
+	struct evdp_cio_op *op = EVDP_CIO_OP_FROM_DATA(e->user_data);
+
+	int rearm = !(e->flags & IORING_CQE_F_MORE);
+	switch (op->type) {
+	case EVDP_CIO_OP_RECV:
+		ret = cio_handle_recv(s, op, e, &rearm);
+		break;
+	case EVDP_CIO_OP_ACCEPT:
+		ret = cio_handle_accept(s, e, &rearm);
+		break;
+	case EVDP_CIO_OP_SEND:
+		// the op is done, let it be freed as orphan when finish
+		LIST_REMOVE(op, list);
+		if (conf->do_send)
+			op->release = NULL; // the send handler takes it
+		cio_op_orphan(s->q_in_use->context, op);
+		rearm = LIST_EMPTY(&sc->sending) && !STAILQ_EMPTY(&sc->sendq);
+		if (conf->do_send)
+			ret = conf->do_send(conf->fd, s->udata, e->res, op->sdata);
+		break;
+	default:
+		neb_syslog(LOG_ERR, "Unknown cio op type %d", op->type);
+		return NEB_EVDP_CB_BREAK_ERR;
+		break;
+	}
+
+	if (rearm && ret == NEB_EVDP_CB_CONTINUE && !s->pending)
+		cio_source_to_pending(s->q_in_use, s);
+
+	return ret;
+}
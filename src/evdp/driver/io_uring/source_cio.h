@@ -0,0 +1,34 @@
+
+#ifndef NEB_SRC_EVDP_DRIVER_IO_URING_SOURCE_CIO_H
+#define NEB_SRC_EVDP_DRIVER_IO_URING_SOURCE_CIO_H 1
+
+#include <nebase/cdefs.h>
+
+#include "core.h"
+#include "types.h"
+
+#define EVDP_CIO_OP_IS_TAGGED(ud) ((ud) & EVDP_CIO_OP_TAG)
+#define EVDP_CIO_OP_FROM_DATA(ud) ((struct evdp_cio_op *)(uintptr_t)((ud) & ~EVDP_CIO_OP_TAG))
+
+/**
+ * \brief prep sqes for the recv/accept op and the queued sends
+ */
+extern int evdp_source_cio_prep(struct evdp_queue_context *qc, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+/**
+ * \brief should be called after the cqe is handled, the op may be freed
+ */
+extern void evdp_cio_op_finish(struct evdp_queue_context *qc, struct evdp_cio_op *op, const struct io_uring_cqe *e)
+	_nattr_nonnull((1, 2, 3)) _nattr_hidden;
+/**
+ * \brief free orphaned ops except sends to be released, should be called before the ring exit
+ */
+extern void evdp_cio_free_orphan_ops(struct evdp_queue_context *qc)
+	_nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief release and free the remaining orphaned sends, should be called after the ring exit
+ */
+extern void evdp_cio_release_orphan_ops(struct evdp_queue_context *qc)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+#endif
@@ -0,0 +1,102 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_base.h"
+#include "types.h"
+#include "helper.h"
+
+#include <stdlib.h>
+#include <poll.h>
+#include <errno.h>
+
+/*
+ * multishot poll is edge triggered unless IORING_POLL_ADD_LEVEL is set
+ */
+
+void *evdp_create_source_et_fd_context(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_et_fd_context));
+	if (!c)
+		return NULL;
+
+	c->multishot = 1;
+	c->submitted = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_et_fd_context(void *context)
+{
+	struct evdp_source_et_fd_context *c = context;
+
+	evdp_source_context_free(c);
+}
+
+int evdp_source_et_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+
+	sc->fd = conf->fd;
+	sc->ctl_event = 0;
+	if (conf->do_read)
+		sc->ctl_event |= POLLIN;
+	if (conf->do_write) // always registered, want_write is checked in handler
+		sc->ctl_event |= POLLOUT;
+
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_et_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	struct evdp_queue_context *qc = q->context;
+	struct evdp_source_et_fd_context *sc = s->context;
+
+	if (to_close) {
+		sc->submitted = 0;
+		return;
+	}
+
+	if (sc->submitted) {
+		if (neb_io_uring_cancel_fd(qc, s) != 0)
+			neb_syslog(LOG_ERR, "failed to cancel et_fd source");
+		sc->submitted = 0;
+	}
+}
+
+int evdp_source_et_fd_rearm_write(neb_evdp_source_t s _nattr_unused)
+{
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_et_fd_handle(const struct neb_evdp_event *ne)
+{
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct io_uring_cqe *e = ne->event;
+	int rearm = !(e->flags & IORING_CQE_F_MORE); // multishot poll terminated
+	if (rearm)
+		sc->submitted = 0;
+	if (e->res < 0) {
+		if (e->res == -ECANCELED) // detached
+			return NEB_EVDP_CB_CONTINUE;
+		neb_syslogl_en(-e->res, LOG_ERR, "poll on fd %d: %m", sc->fd);
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+
+	const int fd = sc->fd;
+	neb_evdp_cb_ret_t ret = evdp_source_et_fd_dispatch(s, e->res & POLLIN, e->res & POLLOUT,
+	                                                   e->res & (POLLHUP | POLLERR), &fd);
+	if (ret == NEB_EVDP_CB_CONTINUE && rearm) {
+		neb_evdp_queue_t q = s->q_in_use;
+		EVDP_SLIST_REMOVE(s);
+		q->stats.running--;
+		EVDP_SLIST_PENDING_INSERT(q, s);
+	}
+
+	return ret;
+}
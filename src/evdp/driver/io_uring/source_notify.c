@@ -0,0 +1,101 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "notify.h"
+#include "types.h"
+#include "helper.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+
+void *evdp_create_source_notify_context(neb_evdp_source_t s)
+{
+	struct evdp_source_notify_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_notify_context));
+	if (!c)
+		return NULL;
+
+	c->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (c->fd == -1) {
+		neb_syslogl(LOG_ERR, "eventfd: %m");
+		evdp_destroy_source_notify_context(c);
+		return NULL;
+	}
+	c->multishot = 1;
+	c->submitted = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_notify_context(void *context)
+{
+	struct evdp_source_notify_context *c = context;
+
+	if (c->fd >= 0)
+		close(c->fd);
+	evdp_source_context_free(c);
+}
+
+int evdp_source_notify_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_source_notify_context *sc = s->context;
+
+	sc->ctl_event = POLLIN;
+
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_notify_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	struct evdp_queue_context *qc = q->context;
+	struct evdp_source_notify_context *sc = s->context;
+
+	if (sc->submitted) {
+		if (neb_io_uring_cancel_fd(qc, s) != 0)
+			neb_syslog(LOG_ERR, "failed to cancel notify source");
+		sc->submitted = 0;
+	}
+}
+
+int evdp_source_notify_wakeup(neb_evdp_source_t s)
+{
+	const struct evdp_source_notify_context *sc = s->context;
+
+	uint64_t v = 1;
+	if (write(sc->fd, &v, sizeof(v)) == -1 && errno != EAGAIN) {
+		neb_syslogl(LOG_ERR, "write: %m");
+		return -1;
+	}
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_notify_handle(const struct neb_evdp_event *ne)
+{
+	struct evdp_source_notify_context *sc = ne->source->context;
+	const struct io_uring_cqe *e = ne->event;
+	int rearm = !(e->flags & IORING_CQE_F_MORE); // multishot poll terminated
+	if (rearm)
+		sc->submitted = 0;
+
+	uint64_t v = 0;
+	if (read(sc->fd, &v, sizeof(v)) == -1 && errno != EAGAIN) {
+		neb_syslogl(LOG_ERR, "read: %m");
+		return NEB_EVDP_CB_BREAK_ERR; // should not happen
+	}
+
+	neb_evdp_cb_ret_t ret = evdp_source_notify_dispatch(ne->source);
+	if (ret == NEB_EVDP_CB_CONTINUE && rearm) {
+		neb_evdp_queue_t q = ne->source->q_in_use;
+		EVDP_SLIST_REMOVE(ne->source);
+		q->stats.running--;
+		EVDP_SLIST_PENDING_INSERT(q, ne->source);
+	}
+
+	return ret;
+}
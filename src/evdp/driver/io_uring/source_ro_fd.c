@@ -8,14 +8,13 @@
 
 #include <stdlib.h>
 #include <poll.h>
+#include <errno.h>
 
 void *evdp_create_source_ro_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_ro_fd_context *c = calloc(1, sizeof(struct evdp_source_ro_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_ro_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_ro_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	c->multishot = 1;
 	c->submitted = 0;
@@ -28,7 +27,7 @@ void evdp_destroy_source_ro_fd_context(void *context)
 {
 	struct evdp_source_ro_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -66,9 +65,12 @@ neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
 	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
 
 	struct evdp_source_ro_fd_context *sc = ne->source->context;
-	sc->submitted = 0;
-
 	const struct io_uring_cqe *e = ne->event;
+	if (e->res == -ECANCELED) // detached or restarted by defer
+		return NEB_EVDP_CB_CONTINUE;
+	int rearm = !(e->flags & IORING_CQE_F_MORE); // multishot poll terminated
+	if (rearm)
+		sc->submitted = 0;
 
 	const int fd = sc->fd;
 	const struct evdp_conf_ro_fd *conf = ne->source->conf;
@@ -90,6 +92,35 @@ neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
 			break;
 		}
 	}
+	if (ret == NEB_EVDP_CB_CONTINUE && rearm) {
+		neb_evdp_queue_t q = ne->source->q_in_use;
+		EVDP_SLIST_REMOVE(ne->source);
+		q->stats.running--;
+		EVDP_SLIST_PENDING_INSERT(q, ne->source);
+	}
 
 	return ret;
 }
+
+int evdp_source_ro_fd_defer(const struct neb_evdp_event *ne)
+{
+	neb_evdp_source_t s = ne->source;
+	struct evdp_source_ro_fd_context *sc = s->context;
+	const struct io_uring_cqe *e = ne->event;
+	if (e->res == -ECANCELED)
+		return 0;
+
+	neb_evdp_queue_t q = s->q_in_use;
+	if (e->flags & IORING_CQE_F_MORE) {
+		// the multishot poll will not report it again, restart it
+		if (neb_io_uring_cancel_fd(q->context, s) != 0)
+			return -1;
+	}
+	sc->submitted = 0;
+
+	EVDP_SLIST_REMOVE(s);
+	q->stats.running--;
+	EVDP_SLIST_PENDING_INSERT(q, s);
+
+	return 0;
+}
@@ -2,12 +2,56 @@
 #ifndef NEB_SRC_EVDP_DRIVER_IO_URING_TYPES_H
 #define NEB_SRC_EVDP_DRIVER_IO_URING_TYPES_H 1
 
+#include <nebase/evdp/io_cio.h>
+
 #include <liburing.h>
+#include <sys/queue.h>
+
+/*
+ * cio ops are submitted with tagged op pointer as user_data, so the source can
+ * be detached or freed while there are still ops in flight
+ */
+#define EVDP_CIO_OP_TAG 0x1UL
+
+enum {
+	EVDP_CIO_OP_RECV = 1,
+	EVDP_CIO_OP_ACCEPT,
+	EVDP_CIO_OP_SEND,
+};
+
+struct evdp_queue_context;
+
+struct evdp_cio_op {
+	LIST_ENTRY(evdp_cio_op) list; // in sending list or orphan list
+	STAILQ_ENTRY(evdp_cio_op) sendq;
+	neb_evdp_source_t s; // NULL if orphaned
+	struct evdp_queue_context *qc; // set when buf ring registered
+	int type;
+	int armed;
+	// send
+	const void *buf;
+	size_t len;
+	struct msghdr msg;
+	int use_msg;
+	void *sdata;
+	neb_evdp_cio_send_release_t release; // NULL if the send handler is called
+	// recv
+	struct io_uring_buf_ring *br;
+	char *bufs;
+	int buf_count;
+	int buf_size;
+	int bgid;
+};
+
+LIST_HEAD(evdp_cio_op_list, evdp_cio_op);
+STAILQ_HEAD(evdp_cio_op_queue, evdp_cio_op);
 
 struct evdp_queue_context {
 	struct io_uring ring;
 	int ring_ok;
 	struct io_uring_cqe **cqe;
+	struct evdp_cio_op_list orphan_ops;
+	int next_bgid;
 };
 
 // base source context
@@ -27,6 +71,26 @@ struct evdp_source_timer_context {
 	struct itimerspec its;
 };
 
+struct evdp_source_notify_context {
+	short ctl_event;
+	int fd;
+	uint32_t submitted:1;
+	uint32_t multishot:1;
+};
+
+struct evdp_source_et_fd_context {
+	short ctl_event;
+	int fd;
+	uint32_t submitted:1;
+	uint32_t multishot:1;
+};
+
+struct evdp_source_cio_context {
+	struct evdp_cio_op *rop; // recv or accept op
+	struct evdp_cio_op_queue sendq; // not yet submitted
+	struct evdp_cio_op_list sending; // submitted
+};
+
 struct evdp_source_ro_fd_context {
 	short ctl_event;
 	int fd;
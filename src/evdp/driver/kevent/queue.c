@@ -49,22 +49,18 @@ void evdp_destroy_queue_context(void *context)
 	free(c);
 }
 
-void evdp_queue_rm_pending_events(neb_evdp_queue_t q, neb_evdp_source_t s)
+int evdp_queue_resize_events(neb_evdp_queue_t q, int size)
 {
-	void *s_got = NULL, *s_to_rm = s;
-	const struct evdp_queue_context *c = q->context;
-	if (!c->ee)
-		return;
-	for (int i = q->current_event; i < q->nevents; i++) {
-		struct kevent *e = c->ee + i;
-		s_got = (neb_evdp_source_t)e->udata;
-		if (s_got == s_to_rm)
-#if defined(OS_NETBSD)
-			e->udata = (intptr_t)NULL;
-#else
-			e->udata = NULL;
-#endif
+	struct evdp_queue_context *c = q->context;
+
+	struct kevent *ee = realloc(c->ee, size * sizeof(struct kevent));
+	if (!ee) {
+		neb_syslogl(LOG_ERR, "realloc: %m");
+		return -1;
 	}
+	c->ee = ee;
+
+	return 0;
 }
 
 int evdp_queue_wait_events(neb_evdp_queue_t q, struct timespec *timeout)
@@ -147,6 +143,16 @@ void evdp_queue_finish_event(neb_evdp_queue_t q _nattr_unused, struct neb_evdp_e
 	return;
 }
 
+neb_evdp_source_t evdp_queue_peek_event_source(neb_evdp_queue_t q, int i)
+{
+	const struct evdp_queue_context *c = q->context;
+
+	const struct kevent *e = c->ee + i;
+	if (e->flags & EV_ERROR) // logged in fetch_event
+		return NULL;
+	return (neb_evdp_source_t)e->udata;
+}
+
 static int do_batch_flush(neb_evdp_queue_t q, int nr)
 {
 	const struct evdp_queue_context *qc = q->context;
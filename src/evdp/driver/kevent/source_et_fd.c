@@ -0,0 +1,82 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_base.h"
+#include "types.h"
+
+#include <stdlib.h>
+#include <errno.h>
+
+void *evdp_create_source_et_fd_context(neb_evdp_source_t s)
+{
+	struct evdp_source_et_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_et_fd_context));
+	if (!c)
+		return NULL;
+
+	c->nchanges = 0;
+	c->added = 0;
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_et_fd_context(void *context)
+{
+	struct evdp_source_et_fd_context *c = context;
+
+	evdp_source_context_free(c);
+}
+
+int evdp_source_et_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_et_fd_context *sc = s->context;
+	const struct evdp_conf_et_fd *conf = s->conf;
+
+	sc->nchanges = 0;
+	if (conf->do_read)
+		EV_SET(&sc->ctl_event[sc->nchanges++], conf->fd, EVFILT_READ, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, s);
+	if (conf->do_write) // always registered, want_write is checked in handler
+		EV_SET(&sc->ctl_event[sc->nchanges++], conf->fd, EVFILT_WRITE, EV_ADD | EV_ENABLE | EV_CLEAR, 0, 0, s);
+
+	// add it now, as there will be no more change after attach
+	if (sc->nchanges && kevent(qc->fd, sc->ctl_event, sc->nchanges, NULL, 0, NULL) == -1) {
+		neb_syslogl(LOG_ERR, "kevent: %m");
+		return -1;
+	}
+	sc->added = 1;
+	EVDP_SLIST_RUNNING_INSERT(q, s);
+
+	return 0;
+}
+
+void evdp_source_et_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_et_fd_context *sc = s->context;
+
+	if (to_close || !sc->added) {
+		sc->added = 0;
+		return;
+	}
+
+	for (int i = 0; i < sc->nchanges; i++)
+		sc->ctl_event[i].flags = EV_DISABLE | EV_DELETE;
+	if (sc->nchanges && kevent(qc->fd, sc->ctl_event, sc->nchanges, NULL, 0, NULL) == -1 && errno != ENOENT)
+		neb_syslogl(LOG_ERR, "kevent: %m");
+	sc->added = 0;
+}
+
+int evdp_source_et_fd_rearm_write(neb_evdp_source_t s _nattr_unused)
+{
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_et_fd_handle(const struct neb_evdp_event *ne)
+{
+	const struct kevent *e = ne->event;
+
+	return evdp_source_et_fd_dispatch(ne->source, e->filter == EVFILT_READ, e->filter == EVFILT_WRITE,
+	                                  e->flags & EV_EOF, e);
+}
@@ -0,0 +1,94 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "notify.h"
+#include "types.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+void *evdp_create_source_notify_context(neb_evdp_source_t s)
+{
+	struct evdp_source_notify_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_notify_context));
+	if (!c)
+		return NULL;
+
+	// the source address is unique within the kqueue
+	EV_SET(&c->ctl_event, (uintptr_t)s, EVFILT_USER, EV_ADD | EV_CLEAR, 0, 0, s);
+	atomic_init(&c->kq_fd, -1);
+	s->pending = 0;
+
+	return c;
+}
+
+void evdp_destroy_source_notify_context(void *context)
+{
+	struct evdp_source_notify_context *c = context;
+
+	evdp_source_context_free(c);
+}
+
+static int do_trigger(int kq_fd, neb_evdp_source_t s)
+{
+	struct kevent e;
+	EV_SET(&e, (uintptr_t)s, EVFILT_USER, 0, NOTE_TRIGGER, 0, s);
+	if (kevent(kq_fd, &e, 1, NULL, 0, NULL) == -1) {
+		if (errno == ENOENT || errno == EBADF) // detached in the meantime
+			return 0;
+		neb_syslogl(LOG_ERR, "kevent(NOTE_TRIGGER): %m");
+		return -1;
+	}
+	return 0;
+}
+
+int evdp_source_notify_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_notify_context *sc = s->context;
+
+	// add it now, so other threads can trigger it as soon as kq_fd is set
+	if (kevent(qc->fd, &sc->ctl_event, 1, NULL, 0, NULL) == -1) {
+		neb_syslogl(LOG_ERR, "kevent(EVFILT_USER): %m");
+		return -1;
+	}
+	EVDP_SLIST_RUNNING_INSERT(q, s);
+	atomic_store(&sc->kq_fd, qc->fd);
+
+	// signaled before attach
+	const struct evdp_conf_notify *conf = s->conf;
+	if (atomic_load(&conf->signaled))
+		return do_trigger(qc->fd, s);
+
+	return 0;
+}
+
+void evdp_source_notify_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+{
+	const struct evdp_queue_context *qc = q->context;
+	struct evdp_source_notify_context *sc = s->context;
+
+	if (atomic_exchange(&sc->kq_fd, -1) != -1) {
+		struct kevent e;
+		EV_SET(&e, (uintptr_t)s, EVFILT_USER, EV_DELETE, 0, 0, s);
+		if (kevent(qc->fd, &e, 1, NULL, 0, NULL) == -1 && errno != ENOENT)
+			neb_syslogl(LOG_ERR, "kevent: %m");
+	}
+}
+
+int evdp_source_notify_wakeup(neb_evdp_source_t s)
+{
+	struct evdp_source_notify_context *sc = s->context;
+
+	int kq_fd = atomic_load(&sc->kq_fd);
+	if (kq_fd == -1) // will be triggered while attaching
+		return 0;
+	return do_trigger(kq_fd, s);
+}
+
+neb_evdp_cb_ret_t evdp_source_notify_handle(const struct neb_evdp_event *ne)
+{
+	// EV_CLEAR is set, so the trigger state has been reset
+	return evdp_source_notify_dispatch(ne->source);
+}
@@ -10,11 +10,9 @@
 
 void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_os_fd_context *c = calloc(1, sizeof(struct evdp_source_os_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_os_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_os_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	s->pending = 0;
 	c->rd.added = 0;
@@ -40,7 +38,7 @@ void evdp_destroy_source_os_fd_context(void *context)
 {
 	struct evdp_source_os_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -150,7 +148,7 @@ neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 			}
 		}
 
-		ret = conf->do_write(e->ident, ne->source->udata, e);
+		ret = evdp_source_os_fd_call_write(ne->source, e->ident, e);
 		if (ret != NEB_EVDP_CB_CONTINUE)
 			return ret;
 		break;
@@ -10,11 +10,9 @@
 
 void *evdp_create_source_ro_fd_context(neb_evdp_source_t s)
 {
-	struct evdp_source_ro_fd_context *c = calloc(1, sizeof(struct evdp_source_ro_fd_context));
-	if (!c) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	struct evdp_source_ro_fd_context *c = evdp_source_context_alloc(s, sizeof(struct evdp_source_ro_fd_context));
+	if (!c)
 		return NULL;
-	}
 
 	s->pending = 0;
 
@@ -25,7 +23,7 @@ void evdp_destroy_source_ro_fd_context(void *context)
 {
 	struct evdp_source_ro_fd_context *c = context;
 
-	free(c);
+	evdp_source_context_free(c);
 }
 
 int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
@@ -83,3 +81,8 @@ neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
 
 	return ret;
 }
+
+int evdp_source_ro_fd_defer(const struct neb_evdp_event *ne _nattr_unused)
+{
+	return 0; // level triggered, it will be reported again by the next wait
+}
@@ -3,6 +3,7 @@
 #define NEB_SRC_EVDP_DRIVER_KEVENT_TYPES_H 1
 
 #include <sys/event.h>
+#include <stdatomic.h>
 
 struct evdp_queue_context {
 	int fd;
@@ -14,10 +15,21 @@ struct evdp_source_timer_context {
 	int attached;
 };
 
+struct evdp_source_notify_context {
+	struct kevent ctl_event;
+	atomic_int kq_fd; // -1 if not attached, may be read by other threads
+};
+
 struct evdp_source_ro_fd_context {
 	struct kevent ctl_event;
 };
 
+struct evdp_source_et_fd_context {
+	struct kevent ctl_event[2];
+	int nchanges;
+	int added;
+};
+
 struct evdp_source_os_fd_context {
 	struct {
 		int added;
@@ -0,0 +1,460 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/thread.h>
+#include <nebase/pipe.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/group.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#if defined(OS_FREEBSD)
+# include <pthread_np.h>
+# include <sys/cpuset.h>
+typedef cpuset_t cpu_set_t;
+#endif
+
+#define GROUP_MSG_QUIT -1
+#define GROUP_MSG_BATCH 64
+#define GROUP_STOP_RETRY 1000
+
+enum {
+	GROUP_MEMBER_NONE = 0,
+	GROUP_MEMBER_ENTERED,
+	GROUP_MEMBER_READY,
+	GROUP_MEMBER_FAILED,
+};
+
+struct evdp_group_member {
+	neb_evdp_group_t g;
+	int index;
+	int cpu; // -1 if not pinned
+	int pipefd[2];
+	pthread_t ptid;
+	int thread_ok;
+	_Atomic int state;
+	neb_evdp_queue_t q;
+};
+
+struct neb_evdp_group {
+	int nqueues;
+	int batch_size;
+	int started;
+	bool cpu_affinity;
+	atomic_uint next;
+
+	neb_evdp_group_setup_t setup;
+	neb_evdp_group_cleanup_t cleanup;
+	neb_evdp_group_fd_handler_t fd_handler;
+	void *udata;
+
+	struct evdp_group_member members[];
+};
+
+static const char group_thread_failed[] = "failed";
+
+static void group_handle_fd(struct evdp_group_member *m, int fd)
+{
+	neb_evdp_group_t g = m->g;
+	if (!g->fd_handler) {
+		neb_syslog(LOG_NOTICE, "No fd handler set for evdp group, close fd %d", fd);
+		close(fd);
+		return;
+	}
+	if (g->fd_handler(m->q, m->index, fd, g->udata) != 0)
+		close(fd);
+}
+
+static neb_evdp_cb_ret_t group_on_msg(int fd, void *udata, const void *context _nattr_unused)
+{
+	struct evdp_group_member *m = udata;
+	int msgs[GROUP_MSG_BATCH];
+
+	ssize_t nr = read(fd, msgs, sizeof(msgs));
+	if (nr == -1) {
+		if (errno == EAGAIN || errno == EINTR)
+			return NEB_EVDP_CB_CONTINUE;
+		neb_syslogl(LOG_ERR, "read: %m");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (nr == 0) {
+		neb_syslog(LOG_ERR, "Control pipe of evdp group queue %d closed", m->index);
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+
+	// writes of int size is atomic for pipe, so we will always get full msgs
+	int quit = 0;
+	for (int i = 0; i < nr / (ssize_t)sizeof(int); i++) {
+		if (msgs[i] == GROUP_MSG_QUIT)
+			quit = 1;
+		else if (quit) // no more fds should be handled after quit
+			close(msgs[i]);
+		else
+			group_handle_fd(m, msgs[i]);
+	}
+
+	return quit ? NEB_EVDP_CB_BREAK_EXP : NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t group_on_hup(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	struct evdp_group_member *m = udata;
+	neb_syslog(LOG_ERR, "Control pipe of evdp group queue %d hup", m->index);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static void group_drain_pipe(struct evdp_group_member *m)
+{
+	int msgs[GROUP_MSG_BATCH];
+	for (;;) {
+		ssize_t nr = read(m->pipefd[0], msgs, sizeof(msgs));
+		if (nr <= 0)
+			break;
+		for (int i = 0; i < nr / (ssize_t)sizeof(int); i++) {
+			if (msgs[i] != GROUP_MSG_QUIT)
+				close(msgs[i]);
+		}
+	}
+}
+
+static int group_set_thread_cpu(int cpu)
+{
+#if defined(OS_LINUX) || defined(OS_FREEBSD)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret != 0) {
+		neb_syslog_en(ret, LOG_ERR, "pthread_setaffinity_np: %m");
+		return -1;
+	}
+#else
+	neb_syslog(LOG_INFO, "Setting cpu affinity is not supported, ignore cpu %d", cpu);
+#endif
+	return 0;
+}
+
+static void *group_thread_main(void *arg)
+{
+	struct evdp_group_member *m = arg;
+	neb_evdp_group_t g = m->g;
+	neb_evdp_source_t s = NULL;
+	int setup_ok = 0;
+	void *retval = NULL;
+
+	atomic_store(&m->state, GROUP_MEMBER_ENTERED);
+
+	char name[16];
+	snprintf(name, sizeof(name), "evdp-%d", m->index);
+	neb_thread_setname(name);
+
+	if (neb_thread_register() != 0) {
+		neb_syslog(LOG_ERR, "Failed to register evdp group thread %d", m->index);
+		goto exit_fail;
+	}
+
+	if (m->cpu >= 0 && group_set_thread_cpu(m->cpu) != 0)
+		neb_syslog(LOG_ERR, "Failed to pin evdp group thread %d to cpu %d", m->index, m->cpu);
+
+	m->q = neb_evdp_queue_create(g->batch_size);
+	if (!m->q) {
+		neb_syslog(LOG_ERR, "Failed to create evdp queue for group thread %d", m->index);
+		goto exit_fail;
+	}
+
+	s = neb_evdp_source_new_ro_fd(m->pipefd[0], group_on_msg, group_on_hup);
+	if (!s) {
+		neb_syslog(LOG_ERR, "Failed to create control source for group thread %d", m->index);
+		goto exit_fail;
+	}
+	neb_evdp_source_set_udata(s, m);
+	if (neb_evdp_queue_attach(m->q, s) != 0) {
+		neb_syslog(LOG_ERR, "Failed to attach control source for group thread %d", m->index);
+		neb_evdp_source_del(s);
+		s = NULL;
+		goto exit_fail;
+	}
+
+	if (g->setup && g->setup(m->q, m->index, g->udata) != 0) {
+		neb_syslog(LOG_ERR, "Failed to setup evdp group queue %d", m->index);
+		goto exit_fail;
+	}
+	setup_ok = 1;
+
+	atomic_store(&m->state, GROUP_MEMBER_READY);
+	if (neb_thread_set_ready() != 0) {
+		neb_syslog(LOG_ERR, "Failed to set evdp group thread %d ready", m->index);
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(m->q) != 0) {
+		neb_syslog(LOG_ERR, "Error occured while running evdp group queue %d", m->index);
+		retval = (void *)group_thread_failed;
+	}
+	goto exit_clean;
+
+exit_fail:
+	retval = (void *)group_thread_failed;
+	atomic_store(&m->state, GROUP_MEMBER_FAILED);
+	if (neb_thread_set_ready() != 0)
+		neb_syslog(LOG_ERR, "Failed to set evdp group thread %d ready", m->index);
+exit_clean:
+	if (setup_ok && g->cleanup)
+		g->cleanup(m->q, m->index, g->udata);
+	if (s) {
+		if (neb_evdp_queue_detach(m->q, s, 0) != 0)
+			neb_syslog(LOG_ERR, "Failed to detach control source for group thread %d", m->index);
+		neb_evdp_source_del(s);
+	}
+	if (m->q) {
+		neb_evdp_queue_destroy(m->q);
+		m->q = NULL;
+	}
+	return retval;
+}
+
+neb_evdp_group_t neb_evdp_group_create(int nqueues, int batch_size)
+{
+	if (nqueues <= 0) {
+		long n = sysconf(_SC_NPROCESSORS_ONLN);
+		if (n == -1) {
+			neb_syslogl(LOG_ERR, "sysconf(_SC_NPROCESSORS_ONLN): %m");
+			return NULL;
+		}
+		nqueues = n > 0 ? (int)n : 1;
+	}
+
+	neb_evdp_group_t g = calloc(1, sizeof(struct neb_evdp_group) + nqueues * sizeof(struct evdp_group_member));
+	if (!g) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	g->nqueues = nqueues;
+	g->batch_size = batch_size;
+	atomic_init(&g->next, 0);
+
+	for (int i = 0; i < nqueues; i++) {
+		struct evdp_group_member *m = &g->members[i];
+		m->g = g;
+		m->index = i;
+		m->cpu = -1;
+		m->pipefd[0] = -1;
+		m->pipefd[1] = -1;
+		atomic_init(&m->state, GROUP_MEMBER_NONE);
+	}
+	for (int i = 0; i < nqueues; i++) {
+		if (neb_pipe_new(g->members[i].pipefd) != 0) {
+			neb_syslog(LOG_ERR, "Failed to create control pipe for evdp group queue %d", i);
+			neb_evdp_group_destroy(g);
+			return NULL;
+		}
+	}
+
+	return g;
+}
+
+void neb_evdp_group_destroy(neb_evdp_group_t g)
+{
+	if (g->started)
+		neb_evdp_group_stop(g);
+	for (int i = 0; i < g->nqueues; i++) {
+		struct evdp_group_member *m = &g->members[i];
+		if (m->pipefd[0] >= 0) {
+			group_drain_pipe(m);
+			close(m->pipefd[0]);
+		}
+		if (m->pipefd[1] >= 0)
+			close(m->pipefd[1]);
+	}
+	free(g);
+}
+
+int neb_evdp_group_get_size(neb_evdp_group_t g)
+{
+	return g->nqueues;
+}
+
+void neb_evdp_group_set_cpu_affinity(neb_evdp_group_t g, bool enable)
+{
+	g->cpu_affinity = enable;
+}
+
+void neb_evdp_group_set_udata(neb_evdp_group_t g, void *udata)
+{
+	g->udata = udata;
+}
+
+void neb_evdp_group_set_setup(neb_evdp_group_t g, neb_evdp_group_setup_t setup, neb_evdp_group_cleanup_t cleanup)
+{
+	g->setup = setup;
+	g->cleanup = cleanup;
+}
+
+void neb_evdp_group_set_fd_handler(neb_evdp_group_t g, neb_evdp_group_fd_handler_t fh)
+{
+	g->fd_handler = fh;
+}
+
+static void group_assign_cpus(neb_evdp_group_t g)
+{
+#if defined(OS_LINUX) || defined(OS_FREEBSD)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	int ret = pthread_getaffinity_np(pthread_self(), sizeof(set), &set);
+	if (ret != 0) {
+		neb_syslog_en(ret, LOG_ERR, "pthread_getaffinity_np: %m");
+		return;
+	}
+	int ncpus = CPU_COUNT(&set);
+	if (ncpus <= 0)
+		return;
+	for (int i = 0; i < g->nqueues; i++) {
+		int nth = i % ncpus;
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (!CPU_ISSET(cpu, &set))
+				continue;
+			if (nth-- == 0) {
+				g->members[i].cpu = cpu;
+				break;
+			}
+		}
+	}
+#else
+	neb_syslog(LOG_INFO, "Setting cpu affinity is not supported on this platform");
+#endif
+}
+
+static int group_send_msg(struct evdp_group_member *m, int msg)
+{
+	for (int i = 0; i < GROUP_STOP_RETRY; i++) {
+		if (write(m->pipefd[1], &msg, sizeof(msg)) == sizeof(msg))
+			return 0;
+		switch (errno) {
+		case EINTR:
+			break;
+		case EAGAIN: // only wait if it's a quit msg
+			if (msg != GROUP_MSG_QUIT) {
+				neb_syslog(LOG_ERR, "Control pipe of evdp group queue %d is full", m->index);
+				return -1;
+			}
+			usleep(1000);
+			break;
+		default:
+			neb_syslogl(LOG_ERR, "write: %m");
+			return -1;
+		}
+	}
+	neb_syslog(LOG_ERR, "Timeout to send msg to evdp group queue %d", m->index);
+	return -1;
+}
+
+static int group_join_member(struct evdp_group_member *m)
+{
+	void *retval = NULL;
+	int ret = pthread_join(m->ptid, &retval);
+	m->thread_ok = 0;
+	if (ret != 0) {
+		neb_syslogl_en(ret, LOG_ERR, "pthread_join: %m");
+		return -1;
+	}
+	if (retval != NULL) {
+		neb_syslog(LOG_ERR, "evdp group thread %d exit with error", m->index);
+		return -1;
+	}
+	return 0;
+}
+
+int neb_evdp_group_start(neb_evdp_group_t g)
+{
+	if (g->started) {
+		neb_syslog(LOG_ERR, "evdp group has already been started");
+		return -1;
+	}
+
+	if (g->cpu_affinity)
+		group_assign_cpus(g);
+
+	for (int i = 0; i < g->nqueues; i++) {
+		struct evdp_group_member *m = &g->members[i];
+		if (neb_thread_create(&m->ptid, NULL, group_thread_main, m) != 0) {
+			neb_syslog(LOG_ERR, "Failed to create evdp group thread %d", i);
+			// the thread may be created but not ready in time
+			if (atomic_load(&m->state) != GROUP_MEMBER_NONE) {
+				m->thread_ok = 1;
+				if (group_send_msg(m, GROUP_MSG_QUIT) == 0)
+					group_join_member(m);
+			}
+			goto exit_fail;
+		}
+		m->thread_ok = 1;
+		if (atomic_load(&m->state) != GROUP_MEMBER_READY) {
+			group_join_member(m);
+			goto exit_fail;
+		}
+	}
+
+	g->started = 1;
+	return 0;
+
+exit_fail:
+	g->started = 1;
+	neb_evdp_group_stop(g);
+	return -1;
+}
+
+int neb_evdp_group_stop(neb_evdp_group_t g)
+{
+	if (!g->started)
+		return 0;
+
+	int ret = 0;
+	for (int i = 0; i < g->nqueues; i++) {
+		struct evdp_group_member *m = &g->members[i];
+		if (!m->thread_ok)
+			continue;
+		if (group_send_msg(m, GROUP_MSG_QUIT) != 0) {
+			neb_syslog(LOG_CRIT, "Failed to notify evdp group queue %d to quit", i);
+			ret = -1;
+			m->thread_ok = 0; // we can not join it
+		}
+	}
+	for (int i = 0; i < g->nqueues; i++) {
+		struct evdp_group_member *m = &g->members[i];
+		if (!m->thread_ok)
+			continue;
+		if (group_join_member(m) != 0)
+			ret = -1;
+		atomic_store(&m->state, GROUP_MEMBER_NONE);
+	}
+
+	g->started = 0;
+	return ret;
+}
+
+int neb_evdp_group_dispatch_fd_to(neb_evdp_group_t g, int index, int fd)
+{
+	if (index < 0 || index >= g->nqueues) {
+		neb_syslog(LOG_ERR, "Invalid evdp group queue index %d", index);
+		return -1;
+	}
+	if (fd < 0) {
+		neb_syslog(LOG_ERR, "Invalid fd %d to dispatch", fd);
+		return -1;
+	}
+	if (group_send_msg(&g->members[index], fd) != 0)
+		return -1;
+	return index;
+}
+
+int neb_evdp_group_dispatch_fd(neb_evdp_group_t g, int fd)
+{
+	int index = atomic_fetch_add_explicit(&g->next, 1, memory_order_relaxed) % (unsigned int)g->nqueues;
+	return neb_evdp_group_dispatch_fd_to(g, index, fd);
+}
@@ -0,0 +1,82 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "instr.h"
+
+#include <stdlib.h>
+
+struct evdp_queue_instr *evdp_queue_instr_create(void)
+{
+	struct evdp_queue_instr *instr = calloc(1, sizeof(struct evdp_queue_instr));
+	if (!instr) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	return instr;
+}
+
+void evdp_queue_instr_destroy(struct evdp_queue_instr *instr)
+{
+	free(instr);
+}
+
+int neb_evdp_queue_get_hist(neb_evdp_queue_t q, int id, struct neb_evdp_hist *h)
+{
+	if (!q->instr) {
+		neb_syslog(LOG_ERR, "Instrumentation is not enabled for queue %p", q);
+		return -1;
+	}
+	if (id < 0 || id >= NEB_EVDP_HIST_MAX) {
+		neb_syslog(LOG_ERR, "Invalid evdp hist id %d", id);
+		return -1;
+	}
+
+	struct evdp_hist *eh = &q->instr->hists[id];
+	h->count = atomic_load_explicit(&eh->count, memory_order_relaxed);
+	h->sum = atomic_load_explicit(&eh->sum, memory_order_relaxed);
+	h->max = atomic_load_explicit(&eh->max, memory_order_relaxed);
+	for (int i = 0; i < NEB_EVDP_HIST_BUCKETS; i++)
+		h->buckets[i] = atomic_load_explicit(&eh->buckets[i], memory_order_relaxed);
+	return 0;
+}
+
+/**
+ * \return the highest value that is in the same bucket
+ */
+static uint64_t hist_bucket_high(int i)
+{
+	if (i < (1 << NEB_EVDP_HIST_SUB_BITS))
+		return i;
+	int mag = (i >> NEB_EVDP_HIST_SUB_BITS) + NEB_EVDP_HIST_SUB_BITS - 1;
+	uint64_t sub = i & ((1 << NEB_EVDP_HIST_SUB_BITS) - 1);
+	uint64_t step = (uint64_t)1 << (mag - NEB_EVDP_HIST_SUB_BITS);
+	return ((uint64_t)1 << mag) + sub * step + step - 1;
+}
+
+uint64_t neb_evdp_hist_percentile(const struct neb_evdp_hist *h, double percentile)
+{
+	uint64_t total = 0;
+	for (int i = 0; i < NEB_EVDP_HIST_BUCKETS; i++)
+		total += h->buckets[i];
+	if (!total)
+		return 0;
+
+	if (percentile < 0)
+		percentile = 0;
+	if (percentile > 100)
+		percentile = 100;
+	uint64_t rank = (uint64_t)(percentile / 100 * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < NEB_EVDP_HIST_BUCKETS; i++) {
+		seen += h->buckets[i];
+		if (seen >= rank) {
+			uint64_t v = hist_bucket_high(i);
+			return v < h->max ? v : h->max;
+		}
+	}
+	return h->max;
+}
@@ -0,0 +1,85 @@
+
+#ifndef NEB_SRC_EVDP_INSTR_H
+#define NEB_SRC_EVDP_INSTR_H 1
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/time.h>
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+/*
+ * queue instrumentation
+ *  histograms are only written by the queue thread, and read by any thread
+ *  with relaxed atomics, so a snapshot may be slightly inconsistent
+ */
+
+struct evdp_hist {
+	atomic_uint_fast64_t count;
+	atomic_uint_fast64_t sum;
+	atomic_uint_fast64_t max;
+	atomic_uint_fast64_t buckets[NEB_EVDP_HIST_BUCKETS];
+};
+
+struct evdp_queue_instr {
+	struct evdp_hist hists[NEB_EVDP_HIST_MAX];
+};
+
+static inline int evdp_hist_index(uint64_t v)
+{
+	if (v < (1 << NEB_EVDP_HIST_SUB_BITS))
+		return (int)v;
+	int mag = 63 - __builtin_clzll(v);
+	if (mag >= NEB_EVDP_HIST_MAX_BITS)
+		return NEB_EVDP_HIST_BUCKETS - 1;
+	return ((mag - NEB_EVDP_HIST_SUB_BITS + 1) << NEB_EVDP_HIST_SUB_BITS) +
+	       (int)((v >> (mag - NEB_EVDP_HIST_SUB_BITS)) & ((1 << NEB_EVDP_HIST_SUB_BITS) - 1));
+}
+
+#define EVDP_HIST_INC(a, v) atomic_store_explicit(&(a), atomic_load_explicit(&(a), memory_order_relaxed) + (v), memory_order_relaxed)
+
+static inline void evdp_hist_record(struct evdp_hist *h, uint64_t v)
+{
+	EVDP_HIST_INC(h->buckets[evdp_hist_index(v)], 1);
+	EVDP_HIST_INC(h->sum, v);
+	if (v > atomic_load_explicit(&h->max, memory_order_relaxed))
+		atomic_store_explicit(&h->max, v, memory_order_relaxed);
+	EVDP_HIST_INC(h->count, 1);
+}
+
+/**
+ * \return monotonic time in ns, not the coarse one as used in queue cur_ts
+ */
+static inline uint64_t evdp_instr_now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * \return time in ns of the clock timer points are scheduled on, so the lag
+ *         is not biased by the difference of clocks
+ */
+static inline uint64_t evdp_instr_timer_now_ns(void)
+{
+	struct timespec ts;
+	if (neb_time_gettime_fast(&ts) != 0)
+		return 0;
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline void evdp_instr_record_since(struct evdp_queue_instr *instr, int id, uint64_t start_ns)
+{
+	uint64_t now = evdp_instr_now_ns();
+	evdp_hist_record(&instr->hists[id], now > start_ns ? now - start_ns : 0);
+}
+
+extern struct evdp_queue_instr *evdp_queue_instr_create(void)
+	_nattr_warn_unused_result _nattr_hidden;
+extern void evdp_queue_instr_destroy(struct evdp_queue_instr *instr)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+#endif
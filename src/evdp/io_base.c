@@ -18,23 +18,14 @@ neb_evdp_cb_ret_t neb_evdp_sock_log_on_hup(int fd, void *udata _nattr_unused, co
 
 neb_evdp_source_t neb_evdp_source_new_ro_fd(int fd, neb_evdp_io_handler_t rf, neb_evdp_io_handler_t hf)
 {
-	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
-	if (!s) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_RO_FD, sizeof(struct evdp_conf_ro_fd));
+	if (!s)
 		return NULL;
-	}
-	s->type = EVDP_SOURCE_RO_FD;
 
-	struct evdp_conf_ro_fd *conf = calloc(1, sizeof(struct evdp_conf_ro_fd));
-	if (!conf) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
-		neb_evdp_source_del(s);
-		return NULL;
-	}
+	struct evdp_conf_ro_fd *conf = s->conf;
 	conf->fd = fd;
 	conf->do_read = rf;
 	conf->do_hup = hf;
-	s->conf = conf;
 
 	s->context = evdp_create_source_ro_fd_context(s);
 	if (!s->context) {
@@ -47,22 +38,13 @@ neb_evdp_source_t neb_evdp_source_new_ro_fd(int fd, neb_evdp_io_handler_t rf, ne
 
 neb_evdp_source_t neb_evdp_source_new_os_fd(int fd, neb_evdp_io_handler_t hf)
 {
-	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
-	if (!s) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_OS_FD, sizeof(struct evdp_conf_fd));
+	if (!s)
 		return NULL;
-	}
-	s->type = EVDP_SOURCE_OS_FD;
 
-	struct evdp_conf_fd *conf = calloc(1, sizeof(struct evdp_conf_fd));
-	if (!conf) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
-		neb_evdp_source_del(s);
-		return NULL;
-	}
+	struct evdp_conf_fd *conf = s->conf;
 	conf->fd = fd;
 	conf->do_hup = hf;
-	s->conf = conf;
 
 	s->context = evdp_create_source_os_fd_context(s);
 	if (!s->context) {
@@ -110,6 +92,16 @@ int neb_evdp_source_os_fd_next_read(neb_evdp_source_t s, neb_evdp_io_handler_t r
 }
 
 int neb_evdp_source_os_fd_next_write(neb_evdp_source_t s, neb_evdp_io_handler_t wf)
+{
+	struct evdp_conf_fd *conf = s->conf;
+	if (conf->stream) {
+		neb_syslog(LOG_ERR, "os_fd source %p is bound to stream writer %p", s, conf->stream);
+		return -1;
+	}
+	return evdp_source_os_fd_set_write(s, wf);
+}
+
+int evdp_source_os_fd_set_write(neb_evdp_source_t s, neb_evdp_io_handler_t wf)
 {
 	struct evdp_conf_fd *conf = s->conf;
 	conf->do_write = wf;
@@ -122,3 +114,84 @@ int neb_evdp_source_os_fd_next_write(neb_evdp_source_t s, neb_evdp_io_handler_t
 		return evdp_source_os_fd_unset_write(s);
 	}
 }
+
+neb_evdp_cb_ret_t evdp_source_os_fd_call_write(neb_evdp_source_t s, int fd, const void *context)
+{
+	struct evdp_conf_fd *conf = s->conf;
+	void *udata = conf->stream ? conf->stream : s->udata;
+	return conf->do_write(fd, udata, context);
+}
+
+neb_evdp_source_t neb_evdp_source_new_et_fd(int fd, neb_evdp_io_handler_t rf, neb_evdp_io_handler_t wf, neb_evdp_io_handler_t hf)
+{
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_ET_FD, sizeof(struct evdp_conf_et_fd));
+	if (!s)
+		return NULL;
+
+	struct evdp_conf_et_fd *conf = s->conf;
+	conf->fd = fd;
+	conf->want_write = wf ? 1 : 0;
+	conf->do_read = rf;
+	conf->do_write = wf;
+	conf->do_hup = hf;
+
+	s->context = evdp_create_source_et_fd_context(s);
+	if (!s->context) {
+		neb_evdp_source_del(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+int neb_evdp_source_et_fd_want_write(neb_evdp_source_t s)
+{
+	if (s->type != EVDP_SOURCE_ET_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to set want write", s->type);
+		return -1;
+	}
+	struct evdp_conf_et_fd *conf = s->conf;
+	if (!conf->do_write) {
+		neb_syslog(LOG_ERR, "No write handler set for et_fd source %p", s);
+		return -1;
+	}
+	if (conf->want_write)
+		return 0;
+	conf->want_write = 1;
+	if (s->q_in_use)
+		return evdp_source_et_fd_rearm_write(s);
+	return 0;
+}
+
+neb_evdp_cb_ret_t evdp_source_et_fd_dispatch(neb_evdp_source_t s, int readable, int writable, int hup, const void *context)
+{
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+
+	struct evdp_conf_et_fd *conf = s->conf;
+	if (readable && conf->do_read) {
+		ret = conf->do_read(conf->fd, s->udata, context);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
+	if (writable && conf->want_write) {
+		conf->want_write = 0;
+		ret = conf->do_write(conf->fd, s->udata, context);
+		if (ret != NEB_EVDP_CB_CONTINUE)
+			return ret;
+	}
+	if (hup) {
+		ret = conf->do_hup(conf->fd, s->udata, context);
+		switch (ret) {
+		case NEB_EVDP_CB_BREAK_ERR:
+		case NEB_EVDP_CB_BREAK_EXP:
+		case NEB_EVDP_CB_CLOSE:
+			return ret;
+			break;
+		default:
+			return NEB_EVDP_CB_REMOVE;
+			break;
+		}
+	}
+
+	return ret;
+}
@@ -19,6 +19,7 @@ struct evdp_conf_fd {
 	neb_evdp_io_handler_t do_hup;
 	neb_evdp_io_handler_t do_read;
 	neb_evdp_io_handler_t do_write;
+	struct neb_evdp_stream *stream; // bound writer, passed to do_write as udata
 };
 extern void *evdp_create_source_os_fd_context(neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
@@ -27,12 +28,29 @@ extern void evdp_reset_source_os_fd_context(neb_evdp_source_t s)
 extern void evdp_destroy_source_os_fd_context(void *context)
 	_nattr_nonnull((1)) _nattr_hidden;
 
+struct evdp_conf_et_fd {
+	int fd;
+	int want_write;
+	neb_evdp_io_handler_t do_hup;
+	neb_evdp_io_handler_t do_read;
+	neb_evdp_io_handler_t do_write;
+};
+extern void *evdp_create_source_et_fd_context(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+extern void evdp_destroy_source_et_fd_context(void *context)
+	_nattr_nonnull((1)) _nattr_hidden;
+
 extern int evdp_source_ro_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
 extern void evdp_source_ro_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
 	_nattr_nonnull((1, 2)) _nattr_hidden;
 extern neb_evdp_cb_ret_t evdp_source_ro_fd_handle(const struct neb_evdp_event *ne)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief skip the event and make sure it will be reported again in later rounds
+ */
+extern int evdp_source_ro_fd_defer(const struct neb_evdp_event *ne)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
 
 extern int evdp_source_os_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
@@ -40,6 +58,17 @@ extern void evdp_source_os_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, in
 	_nattr_nonnull((1, 2)) _nattr_hidden;
 extern neb_evdp_cb_ret_t evdp_source_os_fd_handle(const struct neb_evdp_event *ne)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief call the write handler, should be called by driver
+ */
+extern neb_evdp_cb_ret_t evdp_source_os_fd_call_write(neb_evdp_source_t s, int fd, const void *context)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief the same as neb_evdp_source_os_fd_next_write, but without the check
+ *        for bound stream writer
+ */
+extern int evdp_source_os_fd_set_write(neb_evdp_source_t s, neb_evdp_io_handler_t wf)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
 extern void evdp_source_os_fd_init_read(neb_evdp_source_t s, neb_evdp_io_handler_t rf)
 	_nattr_nonnull((1)) _nattr_hidden;
 extern int evdp_source_os_fd_reset_read(neb_evdp_source_t s)
@@ -53,4 +82,23 @@ extern int evdp_source_os_fd_reset_write(neb_evdp_source_t s)
 extern int evdp_source_os_fd_unset_write(neb_evdp_source_t s)
 	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
 
+extern int evdp_source_et_fd_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+extern void evdp_source_et_fd_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
+extern neb_evdp_cb_ret_t evdp_source_et_fd_handle(const struct neb_evdp_event *ne)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief called after want_write is set for attached source, drivers with
+ *        native edge triggered support need to do nothing
+ */
+extern int evdp_source_et_fd_rearm_write(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief call handlers for the ready events, should be called by driver
+ * \param[in] context the one passed to handlers
+ */
+extern neb_evdp_cb_ret_t evdp_source_et_fd_dispatch(neb_evdp_source_t s, int readable, int writable, int hup, const void *context)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+
 #endif
@@ -0,0 +1,168 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "io_cio.h"
+
+#include <stdlib.h>
+
+#ifdef USE_IO_URING
+
+bool neb_evdp_cio_is_supported(void)
+{
+	return true;
+}
+
+static neb_evdp_source_t evdp_source_new_cio(int fd, int is_listen, neb_evdp_io_handler_t hf)
+{
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_CIO_FD, sizeof(struct evdp_conf_cio));
+	if (!s)
+		return NULL;
+
+	struct evdp_conf_cio *conf = s->conf;
+	conf->fd = fd;
+	conf->is_listen = is_listen;
+	conf->do_hup = hf;
+
+	s->context = evdp_create_source_cio_context(s);
+	if (!s->context) {
+		neb_evdp_source_del(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+neb_evdp_source_t neb_evdp_source_new_cio_sock(int fd, neb_evdp_io_handler_t hf)
+{
+	return evdp_source_new_cio(fd, 0, hf);
+}
+
+neb_evdp_source_t neb_evdp_source_new_cio_listen(int fd, neb_evdp_cio_accept_handler_t af, neb_evdp_io_handler_t hf)
+{
+	neb_evdp_source_t s = evdp_source_new_cio(fd, 1, hf);
+	if (!s)
+		return NULL;
+	struct evdp_conf_cio *conf = s->conf;
+	conf->do_accept = af;
+	return s;
+}
+
+int neb_evdp_source_cio_set_recv(neb_evdp_source_t s, neb_evdp_cio_recv_handler_t rf, int buf_count, int buf_size)
+{
+	if (s->type != EVDP_SOURCE_CIO_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to set recv", s->type);
+		return -1;
+	}
+	struct evdp_conf_cio *conf = s->conf;
+	if (conf->is_listen) {
+		neb_syslog(LOG_ERR, "recv is not allowed for listen source");
+		return -1;
+	}
+	if (s->q_in_use) {
+		neb_syslog(LOG_ERR, "recv should be set before attach");
+		return -1;
+	}
+	if (buf_count <= 0 || buf_count > 32768 || (buf_count & (buf_count - 1))) {
+		neb_syslog(LOG_ERR, "Invalid buf_count %d, should be power of 2 and <= 32768", buf_count);
+		return -1;
+	}
+	if (buf_size <= 0) {
+		neb_syslog(LOG_ERR, "Invalid buf_size %d", buf_size);
+		return -1;
+	}
+	conf->do_recv = rf;
+	conf->buf_count = buf_count;
+	conf->buf_size = buf_size;
+	return 0;
+}
+
+void neb_evdp_source_cio_set_send_handler(neb_evdp_source_t s, neb_evdp_cio_send_handler_t sf)
+{
+	if (s->type != EVDP_SOURCE_CIO_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to set send handler", s->type);
+		return;
+	}
+	struct evdp_conf_cio *conf = s->conf;
+	conf->do_send = sf;
+}
+
+void neb_evdp_source_cio_set_send_release(neb_evdp_source_t s, neb_evdp_cio_send_release_t rf)
+{
+	if (s->type != EVDP_SOURCE_CIO_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to set send release", s->type);
+		return;
+	}
+	struct evdp_conf_cio *conf = s->conf;
+	conf->do_release = rf;
+}
+
+int neb_evdp_source_cio_send(neb_evdp_source_t s, const void *buf, size_t len, void *sdata)
+{
+	if (s->type != EVDP_SOURCE_CIO_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to send", s->type);
+		return -1;
+	}
+	return evdp_source_cio_queue_send(s, buf, len, NULL, sdata);
+}
+
+int neb_evdp_source_cio_sendmsg(neb_evdp_source_t s, const struct msghdr *msg, void *sdata)
+{
+	if (s->type != EVDP_SOURCE_CIO_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to sendmsg", s->type);
+		return -1;
+	}
+	return evdp_source_cio_queue_send(s, NULL, 0, msg, sdata);
+}
+
+#else
+
+bool neb_evdp_cio_is_supported(void)
+{
+	return false;
+}
+
+neb_evdp_source_t neb_evdp_source_new_cio_sock(int fd _nattr_unused, neb_evdp_io_handler_t hf _nattr_unused)
+{
+	neb_syslog(LOG_ERR, "Completion based I/O is not supported by this evdp driver");
+	return NULL;
+}
+
+neb_evdp_source_t neb_evdp_source_new_cio_listen(int fd _nattr_unused, neb_evdp_cio_accept_handler_t af _nattr_unused,
+                                                 neb_evdp_io_handler_t hf _nattr_unused)
+{
+	neb_syslog(LOG_ERR, "Completion based I/O is not supported by this evdp driver");
+	return NULL;
+}
+
+int neb_evdp_source_cio_set_recv(neb_evdp_source_t s _nattr_unused, neb_evdp_cio_recv_handler_t rf _nattr_unused,
+                                 int buf_count _nattr_unused, int buf_size _nattr_unused)
+{
+	return -1;
+}
+
+void neb_evdp_source_cio_set_send_handler(neb_evdp_source_t s _nattr_unused, neb_evdp_cio_send_handler_t sf _nattr_unused)
+{
+	return;
+}
+
+void neb_evdp_source_cio_set_send_release(neb_evdp_source_t s _nattr_unused, neb_evdp_cio_send_release_t rf _nattr_unused)
+{
+	return;
+}
+
+int neb_evdp_source_cio_send(neb_evdp_source_t s _nattr_unused, const void *buf _nattr_unused,
+                             size_t len _nattr_unused, void *sdata _nattr_unused)
+{
+	return -1;
+}
+
+int neb_evdp_source_cio_sendmsg(neb_evdp_source_t s _nattr_unused, const struct msghdr *msg _nattr_unused,
+                                void *sdata _nattr_unused)
+{
+	return -1;
+}
+
+#endif
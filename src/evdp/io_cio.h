@@ -0,0 +1,36 @@
+
+#ifndef NEB_SRC_EVDP_IO_CIO_H
+#define NEB_SRC_EVDP_IO_CIO_H 1
+
+#include <nebase/evdp/io_cio.h>
+
+struct evdp_conf_cio {
+	int fd;
+	int is_listen;
+	neb_evdp_io_handler_t do_hup;
+	neb_evdp_cio_recv_handler_t do_recv;
+	neb_evdp_cio_send_handler_t do_send;
+	neb_evdp_cio_send_release_t do_release;
+	neb_evdp_cio_accept_handler_t do_accept;
+	int buf_count;
+	int buf_size;
+};
+
+extern void *evdp_create_source_cio_context(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+extern void evdp_destroy_source_cio_context(void *context)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+extern int evdp_source_cio_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+extern void evdp_source_cio_detach(neb_evdp_queue_t q, neb_evdp_source_t s, int to_close)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
+extern neb_evdp_cb_ret_t evdp_source_cio_handle(const struct neb_evdp_event *ne)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \param[in] msg NULL for plain send
+ */
+extern int evdp_source_cio_queue_send(neb_evdp_source_t s, const void *buf, size_t len, const struct msghdr *msg, void *sdata)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+
+#endif
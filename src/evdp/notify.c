@@ -0,0 +1,129 @@
+
+#include <nebase/syslog.h>
+
+#include "core.h"
+#include "notify.h"
+
+#include <stdlib.h>
+
+static void notify_queue_push(struct evdp_conf_notify *conf, struct evdp_notify_task *t)
+{
+	atomic_store_explicit(&t->next, NULL, memory_order_relaxed);
+	struct evdp_notify_task *prev = atomic_exchange_explicit(&conf->head, t, memory_order_acq_rel);
+	atomic_store_explicit(&prev->next, t, memory_order_release);
+}
+
+/**
+ * \return NULL if empty, or if a producer is in the middle of push,
+ *         in which case the producer will signal again
+ */
+static struct evdp_notify_task *notify_queue_pop(struct evdp_conf_notify *conf)
+{
+	struct evdp_notify_task *tail = conf->tail;
+	struct evdp_notify_task *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (tail == &conf->stub) {
+		if (!next)
+			return NULL;
+		conf->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+	if (next) {
+		conf->tail = next;
+		return tail;
+	}
+	if (tail != atomic_load_explicit(&conf->head, memory_order_acquire))
+		return NULL;
+	notify_queue_push(conf, &conf->stub);
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if (next) {
+		conf->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+neb_evdp_source_t neb_evdp_source_new_notify(neb_evdp_notify_handler_t nf)
+{
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_NOTIFY, sizeof(struct evdp_conf_notify));
+	if (!s)
+		return NULL;
+
+	struct evdp_conf_notify *conf = s->conf;
+	atomic_init(&conf->stub.next, NULL);
+	atomic_init(&conf->head, &conf->stub);
+	conf->tail = &conf->stub;
+	atomic_init(&conf->signaled, false);
+	conf->do_notify = nf;
+
+	s->context = evdp_create_source_notify_context(s);
+	if (!s->context) {
+		neb_evdp_source_del(s);
+		return NULL;
+	}
+
+	return s;
+}
+
+int neb_evdp_source_notify_signal(neb_evdp_source_t s)
+{
+	if (s->type != EVDP_SOURCE_NOTIFY) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to signal", s->type);
+		return -1;
+	}
+	struct evdp_conf_notify *conf = s->conf;
+	if (atomic_exchange(&conf->signaled, true))
+		return 0; // the queue has not handled the previous one yet
+	return evdp_source_notify_wakeup(s);
+}
+
+int neb_evdp_source_notify_post(neb_evdp_source_t s, neb_evdp_notify_task_t fn, void *arg)
+{
+	if (s->type != EVDP_SOURCE_NOTIFY) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to post task", s->type);
+		return -1;
+	}
+	struct evdp_notify_task *t = malloc(sizeof(struct evdp_notify_task));
+	if (!t) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		return -1;
+	}
+	t->fn = fn;
+	t->arg = arg;
+	notify_queue_push(s->conf, t);
+	return neb_evdp_source_notify_signal(s);
+}
+
+neb_evdp_cb_ret_t evdp_source_notify_dispatch(neb_evdp_source_t s)
+{
+	struct evdp_conf_notify *conf = s->conf;
+
+	// clear before drain, so producers after this point will signal again
+	atomic_store(&conf->signaled, false);
+
+	int count = 0;
+	struct evdp_notify_task *t;
+	while (count < EVDP_NOTIFY_BATCH_SIZE && (t = notify_queue_pop(conf)) != NULL) {
+		t->fn(t->arg);
+		free(t);
+		count++;
+	}
+	if (count == EVDP_NOTIFY_BATCH_SIZE) { // there may be more, run them in the next round
+		if (neb_evdp_source_notify_signal(s) != 0)
+			neb_syslog(LOG_ERR, "Failed to signal notify source %p for remaining tasks", s);
+	}
+
+	if (conf->do_notify)
+		return conf->do_notify(s->udata);
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+void evdp_source_notify_drop_tasks(neb_evdp_source_t s)
+{
+	struct evdp_conf_notify *conf = s->conf;
+	if (!conf)
+		return;
+	struct evdp_notify_task *t;
+	while ((t = notify_queue_pop(conf)) != NULL)
+		free(t);
+}
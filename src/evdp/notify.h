@@ -0,0 +1,56 @@
+
+#ifndef NEB_SRC_EVDP_NOTIFY_H
+#define NEB_SRC_EVDP_NOTIFY_H 1
+
+#include <nebase/evdp/notify.h>
+
+#include <stdatomic.h>
+#include <stdbool.h>
+
+#define EVDP_NOTIFY_BATCH_SIZE 256
+
+struct evdp_notify_task {
+	_Atomic(struct evdp_notify_task *) next;
+	neb_evdp_notify_task_t fn;
+	void *arg;
+};
+
+/*
+ * tasks are in an intrusive MPSC queue, the producers push to head and the
+ * consumer pops from tail, with a stub node to make it always non-empty
+ */
+struct evdp_conf_notify {
+	_Atomic(struct evdp_notify_task *) head;
+	struct evdp_notify_task *tail;
+	struct evdp_notify_task stub;
+	atomic_bool signaled;
+	neb_evdp_notify_handler_t do_notify;
+};
+
+extern void *evdp_create_source_notify_context(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+extern void evdp_destroy_source_notify_context(void *context)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+extern int evdp_source_notify_attach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2)) _nattr_hidden;
+extern void evdp_source_notify_detach(neb_evdp_queue_t q, neb_evdp_source_t s)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
+extern neb_evdp_cb_ret_t evdp_source_notify_handle(const struct neb_evdp_event *ne)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief wake up the queue the source attached to, may be called in any thread
+ */
+extern int evdp_source_notify_wakeup(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+
+/**
+ * \brief run posted tasks and the notify handler, should be called by driver
+ *        after the wakeup event is cleared
+ */
+extern neb_evdp_cb_ret_t evdp_source_notify_dispatch(neb_evdp_source_t s)
+	_nattr_warn_unused_result _nattr_nonnull((1)) _nattr_hidden;
+extern void evdp_source_notify_drop_tasks(neb_evdp_source_t s)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+#endif
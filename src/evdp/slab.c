@@ -0,0 +1,275 @@
+
+#include <nebase/syslog.h>
+
+#include "slab.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define EVDP_SLAB_CHUNK_SIZE (64 * 1024)
+#define EVDP_SLAB_CLASSES 6 /* 64 to 2048 */
+#define EVDP_SLAB_CLASS_LARGE EVDP_SLAB_CLASSES
+#define EVDP_SLAB_TCACHE_CHUNKS 2 /* free blocks kept in a thread cache, others are moved to the depot */
+
+struct evdp_slab_chunk {
+	union {
+		struct {
+			uint32_t class;
+			uint32_t block_size;
+		};
+		char pad[EVDP_SLAB_ALIGN];
+	};
+	char data[];
+};
+
+_Static_assert(sizeof(struct evdp_slab_chunk) == EVDP_SLAB_ALIGN, "slab chunk header should be one cache line");
+_Static_assert((EVDP_SLAB_ALIGN << (EVDP_SLAB_CLASSES - 1)) == EVDP_SLAB_MAX_BLOCK_SIZE, "slab classes and max block size should match");
+
+struct evdp_slab_block {
+	struct evdp_slab_block *next;
+};
+
+struct evdp_slab_freelist {
+	struct evdp_slab_block *head;
+	int count;
+};
+
+static _Thread_local struct evdp_slab_freelist tcache[EVDP_SLAB_CLASSES];
+static _Thread_local int tcache_registered = 0;
+static _Thread_local int tcache_released = 0;
+
+static struct evdp_slab_freelist depot[EVDP_SLAB_CLASSES];
+static pthread_mutex_t depot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+static int tcache_key_ok = 0;
+
+static struct evdp_slab_chunk *slab_chunk_of(const void *ptr)
+{
+	return (struct evdp_slab_chunk *)((uintptr_t)ptr & ~((uintptr_t)EVDP_SLAB_CHUNK_SIZE - 1));
+}
+
+static int slab_class_nblocks(int class)
+{
+	return (EVDP_SLAB_CHUNK_SIZE - sizeof(struct evdp_slab_chunk)) / (EVDP_SLAB_ALIGN << class);
+}
+
+static int slab_class_of(size_t size)
+{
+	int class = 0;
+	size_t block_size = EVDP_SLAB_ALIGN;
+	while (block_size < size) {
+		block_size <<= 1;
+		class++;
+	}
+	return class;
+}
+
+/**
+ * \brief move the thread cache to the depot at thread exit
+ */
+static void tcache_release(void *arg)
+{
+	struct evdp_slab_freelist *lists = arg;
+	tcache_released = 1; // blocks freed later by other destructors go to the depot
+	pthread_mutex_lock(&depot_lock);
+	for (int i = 0; i < EVDP_SLAB_CLASSES; i++) {
+		struct evdp_slab_block *head = lists[i].head;
+		if (!head)
+			continue;
+		struct evdp_slab_block *tail = head;
+		while (tail->next)
+			tail = tail->next;
+		tail->next = depot[i].head;
+		depot[i].head = head;
+		depot[i].count += lists[i].count;
+		lists[i].head = NULL;
+		lists[i].count = 0;
+	}
+	pthread_mutex_unlock(&depot_lock);
+}
+
+static void tcache_key_create(void)
+{
+	int ret = pthread_key_create(&tcache_key, tcache_release);
+	if (ret != 0) {
+		neb_syslogl_en(ret, LOG_ERR, "pthread_key_create: %m");
+		return;
+	}
+	tcache_key_ok = 1;
+}
+
+static void tcache_register(void)
+{
+	tcache_registered = 1;
+	pthread_once(&tcache_key_once, tcache_key_create);
+	if (!tcache_key_ok)
+		return; // blocks will not be reused after thread exit
+	int ret = pthread_setspecific(tcache_key, tcache);
+	if (ret != 0)
+		neb_syslogl_en(ret, LOG_ERR, "pthread_setspecific: %m");
+}
+
+/**
+ * \brief keep the recently freed half in the thread cache, and move the others
+ *        to the depot, where other threads could refill from
+ */
+static void tcache_flush(int class)
+{
+	struct evdp_slab_freelist *fl = &tcache[class];
+	int keep = slab_class_nblocks(class) * EVDP_SLAB_TCACHE_CHUNKS / 2;
+
+	struct evdp_slab_block *last = fl->head;
+	for (int i = 1; i < keep; i++)
+		last = last->next;
+	struct evdp_slab_block *head = last->next;
+	last->next = NULL;
+	struct evdp_slab_block *tail = head;
+	while (tail->next)
+		tail = tail->next;
+
+	pthread_mutex_lock(&depot_lock);
+	tail->next = depot[class].head;
+	depot[class].head = head;
+	depot[class].count += fl->count - keep;
+	pthread_mutex_unlock(&depot_lock);
+	fl->count = keep;
+}
+
+static int tcache_refill(int class)
+{
+	struct evdp_slab_freelist *fl = &tcache[class];
+
+	pthread_mutex_lock(&depot_lock);
+	if (depot[class].head) {
+		fl->head = depot[class].head;
+		fl->count = depot[class].count;
+		depot[class].head = NULL;
+		depot[class].count = 0;
+	}
+	pthread_mutex_unlock(&depot_lock);
+	if (fl->head)
+		return 0;
+
+	struct evdp_slab_chunk *c = aligned_alloc(EVDP_SLAB_CHUNK_SIZE, EVDP_SLAB_CHUNK_SIZE);
+	if (!c) {
+		neb_syslogl(LOG_ERR, "aligned_alloc: %m");
+		return -1;
+	}
+	c->class = class;
+	c->block_size = EVDP_SLAB_ALIGN << class;
+	int nblocks = slab_class_nblocks(class);
+	for (int i = nblocks - 1; i >= 0; i--) {
+		struct evdp_slab_block *b = (struct evdp_slab_block *)(c->data + (size_t)i * c->block_size);
+		b->next = fl->head;
+		fl->head = b;
+	}
+	fl->count += nblocks;
+	return 0;
+}
+
+static void *slab_alloc_large(size_t size)
+{
+	size_t total = (sizeof(struct evdp_slab_chunk) + size + EVDP_SLAB_CHUNK_SIZE - 1) & ~((size_t)EVDP_SLAB_CHUNK_SIZE - 1);
+	struct evdp_slab_chunk *c = aligned_alloc(EVDP_SLAB_CHUNK_SIZE, total);
+	if (!c) {
+		neb_syslogl(LOG_ERR, "aligned_alloc: %m");
+		return NULL;
+	}
+	c->class = EVDP_SLAB_CLASS_LARGE;
+	c->block_size = total - sizeof(struct evdp_slab_chunk);
+	memset(c->data, 0, size);
+	return c->data;
+}
+
+void *evdp_slab_alloc(size_t size)
+{
+	if (size > EVDP_SLAB_MAX_BLOCK_SIZE)
+		return slab_alloc_large(size);
+
+	if (!tcache_registered)
+		tcache_register();
+
+	int class = slab_class_of(size);
+	struct evdp_slab_freelist *fl = &tcache[class];
+	if (!fl->head && tcache_refill(class) != 0)
+		return NULL;
+
+	struct evdp_slab_block *b = fl->head;
+	fl->head = b->next;
+	fl->count--;
+	if (tcache_released) // not to leak the refilled ones
+		tcache_release(tcache);
+	memset(b, 0, EVDP_SLAB_ALIGN << class);
+	return b;
+}
+
+void evdp_slab_free(void *ptr)
+{
+	struct evdp_slab_chunk *c = slab_chunk_of(ptr);
+	if (c->class == EVDP_SLAB_CLASS_LARGE) {
+		free(c);
+		return;
+	}
+
+	if (!tcache_registered)
+		tcache_register();
+
+	struct evdp_slab_freelist *fl = &tcache[c->class];
+	struct evdp_slab_block *b = ptr;
+	b->next = fl->head;
+	fl->head = b;
+	fl->count++;
+	if (tcache_released)
+		tcache_release(tcache);
+	else if (fl->count > slab_class_nblocks(c->class) * EVDP_SLAB_TCACHE_CHUNKS)
+		tcache_flush(c->class);
+}
+
+bool evdp_slab_is_block(const void *ptr)
+{
+	const struct evdp_slab_chunk *c = slab_chunk_of(ptr);
+	size_t offset = (const char *)ptr - c->data;
+	if (c->class == EVDP_SLAB_CLASS_LARGE)
+		return offset == 0;
+	return offset % c->block_size == 0;
+}
+
+size_t evdp_slab_block_size(const void *ptr)
+{
+	return slab_chunk_of(ptr)->block_size;
+}
+
+int evdp_slab_reserve(size_t size, int count)
+{
+	if (size > EVDP_SLAB_MAX_BLOCK_SIZE) {
+		neb_syslog(LOG_ERR, "Size %zu is too large to reserve", size);
+		return -1;
+	}
+
+	if (!tcache_registered)
+		tcache_register();
+
+	int class = slab_class_of(size);
+	struct evdp_slab_freelist *fl = &tcache[class];
+	while (fl->count < count) {
+		struct evdp_slab_block *head = fl->head;
+		int n = fl->count;
+		fl->head = NULL;
+		fl->count = 0;
+		if (tcache_refill(class) != 0) {
+			fl->head = head;
+			fl->count = n;
+			return -1;
+		}
+		struct evdp_slab_block *tail = fl->head;
+		while (tail->next)
+			tail = tail->next;
+		tail->next = head;
+		fl->count += n;
+	}
+	return 0;
+}
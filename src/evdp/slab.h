@@ -0,0 +1,53 @@
+
+#ifndef NEB_SRC_EVDP_SLAB_H
+#define NEB_SRC_EVDP_SLAB_H 1
+
+#include <nebase/cdefs.h>
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*
+ * slab allocator for evdp sources
+ *  blocks are cache line aligned, and grouped in size classes. Each thread
+ *  keeps its own freelists, and refills them from a shared locked depot before
+ *  allocating new chunks. Chunks are never returned to the system, so blocks
+ *  can be freed by any thread:
+ *   - a block freed by another thread goes to the freeing thread's cache, if
+ *     the cache is over two chunks of blocks, half of it is moved to the depot,
+ *     so memory of producer/consumer threads is reused but not piled up
+ *   - the thread cache is moved to the depot at thread exit, and blocks freed
+ *     later in the exiting thread go to the depot directly
+ */
+
+#define EVDP_SLAB_ALIGN 64
+#define EVDP_SLAB_ALIGN_UP(x) (((x) + EVDP_SLAB_ALIGN - 1) & ~((size_t)EVDP_SLAB_ALIGN - 1))
+#define EVDP_SLAB_MAX_BLOCK_SIZE 2048
+
+/**
+ * \return zeroed memory, with the size rounded up to the size class
+ */
+extern void *evdp_slab_alloc(size_t size)
+	_nattr_warn_unused_result _nattr_hidden;
+/**
+ * \param[in] ptr should be the one returned by evdp_slab_alloc
+ */
+extern void evdp_slab_free(void *ptr)
+	_nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief whether ptr is the start of a block, false if it is inside one
+ */
+extern bool evdp_slab_is_block(const void *ptr)
+	_nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \return the real usable size of the block
+ */
+extern size_t evdp_slab_block_size(const void *ptr)
+	_nattr_nonnull((1)) _nattr_hidden;
+/**
+ * \brief make sure there are at least count free blocks of size in the current thread
+ */
+extern int evdp_slab_reserve(size_t size, int count)
+	_nattr_warn_unused_result _nattr_hidden;
+
+#endif
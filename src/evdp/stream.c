@@ -0,0 +1,363 @@
+
+#include <nebase/syslog.h>
+#include <nebase/evdp/stream.h>
+#include <nebase/evdp/defer.h>
+#include <nebase/iobuf.h>
+
+#include "core.h"
+#include "io_base.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+
+// max blocks in one flush call, which is far less than IOV_MAX
+#define EVDP_STREAM_IOV_MAX 64
+
+struct neb_evdp_stream {
+	neb_evdp_source_t s;
+	neb_evdp_source_t ds; // defer source for the end of round flush
+	void *udata;
+	struct neb_evdp_stream_conf conf;
+	struct neb_evdp_stream_stats stats;
+	neb_iobuf_pool_t pool;
+	neb_iobuf_t out;
+	int own_pool;
+	int error;
+	int want_write; // blocked and waiting for the writable event
+	int above_high;
+	int drained;
+	int not_sock; // use writev instead of sendmsg
+};
+
+static void stream_drop_all(neb_evdp_stream_t st)
+{
+	neb_iobuf_clear(st->out);
+	st->stats.queued = 0;
+}
+
+static void stream_consume(neb_evdp_stream_t st, size_t len)
+{
+	neb_iobuf_consume(st->out, len);
+	st->stats.queued -= len;
+	st->stats.bytes_written += len;
+
+	if (st->above_high && st->stats.queued <= st->conf.low_watermark) {
+		st->above_high = 0;
+		st->drained = 1;
+	}
+}
+
+static neb_evdp_cb_ret_t stream_on_writable(int fd, void *udata, const void *context);
+
+static int stream_want_write(neb_evdp_stream_t st)
+{
+	if (st->want_write)
+		return 0;
+	if (evdp_source_os_fd_set_write(st->s, stream_on_writable) != 0)
+		return -1; // not set, so the next write could schedule again
+	st->want_write = 1;
+	return 0;
+}
+
+/**
+ * \return 0 if all written or blocked, -1 if failed and st->error is set
+ */
+static int stream_do_flush(neb_evdp_stream_t st)
+{
+	const struct evdp_conf_fd *fconf = st->s->conf;
+	while (st->stats.queued) {
+		struct iovec iov[EVDP_STREAM_IOV_MAX];
+		int iovcnt = neb_iobuf_export_iov(st->out, iov, EVDP_STREAM_IOV_MAX);
+		size_t total = 0;
+		for (int i = 0; i < iovcnt; i++)
+			total += iov[i].iov_len;
+
+		ssize_t nw;
+		if (!st->not_sock) {
+			struct msghdr msg = {
+				.msg_iov = iov,
+				.msg_iovlen = iovcnt,
+			};
+			nw = sendmsg(fconf->fd, &msg, MSG_NOSIGNAL);
+			if (nw == -1 && errno == ENOTSOCK) {
+				st->not_sock = 1;
+				continue;
+			}
+		} else {
+			nw = writev(fconf->fd, iov, iovcnt);
+		}
+		st->stats.flushes++;
+		if (nw == -1) {
+			switch (errno) {
+			case EINTR:
+				continue;
+				break;
+			case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+#endif
+				st->stats.blocked++;
+				return stream_want_write(st);
+				break;
+			default:
+				st->error = errno;
+				return -1;
+				break;
+			}
+		}
+
+		stream_consume(st, nw);
+		if ((size_t)nw < total) { // the send buffer is full
+			st->stats.blocked++;
+			return stream_want_write(st);
+		}
+	}
+	return 0;
+}
+
+static neb_evdp_cb_ret_t stream_run(neb_evdp_stream_t st)
+{
+	if (st->error)
+		return NEB_EVDP_CB_CONTINUE;
+
+	if (stream_do_flush(st) != 0) {
+		if (st->error) {
+			const struct evdp_conf_fd *fconf = st->s->conf;
+			neb_syslog_en(st->error, LOG_ERR, "Failed to flush stream writer on fd %d: %m", fconf->fd);
+			stream_drop_all(st);
+			if (st->conf.on_error)
+				return st->conf.on_error(st, st->udata);
+			return NEB_EVDP_CB_CONTINUE;
+		}
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+
+	if (st->drained) {
+		st->drained = 0;
+		if (st->conf.on_drain)
+			return st->conf.on_drain(st, st->udata);
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t stream_on_writable(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_stream_t st = udata;
+	st->want_write = 0;
+	return stream_run(st);
+}
+
+static neb_evdp_cb_ret_t stream_on_defer(void *udata)
+{
+	neb_evdp_stream_t st = udata;
+	neb_evdp_queue_t q = st->s->q_in_use;
+	if (!q || st->want_write) // flush when writable
+		return NEB_EVDP_CB_CONTINUE;
+
+	neb_evdp_cb_ret_t ret = stream_run(st);
+	switch (ret) {
+	case NEB_EVDP_CB_REMOVE:
+	case NEB_EVDP_CB_CLOSE:
+		if (neb_evdp_queue_detach(q, st->s, ret == NEB_EVDP_CB_CLOSE) != 0)
+			return NEB_EVDP_CB_BREAK_ERR;
+		return NEB_EVDP_CB_CONTINUE;
+		break;
+	default:
+		return ret;
+		break;
+	}
+}
+
+/**
+ * \brief flush at the end of the round, or when writable if not attached
+ */
+static int stream_schedule(neb_evdp_stream_t st)
+{
+	neb_evdp_queue_t q = st->s->q_in_use;
+	if (!q)
+		return stream_want_write(st);
+
+	if (st->ds->q_in_use != q) {
+		if (st->ds->q_in_use && neb_evdp_queue_detach(st->ds->q_in_use, st->ds, 0) != 0)
+			return -1;
+		if (neb_evdp_queue_attach(q, st->ds) != 0)
+			return -1;
+	}
+	return neb_evdp_source_defer_activate(st->ds);
+}
+
+static void stream_free(neb_evdp_stream_t st)
+{
+	if (st->out)
+		neb_iobuf_del(st->out);
+	if (st->own_pool)
+		neb_iobuf_pool_destroy(st->pool);
+	free(st);
+}
+
+neb_evdp_stream_t neb_evdp_stream_create(neb_evdp_source_t s, const struct neb_evdp_stream_conf *conf, void *udata)
+{
+	if (s->type != EVDP_SOURCE_OS_FD) {
+		neb_syslog(LOG_ERR, "Invalid evdp_source type %d to bind stream writer", s->type);
+		return NULL;
+	}
+	struct evdp_conf_fd *fconf = s->conf;
+	if (fconf->stream) {
+		neb_syslog(LOG_ERR, "os_fd source %p is already bound to stream writer %p", s, fconf->stream);
+		return NULL;
+	}
+	if (fconf->do_write) {
+		neb_syslog(LOG_ERR, "os_fd source %p has write handler set", s);
+		return NULL;
+	}
+	if (conf && conf->high_watermark && conf->low_watermark >= conf->high_watermark) {
+		neb_syslog(LOG_ERR, "low_watermark %zu should be less than high_watermark %zu", conf->low_watermark, conf->high_watermark);
+		return NULL;
+	}
+
+	neb_evdp_stream_t st = calloc(1, sizeof(struct neb_evdp_stream));
+	if (!st) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	if (conf)
+		st->conf = *conf;
+	if (!st->conf.chunk_size)
+		st->conf.chunk_size = NEB_EVDP_STREAM_DEFAULT_CHUNK_SIZE;
+
+	st->pool = st->conf.pool;
+	if (!st->pool) {
+		st->pool = neb_iobuf_pool_create(st->conf.chunk_size, 0);
+		if (!st->pool) {
+			free(st);
+			return NULL;
+		}
+		st->own_pool = 1;
+	}
+	st->out = neb_iobuf_new(st->pool);
+	if (!st->out) {
+		stream_free(st);
+		return NULL;
+	}
+
+	st->ds = neb_evdp_source_new_defer(stream_on_defer);
+	if (!st->ds) {
+		stream_free(st);
+		return NULL;
+	}
+	neb_evdp_source_set_udata(st->ds, st);
+
+	st->s = s;
+	st->udata = udata;
+	fconf->stream = st;
+	return st;
+}
+
+void neb_evdp_stream_destroy(neb_evdp_stream_t st)
+{
+	struct evdp_conf_fd *fconf = st->s->conf;
+	if (fconf->do_write && evdp_source_os_fd_set_write(st->s, NULL) != 0)
+		neb_syslog(LOG_ERR, "Failed to unset write for os_fd source %p", st->s);
+	fconf->stream = NULL;
+
+	if (st->ds->q_in_use && neb_evdp_queue_detach(st->ds->q_in_use, st->ds, 0) != 0)
+		neb_syslog(LOG_ERR, "Failed to detach defer source of stream writer %p", st);
+	neb_evdp_source_del(st->ds);
+
+	stream_free(st);
+}
+
+static int stream_check_error(neb_evdp_stream_t st)
+{
+	if (st->error) {
+		neb_syslog_en(st->error, LOG_ERR, "Stream writer %p has failed before: %m", st);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * \brief schedule the flush and apply the high watermark after data queued
+ */
+static int stream_queued(neb_evdp_stream_t st, size_t len)
+{
+	st->stats.queued += len;
+	st->stats.bytes_queued += len;
+	if (st->stats.queued > st->stats.queued_max)
+		st->stats.queued_max = st->stats.queued;
+
+	if (!st->want_write && stream_schedule(st) != 0)
+		return -1;
+
+	if (st->conf.high_watermark && !st->above_high && st->stats.queued >= st->conf.high_watermark) {
+		st->above_high = 1;
+		st->drained = 0;
+		st->stats.high_reached++;
+	}
+	return st->above_high ? 1 : 0;
+}
+
+int neb_evdp_stream_write(neb_evdp_stream_t st, const void *buf, size_t len)
+{
+	if (stream_check_error(st) != 0)
+		return -1;
+
+	size_t old_len = neb_iobuf_len(st->out);
+	int ret = neb_iobuf_append(st->out, buf, len);
+	size_t added = neb_iobuf_len(st->out) - old_len; // keep the partial appended
+	if (added && stream_queued(st, added) < 0)
+		return -1;
+	if (ret != 0)
+		return -1;
+	return st->above_high ? 1 : 0;
+}
+
+int neb_evdp_stream_write_iobuf(neb_evdp_stream_t st, neb_iobuf_t b)
+{
+	if (stream_check_error(st) != 0)
+		return -1;
+
+	size_t len = neb_iobuf_len(b);
+	if (neb_iobuf_append_buf(st->out, b) != 0)
+		return -1;
+	if (len && stream_queued(st, len) < 0)
+		return -1;
+	return st->above_high ? 1 : 0;
+}
+
+int neb_evdp_stream_flush(neb_evdp_stream_t st)
+{
+	if (stream_check_error(st) != 0)
+		return -1;
+	if (st->want_write)
+		return 0;
+
+	if (stream_do_flush(st) != 0) {
+		if (st->error) {
+			neb_syslog_en(st->error, LOG_ERR, "Failed to flush stream writer %p: %m", st);
+			stream_drop_all(st);
+		}
+		return -1;
+	}
+	if (st->drained) // call on_drain at the end of the round
+		return stream_schedule(st);
+	return 0;
+}
+
+size_t neb_evdp_stream_get_queued(neb_evdp_stream_t st)
+{
+	return st->stats.queued;
+}
+
+int neb_evdp_stream_get_error(neb_evdp_stream_t st)
+{
+	return st->error;
+}
+
+void neb_evdp_stream_get_stats(neb_evdp_stream_t st, struct neb_evdp_stream_stats *stats)
+{
+	*stats = st->stats;
+}
@@ -10,23 +10,14 @@
 
 neb_evdp_source_t neb_evdp_source_new_itimer_s(unsigned int ident, int val, neb_evdp_wakeup_handler_t tf)
 {
-	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
-	if (!s) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_ITIMER_SEC, sizeof(struct evdp_conf_itimer));
+	if (!s)
 		return NULL;
-	}
-	s->type = EVDP_SOURCE_ITIMER_SEC;
 
-	struct evdp_conf_itimer *conf = calloc(1, sizeof(struct evdp_conf_itimer));
-	if (!conf) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
-		neb_evdp_source_del(s);
-		return NULL;
-	}
+	struct evdp_conf_itimer *conf = s->conf;
 	conf->ident = ident;
 	conf->sec = val;
 	conf->do_wakeup = tf;
-	s->conf = conf;
 
 	s->context = evdp_create_source_itimer_context(s);
 	if (!s->context) {
@@ -39,23 +30,14 @@ neb_evdp_source_t neb_evdp_source_new_itimer_s(unsigned int ident, int val, neb_
 
 neb_evdp_source_t neb_evdp_source_new_itimer_ms(unsigned int ident, int val, neb_evdp_wakeup_handler_t tf)
 {
-	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
-	if (!s) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_ITIMER_MSEC, sizeof(struct evdp_conf_itimer));
+	if (!s)
 		return NULL;
-	}
-	s->type = EVDP_SOURCE_ITIMER_MSEC;
 
-	struct evdp_conf_itimer *conf = calloc(1, sizeof(struct evdp_conf_itimer));
-	if (!conf) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
-		neb_evdp_source_del(s);
-		return NULL;
-	}
+	struct evdp_conf_itimer *conf = s->conf;
 	conf->ident = ident;
 	conf->msec = val;
 	conf->do_wakeup = tf;
-	s->conf = conf;
 
 	s->context = evdp_create_source_itimer_context(s);
 	if (!s->context) {
@@ -73,23 +55,14 @@ neb_evdp_source_t neb_evdp_source_new_abstimer(unsigned int ident, int sec_of_da
 		return NULL;
 	}
 
-	neb_evdp_source_t s = calloc(1, sizeof(struct neb_evdp_source));
-	if (!s) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
+	neb_evdp_source_t s = evdp_source_new(EVDP_SOURCE_ABSTIMER, sizeof(struct evdp_conf_abstimer));
+	if (!s)
 		return NULL;
-	}
-	s->type = EVDP_SOURCE_ABSTIMER;
 
-	struct evdp_conf_abstimer *conf = calloc(1, sizeof(struct evdp_conf_abstimer));
-	if (!conf) {
-		neb_syslogl(LOG_ERR, "calloc: %m");
-		neb_evdp_source_del(s);
-		return NULL;
-	}
+	struct evdp_conf_abstimer *conf = s->conf;
 	conf->ident = ident;
 	conf->sec_of_day = sec_of_day;
 	conf->do_wakeup = tf;
-	s->conf = conf;
 
 	s->context = evdp_create_source_abstimer_context(s);
 	if (!s->context) {
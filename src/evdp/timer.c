@@ -3,6 +3,7 @@
 #include <nebase/time.h>
 
 #include "timer.h"
+#include "instr.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -127,6 +128,26 @@ static int evdp_timer_rbtree_cmp_key(void *context _nattr_unused, const void *no
 	}
 }
 
+neb_evdp_timer_t neb_evdp_timer_create_wheel(int tick_usec, int ncache_size)
+{
+	struct neb_evdp_timer *dt = calloc(1, sizeof(struct neb_evdp_timer));
+	if (!dt) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+
+	rb_tree_init(&dt->rbtree, &evdp_timer_rbtree_ops);
+	LIST_INIT(&dt->keeplist);
+
+	dt->wheel = evdp_timer_wheel_create(tick_usec, ncache_size);
+	if (!dt->wheel) {
+		neb_evdp_timer_destroy(dt);
+		return NULL;
+	}
+
+	return dt;
+}
+
 neb_evdp_timer_t neb_evdp_timer_create(int tcache_size, int lcache_size)
 {
 	struct neb_evdp_timer *dt = calloc(1, sizeof(struct neb_evdp_timer));
@@ -162,6 +183,11 @@ neb_evdp_timer_t neb_evdp_timer_create(int tcache_size, int lcache_size)
 
 void neb_evdp_timer_destroy(neb_evdp_timer_t t)
 {
+	if (t->wheel) {
+		evdp_timer_wheel_destroy(t->wheel);
+		t->wheel = NULL;
+	}
+
 	struct evdp_timer_rbtree_node *tnode, *tnext;
 	RB_TREE_FOREACH_SAFE(tnode, &t->rbtree, tnext) {
 		rb_tree_remove_node(&t->rbtree, tnode);
@@ -193,6 +219,9 @@ void neb_evdp_timer_destroy(neb_evdp_timer_t t)
 
 neb_evdp_timer_point neb_evdp_timer_new_point(neb_evdp_timer_t t, struct timespec* abs_ts, neb_evdp_timeout_handler_t cb, void* udata)
 {
+	if (t->wheel)
+		return evdp_timer_wheel_new_point(t->wheel, abs_ts, cb, udata);
+
 	struct evdp_timer_rbtree_node *tn = evdp_timer_rbtree_node_new(abs_ts, t);
 	if (!tn)
 		return NULL;
@@ -214,6 +243,11 @@ neb_evdp_timer_point neb_evdp_timer_new_point(neb_evdp_timer_t t, struct timespe
 
 void neb_evdp_timer_del_point(neb_evdp_timer_t t, neb_evdp_timer_point p)
 {
+	if (t->wheel) {
+		evdp_timer_wheel_del_point(t->wheel, p);
+		return;
+	}
+
 	struct evdp_timer_cblist_node *ln = p;
 	struct evdp_timer_rbtree_node *tn = ln->ref_tnode;
 
@@ -232,6 +266,11 @@ void neb_evdp_timer_del_point(neb_evdp_timer_t t, neb_evdp_timer_point p)
 
 int neb_evdp_timer_point_reset(neb_evdp_timer_t t, neb_evdp_timer_point p, struct timespec *abs_ts)
 {
+	if (t->wheel) {
+		evdp_timer_wheel_point_reset(t->wheel, p, abs_ts);
+		return 0;
+	}
+
 	struct evdp_timer_rbtree_node *tn = evdp_timer_rbtree_node_new(abs_ts, t);
 	if (!tn)
 		return -1;
@@ -262,6 +301,9 @@ int neb_evdp_timer_point_reset(neb_evdp_timer_t t, neb_evdp_timer_point p, struc
 
 struct timespec *evdp_timer_fetch_neareast_ts(neb_evdp_timer_t t, struct timespec *cur_ts)
 {
+	if (t->wheel)
+		return evdp_timer_wheel_fetch_nearest_ts(t->wheel, cur_ts);
+
 	struct evdp_timer_rbtree_node *min_node = RB_TREE_MIN(&t->rbtree);
 
 	if (min_node == NULL) {
@@ -275,8 +317,12 @@ struct timespec *evdp_timer_fetch_neareast_ts(neb_evdp_timer_t t, struct timespe
 	}
 }
 
-int evdp_timer_run_until(neb_evdp_timer_t t, struct timespec *abs_ts)
+int evdp_timer_run_until(neb_evdp_timer_t t, struct timespec *abs_ts, struct evdp_queue_instr *instr,
+                         int max_count, uint64_t deadline_ns)
 {
+	if (t->wheel)
+		return evdp_timer_wheel_run_until(t->wheel, abs_ts, instr, max_count, deadline_ns);
+
 	int count = 0;
 	struct evdp_timer_rbtree_node *tn, *nxt;
 	for (tn = RB_TREE_MIN(&t->rbtree); tn; tn = nxt) {
@@ -286,10 +332,23 @@ int evdp_timer_run_until(neb_evdp_timer_t t, struct timespec *abs_ts)
 		tn->no_auto_del = 1;
 		struct evdp_timer_cblist_node *ln;
 		for (ln = LIST_FIRST(&tn->cblist); ln; ln = LIST_FIRST(&tn->cblist)) {
+			if (count && evdp_round_budget_exhausted(count, max_count, deadline_ns)) {
+				tn->no_auto_del = 0; // the rest are still expired in the next round
+				return count;
+			}
 			LIST_REMOVE(ln, list); // keep ref_tnode
+			uint64_t start_ns = 0;
+			if (instr) {
+				start_ns = evdp_instr_now_ns();
+				uint64_t sched_ns = (uint64_t)tn->ts.tv_sec * 1000000000 + tn->ts.tv_nsec;
+				uint64_t fire_ns = evdp_instr_timer_now_ns();
+				evdp_hist_record(&instr->hists[NEB_EVDP_HIST_TIMER_LAG], fire_ns > sched_ns ? fire_ns - sched_ns : 0);
+			}
 			ln->running = 1;
 			neb_evdp_timeout_ret_t tret = ln->on_timeout(ln->udata);
 			ln->running = 0;
+			if (instr)
+				evdp_instr_record_since(instr, NEB_EVDP_HIST_CB_TIMER, start_ns);
 			count += 1;
 			if (!ln->ref_tnode) { // del_point is called in cb
 				evdp_timer_cblist_node_free(ln, t);
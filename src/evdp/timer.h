@@ -6,7 +6,10 @@
 #include <nebase/evdp/core.h>
 #include <nebase/rbtree.h>
 
+#include "instr.h"
+
 #include <sys/queue.h>
+#include <stdint.h>
 #include <time.h>
 
 struct evdp_timer_cblist_node {
@@ -26,7 +29,41 @@ struct evdp_timer_rbtree_node {
 	int no_auto_del;
 };
 
+#define EVDP_TIMER_WHEEL_BITS 8
+#define EVDP_TIMER_WHEEL_SIZE (1 << EVDP_TIMER_WHEEL_BITS)
+#define EVDP_TIMER_WHEEL_MASK (EVDP_TIMER_WHEEL_SIZE - 1)
+#define EVDP_TIMER_WHEEL_LEVELS 4
+
+struct evdp_timer_wheel_node {
+	LIST_ENTRY(evdp_timer_wheel_node) list;
+	uint64_t expires; // in ticks
+	neb_evdp_timeout_handler_t on_timeout;
+	void *udata;
+	int level;            // -1 if not in the wheel
+	uint32_t running:1;
+	uint32_t rearmed:1;   // reset in cb
+	uint32_t deleted:1;   // del_point in cb
+};
+
+LIST_HEAD(evdp_timer_wheel_list, evdp_timer_wheel_node);
+
+struct evdp_timer_wheel {
+	int64_t tick_ns;
+	uint64_t cur_tick; // the next tick to run
+	int count[EVDP_TIMER_WHEEL_LEVELS];
+	uint64_t l0_bitmap[EVDP_TIMER_WHEEL_SIZE / 64]; // may have stale bits
+	struct evdp_timer_wheel_list slots[EVDP_TIMER_WHEEL_LEVELS][EVDP_TIMER_WHEEL_SIZE];
+	struct evdp_timer_wheel_list keeplist;
+	struct evdp_timer_wheel_list expired; // carried over by the round budget
+	struct {
+		struct evdp_timer_wheel_node **nodes;
+		int size;
+		int count;
+	} ncache;
+};
+
 struct neb_evdp_timer {
+	struct evdp_timer_wheel *wheel; // use wheel instead of rbtree if set
 	rb_tree_t rbtree;
 	struct {
 		struct evdp_timer_rbtree_node **nodes;
@@ -43,7 +80,45 @@ struct neb_evdp_timer {
 
 extern struct timespec *evdp_timer_fetch_neareast_ts(neb_evdp_timer_t t, struct timespec *cur_ts)
 	_nattr_nonnull((1, 2)) _nattr_warn_unused_result _nattr_hidden;
-extern int evdp_timer_run_until(neb_evdp_timer_t t, struct timespec *abs_ts)
+/**
+ * \param[in] count callbacks already run in this round
+ * \param[in] max_count 0 for no limit
+ * \param[in] deadline_ns CLOCK_MONOTONIC time in ns, 0 for no limit
+ */
+static inline int evdp_round_budget_exhausted(int count, int max_count, uint64_t deadline_ns)
+{
+	if (max_count > 0 && count >= max_count)
+		return 1;
+	if (deadline_ns && evdp_instr_now_ns() >= deadline_ns)
+		return 1;
+	return 0;
+}
+
+/**
+ * \param[in] instr NULL if not instrumented
+ * \param[in] max_count max callbacks to run, 0 for no limit
+ * \param[in] deadline_ns see evdp_round_budget_exhausted
+ * \return callbacks run, at least one is run if any expired, and the rest
+ *         will be run in the next call
+ */
+extern int evdp_timer_run_until(neb_evdp_timer_t t, struct timespec *abs_ts, struct evdp_queue_instr *instr,
+                                int max_count, uint64_t deadline_ns)
+	_nattr_nonnull((1)) _nattr_hidden;
+
+extern struct evdp_timer_wheel *evdp_timer_wheel_create(int tick_usec, int ncache_size)
+	_nattr_warn_unused_result _nattr_hidden;
+extern void evdp_timer_wheel_destroy(struct evdp_timer_wheel *w)
 	_nattr_nonnull((1)) _nattr_hidden;
+extern void *evdp_timer_wheel_new_point(struct evdp_timer_wheel *w, struct timespec *abs_ts, neb_evdp_timeout_handler_t cb, void *udata)
+	_nattr_warn_unused_result _nattr_nonnull((1, 2, 3)) _nattr_hidden;
+extern void evdp_timer_wheel_del_point(struct evdp_timer_wheel *w, void *p)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
+extern void evdp_timer_wheel_point_reset(struct evdp_timer_wheel *w, void *p, struct timespec *abs_ts)
+	_nattr_nonnull((1, 2, 3)) _nattr_hidden;
+extern struct timespec *evdp_timer_wheel_fetch_nearest_ts(struct evdp_timer_wheel *w, struct timespec *cur_ts)
+	_nattr_nonnull((1, 2)) _nattr_warn_unused_result _nattr_hidden;
+extern int evdp_timer_wheel_run_until(struct evdp_timer_wheel *w, struct timespec *abs_ts, struct evdp_queue_instr *instr,
+                                      int max_count, uint64_t deadline_ns)
+	_nattr_nonnull((1, 2)) _nattr_hidden;
 
 #endif
@@ -0,0 +1,382 @@
+
+#include <nebase/syslog.h>
+#include <nebase/time.h>
+
+#include "timer.h"
+#include "instr.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Hierarchical timing wheel, see "Hashed and Hierarchical Timing Wheels"
+ *
+ * Level n holds nodes that will expire within 2^(8*(n+1)) ticks, and nodes in
+ * level n > 0 will be cascaded to lower levels when the lower wheel wraps.
+ */
+
+#define WHEEL_LEVEL_SHIFT(l) ((l) * EVDP_TIMER_WHEEL_BITS)
+#define WHEEL_LEVEL_SPAN(l) ((uint64_t)1 << WHEEL_LEVEL_SHIFT((l) + 1))
+#define WHEEL_MAX_DELTA (WHEEL_LEVEL_SPAN(EVDP_TIMER_WHEEL_LEVELS - 1) - 1)
+
+static inline int64_t timespec_to_ns(const struct timespec *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000000 + ts->tv_nsec;
+}
+
+static inline uint64_t wheel_tick_ceil(const struct evdp_timer_wheel *w, const struct timespec *ts)
+{
+	int64_t ns = timespec_to_ns(ts);
+	if (ns <= 0)
+		return 0;
+	return (ns + w->tick_ns - 1) / w->tick_ns;
+}
+
+static inline uint64_t wheel_tick_floor(const struct evdp_timer_wheel *w, const struct timespec *ts)
+{
+	int64_t ns = timespec_to_ns(ts);
+	if (ns <= 0)
+		return 0;
+	return ns / w->tick_ns;
+}
+
+static struct evdp_timer_wheel_node *wheel_node_new(struct evdp_timer_wheel *w, neb_evdp_timeout_handler_t cb, void *udata)
+{
+	struct evdp_timer_wheel_node *n;
+	if (w->ncache.count) {
+		n = w->ncache.nodes[w->ncache.count - 1];
+		w->ncache.count -= 1;
+		memset(n, 0, sizeof(*n));
+	} else {
+		n = calloc(1, sizeof(struct evdp_timer_wheel_node));
+		if (!n) {
+			neb_syslogl(LOG_ERR, "calloc: %m");
+			return NULL;
+		}
+	}
+
+	n->on_timeout = cb;
+	n->udata = udata;
+	n->level = -1;
+
+	return n;
+}
+
+static void wheel_node_free(struct evdp_timer_wheel *w, struct evdp_timer_wheel_node *n)
+{
+	if (w->ncache.count < w->ncache.size) {
+		w->ncache.nodes[w->ncache.count] = n;
+		w->ncache.count += 1;
+	} else {
+		free(n);
+	}
+}
+
+static void wheel_add_node(struct evdp_timer_wheel *w, struct evdp_timer_wheel_node *n)
+{
+	uint64_t expires = n->expires;
+	if (expires < w->cur_tick)
+		expires = w->cur_tick; // already expired, run it at the next tick
+	uint64_t delta = expires - w->cur_tick;
+	if (delta > WHEEL_MAX_DELTA) { // will be re-added after cascade
+		delta = WHEEL_MAX_DELTA;
+		expires = w->cur_tick + delta;
+	}
+
+	int level = 0;
+	while (level < EVDP_TIMER_WHEEL_LEVELS - 1 && delta >= WHEEL_LEVEL_SPAN(level))
+		level++;
+
+	int slot = (expires >> WHEEL_LEVEL_SHIFT(level)) & EVDP_TIMER_WHEEL_MASK;
+	LIST_INSERT_HEAD(&w->slots[level][slot], n, list);
+	n->level = level;
+	w->count[level]++;
+	if (level == 0)
+		w->l0_bitmap[slot >> 6] |= (uint64_t)1 << (slot & 63);
+}
+
+static void wheel_remove_node(struct evdp_timer_wheel *w, struct evdp_timer_wheel_node *n)
+{
+	LIST_REMOVE(n, list); // either in wheel slot or in keeplist
+	if (n->level >= 0) {
+		w->count[n->level]--;
+		n->level = -1;
+	}
+}
+
+static int wheel_cascade(struct evdp_timer_wheel *w, int level)
+{
+	int slot = (w->cur_tick >> WHEEL_LEVEL_SHIFT(level)) & EVDP_TIMER_WHEEL_MASK;
+	struct evdp_timer_wheel_list *head = &w->slots[level][slot];
+
+	struct evdp_timer_wheel_node *n;
+	while ((n = LIST_FIRST(head)) != NULL) {
+		wheel_remove_node(w, n);
+		wheel_add_node(w, n);
+	}
+
+	return slot;
+}
+
+struct evdp_timer_wheel *evdp_timer_wheel_create(int tick_usec, int ncache_size)
+{
+	if (tick_usec <= 0)
+		tick_usec = NEB_EVDP_TIMER_WHEEL_DEFAULT_TICK_USEC;
+
+	struct timespec ts;
+	if (neb_time_gettime_fast(&ts) != 0)
+		return NULL;
+
+	struct evdp_timer_wheel *w = calloc(1, sizeof(struct evdp_timer_wheel));
+	if (!w) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+
+	w->tick_ns = (int64_t)tick_usec * 1000;
+	w->cur_tick = wheel_tick_floor(w, &ts);
+	for (int l = 0; l < EVDP_TIMER_WHEEL_LEVELS; l++) {
+		for (int i = 0; i < EVDP_TIMER_WHEEL_SIZE; i++)
+			LIST_INIT(&w->slots[l][i]);
+	}
+	LIST_INIT(&w->keeplist);
+	LIST_INIT(&w->expired);
+
+	w->ncache.size = ncache_size;
+	if (ncache_size > 0) {
+		w->ncache.nodes = malloc(ncache_size * sizeof(struct evdp_timer_wheel_node *));
+		if (!w->ncache.nodes) {
+			neb_syslogl(LOG_ERR, "malloc: %m");
+			evdp_timer_wheel_destroy(w);
+			return NULL;
+		}
+	} else {
+		w->ncache.size = 0;
+	}
+	w->ncache.count = 0;
+
+	return w;
+}
+
+static void wheel_list_free_all(struct evdp_timer_wheel_list *head)
+{
+	struct evdp_timer_wheel_node *n, *next;
+	LIST_FOREACH_SAFE(n, head, list, next) {
+		free(n);
+	}
+	LIST_INIT(head);
+}
+
+void evdp_timer_wheel_destroy(struct evdp_timer_wheel *w)
+{
+	for (int l = 0; l < EVDP_TIMER_WHEEL_LEVELS; l++) {
+		if (!w->count[l])
+			continue;
+		for (int i = 0; i < EVDP_TIMER_WHEEL_SIZE; i++)
+			wheel_list_free_all(&w->slots[l][i]);
+	}
+	wheel_list_free_all(&w->keeplist);
+	wheel_list_free_all(&w->expired);
+
+	if (w->ncache.nodes) {
+		for (int i = 0; i < w->ncache.count; i++)
+			free(w->ncache.nodes[i]);
+		free(w->ncache.nodes);
+	}
+
+	free(w);
+}
+
+void *evdp_timer_wheel_new_point(struct evdp_timer_wheel *w, struct timespec *abs_ts, neb_evdp_timeout_handler_t cb, void *udata)
+{
+	struct evdp_timer_wheel_node *n = wheel_node_new(w, cb, udata);
+	if (!n)
+		return NULL;
+
+	n->expires = wheel_tick_ceil(w, abs_ts);
+	wheel_add_node(w, n);
+
+	return n;
+}
+
+void evdp_timer_wheel_del_point(struct evdp_timer_wheel *w, void *p)
+{
+	struct evdp_timer_wheel_node *n = p;
+
+	if (n->running) {
+		n->deleted = 1; // will be freed after the callback
+		return;
+	}
+
+	wheel_remove_node(w, n);
+	wheel_node_free(w, n);
+}
+
+void evdp_timer_wheel_point_reset(struct evdp_timer_wheel *w, void *p, struct timespec *abs_ts)
+{
+	struct evdp_timer_wheel_node *n = p;
+
+	n->expires = wheel_tick_ceil(w, abs_ts);
+	if (n->running) {
+		n->rearmed = 1; // The insert will happen after the callback
+		return;
+	}
+
+	wheel_remove_node(w, n);
+	wheel_add_node(w, n);
+}
+
+static int wheel_l0_next_slot(struct evdp_timer_wheel *w, int from)
+{
+	for (int i = 0; i < EVDP_TIMER_WHEEL_SIZE; ) {
+		int slot = (from + i) & EVDP_TIMER_WHEEL_MASK;
+		uint64_t bits = w->l0_bitmap[slot >> 6] >> (slot & 63);
+		if (!bits) {
+			i += 64 - (slot & 63);
+			continue;
+		}
+		slot += __builtin_ctzll(bits);
+		i = (slot - from) & EVDP_TIMER_WHEEL_MASK;
+		if (!LIST_EMPTY(&w->slots[0][slot]))
+			return i;
+		w->l0_bitmap[slot >> 6] &= ~((uint64_t)1 << (slot & 63)); // stale
+		i += 1;
+	}
+	return -1;
+}
+
+struct timespec *evdp_timer_wheel_fetch_nearest_ts(struct evdp_timer_wheel *w, struct timespec *cur_ts)
+{
+	if (!LIST_EMPTY(&w->expired)) {
+		neb_timespecclear(cur_ts);
+		return cur_ts;
+	}
+
+	uint64_t next_tick;
+	if (!(w->cur_tick & EVDP_TIMER_WHEEL_MASK) &&
+	    (w->count[1] || w->count[2] || w->count[3])) {
+		// the cascade at cur_tick is still pending
+		next_tick = w->cur_tick;
+	} else if (w->count[0]) {
+		int d = wheel_l0_next_slot(w, w->cur_tick & EVDP_TIMER_WHEEL_MASK);
+		if (d < 0) // should not happen
+			d = 0;
+		next_tick = w->cur_tick + d;
+		// nodes cascaded from higher levels may expire earlier
+		uint64_t cascade_tick = (w->cur_tick | EVDP_TIMER_WHEEL_MASK) + 1;
+		if (next_tick > cascade_tick && (w->count[1] || w->count[2] || w->count[3]))
+			next_tick = cascade_tick;
+	} else {
+		int level = 1;
+		while (level < EVDP_TIMER_WHEEL_LEVELS && !w->count[level])
+			level++;
+		if (level == EVDP_TIMER_WHEEL_LEVELS)
+			return NULL;
+		// wake up at the next cascade point, which may be a little earlier
+		next_tick = (w->cur_tick | (((uint64_t)1 << WHEEL_LEVEL_SHIFT(level)) - 1)) + 1;
+	}
+
+	int64_t delta_ns = (int64_t)next_tick * w->tick_ns - timespec_to_ns(cur_ts);
+	if (delta_ns <= 0) {
+		neb_timespecclear(cur_ts);
+	} else {
+		cur_ts->tv_sec = delta_ns / 1000000000;
+		cur_ts->tv_nsec = delta_ns % 1000000000;
+	}
+	return cur_ts;
+}
+
+/**
+ * \return the new count, nodes left in head if the budget is exhausted
+ */
+static int wheel_run_list(struct evdp_timer_wheel *w, struct evdp_timer_wheel_list *head, struct evdp_queue_instr *instr,
+                          int count, int max_count, uint64_t deadline_ns)
+{
+	struct evdp_timer_wheel_node *n;
+	while ((n = LIST_FIRST(head)) != NULL) {
+		if (count && evdp_round_budget_exhausted(count, max_count, deadline_ns))
+			break;
+		LIST_REMOVE(n, list);
+		uint64_t start_ns = 0;
+		if (instr) { // the scheduled time is rounded up to tick
+			start_ns = evdp_instr_now_ns();
+			uint64_t sched_ns = n->expires * w->tick_ns;
+			uint64_t fire_ns = evdp_instr_timer_now_ns();
+			evdp_hist_record(&instr->hists[NEB_EVDP_HIST_TIMER_LAG], fire_ns > sched_ns ? fire_ns - sched_ns : 0);
+		}
+		n->running = 1;
+		neb_evdp_timeout_ret_t tret = n->on_timeout(n->udata);
+		n->running = 0;
+		if (instr)
+			evdp_instr_record_since(instr, NEB_EVDP_HIST_CB_TIMER, start_ns);
+		count += 1;
+		if (n->deleted) { // del_point is called in cb
+			wheel_node_free(w, n);
+			continue;
+		}
+		switch (tret) {
+		case NEB_EVDP_TIMEOUT_FREE: // free even if reset in cb
+			wheel_node_free(w, n);
+			break;
+		case NEB_EVDP_TIMEOUT_KEEP:
+		default:
+			if (n->rearmed) {
+				n->rearmed = 0;
+				wheel_add_node(w, n);
+			} else {
+				LIST_INSERT_HEAD(&w->keeplist, n, list);
+			}
+			break;
+		}
+	}
+	return count;
+}
+
+int evdp_timer_wheel_run_until(struct evdp_timer_wheel *w, struct timespec *abs_ts, struct evdp_queue_instr *instr,
+                               int max_count, uint64_t deadline_ns)
+{
+	int count = wheel_run_list(w, &w->expired, instr, 0, max_count, deadline_ns);
+	if (!LIST_EMPTY(&w->expired))
+		return count;
+
+	uint64_t end_tick = wheel_tick_floor(w, abs_ts);
+	while (w->cur_tick <= end_tick) {
+		int slot = w->cur_tick & EVDP_TIMER_WHEEL_MASK;
+		if (!slot) {
+			for (int l = 1; l < EVDP_TIMER_WHEEL_LEVELS; l++) {
+				if (wheel_cascade(w, l) != 0)
+					break;
+			}
+		}
+
+		if (!w->count[0]) { // jump to the next cascade point
+			int level = 1;
+			while (level < EVDP_TIMER_WHEEL_LEVELS && !w->count[level])
+				level++;
+			if (level == EVDP_TIMER_WHEEL_LEVELS) {
+				w->cur_tick = end_tick + 1;
+				break;
+			}
+			uint64_t next_tick = (w->cur_tick | (((uint64_t)1 << WHEEL_LEVEL_SHIFT(level)) - 1)) + 1;
+			if (next_tick > end_tick + 1)
+				next_tick = end_tick + 1;
+			w->cur_tick = next_tick;
+			continue;
+		}
+
+		struct evdp_timer_wheel_node *n;
+		while ((n = LIST_FIRST(&w->slots[0][slot])) != NULL) {
+			wheel_remove_node(w, n);
+			LIST_INSERT_HEAD(&w->expired, n, list);
+		}
+		w->l0_bitmap[slot >> 6] &= ~((uint64_t)1 << (slot & 63));
+
+		// nodes added in cb should go to the next tick
+		w->cur_tick++;
+		count = wheel_run_list(w, &w->expired, instr, count, max_count, deadline_ns);
+		if (!LIST_EMPTY(&w->expired))
+			break;
+	}
+
+	return count;
+}
@@ -0,0 +1,623 @@
+
+#include "options.h"
+
+#include <nebase/syslog.h>
+#include <nebase/iobuf.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#define IOBUF_BLOCK_ALIGN 16 // for SIMD loads on data, malloc returns at least this
+#define IOBUF_SEGS_MIN 4
+
+struct iobuf_block {
+	neb_iobuf_pool_t pool;
+	struct iobuf_block *next_free;
+	int refcnt;
+	_Alignas(IOBUF_BLOCK_ALIGN) char data[];
+};
+
+_Static_assert(offsetof(struct iobuf_block, data) % IOBUF_BLOCK_ALIGN == 0, "iobuf block data should be aligned");
+
+struct iobuf_arena {
+	struct iobuf_arena *next;
+	_Alignas(IOBUF_BLOCK_ALIGN) char blocks[];
+};
+
+struct neb_iobuf_pool {
+	size_t block_size;
+	size_t block_stride;
+	int arena_blocks;
+	int destroyed; // freed after all blocks are released
+	struct iobuf_arena *arenas;
+	struct iobuf_block *free_blocks;
+	struct neb_iobuf_pool_stats stats;
+};
+
+struct iobuf_seg {
+	struct iobuf_block *blk;
+	size_t off;
+	size_t len;
+};
+
+struct neb_iobuf {
+	neb_iobuf_pool_t pool;
+	struct iobuf_seg *segs; // used ones are [first, first + count)
+	int first;
+	int count;
+	int cap;
+	int rsv_start; // the first seg with reserved room, -1 if not reserved
+	size_t len;
+};
+
+#define IOBUF_SEG(b, i) (&(b)->segs[(b)->first + (i)])
+
+static void iobuf_pool_free(neb_iobuf_pool_t p)
+{
+	struct iobuf_arena *a = p->arenas;
+	while (a) {
+		struct iobuf_arena *next = a->next;
+		free(a);
+		a = next;
+	}
+	free(p);
+}
+
+neb_iobuf_pool_t neb_iobuf_pool_create(size_t block_size, int arena_blocks)
+{
+	neb_iobuf_pool_t p = calloc(1, sizeof(struct neb_iobuf_pool));
+	if (!p) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	p->block_size = block_size ? block_size : NEB_IOBUF_DEFAULT_BLOCK_SIZE;
+	p->block_stride = sizeof(struct iobuf_block) + p->block_size;
+	p->block_stride = (p->block_stride + IOBUF_BLOCK_ALIGN - 1) & ~((size_t)IOBUF_BLOCK_ALIGN - 1);
+	p->arena_blocks = arena_blocks > 0 ? arena_blocks : NEB_IOBUF_DEFAULT_ARENA_BLOCKS;
+	return p;
+}
+
+void neb_iobuf_pool_destroy(neb_iobuf_pool_t p)
+{
+	if (p->stats.blocks_used)
+		p->destroyed = 1;
+	else
+		iobuf_pool_free(p);
+}
+
+size_t neb_iobuf_pool_block_size(neb_iobuf_pool_t p)
+{
+	return p->block_size;
+}
+
+void neb_iobuf_pool_get_stats(neb_iobuf_pool_t p, struct neb_iobuf_pool_stats *stats)
+{
+	*stats = p->stats;
+}
+
+static struct iobuf_block *iobuf_pool_get_block(neb_iobuf_pool_t p)
+{
+	if (!p->free_blocks) {
+		struct iobuf_arena *a = malloc(sizeof(struct iobuf_arena) + p->block_stride * p->arena_blocks);
+		if (!a) {
+			neb_syslogl(LOG_ERR, "malloc: %m");
+			return NULL;
+		}
+		a->next = p->arenas;
+		p->arenas = a;
+		for (int i = p->arena_blocks - 1; i >= 0; i--) {
+			struct iobuf_block *blk = (struct iobuf_block *)(a->blocks + p->block_stride * i);
+			blk->pool = p;
+			blk->next_free = p->free_blocks;
+			p->free_blocks = blk;
+		}
+		p->stats.arenas++;
+		p->stats.blocks += p->arena_blocks;
+	}
+
+	struct iobuf_block *blk = p->free_blocks;
+	p->free_blocks = blk->next_free;
+	blk->next_free = NULL;
+	blk->refcnt = 1;
+	p->stats.blocks_used++;
+	return blk;
+}
+
+static void iobuf_block_unref(struct iobuf_block *blk)
+{
+	if (--blk->refcnt > 0)
+		return;
+
+	neb_iobuf_pool_t p = blk->pool;
+	blk->next_free = p->free_blocks;
+	p->free_blocks = blk;
+	p->stats.blocks_used--;
+	if (p->destroyed && !p->stats.blocks_used)
+		iobuf_pool_free(p);
+}
+
+/**
+ * \return the free room after the seg, 0 if the block is shared
+ */
+static size_t iobuf_seg_tailroom(const struct iobuf_seg *seg)
+{
+	if (seg->blk->refcnt != 1)
+		return 0;
+	return seg->blk->pool->block_size - seg->off - seg->len;
+}
+
+static size_t iobuf_seg_headroom(const struct iobuf_seg *seg)
+{
+	if (seg->blk->refcnt != 1)
+		return 0;
+	return seg->off;
+}
+
+/**
+ * \brief make sure there are free seg slots before and after used ones
+ */
+static int iobuf_segs_prepare(neb_iobuf_t b, int head, int tail)
+{
+	if (b->first >= head && b->cap - b->first - b->count >= tail)
+		return 0;
+
+	int need = head + b->count + tail;
+	if (need > b->cap) {
+		int cap = b->cap ? b->cap : IOBUF_SEGS_MIN;
+		while (cap < need)
+			cap <<= 1;
+		struct iobuf_seg *segs = realloc(b->segs, sizeof(struct iobuf_seg) * cap);
+		if (!segs) {
+			neb_syslogl(LOG_ERR, "realloc: %m");
+			return -1;
+		}
+		b->segs = segs;
+		b->cap = cap;
+	}
+
+	int first = head ? head + (b->cap - need) / 2 : 0;
+	if (b->count)
+		memmove(b->segs + first, b->segs + b->first, sizeof(struct iobuf_seg) * b->count);
+	b->first = first;
+	return 0;
+}
+
+static void iobuf_drop_empty_tail(neb_iobuf_t b)
+{
+	while (b->count) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, b->count - 1);
+		if (seg->len)
+			break;
+		iobuf_block_unref(seg->blk);
+		b->count--;
+	}
+	if (!b->count)
+		b->first = 0;
+}
+
+neb_iobuf_t neb_iobuf_new(neb_iobuf_pool_t p)
+{
+	neb_iobuf_t b = calloc(1, sizeof(struct neb_iobuf));
+	if (!b) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	b->pool = p;
+	b->rsv_start = -1;
+	return b;
+}
+
+void neb_iobuf_del(neb_iobuf_t b)
+{
+	neb_iobuf_clear(b);
+	free(b->segs);
+	free(b);
+}
+
+void neb_iobuf_clear(neb_iobuf_t b)
+{
+	for (int i = 0; i < b->count; i++)
+		iobuf_block_unref(IOBUF_SEG(b, i)->blk);
+	b->first = 0;
+	b->count = 0;
+	b->rsv_start = -1;
+	b->len = 0;
+}
+
+size_t neb_iobuf_len(neb_iobuf_t b)
+{
+	return b->len;
+}
+
+int neb_iobuf_append(neb_iobuf_t b, const void *data, size_t len)
+{
+	const char *p = data;
+	if (b->count && len) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, b->count - 1);
+		size_t n = iobuf_seg_tailroom(seg);
+		if (n > len)
+			n = len;
+		memcpy(seg->blk->data + seg->off + seg->len, p, n);
+		seg->len += n;
+		b->len += n;
+		p += n;
+		len -= n;
+	}
+
+	size_t block_size = b->pool->block_size;
+	while (len) {
+		if (iobuf_segs_prepare(b, 0, 1) != 0)
+			return -1;
+		struct iobuf_block *blk = iobuf_pool_get_block(b->pool);
+		if (!blk)
+			return -1;
+		size_t n = len < block_size ? len : block_size;
+		memcpy(blk->data, p, n);
+
+		struct iobuf_seg *seg = IOBUF_SEG(b, b->count);
+		seg->blk = blk;
+		seg->off = 0;
+		seg->len = n;
+		b->count++;
+		b->len += n;
+		p += n;
+		len -= n;
+	}
+	return 0;
+}
+
+int neb_iobuf_prepend(neb_iobuf_t b, const void *data, size_t len)
+{
+	const char *end = (const char *)data + len;
+	if (b->count && len) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, 0);
+		size_t n = iobuf_seg_headroom(seg);
+		if (n > len)
+			n = len;
+		seg->off -= n;
+		seg->len += n;
+		memcpy(seg->blk->data + seg->off, end - n, n);
+		b->len += n;
+		end -= n;
+		len -= n;
+	}
+
+	size_t block_size = b->pool->block_size;
+	while (len) {
+		if (iobuf_segs_prepare(b, 1, 0) != 0)
+			return -1;
+		struct iobuf_block *blk = iobuf_pool_get_block(b->pool);
+		if (!blk)
+			return -1;
+		size_t n = len < block_size ? len : block_size;
+		// put at the end of the block, so the head room could be used later
+		memcpy(blk->data + block_size - n, end - n, n);
+
+		b->first--;
+		b->count++;
+		struct iobuf_seg *seg = IOBUF_SEG(b, 0);
+		seg->blk = blk;
+		seg->off = block_size - n;
+		seg->len = n;
+		b->len += n;
+		end -= n;
+		len -= n;
+	}
+	return 0;
+}
+
+int neb_iobuf_append_buf(neb_iobuf_t dst, neb_iobuf_t src)
+{
+	if (dst == src) {
+		neb_syslog(LOG_ERR, "It's not allowed to append iobuf %p to itself", src);
+		return -1;
+	}
+	if (!src->count)
+		return 0;
+	if (iobuf_segs_prepare(dst, 0, src->count) != 0)
+		return -1;
+
+	memcpy(IOBUF_SEG(dst, dst->count), IOBUF_SEG(src, 0), sizeof(struct iobuf_seg) * src->count);
+	dst->count += src->count;
+	dst->len += src->len;
+	src->first = 0;
+	src->count = 0;
+	src->len = 0;
+	return 0;
+}
+
+int neb_iobuf_prepend_buf(neb_iobuf_t dst, neb_iobuf_t src)
+{
+	if (dst == src) {
+		neb_syslog(LOG_ERR, "It's not allowed to prepend iobuf %p to itself", src);
+		return -1;
+	}
+	if (!src->count)
+		return 0;
+	if (iobuf_segs_prepare(dst, src->count, 0) != 0)
+		return -1;
+
+	dst->first -= src->count;
+	memcpy(IOBUF_SEG(dst, 0), IOBUF_SEG(src, 0), sizeof(struct iobuf_seg) * src->count);
+	dst->count += src->count;
+	dst->len += src->len;
+	src->first = 0;
+	src->count = 0;
+	src->len = 0;
+	return 0;
+}
+
+neb_iobuf_t neb_iobuf_slice(neb_iobuf_t b, size_t off, size_t len)
+{
+	if (off > b->len || len > b->len - off) {
+		neb_syslog(LOG_ERR, "Invalid slice [%zu, +%zu) for iobuf of len %zu", off, len, b->len);
+		return NULL;
+	}
+
+	neb_iobuf_t nb = neb_iobuf_new(b->pool);
+	if (!nb)
+		return NULL;
+	for (int i = 0; i < b->count && len; i++) {
+		const struct iobuf_seg *seg = IOBUF_SEG(b, i);
+		if (off >= seg->len) {
+			off -= seg->len;
+			continue;
+		}
+		if (iobuf_segs_prepare(nb, 0, 1) != 0) {
+			neb_iobuf_del(nb);
+			return NULL;
+		}
+		size_t n = seg->len - off;
+		if (n > len)
+			n = len;
+		struct iobuf_seg *nseg = IOBUF_SEG(nb, nb->count);
+		nseg->blk = seg->blk;
+		nseg->off = seg->off + off;
+		nseg->len = n;
+		seg->blk->refcnt++;
+		nb->count++;
+		nb->len += n;
+		off = 0;
+		len -= n;
+	}
+	return nb;
+}
+
+neb_iobuf_t neb_iobuf_split(neb_iobuf_t b, size_t off)
+{
+	if (off > b->len) {
+		neb_syslog(LOG_ERR, "Invalid split offset %zu for iobuf of len %zu", off, b->len);
+		return NULL;
+	}
+
+	neb_iobuf_t nb = neb_iobuf_new(b->pool);
+	if (!nb)
+		return NULL;
+
+	int i = 0;
+	size_t pos = 0;
+	for (; i < b->count; i++) {
+		const struct iobuf_seg *seg = IOBUF_SEG(b, i);
+		if (pos + seg->len > off)
+			break;
+		pos += seg->len;
+	}
+	if (i == b->count)
+		return nb;
+
+	int moved = b->count - i;
+	if (iobuf_segs_prepare(nb, 0, moved) != 0) {
+		neb_iobuf_del(nb);
+		return NULL;
+	}
+	memcpy(IOBUF_SEG(nb, 0), IOBUF_SEG(b, i), sizeof(struct iobuf_seg) * moved);
+	nb->count = moved;
+	nb->len = b->len - off;
+	b->count = i;
+	b->len = off;
+
+	size_t k = off - pos;
+	if (k) { // the seg is shared by both
+		struct iobuf_seg *seg = IOBUF_SEG(nb, 0);
+		struct iobuf_seg *bseg = IOBUF_SEG(b, b->count);
+		bseg->blk = seg->blk;
+		bseg->off = seg->off;
+		bseg->len = k;
+		b->count++;
+		seg->blk->refcnt++;
+		seg->off += k;
+		seg->len -= k;
+	}
+	if (!b->count)
+		b->first = 0;
+	return nb;
+}
+
+void neb_iobuf_consume(neb_iobuf_t b, size_t len)
+{
+	while (len && b->count) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, 0);
+		if (seg->len > len) {
+			seg->off += len;
+			seg->len -= len;
+			b->len -= len;
+			break;
+		}
+		len -= seg->len;
+		b->len -= seg->len;
+		iobuf_block_unref(seg->blk);
+		b->first++;
+		b->count--;
+	}
+	if (!b->count)
+		b->first = 0;
+}
+
+void neb_iobuf_truncate(neb_iobuf_t b, size_t len)
+{
+	if (len >= b->len)
+		return;
+
+	size_t pos = 0;
+	int keep = 0;
+	for (; keep < b->count; keep++) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, keep);
+		if (pos + seg->len >= len) {
+			seg->len = len - pos;
+			if (seg->len)
+				keep++;
+			break;
+		}
+		pos += seg->len;
+	}
+	for (int i = keep; i < b->count; i++)
+		iobuf_block_unref(IOBUF_SEG(b, i)->blk);
+	b->count = keep;
+	b->len = len;
+	if (!b->count)
+		b->first = 0;
+}
+
+int neb_iobuf_export_iov(neb_iobuf_t b, struct iovec *iov, int iovcnt)
+{
+	int n = 0;
+	for (; n < b->count && n < iovcnt; n++) {
+		const struct iobuf_seg *seg = IOBUF_SEG(b, n);
+		iov[n].iov_base = seg->blk->data + seg->off;
+		iov[n].iov_len = seg->len;
+	}
+	return n;
+}
+
+int neb_iobuf_reserve(neb_iobuf_t b, size_t size, struct iovec *iov, int iovcnt)
+{
+	if (b->rsv_start >= 0) {
+		neb_syslog(LOG_ERR, "iobuf %p is already reserved", b);
+		return -1;
+	}
+
+	int n = 0;
+	size_t room = 0;
+	int start = b->count;
+	if (b->count && iovcnt > 0) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, b->count - 1);
+		size_t r = iobuf_seg_tailroom(seg);
+		if (r) {
+			iov[n].iov_base = seg->blk->data + seg->off + seg->len;
+			iov[n].iov_len = r;
+			n++;
+			room += r;
+			start = b->count - 1;
+		}
+	}
+
+	size_t block_size = b->pool->block_size;
+	while (room < size) {
+		if (n >= iovcnt) {
+			neb_syslog(LOG_ERR, "%d iovec is not enough to reserve %zu bytes", iovcnt, size);
+			goto exit_rollback;
+		}
+		if (iobuf_segs_prepare(b, 0, 1) != 0)
+			goto exit_rollback;
+		struct iobuf_block *blk = iobuf_pool_get_block(b->pool);
+		if (!blk)
+			goto exit_rollback;
+
+		struct iobuf_seg *seg = IOBUF_SEG(b, b->count);
+		seg->blk = blk;
+		seg->off = 0;
+		seg->len = 0;
+		b->count++;
+		iov[n].iov_base = blk->data;
+		iov[n].iov_len = block_size;
+		n++;
+		room += block_size;
+	}
+
+	b->rsv_start = start;
+	return n;
+
+exit_rollback:
+	iobuf_drop_empty_tail(b);
+	return -1;
+}
+
+void neb_iobuf_commit(neb_iobuf_t b, size_t len)
+{
+	if (b->rsv_start < 0)
+		return;
+
+	for (int i = b->rsv_start; i < b->count && len; i++) {
+		struct iobuf_seg *seg = IOBUF_SEG(b, i);
+		size_t n = iobuf_seg_tailroom(seg);
+		if (n > len)
+			n = len;
+		seg->len += n;
+		b->len += n;
+		len -= n;
+	}
+	iobuf_drop_empty_tail(b);
+	b->rsv_start = -1;
+}
+
+size_t neb_iobuf_copyout(neb_iobuf_t b, size_t off, void *data, size_t len)
+{
+	char *p = data;
+	size_t copied = 0;
+	for (int i = 0; i < b->count && len; i++) {
+		const struct iobuf_seg *seg = IOBUF_SEG(b, i);
+		if (off >= seg->len) {
+			off -= seg->len;
+			continue;
+		}
+		size_t n = seg->len - off;
+		if (n > len)
+			n = len;
+		memcpy(p + copied, seg->blk->data + seg->off + off, n);
+		copied += n;
+		len -= n;
+		off = 0;
+	}
+	return copied;
+}
+
+void *neb_iobuf_pullup(neb_iobuf_t b, size_t len)
+{
+	if (!b->count || len > b->len || len > b->pool->block_size)
+		return NULL;
+
+	struct iobuf_seg *seg = IOBUF_SEG(b, 0);
+	if (seg->len >= len)
+		return seg->blk->data + seg->off;
+
+	struct iobuf_seg head;
+	if (iobuf_seg_tailroom(seg) >= len - seg->len) { // fill the first block
+		head = *seg;
+		neb_iobuf_copyout(b, head.len, head.blk->data + head.off + head.len, len - head.len);
+		b->first++;
+		b->count--;
+		b->len -= head.len;
+	} else {
+		struct iobuf_block *blk = iobuf_pool_get_block(b->pool);
+		if (!blk)
+			return NULL;
+		head.blk = blk;
+		head.off = 0;
+		head.len = 0;
+		neb_iobuf_copyout(b, 0, blk->data, len);
+	}
+	neb_iobuf_consume(b, len - head.len);
+	head.len = len;
+
+	// there is at least one free slot as one seg is removed above
+	if (iobuf_segs_prepare(b, 1, 0) != 0) {
+		iobuf_block_unref(head.blk);
+		return NULL;
+	}
+	b->first--;
+	b->count++;
+	*IOBUF_SEG(b, 0) = head;
+	b->len += len;
+	return head.blk->data + head.off;
+}
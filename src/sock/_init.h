@@ -5,5 +5,6 @@
 #include <nebase/cdefs.h>
 
 extern void neb_sock_unix_do_sysconf(void) _nattr_hidden;
+extern void neb_sock_csum_select_impl(void) _nattr_hidden;
 
 #endif
@@ -2,13 +2,26 @@
 #include <nebase/endian.h>
 #include <nebase/sock/csum.h>
 
+#include "_init.h"
+
 #include <sys/types.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+# define CSUM_USE_SSE2
+# define CSUM_USE_AVX2
+# include <immintrin.h>
+#elif defined(__aarch64__)
+# define CSUM_USE_NEON
+# include <arm_neon.h>
+#endif
 
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 #include <netinet/ip_icmp.h>
+#include <netinet/icmp6.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 
@@ -28,7 +41,11 @@ static inline uint16_t from32to16(uint32_t x)
 	return x;
 }
 
-static unsigned int do_csum(const u_char *buff, int len)
+/*
+ * scalar version ported from the kernel generic path, also used as the
+ * reference of the accelerated ones
+ */
+static unsigned int csum_generic(const u_char *buff, int len)
 {
 	int odd;
 	unsigned int result = 0;
@@ -82,6 +99,222 @@ out:
 	return result;
 }
 
+static inline uint32_t from64to32(uint64_t x)
+{
+	/* add up 32-bit and 32-bit for 32+c bit */
+	x = (x & 0xffffffff) + (x >> 32);
+	/* add up carry.. */
+	x = (x & 0xffffffff) + (x >> 32);
+	return (uint32_t)x;
+}
+
+/*
+ * The accelerated versions sum up 16-bit words at even offsets from buff by
+ * unaligned loads, so no byte swap is needed for odd addresses. Words are
+ * zero extended and added to 64-bit lanes, which will not overflow for any int
+ * length, and the tail is added by csum_tail64.
+ */
+
+static inline uint64_t add64_carry(uint64_t sum, uint64_t w)
+{
+	sum += w;
+	return sum + (sum < w);
+}
+
+static unsigned int csum_tail64(const u_char *buff, int len, uint64_t sum)
+{
+	while (len >= 8) {
+		uint64_t w;
+		memcpy(&w, buff, 8);
+		sum = add64_carry(sum, w);
+		buff += 8;
+		len -= 8;
+	}
+	if (len & 4) {
+		uint32_t w;
+		memcpy(&w, buff, 4);
+		sum = add64_carry(sum, w);
+		buff += 4;
+	}
+	if (len & 2) {
+		uint16_t w;
+		memcpy(&w, buff, 2);
+		sum = add64_carry(sum, w);
+		buff += 2;
+	}
+	if (len & 1)
+#if BYTE_ORDER == LITTLE_ENDIAN
+		sum = add64_carry(sum, *buff);
+#else
+		sum = add64_carry(sum, (uint64_t)*buff << 8);
+#endif
+	return from32to16(from64to32(sum));
+}
+
+#ifdef CSUM_USE_SSE2
+static unsigned int csum_sse2(const u_char *buff, int len)
+{
+	if (len < 64)
+		return csum_tail64(buff, len, 0);
+
+	const __m128i zero = _mm_setzero_si128();
+	__m128i acc0 = zero, acc1 = zero;
+
+	for (; len >= 64; len -= 64, buff += 64) {
+		for (int i = 0; i < 64; i += 32) {
+			__m128i v0 = _mm_loadu_si128((const __m128i *)(buff + i));
+			__m128i v1 = _mm_loadu_si128((const __m128i *)(buff + i + 16));
+			acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v0, zero));
+			acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v0, zero));
+			acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v1, zero));
+			acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v1, zero));
+		}
+	}
+	for (; len >= 16; len -= 16, buff += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)buff);
+		acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+		acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+	}
+
+	uint64_t lanes[4];
+	_mm_storeu_si128((__m128i *)lanes, acc0);
+	_mm_storeu_si128((__m128i *)(lanes + 2), acc1);
+	uint64_t sum = 0;
+	for (int i = 0; i < 4; i++)
+		sum = add64_carry(sum, lanes[i]);
+	return csum_tail64(buff, len, sum);
+}
+#endif
+
+#ifdef CSUM_USE_AVX2
+__attribute__((target("avx2")))
+static unsigned int csum_avx2(const u_char *buff, int len)
+{
+	if (len < 128)
+		return csum_sse2(buff, len);
+
+	const __m256i zero = _mm256_setzero_si256();
+	__m256i acc0 = zero, acc1 = zero;
+
+	for (; len >= 128; len -= 128, buff += 128) {
+		for (int i = 0; i < 128; i += 64) {
+			__m256i v0 = _mm256_loadu_si256((const __m256i *)(buff + i));
+			__m256i v1 = _mm256_loadu_si256((const __m256i *)(buff + i + 32));
+			acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+			acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+			acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+			acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+		}
+	}
+	for (; len >= 32; len -= 32, buff += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)buff);
+		acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+		acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+	}
+
+	uint64_t lanes[8];
+	_mm256_storeu_si256((__m256i *)lanes, acc0);
+	_mm256_storeu_si256((__m256i *)(lanes + 4), acc1);
+	uint64_t sum = 0;
+	for (int i = 0; i < 8; i++)
+		sum = add64_carry(sum, lanes[i]);
+	return csum_tail64(buff, len, sum);
+}
+#endif
+
+#ifdef CSUM_USE_NEON
+static unsigned int csum_neon(const u_char *buff, int len)
+{
+	if (len < 64)
+		return csum_tail64(buff, len, 0);
+
+	uint64x2_t acc0 = vdupq_n_u64(0), acc1 = vdupq_n_u64(0);
+
+	for (; len >= 64; len -= 64, buff += 64) {
+		acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(buff)));
+		acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(buff + 16)));
+		acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(buff + 32)));
+		acc1 = vpadalq_u32(acc1, vreinterpretq_u32_u8(vld1q_u8(buff + 48)));
+	}
+	for (; len >= 16; len -= 16, buff += 16)
+		acc0 = vpadalq_u32(acc0, vreinterpretq_u32_u8(vld1q_u8(buff)));
+
+	uint64_t sum = 0;
+	sum = add64_carry(sum, vgetq_lane_u64(acc0, 0));
+	sum = add64_carry(sum, vgetq_lane_u64(acc0, 1));
+	sum = add64_carry(sum, vgetq_lane_u64(acc1, 0));
+	sum = add64_carry(sum, vgetq_lane_u64(acc1, 1));
+	return csum_tail64(buff, len, sum);
+}
+#endif
+
+typedef unsigned int (*csum_func_t)(const u_char *buff, int len);
+
+static const struct {
+	const char *name;
+	csum_func_t func;
+} csum_impls[NEB_SOCK_CSUM_IMPL_MAX] = {
+	[NEB_SOCK_CSUM_IMPL_GENERIC] = {"generic", csum_generic},
+#ifdef CSUM_USE_SSE2
+	[NEB_SOCK_CSUM_IMPL_SSE2] = {"sse2", csum_sse2},
+#endif
+#ifdef CSUM_USE_AVX2
+	[NEB_SOCK_CSUM_IMPL_AVX2] = {"avx2", csum_avx2},
+#endif
+#ifdef CSUM_USE_NEON
+	[NEB_SOCK_CSUM_IMPL_NEON] = {"neon", csum_neon},
+#endif
+};
+
+static int csum_impl = NEB_SOCK_CSUM_IMPL_GENERIC;
+static csum_func_t do_csum = csum_generic;
+
+static int csum_impl_supported(int impl)
+{
+	if (impl < 0 || impl >= NEB_SOCK_CSUM_IMPL_MAX || !csum_impls[impl].func)
+		return 0;
+#ifdef CSUM_USE_AVX2
+	if (impl == NEB_SOCK_CSUM_IMPL_AVX2)
+		return __builtin_cpu_supports("avx2");
+#endif
+	return 1;
+}
+
+void neb_sock_csum_select_impl(void)
+{
+#ifdef CSUM_USE_AVX2
+	__builtin_cpu_init();
+#endif
+	for (int impl = NEB_SOCK_CSUM_IMPL_MAX - 1; impl > NEB_SOCK_CSUM_IMPL_GENERIC; impl--) {
+		if (csum_impl_supported(impl)) {
+			csum_impl = impl;
+			do_csum = csum_impls[impl].func;
+			return;
+		}
+	}
+}
+
+int neb_sock_csum_get_impl(void)
+{
+	return csum_impl;
+}
+
+int neb_sock_csum_set_impl(int impl)
+{
+	if (!csum_impl_supported(impl))
+		return -1;
+	csum_impl = impl;
+	do_csum = csum_impls[impl].func;
+	return 0;
+}
+
+const char *neb_sock_csum_impl_name(int impl)
+{
+	if (impl < 0 || impl >= NEB_SOCK_CSUM_IMPL_MAX || !csum_impls[impl].func)
+		return NULL;
+	return csum_impls[impl].name;
+}
+
 /*
  * computes the checksum of a memory block at buff, length len,
  * and adds in "sum" (32-bit)
@@ -106,15 +339,6 @@ static __wsum csum_partial(const void *buff, int len, __wsum wsum)
 	return (__wsum)result;
 }
 
-static inline uint32_t from64to32(uint64_t x)
-{
-	/* add up 32-bit and 32-bit for 32+c bit */
-	x = (x & 0xffffffff) + (x >> 32);
-	/* add up carry.. */
-	x = (x & 0xffffffff) + (x >> 32);
-	return (uint32_t)x;
-}
-
 static __wsum csum_tcpudp_nofold(in_addr_t saddr, in_addr_t daddr,
                                  unsigned short len, unsigned short proto,
                                  __wsum sum)
@@ -232,6 +456,34 @@ void neb_sock_csum_tcp6_fill(const struct ip6_hdr *ipheader, struct tcphdr *tcph
 	                                    csum_partial(tcpheader, l4len, 0));
 }
 
+void neb_sock_csum_udp4_fill(const struct ip *ipheader, struct udphdr *udpheader, int l4len)
+{
+	udpheader->uh_sum = 0;
+	udpheader->uh_sum = csum_tcpudp_magic(ipheader->ip_src.s_addr, ipheader->ip_dst.s_addr,
+	                                      l4len, IPPROTO_UDP,
+	                                      csum_partial(udpheader, l4len, 0));
+	if (udpheader->uh_sum == 0) // 0 means no checksum for udp
+		udpheader->uh_sum = 0xffff;
+}
+
+void neb_sock_csum_udp6_fill(const struct ip6_hdr *ipheader, struct udphdr *udpheader, int l4len)
+{
+	udpheader->uh_sum = 0;
+	udpheader->uh_sum = csum_ipv6_magic(&ipheader->ip6_src, &ipheader->ip6_dst,
+	                                    l4len, IPPROTO_UDP,
+	                                    csum_partial(udpheader, l4len, 0));
+	if (udpheader->uh_sum == 0)
+		udpheader->uh_sum = 0xffff;
+}
+
+void neb_sock_csum_icmp6_fill(const struct ip6_hdr *ipheader, struct icmp6_hdr *icmpheader, int l4len)
+{
+	icmpheader->icmp6_cksum = 0;
+	icmpheader->icmp6_cksum = csum_ipv6_magic(&ipheader->ip6_src, &ipheader->ip6_dst,
+	                                          l4len, IPPROTO_ICMPV6,
+	                                          csum_partial(icmpheader, l4len, 0));
+}
+
 void neb_sock_csum_icmp4_fill(struct icmp *icmpheader, int l4len)
 {
 	icmpheader->icmp_cksum = 0;
@@ -244,4 +496,41 @@ void neb_sock_csum_ip4_fill(struct ip *ipheader)
 	ipheader->ip_sum = ip_fast_csum(ipheader, ipheader->ip_hl);
 }
 
+uint16_t neb_sock_csum(const void *data, int len)
+{
+	return (uint16_t)~do_csum(data, len);
+}
+
+/*
+ * incremental update, see RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+ */
+
+uint16_t neb_sock_csum_update16(uint16_t csum, uint16_t from, uint16_t to)
+{
+	uint32_t sum = (uint16_t)~csum;
+	sum += (uint16_t)~from;
+	sum += to;
+	return (uint16_t)~from32to16(sum);
+}
 
+uint16_t neb_sock_csum_update32(uint16_t csum, uint32_t from, uint32_t to)
+{
+	uint64_t sum = (uint16_t)~csum;
+	sum += ~from;
+	sum += to;
+	return (uint16_t)~from32to16(from64to32(sum));
+}
+
+uint16_t neb_sock_csum_update_in6(uint16_t csum, const struct in6_addr *from, const struct in6_addr *to)
+{
+	uint32_t f[4], t[4];
+	memcpy(f, from, sizeof(f));
+	memcpy(t, to, sizeof(t));
+
+	uint64_t sum = (uint16_t)~csum;
+	for (int i = 0; i < 4; i++) {
+		sum += ~f[i];
+		sum += t[i];
+	}
+	return (uint16_t)~from32to16(from64to32(sum));
+}
@@ -7,6 +7,9 @@
 
 #include <unistd.h>
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <netinet/in.h>
 
 #ifdef IP_RECVIF
@@ -14,6 +17,22 @@
 #endif
 
 #define RECVMSG_CMSG_BUF_SIZE 10240 // see rfc3542 20.1
+#define RECVMSG_IOBUF_IOV_MAX 64
+#define RECVMMSG_CMSG_BUF_SIZE 256 // enough for timestamp and pktinfo
+#define RECVMMSG_CMSG_BUF_ALIGN 16 // keep cmsghdr aligned in each buffer
+
+#if defined(OS_LINUX) || defined(OS_FREEBSD) || defined(OS_NETBSD)
+# define USE_RECVMMSG
+#endif
+
+struct neb_sock_mmsg_ctx {
+	int vlen;
+	size_t cmsg_size;
+#ifdef USE_RECVMMSG
+	struct mmsghdr *hdrs;
+#endif
+	char *cmsg_bufs;
+};
 
 static int handle_cmsg(const struct cmsghdr *cmsg, neb_sock_cmsg_cb f, void *udata)
 {
@@ -161,6 +180,156 @@ ssize_t neb_sock_inet_recvmsg(int fd, struct neb_sock_msghdr *m)
 	}
 }
 
+ssize_t neb_sock_inet_recvmsg_iobuf(int fd, struct neb_sock_msghdr *m, neb_iobuf_t b, size_t size)
+{
+	struct iovec iov[RECVMSG_IOBUF_IOV_MAX];
+	int iovcnt = neb_iobuf_reserve(b, size, iov, RECVMSG_IOBUF_IOV_MAX);
+	if (iovcnt < 0)
+		return -1;
+
+	struct iovec *saved_iov = m->msg_iov;
+	size_t saved_iovlen = m->msg_iovlen;
+	m->msg_iov = iov;
+	m->msg_iovlen = iovcnt;
+	ssize_t nr = neb_sock_inet_recvmsg(fd, m);
+	m->msg_iov = saved_iov;
+	m->msg_iovlen = saved_iovlen;
+
+	neb_iobuf_commit(b, nr > 0 ? nr : 0);
+	return nr;
+}
+
+neb_sock_mmsg_ctx_t neb_sock_inet_mmsg_ctx_create(int vlen, size_t cmsg_size)
+{
+	if (vlen <= 0) {
+		neb_syslog(LOG_ERR, "Invalid vlen %d for mmsg ctx", vlen);
+		return NULL;
+	}
+	if (!cmsg_size)
+		cmsg_size = RECVMMSG_CMSG_BUF_SIZE;
+	cmsg_size = (cmsg_size + RECVMMSG_CMSG_BUF_ALIGN - 1) & ~((size_t)RECVMMSG_CMSG_BUF_ALIGN - 1);
+
+	neb_sock_mmsg_ctx_t ctx = calloc(1, sizeof(struct neb_sock_mmsg_ctx));
+	if (!ctx) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+	ctx->vlen = vlen;
+	ctx->cmsg_size = cmsg_size;
+	ctx->cmsg_bufs = malloc(cmsg_size * vlen);
+	if (!ctx->cmsg_bufs) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		neb_sock_inet_mmsg_ctx_destroy(ctx);
+		return NULL;
+	}
+#ifdef USE_RECVMMSG
+	ctx->hdrs = calloc(vlen, sizeof(struct mmsghdr));
+	if (!ctx->hdrs) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		neb_sock_inet_mmsg_ctx_destroy(ctx);
+		return NULL;
+	}
+#endif
+	return ctx;
+}
+
+void neb_sock_inet_mmsg_ctx_destroy(neb_sock_mmsg_ctx_t ctx)
+{
+#ifdef USE_RECVMMSG
+	free(ctx->hdrs);
+#endif
+	free(ctx->cmsg_bufs);
+	free(ctx);
+}
+
+static int mmsg_cmsg_cb(int level, int type, const u_char *data, size_t len _nattr_unused, void *udata)
+{
+	struct neb_sock_mmsghdr *m = udata;
+
+	if (level == IPPROTO_IPV6) {
+		if (type == IPV6_PKTINFO) {
+			struct in6_pktinfo info;
+			memcpy(&info, data, sizeof(info));
+			m->msg_ifindex = info.ipi6_ifindex;
+		}
+		return 0;
+	}
+	if (level != NEB_CMSG_LEVEL_COMPAT)
+		return 0;
+
+	switch (type) {
+	case NEB_CMSG_TYPE_TIMESTAMP:
+		memcpy(&m->msg_ts, data, sizeof(struct timespec));
+		break;
+	case NEB_CMSG_TYPE_IP4IFINDEX:
+		memcpy(&m->msg_ifindex, data, sizeof(unsigned int));
+		break;
+	default:
+		break;
+	}
+	return 0;
+}
+
+static void mmsg_init_hdr(neb_sock_mmsg_ctx_t ctx, int i, struct neb_sock_mmsghdr *m, struct msghdr *h)
+{
+	h->msg_name = &m->msg_peer;
+	h->msg_namelen = sizeof(m->msg_peer);
+	h->msg_iov = m->msg_iov;
+	h->msg_iovlen = m->msg_iovlen;
+	h->msg_control = ctx->cmsg_bufs + ctx->cmsg_size * i;
+	h->msg_controllen = ctx->cmsg_size;
+	h->msg_flags = 0;
+}
+
+static void mmsg_parse_hdr(struct neb_sock_mmsghdr *m, struct msghdr *h, size_t len)
+{
+	m->msg_len = len;
+	m->msg_flags = h->msg_flags;
+	m->msg_ifindex = 0;
+	m->msg_ts.tv_sec = 0;
+	m->msg_ts.tv_nsec = 0;
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(h); cmsg; cmsg = CMSG_NXTHDR(h, cmsg))
+		(void)handle_cmsg(cmsg, mmsg_cmsg_cb, m);
+}
+
+int neb_sock_inet_recvmmsg(int fd, neb_sock_mmsg_ctx_t ctx, struct neb_sock_mmsghdr *msgs, int vlen)
+{
+	if (vlen > ctx->vlen) {
+		neb_syslog(LOG_ERR, "vlen %d is larger than the one %d of mmsg ctx", vlen, ctx->vlen);
+		return -1;
+	}
+
+#ifdef USE_RECVMMSG
+	for (int i = 0; i < vlen; i++)
+		mmsg_init_hdr(ctx, i, &msgs[i], &ctx->hdrs[i].msg_hdr);
+	int n = recvmmsg(fd, ctx->hdrs, vlen, MSG_DONTWAIT, NULL);
+	if (n == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK)
+			return 0;
+		neb_syslogl(LOG_ERR, "recvmmsg: %m");
+		return -1;
+	}
+	for (int i = 0; i < n; i++)
+		mmsg_parse_hdr(&msgs[i], &ctx->hdrs[i].msg_hdr, ctx->hdrs[i].msg_len);
+	return n;
+#else
+	int n = 0;
+	for (; n < vlen; n++) {
+		struct msghdr h = NEB_STRUCT_INITIALIZER;
+		mmsg_init_hdr(ctx, n, &msgs[n], &h);
+		ssize_t nr = recvmsg(fd, &h, MSG_DONTWAIT);
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || n > 0) // report the error in the next call
+				break;
+			neb_syslogl(LOG_ERR, "recvmsg: %m");
+			return -1;
+		}
+		mmsg_parse_hdr(&msgs[n], &h, nr);
+	}
+	return n;
+#endif
+}
+
 int neb_sock_inet_new(int domain, int type, int protocol)
 {
 #ifdef SOCK_NONBLOCK
@@ -217,3 +386,24 @@ int neb_sock_inet_enable_recv_time(int fd)
 #endif
 	return 0;
 }
+
+int neb_sock_inet_enable_reuseport(int fd)
+{
+#if defined(SO_REUSEPORT_LB)
+	int enable = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT_LB, &enable, sizeof(enable)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(SO_REUSEPORT_LB): %m");
+		return -1;
+	}
+#elif defined(SO_REUSEPORT)
+	int enable = 1;
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) == -1) {
+		neb_syslogl(LOG_ERR, "setsockopt(SO_REUSEPORT): %m");
+		return -1;
+	}
+#else
+	neb_syslog(LOG_ERR, "SO_REUSEPORT is not supported for fd %d", fd);
+	return -1;
+#endif
+	return 0;
+}
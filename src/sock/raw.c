@@ -7,11 +7,39 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <netinet/ip.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <netinet/udp.h>
 
+#define RAW_SEND_BATCH_SIZE 64
+
+#if defined(OS_LINUX) || defined(OS_FREEBSD) || defined(OS_NETBSD)
+# define USE_SENDMMSG
+#endif
+
+#if defined(IP_PKTINFO)
+# define RAW4_CMSG_DATA_SIZE sizeof(struct in_pktinfo)
+#elif defined(IP_SENDSRCADDR)
+# define RAW4_CMSG_DATA_SIZE sizeof(struct in_addr)
+#else
+# error "fix me"
+#endif
+
+struct raw_send_ctx {
+	struct msghdr msg;
+	struct iovec iov;
+	union {
+		struct sockaddr_in in;
+		struct sockaddr_in6 in6;
+	} dst;
+	union {
+		char cbuf[CMSG_SPACE(sizeof(struct in6_pktinfo))]; // larger than the ipv4 one
+		struct cmsghdr align;
+	};
+};
+
 void neb_sock_raw_init_iphdr(u_char *data, uint16_t total_len, uint8_t hdr_len,
                              const struct in_addr *src, const struct in_addr *dst,
                              uint8_t p, uint8_t tos, uint8_t ttl)
@@ -56,25 +84,29 @@ int neb_sock_raw4_new(int protocol)
 	return fd;
 }
 
-ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
+static void raw4_fill_dst(const u_char *data, struct sockaddr_in *sa)
 {
-	struct ip *iphdr = (struct ip *)data;
-	struct sockaddr_in sa = {
-		.sin_family = AF_INET,
-		.sin_port = 0,
-		.sin_addr.s_addr = iphdr->ip_dst.s_addr,
-	};
+	const struct ip *iphdr = (const struct ip *)data;
+	memset(sa, 0, sizeof(struct sockaddr_in));
+	sa->sin_family = AF_INET;
+	sa->sin_addr.s_addr = iphdr->ip_dst.s_addr;
 	switch (iphdr->ip_p) {
 	case IPPROTO_TCP:
-		sa.sin_port = ((struct tcphdr *)(data + (iphdr->ip_hl << 2)))->th_dport;
+		sa->sin_port = ((const struct tcphdr *)(data + (iphdr->ip_hl << 2)))->th_dport;
 		break;
 	case IPPROTO_UDP:
-		sa.sin_port = ((struct udphdr *)(data + (iphdr->ip_hl << 2)))->uh_dport;
+		sa->sin_port = ((const struct udphdr *)(data + (iphdr->ip_hl << 2)))->uh_dport;
 		break;
 	case IPPROTO_ICMP: // should set port to 0
 	default:
 		break;
 	}
+}
+
+ssize_t neb_sock_raw4_send(int fd, const u_char *data, size_t len)
+{
+	struct sockaddr_in sa = NEB_STRUCT_INITIALIZER;
+	raw4_fill_dst(data, &sa);
 
 	ssize_t nw = sendto(fd, data, len, MSG_DONTWAIT | MSG_NOSIGNAL, (struct sockaddr *)&sa, sizeof(struct sockaddr_in));
 	if (nw == -1) {
@@ -130,38 +162,26 @@ int neb_sock_raw_icmp4_new(void)
 	return fd;
 }
 
-ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
-                                const struct in_addr *dst, const struct in_addr *src)
+static void icmp4_fill_msg(struct raw_send_ctx *c, const u_char *data, size_t len,
+                           const struct in_addr *dst, const struct in_addr *src)
 {
-	struct iovec iov = {
-		.iov_base = (void *)data,
-		.iov_len = len
-	};
-#if defined(IP_PKTINFO)
-	char buf[CMSG_SPACE(sizeof(struct in_pktinfo))];
-#elif defined(IP_SENDSRCADDR)
-	char buf[CMSG_SPACE(sizeof(struct in_addr))];
-#else
-# error "fix me"
-#endif
-	struct sockaddr_in dst_addr = {
-		.sin_family = AF_INET,
-		.sin_port = 0,
-		.sin_addr.s_addr = dst->s_addr,
-	};
-	struct msghdr msg = {
-		.msg_name = &dst_addr,
-		.msg_namelen = sizeof(struct sockaddr_in),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
-		.msg_control = NULL,
-		.msg_controllen = 0,
-	};
+	c->iov.iov_base = (void *)data;
+	c->iov.iov_len = len;
+	memset(&c->dst.in, 0, sizeof(struct sockaddr_in));
+	c->dst.in.sin_family = AF_INET;
+	c->dst.in.sin_addr.s_addr = dst->s_addr;
+	c->msg.msg_name = &c->dst;
+	c->msg.msg_namelen = sizeof(struct sockaddr_in);
+	c->msg.msg_iov = &c->iov;
+	c->msg.msg_iovlen = 1;
+	c->msg.msg_control = NULL;
+	c->msg.msg_controllen = 0;
+	c->msg.msg_flags = 0;
 
 	if (src) {
-		msg.msg_control = buf;
-		msg.msg_controllen = sizeof(buf);
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		c->msg.msg_control = c->cbuf;
+		c->msg.msg_controllen = CMSG_SPACE(RAW4_CMSG_DATA_SIZE);
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&c->msg);
 		cmsg->cmsg_level = IPPROTO_IP;
 #if defined(IP_PKTINFO)
 		cmsg->cmsg_type = IP_PKTINFO;
@@ -179,8 +199,15 @@ ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
 # error "fix me"
 #endif
 	}
+}
 
-	ssize_t nw = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+ssize_t neb_sock_raw_icmp4_send(int fd, const u_char *data, size_t len,
+                                const struct in_addr *dst, const struct in_addr *src)
+{
+	struct raw_send_ctx c;
+	icmp4_fill_msg(&c, data, len, dst, src);
+
+	ssize_t nw = sendmsg(fd, &c.msg, MSG_DONTWAIT | MSG_NOSIGNAL);
 	if (nw == -1) {
 		neb_syslogl(LOG_ERR, "sendmsg: %m");
 		return -1;
@@ -205,33 +232,27 @@ int neb_sock_raw_icmp6_new(void)
 	return fd;
 }
 
-ssize_t neb_sock_raw_icmp6_send(int fd, const u_char *data, size_t len,
-                                const struct in6_addr *dst, const struct in6_addr *src,
-                                unsigned int ifindex)
+static void icmp6_fill_msg(struct raw_send_ctx *c, const u_char *data, size_t len,
+                           const struct in6_addr *dst, const struct in6_addr *src,
+                           unsigned int ifindex)
 {
-	struct iovec iov = {
-		.iov_base = (void *)data,
-		.iov_len = len
-	};
-	char buf[CMSG_SPACE(sizeof(struct in6_pktinfo))];
-	struct sockaddr_in6 dst_addr = {
-		.sin6_family = AF_INET6,
-		.sin6_port = 0,
-	};
-	memcpy(&dst_addr.sin6_addr, dst, sizeof(struct in6_addr));
-	struct msghdr msg = {
-		.msg_name = &dst_addr,
-		.msg_namelen = sizeof(struct sockaddr_in6),
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
-		.msg_control = NULL,
-		.msg_controllen = 0,
-	};
+	c->iov.iov_base = (void *)data;
+	c->iov.iov_len = len;
+	memset(&c->dst.in6, 0, sizeof(struct sockaddr_in6));
+	c->dst.in6.sin6_family = AF_INET6;
+	memcpy(&c->dst.in6.sin6_addr, dst, sizeof(struct in6_addr));
+	c->msg.msg_name = &c->dst;
+	c->msg.msg_namelen = sizeof(struct sockaddr_in6);
+	c->msg.msg_iov = &c->iov;
+	c->msg.msg_iovlen = 1;
+	c->msg.msg_control = NULL;
+	c->msg.msg_controllen = 0;
+	c->msg.msg_flags = 0;
 
 	if (ifindex || src) {
-		msg.msg_control = buf;
-		msg.msg_controllen = sizeof(buf);
-		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+		c->msg.msg_control = c->cbuf;
+		c->msg.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+		struct cmsghdr *cmsg = CMSG_FIRSTHDR(&c->msg);
 		cmsg->cmsg_level = IPPROTO_IPV6;
 		cmsg->cmsg_type = IPV6_PKTINFO;
 		cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
@@ -242,8 +263,16 @@ ssize_t neb_sock_raw_icmp6_send(int fd, const u_char *data, size_t len,
 		else
 			memcpy(&info->ipi6_addr, src, sizeof(struct in6_addr));
 	}
+}
+
+ssize_t neb_sock_raw_icmp6_send(int fd, const u_char *data, size_t len,
+                                const struct in6_addr *dst, const struct in6_addr *src,
+                                unsigned int ifindex)
+{
+	struct raw_send_ctx c;
+	icmp6_fill_msg(&c, data, len, dst, src, ifindex);
 
-	ssize_t nw = sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+	ssize_t nw = sendmsg(fd, &c.msg, MSG_DONTWAIT | MSG_NOSIGNAL);
 	if (nw == -1) {
 		neb_syslogl(LOG_ERR, "sendmsg: %m");
 		return -1;
@@ -251,3 +280,108 @@ ssize_t neb_sock_raw_icmp6_send(int fd, const u_char *data, size_t len,
 
 	return nw;
 }
+
+typedef struct neb_sock_send_result *(*raw_batch_fill_t)(struct raw_send_ctx *c, void *pkts, int i);
+
+/**
+ * \brief send in chunks, the failed packet is skipped with error set
+ * \return the number of packets handled
+ */
+static int raw_send_batch(int fd, void *pkts, int count, raw_batch_fill_t fill)
+{
+	struct raw_send_ctx ctxs[RAW_SEND_BATCH_SIZE];
+	struct neb_sock_send_result *results[RAW_SEND_BATCH_SIZE];
+	int done = 0;
+	while (done < count) {
+		int n = count - done;
+		if (n > RAW_SEND_BATCH_SIZE)
+			n = RAW_SEND_BATCH_SIZE;
+		for (int i = 0; i < n; i++)
+			results[i] = fill(&ctxs[i], pkts, done + i);
+
+		int sent;
+#ifdef USE_SENDMMSG
+		struct mmsghdr hdrs[RAW_SEND_BATCH_SIZE];
+		for (int i = 0; i < n; i++) {
+			hdrs[i].msg_hdr = ctxs[i].msg;
+			hdrs[i].msg_len = 0;
+		}
+		sent = sendmmsg(fd, hdrs, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+		for (int i = 0; i < sent; i++) {
+			results[i]->len = hdrs[i].msg_len;
+			results[i]->err = 0;
+		}
+#else
+		for (sent = 0; sent < n; sent++) {
+			ssize_t nw = sendmsg(fd, &ctxs[sent].msg, MSG_DONTWAIT | MSG_NOSIGNAL);
+			if (nw == -1)
+				break;
+			results[sent]->len = nw;
+			results[sent]->err = 0;
+		}
+		if (!sent)
+			sent = -1;
+#endif
+		if (sent > 0) {
+			done += sent;
+			continue;
+		}
+
+		int e = errno;
+		if (e == EINTR)
+			continue;
+		if (e == EAGAIN || e == EWOULDBLOCK || e == ENOBUFS) // the caller should retry later
+			break;
+		neb_syslog_en(e, LOG_ERR, "Failed to send packet %d in batch: %m", done);
+		results[0]->len = -1;
+		results[0]->err = e;
+		done++;
+	}
+	return done;
+}
+
+static struct neb_sock_send_result *raw4_batch_fill(struct raw_send_ctx *c, void *pkts, int i)
+{
+	struct neb_sock_raw4_pkt *pkt = (struct neb_sock_raw4_pkt *)pkts + i;
+	raw4_fill_dst(pkt->data, &c->dst.in);
+	c->iov.iov_base = (void *)pkt->data;
+	c->iov.iov_len = pkt->len;
+	c->msg.msg_name = &c->dst;
+	c->msg.msg_namelen = sizeof(struct sockaddr_in);
+	c->msg.msg_iov = &c->iov;
+	c->msg.msg_iovlen = 1;
+	c->msg.msg_control = NULL;
+	c->msg.msg_controllen = 0;
+	c->msg.msg_flags = 0;
+	return &pkt->result;
+}
+
+int neb_sock_raw4_send_batch(int fd, struct neb_sock_raw4_pkt *pkts, int count)
+{
+	return raw_send_batch(fd, pkts, count, raw4_batch_fill);
+}
+
+static struct neb_sock_send_result *icmp4_batch_fill(struct raw_send_ctx *c, void *pkts, int i)
+{
+	struct neb_sock_icmp4_pkt *pkt = (struct neb_sock_icmp4_pkt *)pkts + i;
+	icmp4_fill_msg(c, pkt->data, pkt->len, &pkt->dst, pkt->src.s_addr ? &pkt->src : NULL);
+	return &pkt->result;
+}
+
+int neb_sock_raw_icmp4_send_batch(int fd, struct neb_sock_icmp4_pkt *pkts, int count)
+{
+	return raw_send_batch(fd, pkts, count, icmp4_batch_fill);
+}
+
+static struct neb_sock_send_result *icmp6_batch_fill(struct raw_send_ctx *c, void *pkts, int i)
+{
+	struct neb_sock_icmp6_pkt *pkt = (struct neb_sock_icmp6_pkt *)pkts + i;
+	const struct in6_addr *src = IN6_IS_ADDR_UNSPECIFIED(&pkt->src) ? NULL : &pkt->src;
+	icmp6_fill_msg(c, pkt->data, pkt->len, &pkt->dst, src, pkt->ifindex);
+	return &pkt->result;
+}
+
+int neb_sock_raw_icmp6_send_batch(int fd, struct neb_sock_icmp6_pkt *pkts, int count)
+{
+	return raw_send_batch(fd, pkts, count, icmp6_batch_fill);
+}
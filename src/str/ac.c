@@ -0,0 +1,458 @@
+
+#include <nebase/syslog.h>
+#include <nebase/str/ac.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__)
+# define AC_USE_SSE2
+# include <emmintrin.h>
+#elif defined(__aarch64__)
+# define AC_USE_NEON
+# include <arm_neon.h>
+#endif
+
+/**
+ * Reference: https://cr.yp.to/bib/1975/aho.pdf
+ */
+
+#define ASIZE 256
+
+#define AC_SPARSE_MAX 8 // states with more edges use dense rows
+#define AC_SIMD_FIRST_MAX 4 // max first bytes for the SIMD prefilter
+
+/*
+ * trie built by add, children are kept sorted by byte
+ */
+struct ac_node {
+	uint32_t child;   // first child, 0 if none, as root is never a child
+	uint32_t sibling; // next sibling, 0 if none
+	uint32_t out;     // first own output, index + 1 in outs
+	uint32_t out_last;
+	int nchild;
+	u_char c;
+};
+
+struct ac_out {
+	int id;
+	int len;
+	uint32_t next; // index + 1, chained to outputs of the fail state when compiled
+};
+
+/*
+ * compiled state, in BFS order of the trie, with 0 as root
+ */
+struct ac_state {
+	uint32_t fail;
+	uint32_t out;     // index + 1 in outs, 0 if no match ends here
+	uint32_t edges;   // offset in rows if dense, or in labels and targets
+	uint16_t nedges;
+	uint16_t dense;
+};
+
+struct neb_str_ac {
+	struct ac_node *nodes;
+	uint32_t node_count;
+	uint32_t node_size;
+	struct ac_out *outs;
+	uint32_t out_count;
+	uint32_t out_size;
+	int pattern_count;
+
+	bool compiled;
+	struct ac_state *states;
+	uint32_t *rows;   // dense rows, ASIZE targets each, 0 for no edge
+	u_char *labels;   // sparse edges
+	uint32_t *targets;
+	int nfirst;       // distinct first bytes of patterns
+	u_char first[AC_SIMD_FIRST_MAX];
+};
+
+neb_str_ac_t neb_str_ac_create(void)
+{
+	struct neb_str_ac *a = calloc(1, sizeof(struct neb_str_ac));
+	if (!a) {
+		neb_syslogl(LOG_ERR, "calloc: %m");
+		return NULL;
+	}
+
+	a->node_size = 64;
+	a->nodes = malloc(sizeof(struct ac_node) * a->node_size);
+	if (!a->nodes) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		free(a);
+		return NULL;
+	}
+	memset(&a->nodes[0], 0, sizeof(struct ac_node));
+	a->node_count = 1;
+
+	return a;
+}
+
+static void ac_free_compiled(neb_str_ac_t a)
+{
+	free(a->states);
+	a->states = NULL;
+	free(a->rows);
+	a->rows = NULL;
+	free(a->labels);
+	a->labels = NULL;
+	free(a->targets);
+	a->targets = NULL;
+	a->compiled = false;
+}
+
+void neb_str_ac_destroy(neb_str_ac_t a)
+{
+	ac_free_compiled(a);
+	free(a->outs);
+	free(a->nodes);
+	free(a);
+}
+
+int neb_str_ac_pattern_count(neb_str_ac_t a)
+{
+	return a->pattern_count;
+}
+
+static uint32_t ac_node_child(neb_str_ac_t a, uint32_t n, u_char c)
+{
+	for (uint32_t i = a->nodes[n].child; i; i = a->nodes[i].sibling) {
+		if (a->nodes[i].c == c)
+			return i;
+		if (a->nodes[i].c > c)
+			break;
+	}
+	return 0;
+}
+
+static uint32_t ac_node_add_child(neb_str_ac_t a, uint32_t n, u_char c)
+{
+	if (a->node_count == UINT32_MAX) {
+		neb_syslog(LOG_ERR, "Too many states");
+		return 0;
+	}
+	if (a->node_count == a->node_size) {
+		uint32_t size = a->node_size > UINT32_MAX / 2 ? UINT32_MAX : a->node_size * 2;
+		struct ac_node *nodes = realloc(a->nodes, sizeof(struct ac_node) * size);
+		if (!nodes) {
+			neb_syslogl(LOG_ERR, "realloc: %m");
+			return 0;
+		}
+		a->nodes = nodes;
+		a->node_size = size;
+	}
+
+	uint32_t i = a->node_count++;
+	struct ac_node *new = &a->nodes[i];
+	memset(new, 0, sizeof(struct ac_node));
+	new->c = c;
+
+	struct ac_node *parent = &a->nodes[n];
+	uint32_t *link = &parent->child;
+	while (*link && a->nodes[*link].c < c)
+		link = &a->nodes[*link].sibling;
+	new->sibling = *link;
+	*link = i;
+	parent->nchild++;
+
+	return i;
+}
+
+int neb_str_ac_add(neb_str_ac_t a, const u_char *p, int pl, int id)
+{
+	if (pl <= 0) {
+		neb_syslog(LOG_ERR, "Invalid pattern length %d", pl);
+		return -1;
+	}
+
+	if (a->out_count == a->out_size) {
+		uint32_t size = a->out_size ? a->out_size * 2 : 64;
+		struct ac_out *outs = realloc(a->outs, sizeof(struct ac_out) * size);
+		if (!outs) {
+			neb_syslogl(LOG_ERR, "realloc: %m");
+			return -1;
+		}
+		a->outs = outs;
+		a->out_size = size;
+	}
+
+	uint32_t n = 0;
+	for (int i = 0; i < pl; i++) {
+		uint32_t next = ac_node_child(a, n, p[i]);
+		if (!next) {
+			next = ac_node_add_child(a, n, p[i]);
+			if (!next)
+				return -1;
+		}
+		n = next;
+	}
+
+	uint32_t o = a->out_count++;
+	a->outs[o].id = id;
+	a->outs[o].len = pl;
+	a->outs[o].next = 0;
+	struct ac_node *node = &a->nodes[n];
+	if (node->out_last)
+		a->outs[node->out_last - 1].next = o + 1;
+	else
+		node->out = o + 1;
+	node->out_last = o + 1;
+
+	a->pattern_count++;
+	a->compiled = false;
+	return 0;
+}
+
+int neb_str_ac_compile(neb_str_ac_t a)
+{
+	int ret = -1;
+	uint32_t n = a->node_count;
+
+	ac_free_compiled(a);
+
+	uint32_t *order = malloc(sizeof(uint32_t) * n); // BFS index -> node
+	uint32_t *map = malloc(sizeof(uint32_t) * n);   // node -> BFS index
+	if (!order || !map) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		goto exit_free;
+	}
+
+	uint32_t dense_count = 0;
+	order[0] = 0;
+	map[0] = 0;
+	for (uint32_t head = 0, tail = 1; head < tail; head++) {
+		const struct ac_node *node = &a->nodes[order[head]];
+		if (head == 0 || node->nchild > AC_SPARSE_MAX)
+			dense_count++;
+		for (uint32_t i = node->child; i; i = a->nodes[i].sibling) {
+			map[i] = tail;
+			order[tail++] = i;
+		}
+	}
+
+	a->states = calloc(n, sizeof(struct ac_state));
+	a->rows = calloc((size_t)dense_count * ASIZE, sizeof(uint32_t));
+	a->labels = malloc(n); // n - 1 edges
+	a->targets = malloc(sizeof(uint32_t) * n);
+	if (!a->states || !a->rows || !a->labels || !a->targets) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		goto exit_free;
+	}
+
+	// own output lists may be chained by the last compile
+	for (uint32_t i = 0; i < n; i++) {
+		if (a->nodes[i].out_last)
+			a->outs[a->nodes[i].out_last - 1].next = 0;
+	}
+
+	uint32_t row = 0, edge = 0;
+	a->nfirst = 0;
+	for (uint32_t s = 0; s < n; s++) {
+		const struct ac_node *node = &a->nodes[order[s]];
+		struct ac_state *st = &a->states[s];
+
+		// fail of children of the root is the root, and states are visited
+		// after their fail states, so the fail one is always ready here
+		if (node->out) {
+			st->out = node->out;
+			a->outs[node->out_last - 1].next = s ? a->states[st->fail].out : 0;
+		} else if (s) {
+			st->out = a->states[st->fail].out;
+		}
+
+		st->nedges = node->nchild;
+		if (s == 0 || node->nchild > AC_SPARSE_MAX) {
+			st->dense = 1;
+			st->edges = row++ * ASIZE;
+		} else {
+			st->edges = edge;
+			edge += node->nchild;
+		}
+
+		int k = 0;
+		for (uint32_t i = node->child; i; i = a->nodes[i].sibling, k++) {
+			uint32_t child = map[i];
+			if (st->dense)
+				a->rows[st->edges + a->nodes[i].c] = child;
+			else {
+				a->labels[st->edges + k] = a->nodes[i].c;
+				a->targets[st->edges + k] = child;
+			}
+
+			uint32_t fail = 0;
+			if (s) {
+				for (uint32_t f = order[st->fail]; ; f = order[a->states[map[f]].fail]) {
+					uint32_t next = ac_node_child(a, f, a->nodes[i].c);
+					if (next) {
+						fail = map[next];
+						break;
+					}
+					if (f == 0)
+						break;
+				}
+			} else {
+				if (a->nfirst < AC_SIMD_FIRST_MAX)
+					a->first[a->nfirst] = a->nodes[i].c;
+				a->nfirst++;
+			}
+			a->states[child].fail = fail;
+		}
+	}
+
+	a->compiled = true;
+	ret = 0;
+
+exit_free:
+	free(map);
+	free(order);
+	if (ret != 0)
+		ac_free_compiled(a);
+	return ret;
+}
+
+static inline uint32_t ac_goto(neb_str_ac_t a, const struct ac_state *st, u_char c)
+{
+	if (st->dense)
+		return a->rows[st->edges + c];
+	const u_char *labels = a->labels + st->edges;
+	for (int i = 0; i < st->nedges; i++) {
+		if (labels[i] == c)
+			return a->targets[st->edges + i];
+		if (labels[i] > c)
+			break;
+	}
+	return 0;
+}
+
+static inline uint32_t ac_next(neb_str_ac_t a, uint32_t s, u_char c)
+{
+	for (;;) {
+		const struct ac_state *st = &a->states[s];
+		uint32_t next = ac_goto(a, st, c);
+		if (next || s == 0)
+			return next;
+		s = st->fail;
+	}
+}
+
+/**
+ * \return the first byte in [p, end) that could start a pattern, or end
+ */
+static const u_char *ac_skip(neb_str_ac_t a, const u_char *p, const u_char *end)
+{
+	switch (a->nfirst) {
+	case 0:
+		return end;
+	case 1:
+	{
+		const u_char *r = memchr(p, a->first[0], end - p);
+		return r ? r : end;
+	}
+	default:
+		break;
+	}
+
+#if defined(AC_USE_SSE2)
+	if (a->nfirst <= AC_SIMD_FIRST_MAX) {
+		__m128i f[AC_SIMD_FIRST_MAX];
+		for (int i = 0; i < AC_SIMD_FIRST_MAX; i++)
+			f[i] = _mm_set1_epi8((char)a->first[i < a->nfirst ? i : 0]);
+		for (; end - p >= 16; p += 16) {
+			__m128i v = _mm_loadu_si128((const __m128i *)p);
+			__m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, f[0]), _mm_cmpeq_epi8(v, f[1])),
+			                         _mm_or_si128(_mm_cmpeq_epi8(v, f[2]), _mm_cmpeq_epi8(v, f[3])));
+			int mask = _mm_movemask_epi8(m);
+			if (mask)
+				return p + __builtin_ctz(mask);
+		}
+	}
+#elif defined(AC_USE_NEON)
+	if (a->nfirst <= AC_SIMD_FIRST_MAX) {
+		uint8x16_t f[AC_SIMD_FIRST_MAX];
+		for (int i = 0; i < AC_SIMD_FIRST_MAX; i++)
+			f[i] = vdupq_n_u8(a->first[i < a->nfirst ? i : 0]);
+		for (; end - p >= 16; p += 16) {
+			uint8x16_t v = vld1q_u8(p);
+			uint8x16_t m = vorrq_u8(vorrq_u8(vceqq_u8(v, f[0]), vceqq_u8(v, f[1])),
+			                        vorrq_u8(vceqq_u8(v, f[2]), vceqq_u8(v, f[3])));
+			if (vmaxvq_u8(m))
+				break; // find the exact one by the scalar loop
+		}
+	}
+#endif
+
+	const uint32_t *root = a->rows;
+	while (p < end && !root[*p])
+		p++;
+	return p;
+}
+
+/**
+ * \return 1 if stopped by cb, with *pos set to the stop position
+ */
+static int ac_run(neb_str_ac_t a, uint32_t *state, int64_t base, const u_char *t, int64_t tl,
+                  neb_str_ac_match_cb cb, void *udata, int64_t *pos)
+{
+	const u_char *p = t, *end = t + tl;
+	uint32_t s = *state;
+
+	while (p < end) {
+		if (s == 0) {
+			p = ac_skip(a, p, end);
+			if (p == end)
+				break;
+		}
+		s = ac_next(a, s, *p++);
+		uint32_t o = a->states[s].out;
+		if (__predict_false(o)) {
+			int64_t match_end = base + (p - t);
+			for (; o; o = a->outs[o - 1].next) {
+				const struct ac_out *out = &a->outs[o - 1];
+				if (cb(out->id, match_end - out->len, udata)) {
+					*state = s;
+					*pos = p - t;
+					return 1;
+				}
+			}
+		}
+	}
+
+	*state = s;
+	*pos = tl;
+	return 0;
+}
+
+int neb_str_ac_search(neb_str_ac_t a, const u_char *t, int64_t tl, neb_str_ac_match_cb cb, void *udata)
+{
+	if (!a->compiled) {
+		neb_syslog(LOG_ERR, "The automaton is not compiled");
+		return -1;
+	}
+
+	uint32_t s = 0;
+	int64_t pos;
+	return ac_run(a, &s, 0, t, tl, cb, udata, &pos);
+}
+
+void neb_str_ac_stream_init(struct neb_str_ac_stream *s)
+{
+	s->state = 0;
+	s->offset = 0;
+}
+
+int neb_str_ac_stream_search(neb_str_ac_t a, struct neb_str_ac_stream *s,
+                             const u_char *t, int64_t tl, neb_str_ac_match_cb cb, void *udata)
+{
+	if (!a->compiled) {
+		neb_syslog(LOG_ERR, "The automaton is not compiled");
+		return -1;
+	}
+
+	int64_t pos;
+	int ret = ac_run(a, &s->state, s->offset, t, tl, cb, udata, &pos);
+	s->offset += pos;
+	return ret;
+}
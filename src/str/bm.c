@@ -1,7 +1,20 @@
 
+#include <nebase/syslog.h>
 #include <nebase/str/bm.h>
 
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#if defined(__x86_64__)
+# define BM_USE_SSE2
+# include <emmintrin.h>
+#elif defined(__aarch64__)
+# define BM_USE_NEON
+# include <arm_neon.h>
+#endif
 
 /**
  * Reference: http://igm.univ-mlv.fr/~lecroq/string/node14.html
@@ -12,11 +25,46 @@
 #define MAX(a, b) \
 	((a) > (b)) ? (a) : (b)
 
+#define SUFF_STACK_MAX 256 // longer patterns use heap for suffixes
+
+#define BM_SHORT_PATTERN_MAX 16 // shorter ones are searched without BM tables
+#define BM_CACHE_SIZE 8 // thread local contexts for neb_str_bm_search
+#define BM_CACHE_PATTERN_MAX 4096 // longer ones are not cached
+
+/*
+ * shift values are never larger than the pattern length, so the tables are
+ * kept in 8 or 16 bits for short patterns
+ */
 struct neb_str_bm_ctx {
 	const u_char *pattern;
 	int pattern_len;
-	int bmBc[ASIZE];
-	int bmGs[];
+	int width;  // bytes per table entry
+	int rare1;  // offset in pattern of the rarest byte, for the prefilter
+	int rare2;  // offset in pattern of another rare byte
+	void *bmBc; // ASIZE entries
+	void *bmGs; // pattern_len entries
+	u_char tables[];
+};
+
+struct bm_cache_entry {
+	neb_str_bm_ctx_t ctx; // with the pattern copied
+	uint64_t last_used;
+};
+
+static _Thread_local struct bm_cache_entry bm_cache[BM_CACHE_SIZE];
+static _Thread_local uint64_t bm_cache_clock = 0;
+static _Thread_local int bm_cache_registered = 0;
+
+static pthread_once_t bm_cache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t bm_cache_key;
+static int bm_cache_key_ok = 0;
+
+struct neb_str_bm_stream {
+	neb_str_bm_ctx_t ctx;
+	int64_t offset; // bytes consumed in the stream
+	int keep;       // bytes kept from the end of consumed, less than pattern_len
+	u_char *tail;   // pattern_len - 1 bytes
+	u_char *scratch; // 2 * (pattern_len - 1) bytes
 };
 
 static void preBmBc(const u_char *x, int m, int bmBc[])
@@ -46,9 +94,17 @@ static void suffixes(const u_char *x, int m, int *suff)
 	}
 }
 
-static void preBmGs(const u_char *x, int m, int bmGs[])
+static int preBmGs(const u_char *x, int m, int bmGs[])
 {
-	int suff[m];
+	int suff_stack[SUFF_STACK_MAX];
+	int *suff = suff_stack;
+	if (m > SUFF_STACK_MAX) {
+		suff = malloc(sizeof(int) * m);
+		if (!suff) {
+			neb_syslogl(LOG_ERR, "malloc: %m");
+			return -1;
+		}
+	}
 
 	suffixes(x, m, suff);
 
@@ -61,66 +117,437 @@ static void preBmGs(const u_char *x, int m, int bmGs[])
 					bmGs[j] = m - 1 - i;
 	for (int i = 0; i <= m - 2; ++i)
 		bmGs[m - 1 - suff[i]] = m - 1 - i;
+
+	if (suff != suff_stack)
+		free(suff);
+	return 0;
 }
 
-const u_char *neb_str_bm_search(const u_char *p, int pl, const u_char *t, int64_t tl)
+/**
+ * \return a guessed frequency rank of byte c in common text and binary data,
+ *         the lower the rarer
+ */
+static int byte_rank(u_char c)
 {
-	int i, bmGs[pl], bmBc[ASIZE];
-
-	if (pl > tl)
-		return NULL;
+	switch (c) {
+	case 0x00: case 0xff: case ' ':
+	case 'e': case 't': case 'a': case 'o': case 'i': case 'n': case 's': case 'r': case 'h':
+		return 4;
+	case '\n': case '\r': case '\t': case '.': case ',': case '/': case '"': case '=':
+		return 3;
+	default:
+		break;
+	}
+	if ((c >= 'a' && c <= 'z') || (c >= '0' && c <= '9'))
+		return 3;
+	if (c >= 0x20 && c < 0x7f)
+		return 2;
+	if (c < 0x20)
+		return 1;
+	return 0;
+}
 
-	/* Preprocessing */
-	preBmGs(p, pl, bmGs);
-	preBmBc(p, pl, bmBc);
+static void pick_rare_bytes(const u_char *p, int pl, int *rare1, int *rare2)
+{
+	int r1 = pl - 1;
+	for (int i = pl - 2; i >= 0; i--) {
+		if (byte_rank(p[i]) < byte_rank(p[r1]))
+			r1 = i;
+	}
 
-	/* Searching */
-	int64_t j = 0;
-	while (j <= tl - pl) {
-		for (i = pl - 1; i >= 0 && p[i] == t[i + j]; --i);
-		if (i < 0)
-			return t + j;
-		else
-			j += MAX(bmGs[i], bmBc[t[i + j]] - pl + 1 + i);
+	// a different byte is better for filtering
+	int r2 = -1;
+	for (int i = pl - 1; i >= 0; i--) {
+		if (p[i] == p[r1])
+			continue;
+		if (r2 < 0 || byte_rank(p[i]) < byte_rank(p[r2]))
+			r2 = i;
 	}
+	if (r2 < 0)
+		r2 = r1 == pl - 1 ? 0 : pl - 1;
 
-	return NULL;
+	*rare1 = r1;
+	*rare2 = r2;
 }
 
-neb_str_bm_ctx_t neb_str_bm_ctx_create(const u_char *p, int pl)
+/**
+ * \param[in] copy copy the pattern after the tables
+ */
+static neb_str_bm_ctx_t bm_ctx_new(const u_char *p, int pl, bool copy)
 {
-	struct neb_str_bm_ctx *c = malloc(sizeof(struct neb_str_bm_ctx) + sizeof(int) * pl);
-	if (!c)
+	if (pl <= 0) {
+		neb_syslog(LOG_ERR, "Invalid pattern length %d", pl);
+		return NULL;
+	}
+
+	int width = sizeof(int);
+	if (pl <= UINT8_MAX)
+		width = sizeof(uint8_t);
+	else if (pl <= UINT16_MAX)
+		width = sizeof(uint16_t);
+
+	size_t size = sizeof(struct neb_str_bm_ctx) + (size_t)width * (ASIZE + pl);
+	struct neb_str_bm_ctx *c = malloc(size + (copy ? pl : 0));
+	int *bmGs = malloc(sizeof(int) * pl);
+	if (!c || !bmGs) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		free(bmGs);
+		free(c);
 		return NULL;
+	}
 
+	if (copy) {
+		u_char *pattern = (u_char *)c + size;
+		memcpy(pattern, p, pl);
+		p = pattern;
+	}
 	c->pattern = p;
 	c->pattern_len = pl;
-	preBmGs(p, pl, c->bmGs);
-	preBmBc(p, pl, c->bmBc);
+	c->width = width;
+	c->bmBc = c->tables;
+	c->bmGs = c->tables + width * ASIZE;
+	if (pl > 1)
+		pick_rare_bytes(p, pl, &c->rare1, &c->rare2);
+	else
+		c->rare1 = c->rare2 = 0;
+
+	int bmBc[ASIZE];
+	if (preBmGs(p, pl, bmGs) != 0) {
+		free(bmGs);
+		free(c);
+		return NULL;
+	}
+	preBmBc(p, pl, bmBc);
+	switch (width) {
+	case sizeof(uint8_t):
+		for (int i = 0; i < ASIZE; i++)
+			((uint8_t *)c->bmBc)[i] = bmBc[i];
+		for (int i = 0; i < pl; i++)
+			((uint8_t *)c->bmGs)[i] = bmGs[i];
+		break;
+	case sizeof(uint16_t):
+		for (int i = 0; i < ASIZE; i++)
+			((uint16_t *)c->bmBc)[i] = bmBc[i];
+		for (int i = 0; i < pl; i++)
+			((uint16_t *)c->bmGs)[i] = bmGs[i];
+		break;
+	default:
+		memcpy(c->bmBc, bmBc, sizeof(bmBc));
+		memcpy(c->bmGs, bmGs, sizeof(int) * pl);
+		break;
+	}
+	free(bmGs);
 
 	return c;
 }
 
+neb_str_bm_ctx_t neb_str_bm_ctx_create(const u_char *p, int pl)
+{
+	return bm_ctx_new(p, pl, false);
+}
+
 void neb_str_bm_ctx_destroy(neb_str_bm_ctx_t c)
 {
 	free(c);
 }
 
+#define DEFINE_BM_CTX_SEARCH(name, type)                                              \
+static const u_char *name(neb_str_bm_ctx_t c, const u_char *t, int64_t tl, int64_t j) \
+{                                                                                     \
+	const u_char *p = c->pattern;                                                     \
+	const int pl = c->pattern_len;                                                    \
+	const type *bmBc = c->bmBc;                                                       \
+	const type *bmGs = c->bmGs;                                                       \
+	int i;                                                                            \
+                                                                                      \
+	while (j <= tl - pl) {                                                            \
+		for (i = pl - 1; i >= 0 && p[i] == t[i + j]; --i);                            \
+		if (i < 0)                                                                    \
+			return t + j;                                                             \
+		else                                                                          \
+			j += MAX((int)bmGs[i], (int)bmBc[t[i + j]] - pl + 1 + i);                 \
+	}                                                                                 \
+                                                                                      \
+	return NULL;                                                                      \
+}
+
+DEFINE_BM_CTX_SEARCH(bm_ctx_search_u8, uint8_t)
+DEFINE_BM_CTX_SEARCH(bm_ctx_search_u16, uint16_t)
+DEFINE_BM_CTX_SEARCH(bm_ctx_search_int, int)
+
+static const u_char *bm_ctx_search_from(neb_str_bm_ctx_t c, const u_char *t, int64_t tl, int64_t j)
+{
+	switch (c->width) {
+	case sizeof(uint8_t):
+		return bm_ctx_search_u8(c, t, tl, j);
+	case sizeof(uint16_t):
+		return bm_ctx_search_u16(c, t, tl, j);
+	default:
+		return bm_ctx_search_int(c, t, tl, j);
+	}
+}
+
+#if defined(BM_USE_SSE2) || defined(BM_USE_NEON)
+/**
+ * \brief scan 16 candidates at a time, which have both bytes at offsets r1 and
+ *        r2 of the pattern, and verify them by memcmp
+ * \param[in,out] j the start candidate, set to the first one not scanned if
+ *                  returned NULL
+ * \param[in] fallback stop if there are too many false candidates
+ * \return NULL if not found, or stopped
+ */
+static const u_char *bm_prefilter(const u_char *p, int pl, int r1, int r2,
+                                  const u_char *t, int64_t tl, int64_t *j, bool fallback)
+{
+	const int64_t last = tl - pl; // the last candidate
+	int64_t k = *j;
+	int64_t false_count = 0;
+
+#if defined(BM_USE_SSE2)
+	const __m128i b1 = _mm_set1_epi8((char)p[r1]);
+	const __m128i b2 = _mm_set1_epi8((char)p[r2]);
+#else
+	const uint8x16_t b1 = vdupq_n_u8(p[r1]);
+	const uint8x16_t b2 = vdupq_n_u8(p[r2]);
+#endif
+
+	for (; k + 15 <= last; k += 16) {
+#if defined(BM_USE_SSE2)
+		__m128i v1 = _mm_loadu_si128((const __m128i *)(t + k + r1));
+		__m128i v2 = _mm_loadu_si128((const __m128i *)(t + k + r2));
+		uint64_t mask = (unsigned int)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(v1, b1), _mm_cmpeq_epi8(v2, b2)));
+		const int shift = 0;
+#else
+		uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(t + k + r1), b1), vceqq_u8(vld1q_u8(t + k + r2), b2));
+		// 4 bits per byte
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+		const int shift = 2;
+#endif
+		while (mask) {
+			int bit = __builtin_ctzll(mask);
+			int64_t pos = k + (bit >> shift);
+			if (memcmp(t + pos, p, pl) == 0)
+				return t + pos;
+			mask &= ~((((uint64_t)1 << (1 << shift)) - 1) << bit);
+			false_count++;
+		}
+		// let BM skip instead if the rare bytes are not rare in this text
+		if (fallback && false_count > 16 && false_count > (k - *j) >> 3) {
+			k += 16;
+			break;
+		}
+	}
+
+	*j = k;
+	return NULL;
+}
+#endif
+
 const u_char *neb_str_bm_ctx_search(neb_str_bm_ctx_t c, const u_char *t, int64_t tl)
 {
-	int i;
+	if (c->pattern_len > tl)
+		return NULL;
+
+	if (c->pattern_len == 1)
+		return memchr(t, c->pattern[0], tl);
+
 	int64_t j = 0;
+#if defined(BM_USE_SSE2) || defined(BM_USE_NEON)
+	const u_char *r = bm_prefilter(c->pattern, c->pattern_len, c->rare1, c->rare2, t, tl, &j, true);
+	if (r)
+		return r;
+#endif
+	return bm_ctx_search_from(c, t, tl, j);
+}
 
-	if (c->pattern_len > tl)
+/**
+ * \brief free cached contexts at thread exit
+ */
+static void bm_cache_release(void *arg)
+{
+	struct bm_cache_entry *cache = arg;
+	for (int i = 0; i < BM_CACHE_SIZE; i++) {
+		if (cache[i].ctx) {
+			free(cache[i].ctx);
+			cache[i].ctx = NULL;
+		}
+	}
+}
+
+static void bm_cache_key_create(void)
+{
+	int ret = pthread_key_create(&bm_cache_key, bm_cache_release);
+	if (ret != 0) {
+		neb_syslogl_en(ret, LOG_ERR, "pthread_key_create: %m");
+		return;
+	}
+	bm_cache_key_ok = 1;
+}
+
+/**
+ * \return NULL if failed to register the release at thread exit, or to
+ *         create the context
+ */
+static neb_str_bm_ctx_t bm_cache_get(const u_char *p, int pl)
+{
+	if (!bm_cache_registered) {
+		pthread_once(&bm_cache_key_once, bm_cache_key_create);
+		if (!bm_cache_key_ok)
+			return NULL;
+		int ret = pthread_setspecific(bm_cache_key, bm_cache);
+		if (ret != 0) {
+			neb_syslogl_en(ret, LOG_ERR, "pthread_setspecific: %m");
+			return NULL;
+		}
+		bm_cache_registered = 1;
+	}
+
+	struct bm_cache_entry *lru = &bm_cache[0];
+	for (int i = 0; i < BM_CACHE_SIZE; i++) {
+		struct bm_cache_entry *e = &bm_cache[i];
+		if (e->ctx && e->ctx->pattern_len == pl && memcmp(e->ctx->pattern, p, pl) == 0) {
+			e->last_used = ++bm_cache_clock;
+			return e->ctx;
+		}
+		if (!e->ctx || (lru->ctx && e->last_used < lru->last_used))
+			lru = e;
+	}
+
+	neb_str_bm_ctx_t c = bm_ctx_new(p, pl, true);
+	if (!c)
 		return NULL;
+	if (lru->ctx)
+		free(lru->ctx);
+	lru->ctx = c;
+	lru->last_used = ++bm_cache_clock;
+	return c;
+}
+
+static const u_char *bm_short_search(const u_char *p, int pl, const u_char *t, int64_t tl)
+{
+	if (pl == 1)
+		return memchr(t, p[0], tl);
 
-	while (j <= tl - c->pattern_len) {
-		for (i = c->pattern_len - 1; i >= 0 && c->pattern[i] == t[i + j]; --i);
-		if (i < 0)
+#if defined(BM_USE_SSE2) || defined(BM_USE_NEON)
+	int r1, r2;
+	pick_rare_bytes(p, pl, &r1, &r2);
+
+	int64_t j = 0;
+	const u_char *r = bm_prefilter(p, pl, r1, r2, t, tl, &j, false);
+	if (r)
+		return r;
+	for (; j <= tl - pl; j++) {
+		if (t[j + r1] == p[r1] && memcmp(t + j, p, pl) == 0)
 			return t + j;
-		else
-			j += MAX(c->bmGs[i], c->bmBc[t[i + j]] - c->pattern_len + 1 + i);
 	}
-
 	return NULL;
+#else
+	return memmem(t, tl, p, pl);
+#endif
+}
+
+const u_char *neb_str_bm_search(const u_char *p, int pl, const u_char *t, int64_t tl)
+{
+	if (pl <= 0 || pl > tl)
+		return NULL;
+
+	if (pl <= BM_SHORT_PATTERN_MAX)
+		return bm_short_search(p, pl, t, tl);
+
+	neb_str_bm_ctx_t c = NULL;
+	if (pl <= BM_CACHE_PATTERN_MAX) {
+		c = bm_cache_get(p, pl);
+		if (c)
+			return neb_str_bm_ctx_search(c, t, tl);
+	}
+
+	c = bm_ctx_new(p, pl, false);
+	if (!c)
+		return NULL;
+	const u_char *r = neb_str_bm_ctx_search(c, t, tl);
+	neb_str_bm_ctx_destroy(c);
+	return r;
+}
+
+neb_str_bm_stream_t neb_str_bm_stream_create(neb_str_bm_ctx_t c)
+{
+	size_t keep_size = c->pattern_len - 1;
+	struct neb_str_bm_stream *s = malloc(sizeof(struct neb_str_bm_stream) + keep_size * 3);
+	if (!s) {
+		neb_syslogl(LOG_ERR, "malloc: %m");
+		return NULL;
+	}
+
+	s->ctx = c;
+	s->tail = (u_char *)(s + 1);
+	s->scratch = s->tail + keep_size;
+	neb_str_bm_stream_reset(s);
+
+	return s;
+}
+
+void neb_str_bm_stream_destroy(neb_str_bm_stream_t s)
+{
+	free(s);
+}
+
+void neb_str_bm_stream_reset(neb_str_bm_stream_t s)
+{
+	s->offset = 0;
+	s->keep = 0;
+}
+
+int64_t neb_str_bm_stream_offset(neb_str_bm_stream_t s)
+{
+	return s->offset;
+}
+
+int64_t neb_str_bm_stream_search(neb_str_bm_stream_t s, const u_char *t, int64_t tl, int64_t *consumed)
+{
+	const int pl = s->ctx->pattern_len;
+	bool found = false;
+	int64_t start = 0; // from t, negative if in kept bytes
+
+	if (s->keep) {
+		// only matches starting in kept bytes could be found here, as there
+		// are less than pattern_len bytes from t
+		int64_t n = tl < pl - 1 ? tl : pl - 1;
+		memcpy(s->scratch, s->tail, s->keep);
+		memcpy(s->scratch + s->keep, t, n);
+		const u_char *r = neb_str_bm_ctx_search(s->ctx, s->scratch, s->keep + n);
+		if (r) {
+			start = (r - s->scratch) - s->keep;
+			found = true;
+		}
+	}
+	if (!found) {
+		const u_char *r = neb_str_bm_ctx_search(s->ctx, t, tl);
+		if (r) {
+			start = r - t;
+			found = true;
+		}
+	}
+
+	if (found) {
+		*consumed = start + pl;
+		s->offset += *consumed;
+		s->keep = 0;
+		return s->offset - pl;
+	}
+
+	*consumed = tl;
+	s->offset += tl;
+	if (tl >= pl - 1) {
+		s->keep = pl - 1;
+		memcpy(s->tail, t + tl - s->keep, s->keep);
+	} else {
+		int keep = s->keep + tl;
+		if (keep > pl - 1)
+			keep = pl - 1;
+		int drop = s->keep + tl - keep;
+		memmove(s->tail, s->tail + drop, s->keep - drop);
+		memcpy(s->tail + s->keep - drop, t, tl);
+		s->keep = keep;
+	}
+	return -1;
 }
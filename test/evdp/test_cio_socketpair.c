@@ -0,0 +1,185 @@
+
+/*
+ * Echo over socketpair with completion based I/O: peer writes first, the
+ * recv handler sends it back, and the peer shutdown after the send is done,
+ * then recv handler should be called with 0 len. The send release should not
+ * be called as the send handler takes the buffer.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_cio.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define BUFLEN 4
+static const char wbuf[BUFLEN] = {0x01, 0x02, 0x03, 0x04};
+static char ebuf[BUFLEN];
+
+static int peer_fd = -1;
+static int recv_ok = 0, send_ok = 0, close_ok = 0, released = 0, timeout = 0;
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "error on fd %d: %m\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t recv_handler(int fd, void *udata, const void *buf, size_t len)
+{
+	neb_evdp_source_t s = udata;
+	if (!buf) {
+		fprintf(stdout, "peer of fd %d closed\n", fd);
+		close_ok = 1;
+		return NEB_EVDP_CB_BREAK_EXP;
+	}
+	fprintf(stdout, "recv %zu bytes from fd %d\n", len, fd);
+	if (len != BUFLEN || memcmp(buf, wbuf, BUFLEN) != 0) {
+		fprintf(stderr, "recv data mismatch\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	recv_ok = 1;
+	memcpy(ebuf, buf, len); // buf is only valid in handler
+	if (neb_evdp_source_cio_send(s, ebuf, len, ebuf) != 0) {
+		fprintf(stderr, "failed to queue send\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t send_handler(int fd, void *udata _nattr_unused, ssize_t res, void *sdata)
+{
+	fprintf(stdout, "send %lld bytes to fd %d\n", (long long int)res, fd);
+	if (res != BUFLEN || sdata != ebuf) {
+		fprintf(stderr, "send failed\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	send_ok = 1;
+	if (shutdown(peer_fd, SHUT_WR) == -1) {
+		perror("shutdown");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static void send_release(ssize_t res, void *sdata _nattr_unused)
+{
+	fprintf(stderr, "send released with res %lld\n", (long long int)res);
+	released = 1;
+}
+
+int main(void)
+{
+	if (!neb_evdp_cio_is_supported()) {
+		neb_evdp_source_t s = neb_evdp_source_new_cio_sock(-1, hup_handler);
+		if (s) {
+			fprintf(stderr, "cio source should not be created if not supported\n");
+			return -1;
+		}
+		fprintf(stdout, "cio is not supported by current evdp driver\n");
+		return 0;
+	}
+
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	peer_fd = sv[1];
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ds = NULL;
+	neb_evdp_source_t ts = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	ds = neb_evdp_source_new_cio_sock(sv[0], hup_handler);
+	if (!ds) {
+		fprintf(stderr, "failed to create cio source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_source_set_udata(ds, ds);
+	neb_evdp_source_cio_set_send_handler(ds, send_handler);
+	neb_evdp_source_cio_set_send_release(ds, send_release);
+	if (neb_evdp_source_cio_set_recv(ds, recv_handler, 4, 64) != 0) {
+		fprintf(stderr, "failed to set recv\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ds) != 0) {
+		fprintf(stderr, "failed to attach cio source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (write(peer_fd, wbuf, sizeof(wbuf)) == -1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	char rbuf[BUFLEN] = NEB_STRUCT_INITIALIZER;
+	ssize_t nr = read(peer_fd, rbuf, sizeof(rbuf));
+	if (nr != BUFLEN || memcmp(rbuf, wbuf, BUFLEN) != 0) {
+		fprintf(stderr, "echo data mismatch\n");
+		ret = -1;
+	}
+	if (timeout || !recv_ok || !send_ok || !close_ok || released) {
+		fprintf(stderr, "timeout: %d, recv: %d, send: %d, close: %d, released: %d\n",
+		        timeout, recv_ok, send_ok, close_ok, released);
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(dq, ts, 0) != 0)
+			fprintf(stderr, "failed to detach timeout source\n");
+		neb_evdp_source_del(ts);
+	}
+	if (ds) {
+		if (neb_evdp_source_get_queue(ds) && neb_evdp_queue_detach(dq, ds, 1) != 0)
+			fprintf(stderr, "failed to detach cio source\n");
+		neb_evdp_source_del(ds);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+exit_close:
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
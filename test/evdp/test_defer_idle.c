@@ -0,0 +1,209 @@
+/*
+ * Activate a defer source several times in one round, and let it activate
+ * itself again. It should run once per round, and the queue should not block
+ * while an idle source is attached. An idle source attached in the defer
+ * callback should start from the next round.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+#include <nebase/evdp/defer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define DEFER_RUNS 3
+#define IDLE_RUNS 10
+
+static neb_evdp_queue_t q = NULL;
+static neb_evdp_source_t ds = NULL;
+static int defer_runs = 0;
+static int idle_runs = 0;
+static int repeated_in_round = 0;
+static uint64_t last_defer_round = 0;
+static int timeout = 0;
+static neb_evdp_source_t late_is = NULL;
+static uint64_t late_attach_round = 0;
+static uint64_t late_first_round = 0;
+
+static uint64_t current_round(void)
+{
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	return stats.rounds;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) == -1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	for (int i = 0; i < DEFER_RUNS; i++) {
+		if (neb_evdp_source_defer_activate(ds) != 0) {
+			fprintf(stderr, "failed to activate defer source\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t late_idle_handler(void *udata _nattr_unused)
+{
+	if (!late_first_round)
+		late_first_round = current_round();
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t defer_handler(void *udata _nattr_unused)
+{
+	uint64_t round = current_round();
+	if (round == last_defer_round)
+		repeated_in_round++;
+	last_defer_round = round;
+
+	defer_runs++;
+	if (defer_runs == 1) {
+		late_is = neb_evdp_source_new_idle(late_idle_handler);
+		if (!late_is || neb_evdp_queue_attach(q, late_is) != 0) {
+			fprintf(stderr, "failed to attach idle source in defer callback\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		late_attach_round = round;
+	}
+	if (defer_runs < DEFER_RUNS) { // should be run in the next round
+		if (neb_evdp_source_defer_activate(ds) != 0) {
+			fprintf(stderr, "failed to activate defer source\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t idle_handler(void *udata _nattr_unused)
+{
+	idle_runs++;
+	if (idle_runs == IDLE_RUNS)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fds[2];
+	neb_evdp_source_t rs = NULL, is = NULL, ts = NULL;
+
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+
+	q = neb_evdp_queue_create(0);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	ds = neb_evdp_source_new_defer(defer_handler);
+	rs = neb_evdp_source_new_ro_fd(fds[0], read_handler, hup_handler);
+	ts = neb_evdp_source_new_itimer_s(1, 2, timeout_handler);
+	if (!ds || !rs || !ts) {
+		fprintf(stderr, "failed to create sources\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_source_defer_activate(ds) == 0) {
+		fprintf(stderr, "defer source is activated before attach\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(q, ds) != 0 || neb_evdp_queue_attach(q, rs) != 0 || neb_evdp_queue_attach(q, ts) != 0) {
+		fprintf(stderr, "failed to attach sources\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (write(fds[1], "x", 1) != 1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	is = neb_evdp_source_new_idle(idle_handler);
+	if (!is) {
+		fprintf(stderr, "failed to create idle source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(q, is) != 0) {
+		fprintf(stderr, "failed to attach idle source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	fprintf(stdout, "rounds: %llu, defer runs: %d, idle runs: %d\n",
+	        (unsigned long long)current_round(), defer_runs, idle_runs);
+	if (timeout || defer_runs != DEFER_RUNS || repeated_in_round || idle_runs != IDLE_RUNS) {
+		fprintf(stderr, "unexpected defer or idle runs, timeout: %d, repeated: %d\n", timeout, repeated_in_round);
+		ret = -1;
+	}
+	if (late_first_round <= late_attach_round) {
+		fprintf(stderr, "idle source attached in round %llu is run in round %llu\n",
+		        (unsigned long long)late_attach_round, (unsigned long long)late_first_round);
+		ret = -1;
+	}
+
+exit_clean:
+	if (late_is) {
+		if (neb_evdp_source_get_queue(late_is) && neb_evdp_queue_detach(q, late_is, 0) != 0)
+			fprintf(stderr, "failed to detach late idle source\n");
+		neb_evdp_source_del(late_is);
+	}
+	if (is) {
+		if (neb_evdp_source_get_queue(is) && neb_evdp_queue_detach(q, is, 0) != 0)
+			fprintf(stderr, "failed to detach idle source\n");
+		neb_evdp_source_del(is);
+	}
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(q, ts, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ts);
+	}
+	if (rs) {
+		if (neb_evdp_source_get_queue(rs) && neb_evdp_queue_detach(q, rs, 0) != 0)
+			fprintf(stderr, "failed to detach ro_fd source\n");
+		neb_evdp_source_del(rs);
+	}
+	if (ds) {
+		if (neb_evdp_source_get_queue(ds) && neb_evdp_queue_detach(q, ds, 0) != 0)
+			fprintf(stderr, "failed to detach defer source\n");
+		neb_evdp_source_del(ds);
+	}
+	if (q)
+		neb_evdp_queue_destroy(q);
+exit_close:
+	close(fds[0]);
+	close(fds[1]);
+	return ret;
+}
@@ -0,0 +1,153 @@
+/*
+ * Make thousands of ro_fd sources readable in one batch, then detach and
+ * delete all of them in the first handler. None of the remaining events of
+ * the batch should reach a handler.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#define SOURCE_COUNT 4096
+#define RESERVED_FDS 64
+
+static neb_evdp_queue_t q = NULL;
+static neb_evdp_source_t ds[SOURCE_COUNT] = NEB_STRUCT_INITIALIZER;
+static int source_count = SOURCE_COUNT;
+static int handled = 0;
+static int late_calls = 0;
+
+static neb_evdp_cb_ret_t read_handler(int fd _nattr_unused, void *udata, const void *context _nattr_unused)
+{
+	handled++;
+	if (handled > 1) {
+		late_calls++;
+		return NEB_EVDP_CB_CONTINUE;
+	}
+
+	int self = (int)(intptr_t)udata;
+	for (int i = 0; i < source_count; i++) {
+		if (i == self || !ds[i])
+			continue;
+		if (neb_evdp_queue_detach(q, ds[i], 1) != 0) {
+			fprintf(stderr, "failed to detach ro_fd source %d\n", i);
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		if (neb_evdp_source_del(ds[i]) != 0) {
+			fprintf(stderr, "failed to del ro_fd source %d\n", i);
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		ds[i] = NULL;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t batch_handler(void *udata _nattr_unused)
+{
+	return NEB_EVDP_CB_BREAK_EXP;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fds[2];
+
+	struct rlimit rl;
+	if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < SOURCE_COUNT + RESERVED_FDS) {
+		rl.rlim_cur = rl.rlim_max < SOURCE_COUNT + RESERVED_FDS ? rl.rlim_max : SOURCE_COUNT + RESERVED_FDS;
+		if (setrlimit(RLIMIT_NOFILE, &rl) == 0 || getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+			if (rl.rlim_cur < SOURCE_COUNT + RESERVED_FDS)
+				source_count = (int)rl.rlim_cur - RESERVED_FDS;
+		}
+	}
+
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.batch_size = source_count;
+	q = neb_evdp_queue_create_ex(&conf);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+	neb_evdp_queue_set_batch_handler(q, batch_handler);
+
+	// all sources share the same pipe by dup, so they get ready all together
+	for (int i = 0; i < source_count; i++) {
+		int fd = dup(fds[0]);
+		if (fd == -1) {
+			perror("dup");
+			ret = -1;
+			goto exit_clean;
+		}
+		ds[i] = neb_evdp_source_new_ro_fd(fd, read_handler, hup_handler);
+		if (!ds[i]) {
+			fprintf(stderr, "failed to create ro_fd source\n");
+			close(fd);
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(ds[i], (void *)(intptr_t)i);
+		if (neb_evdp_queue_attach(q, ds[i]) != 0) {
+			fprintf(stderr, "failed to attach ro_fd source\n");
+			close(fd);
+			neb_evdp_source_del(ds[i]);
+			ds[i] = NULL;
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	if (write(fds[1], "x", 1) != 1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	fprintf(stdout, "sources: %d, rounds: %llu, events: %llu, handled: %d\n",
+	        source_count, (unsigned long long)stats.rounds, (unsigned long long)stats.events, handled);
+	if (handled != 1 || late_calls != 0) {
+		fprintf(stderr, "handler called %d times after detach\n", late_calls);
+		ret = -1;
+	}
+	if (stats.pending + stats.running != 1) {
+		fprintf(stderr, "%d sources left in queue\n", stats.pending + stats.running);
+		ret = -1;
+	}
+
+exit_clean:
+	for (int i = 0; i < source_count; i++) {
+		if (ds[i]) {
+			if (neb_evdp_source_get_queue(ds[i]) && neb_evdp_queue_detach(q, ds[i], 1) != 0)
+				fprintf(stderr, "failed to detach ro_fd source\n");
+			neb_evdp_source_del(ds[i]);
+		}
+	}
+	if (q)
+		neb_evdp_queue_destroy(q);
+exit_close:
+	close(fds[0]);
+	close(fds[1]);
+	return ret;
+}
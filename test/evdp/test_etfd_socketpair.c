@@ -0,0 +1,170 @@
+/*
+ * Fill a nonblock socketpair with an edge triggered source until EAGAIN, and
+ * drain it on the other side, write interest should be notified again after
+ * neb_evdp_source_et_fd_want_write.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define WRITE_ROUNDS 3
+
+static int write_events = 0;
+static size_t total_written = 0;
+static size_t total_read = 0;
+static int timeout = 0;
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t write_handler(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	char buf[4096] = {0};
+	write_events++;
+	for (;;) {
+		ssize_t nw = write(fd, buf, sizeof(buf));
+		if (nw == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			perror("write");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		total_written += nw;
+	}
+	if (write_events < WRITE_ROUNDS && neb_evdp_source_et_fd_want_write(s) != 0) {
+		fprintf(stderr, "failed to want write\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char buf[4096];
+	for (;;) {
+		ssize_t nr = read(fd, buf, sizeof(buf));
+		if (nr == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				break;
+			perror("read");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		if (nr == 0) {
+			fprintf(stderr, "unexpected eof\n");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		total_read += nr;
+	}
+	if (write_events == WRITE_ROUNDS && total_read == total_written)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		int flags = fcntl(sv[i], F_GETFL);
+		if (flags == -1 || fcntl(sv[i], F_SETFL, flags | O_NONBLOCK) == -1) {
+			perror("fcntl");
+			close(sv[0]);
+			close(sv[1]);
+			return -1;
+		}
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ds[2] = {NULL, NULL};
+	neb_evdp_source_t ts = NULL;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	ds[0] = neb_evdp_source_new_et_fd(sv[0], NULL, write_handler, hup_handler);
+	ds[1] = neb_evdp_source_new_et_fd(sv[1], read_handler, NULL, hup_handler);
+	for (int i = 0; i < 2; i++) {
+		if (!ds[i]) {
+			fprintf(stderr, "failed to create et_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(ds[i], ds[i]);
+	}
+	for (int i = 1; i >= 0; i--) {
+		if (neb_evdp_queue_attach(dq, ds[i]) != 0) {
+			fprintf(stderr, "failed to attach et_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+	fprintf(stdout, "write events: %d, written: %zu, read: %zu\n", write_events, total_written, total_read);
+	if (timeout || write_events != WRITE_ROUNDS || total_read != total_written) {
+		fprintf(stderr, "timeout: %d, write events: %d, expect %d\n", timeout, write_events, WRITE_ROUNDS);
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(dq, ts, 0) != 0)
+			fprintf(stderr, "failed to detach timeout source\n");
+		neb_evdp_source_del(ts);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (ds[i]) {
+			if (neb_evdp_source_get_queue(ds[i]) && neb_evdp_queue_detach(dq, ds[i], 1) != 0)
+				fprintf(stderr, "failed to detach et_fd source\n");
+			neb_evdp_source_del(ds[i]);
+		}
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+exit_close:
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
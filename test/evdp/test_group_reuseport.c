@@ -0,0 +1,201 @@
+
+#include <nebase/cdefs.h>
+#include <nebase/thread.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/group.h>
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdatomic.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define QUEUE_COUNT 2
+#define CLIENT_COUNT 8
+
+static neb_evdp_group_t g = NULL;
+static in_port_t listen_port = 0;
+static int listen_fds[QUEUE_COUNT] = {-1, -1};
+static neb_evdp_source_t listen_srcs[QUEUE_COUNT] = {NULL, NULL};
+static atomic_int handled[QUEUE_COUNT];
+static atomic_int accepted;
+
+static int new_listen_socket(in_port_t port, struct sockaddr_in *addr)
+{
+	int fd = neb_sock_inet_new(AF_INET, SOCK_STREAM, 0);
+	if (fd == -1)
+		return -1;
+	if (neb_sock_inet_enable_reuseport(fd) != 0) {
+		close(fd);
+		return -1;
+	}
+	addr->sin_family = AF_INET;
+	addr->sin_port = port;
+	addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(fd, (struct sockaddr *)addr, sizeof(*addr)) == -1) {
+		perror("bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+static neb_evdp_cb_ret_t on_accept(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	for (;;) {
+		int cfd = accept(fd, NULL, NULL);
+		if (cfd == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+				return NEB_EVDP_CB_CONTINUE;
+			perror("accept");
+			return NEB_EVDP_CB_BREAK_ERR;
+		}
+		atomic_fetch_add(&accepted, 1);
+		if (neb_evdp_group_dispatch_fd(g, cfd) < 0) {
+			fprintf(stderr, "failed to dispatch fd %d\n", cfd);
+			close(cfd);
+		}
+	}
+}
+
+static int setup(neb_evdp_queue_t q, int index, void *udata _nattr_unused)
+{
+	struct sockaddr_in addr;
+	int fd = new_listen_socket(listen_port, &addr);
+	if (fd == -1)
+		return -1;
+	if (listen(fd, CLIENT_COUNT) == -1) {
+		perror("listen");
+		close(fd);
+		return -1;
+	}
+	listen_fds[index] = fd;
+
+	neb_evdp_source_t s = neb_evdp_source_new_ro_fd(fd, on_accept, neb_evdp_sock_log_on_hup);
+	if (!s) {
+		fprintf(stderr, "failed to create listen source\n");
+		return -1;
+	}
+	if (neb_evdp_queue_attach(q, s) != 0) {
+		fprintf(stderr, "failed to attach listen source\n");
+		neb_evdp_source_del(s);
+		return -1;
+	}
+	listen_srcs[index] = s;
+	return 0;
+}
+
+static void cleanup(neb_evdp_queue_t q, int index, void *udata _nattr_unused)
+{
+	neb_evdp_source_t s = listen_srcs[index];
+	if (s) {
+		if (neb_evdp_queue_detach(q, s, 1) != 0)
+			fprintf(stderr, "failed to detach listen source\n");
+		neb_evdp_source_del(s);
+		listen_srcs[index] = NULL;
+	}
+	if (listen_fds[index] >= 0) {
+		close(listen_fds[index]);
+		listen_fds[index] = -1;
+	}
+}
+
+static int fd_handler(neb_evdp_queue_t q _nattr_unused, int index, int fd, void *udata _nattr_unused)
+{
+	atomic_fetch_add(&handled[index], 1);
+	close(fd);
+	return 0;
+}
+
+int main(void)
+{
+	if (neb_thread_init() != 0) {
+		fprintf(stderr, "thread init failed\n");
+		return -1;
+	}
+
+	// get a free port, and keep the socket bound to hold it
+	struct sockaddr_in addr;
+	int hold_fd = new_listen_socket(0, &addr);
+	if (hold_fd == -1) {
+		neb_thread_deinit();
+		return -1;
+	}
+	socklen_t addrlen = sizeof(addr);
+	if (getsockname(hold_fd, (struct sockaddr *)&addr, &addrlen) == -1) {
+		perror("getsockname");
+		close(hold_fd);
+		neb_thread_deinit();
+		return -1;
+	}
+	listen_port = addr.sin_port;
+
+	int ret = 0;
+	g = neb_evdp_group_create(QUEUE_COUNT, 0);
+	if (!g) {
+		fprintf(stderr, "failed to create evdp group\n");
+		ret = -1;
+		goto exit_deinit;
+	}
+	neb_evdp_group_set_setup(g, setup, cleanup);
+	neb_evdp_group_set_fd_handler(g, fd_handler);
+	neb_evdp_group_set_cpu_affinity(g, true);
+	if (neb_evdp_group_start(g) != 0) {
+		fprintf(stderr, "failed to start evdp group\n");
+		ret = -1;
+		goto exit_destroy;
+	}
+
+	for (int i = 0; i < CLIENT_COUNT; i++) {
+		int fd = neb_sock_inet_new(AF_INET, SOCK_STREAM, 0);
+		if (fd == -1) {
+			ret = -1;
+			break;
+		}
+		if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 && errno != EINPROGRESS) {
+			perror("connect");
+			close(fd);
+			ret = -1;
+			break;
+		}
+		close(fd);
+	}
+
+	for (int i = 0; i < 200; i++) {
+		int total = 0;
+		for (int j = 0; j < QUEUE_COUNT; j++)
+			total += atomic_load(&handled[j]);
+		if (total >= CLIENT_COUNT)
+			break;
+		usleep(10000);
+	}
+
+	if (neb_evdp_group_stop(g) != 0) {
+		fprintf(stderr, "failed to stop evdp group\n");
+		ret = -1;
+	}
+
+	if (atomic_load(&accepted) != CLIENT_COUNT) {
+		fprintf(stderr, "accepted %d, but expect %d\n", atomic_load(&accepted), CLIENT_COUNT);
+		ret = -1;
+	}
+	for (int j = 0; j < QUEUE_COUNT; j++) {
+		int n = atomic_load(&handled[j]);
+		fprintf(stdout, "queue %d handled %d fds\n", j, n);
+		if (n != CLIENT_COUNT / QUEUE_COUNT) {
+			fprintf(stderr, "fds are not dispatched in round-robin order\n");
+			ret = -1;
+		}
+	}
+
+exit_destroy:
+	neb_evdp_group_destroy(g);
+exit_deinit:
+	close(hold_fd);
+	neb_thread_deinit();
+	return ret;
+}
@@ -0,0 +1,144 @@
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/notify.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <pthread.h>
+
+#define PRODUCER_COUNT 4
+#define TASK_COUNT 20000
+
+static neb_evdp_source_t ns = NULL;
+static int task_done = 0;
+static int wakeup_count = 0;
+static int producer_failed = 0;
+static int timeout = 0;
+
+static void task(void *arg)
+{
+	int *last = arg;
+	*last += 1; // check per producer order
+	task_done++;
+}
+
+static neb_evdp_cb_ret_t notify_handler(void *udata _nattr_unused)
+{
+	wakeup_count++;
+	if (task_done == PRODUCER_COUNT * TASK_COUNT)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static int counts[PRODUCER_COUNT];
+
+static void *producer(void *arg)
+{
+	int *count = arg;
+	for (int i = 0; i < TASK_COUNT; i++) {
+		if (neb_evdp_source_notify_post(ns, task, count) != 0) {
+			producer_failed = 1;
+			break;
+		}
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ts = NULL;
+	pthread_t ptids[PRODUCER_COUNT];
+	int nthreads = 0;
+
+	dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+
+	ns = neb_evdp_source_new_notify(notify_handler);
+	if (!ns) {
+		fprintf(stderr, "failed to create notify source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	// signal before attach should not be lost
+	if (neb_evdp_source_notify_signal(ns) != 0) {
+		fprintf(stderr, "failed to signal notify source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ns) != 0) {
+		fprintf(stderr, "failed to attach notify source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	ts = neb_evdp_source_new_itimer_s(1, 10, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	for (int i = 0; i < PRODUCER_COUNT; i++) {
+		if (pthread_create(&ptids[i], NULL, producer, &counts[i]) != 0) {
+			fprintf(stderr, "failed to create producer thread\n");
+			ret = -1;
+			break;
+		}
+		nthreads++;
+	}
+
+	if (ret == 0 && neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	for (int i = 0; i < nthreads; i++)
+		pthread_join(ptids[i], NULL);
+
+	if (timeout || producer_failed) {
+		fprintf(stderr, "timeout: %d, producer failed: %d\n", timeout, producer_failed);
+		ret = -1;
+	}
+	for (int i = 0; i < PRODUCER_COUNT; i++) {
+		if (counts[i] != TASK_COUNT) {
+			fprintf(stderr, "producer %d: %d tasks done, expect %d\n", i, counts[i], TASK_COUNT);
+			ret = -1;
+		}
+	}
+	fprintf(stdout, "%d tasks done with %d wakeups\n", task_done, wakeup_count);
+	if (wakeup_count < 1 || wakeup_count > task_done) {
+		fprintf(stderr, "invalid wakeup count\n");
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(dq, ts, 0) != 0)
+			fprintf(stderr, "failed to detach timeout source\n");
+		neb_evdp_source_del(ts);
+	}
+	if (ns) {
+		if (neb_evdp_source_get_queue(ns) && neb_evdp_queue_detach(dq, ns, 0) != 0)
+			fprintf(stderr, "failed to detach notify source\n");
+		neb_evdp_source_del(ns);
+	}
+	neb_evdp_queue_destroy(dq);
+	return ret;
+}
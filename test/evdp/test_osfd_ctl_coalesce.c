@@ -0,0 +1,153 @@
+
+/*
+ * Ping-pong over socketpair with ctl_coalesce set, the read handler is set
+ * again in each callback, which should not need any more ctl syscalls.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define BOUNCE_COUNT 1000
+
+static int bounce = 0;
+static int timeout = 0;
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata, const void *context _nattr_unused)
+{
+	neb_evdp_source_t s = udata;
+	char c;
+	if (read(fd, &c, 1) != 1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (++bounce == BOUNCE_COUNT)
+		return NEB_EVDP_CB_BREAK_EXP;
+	if (write(fd, &c, 1) != 1) {
+		perror("write");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (neb_evdp_source_os_fd_next_read(s, read_handler) != 0) {
+		fprintf(stderr, "failed to set next read handler\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ds[2] = {NULL, NULL};
+	neb_evdp_source_t ts = NULL;
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.ctl_coalesce = 1;
+	dq = neb_evdp_queue_create_ex(&conf);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		ds[i] = neb_evdp_source_new_os_fd(sv[i], hup_handler);
+		if (!ds[i]) {
+			fprintf(stderr, "failed to create os_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(ds[i], ds[i]);
+		if (neb_evdp_source_os_fd_next_read(ds[i], read_handler) != 0) {
+			fprintf(stderr, "failed to set read handler\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_attach(dq, ds[i]) != 0) {
+			fprintf(stderr, "failed to attach os_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (write(sv[0], "x", 1) != 1) {
+		perror("write");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+	if (timeout || bounce != BOUNCE_COUNT) {
+		fprintf(stderr, "timeout: %d, bounce: %d, expect %d\n", timeout, bounce, BOUNCE_COUNT);
+		ret = -1;
+	}
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(dq, &stats);
+	fprintf(stdout, "rounds: %llu, events: %llu, ctl calls: %llu, ctl saved: %llu\n",
+	        (unsigned long long)stats.rounds, (unsigned long long)stats.events,
+	        (unsigned long long)stats.ctl_calls, (unsigned long long)stats.ctl_saved);
+	if (stats.ctl_calls > 0 && (stats.ctl_calls >= BOUNCE_COUNT || stats.ctl_saved < BOUNCE_COUNT - 1)) {
+		fprintf(stderr, "ctl calls are not coalesced\n");
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(dq, ts, 0) != 0)
+			fprintf(stderr, "failed to detach timeout source\n");
+		neb_evdp_source_del(ts);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (ds[i]) {
+			if (neb_evdp_source_get_queue(ds[i]) && neb_evdp_queue_detach(dq, ds[i], 1) != 0)
+				fprintf(stderr, "failed to detach os_fd source\n");
+			neb_evdp_source_del(ds[i]);
+		}
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+exit_close:
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
@@ -0,0 +1,167 @@
+/*
+ * Keep many pipes readable to grow the batch size, then drain them and let a
+ * fast itimer run to shrink it back.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define PIPE_COUNT 64
+#define MIN_BATCH_SIZE 4
+
+static neb_evdp_queue_t q = NULL;
+static int drain = 0;
+static int max_batch_size = 0;
+static int timeout = 0;
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	if (!drain) // keep it readable
+		return NEB_EVDP_CB_CONTINUE;
+	char c;
+	if (read(fd, &c, 1) == -1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t batch_handler(void *udata _nattr_unused)
+{
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	if (stats.batch_size > max_batch_size)
+		max_batch_size = stats.batch_size;
+	if (stats.batch_size >= PIPE_COUNT)
+		drain = 1;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t tick_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	if (drain && stats.batch_size == MIN_BATCH_SIZE)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fds[PIPE_COUNT][2];
+	neb_evdp_source_t ds[PIPE_COUNT] = NEB_STRUCT_INITIALIZER;
+	neb_evdp_source_t ticker = NULL, ts = NULL;
+
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		if (pipe(fds[i]) == -1) {
+			perror("pipe");
+			for (int j = 0; j < i; j++) {
+				close(fds[j][0]);
+				close(fds[j][1]);
+			}
+			return -1;
+		}
+	}
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.batch_size = MIN_BATCH_SIZE;
+	conf.adaptive_batch = 1;
+	q = neb_evdp_queue_create_ex(&conf);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+	neb_evdp_queue_set_batch_handler(q, batch_handler);
+
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		ds[i] = neb_evdp_source_new_ro_fd(fds[i][0], read_handler, hup_handler);
+		if (!ds[i]) {
+			fprintf(stderr, "failed to create ro_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_attach(q, ds[i]) != 0) {
+			fprintf(stderr, "failed to attach ro_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (write(fds[i][1], "x", 1) != 1) {
+			perror("write");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	ticker = neb_evdp_source_new_itimer_ms(1, 1, tick_handler);
+	ts = neb_evdp_source_new_itimer_s(2, 5, timeout_handler);
+	if (!ticker || !ts) {
+		fprintf(stderr, "failed to create itimer source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(q, ticker) != 0 || neb_evdp_queue_attach(q, ts) != 0) {
+		fprintf(stderr, "failed to attach itimer source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	fprintf(stdout, "rounds: %llu, full batches: %llu, max batch size: %d, batch size: %d\n",
+	        (unsigned long long)stats.rounds, (unsigned long long)stats.full_batches, max_batch_size, stats.batch_size);
+	if (timeout || max_batch_size < PIPE_COUNT || stats.full_batches == 0 || stats.batch_size != MIN_BATCH_SIZE) {
+		fprintf(stderr, "batch size is not adapted, timeout: %d\n", timeout);
+		ret = -1;
+	}
+
+exit_clean:
+	if (ticker) {
+		if (neb_evdp_source_get_queue(ticker) && neb_evdp_queue_detach(q, ticker, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ticker);
+	}
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(q, ts, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ts);
+	}
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		if (ds[i]) {
+			if (neb_evdp_source_get_queue(ds[i]) && neb_evdp_queue_detach(q, ds[i], 1) != 0)
+				fprintf(stderr, "failed to detach ro_fd source\n");
+			neb_evdp_source_del(ds[i]);
+		}
+	}
+	if (q)
+		neb_evdp_queue_destroy(q);
+exit_close:
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	return ret;
+}
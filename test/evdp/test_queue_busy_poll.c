@@ -0,0 +1,142 @@
+/*
+ * Data written soon should be got while spinning, and data written later
+ * should be got after falling back to a blocking wait.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define BUSY_POLL_USEC 50000
+#define SOON_USEC 5000
+#define LATER_USEC 300000
+
+static int read_count = 0;
+static int timeout = 0;
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) != 1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (++read_count == 2)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static void *writer_run(void *arg)
+{
+	int fd = *(int *)arg;
+	usleep(SOON_USEC);
+	if (write(fd, "x", 1) != 1)
+		perror("write");
+	usleep(LATER_USEC);
+	if (write(fd, "x", 1) != 1)
+		perror("write");
+	return NULL;
+}
+
+int main(void)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ds = NULL, ts = NULL;
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.busy_poll_usec = BUSY_POLL_USEC;
+	dq = neb_evdp_queue_create_ex(&conf);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	ds = neb_evdp_source_new_ro_fd(sv[0], read_handler, hup_handler);
+	if (!ds) {
+		fprintf(stderr, "failed to create ro_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ds) != 0) {
+		fprintf(stderr, "failed to attach ro_fd source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	pthread_t writer;
+	if (pthread_create(&writer, NULL, writer_run, &sv[1]) != 0) {
+		perror("pthread_create");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+	pthread_join(writer, NULL);
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(dq, &stats);
+	fprintf(stdout, "rounds: %llu, spin hits: %llu, sleeps: %llu\n", (unsigned long long)stats.rounds,
+	        (unsigned long long)stats.spin_hits, (unsigned long long)stats.sleeps);
+	if (timeout || read_count != 2 || stats.spin_hits < 1 || stats.sleeps < 1) {
+		fprintf(stderr, "unexpected busy poll result, timeout: %d, read count: %d\n", timeout, read_count);
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(dq, ts, 0) != 0)
+			fprintf(stderr, "failed to detach timeout source\n");
+		neb_evdp_source_del(ts);
+	}
+	if (ds) {
+		if (neb_evdp_source_get_queue(ds) && neb_evdp_queue_detach(dq, ds, 1) != 0)
+			fprintf(stderr, "failed to detach ro_fd source\n");
+		neb_evdp_source_del(ds);
+	}
+	if (dq)
+		neb_evdp_queue_destroy(dq);
+exit_close:
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
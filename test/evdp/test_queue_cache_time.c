@@ -0,0 +1,103 @@
+/*
+ * Timer points should still fire in time with cache_time set, and the cached
+ * time should not be earlier than the scheduled one in the callback.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/sys_timer.h>
+#include <nebase/events.h>
+#include <nebase/time.h>
+
+#include <stdio.h>
+
+#define TIMER_POINTS 3
+#define TIMER_INTERVAL_MS 10
+
+static neb_evdp_queue_t q = NULL;
+static struct timespec sched_ts[TIMER_POINTS];
+static int fired = 0;
+static int failed = 0;
+
+static neb_evdp_timeout_ret_t timer_cb(void *udata)
+{
+	int i = (int)(intptr_t)udata;
+	struct timespec now;
+	neb_evdp_queue_get_cur_ts(q, &now);
+	if (neb_timespeccmp(&now, &sched_ts[i], <)) {
+		fprintf(stderr, "timer point %d fired before its time\n", i);
+		failed = 1;
+	}
+	if (i != fired) {
+		fprintf(stderr, "timer point %d fired out of order\n", i);
+		failed = 1;
+	}
+	if (++fired == TIMER_POINTS)
+		thread_events |= T_E_QUIT;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static neb_evdp_cb_ret_t timeout_cb(unsigned int id _nattr_unused, long overrun _nattr_unused, void *data _nattr_unused)
+{
+	fprintf(stderr, "timer points are not fired in time\n");
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+int main(void)
+{
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.cache_time = 1;
+	q = neb_evdp_queue_create_ex(&conf);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+
+	int ret = 0;
+	neb_evdp_source_t s = neb_evdp_source_new_itimer_s(0, 5, timeout_cb);
+	if (!s) {
+		fprintf(stderr, "failed to create sys timer source\n");
+		ret = -1;
+		goto exit_destroy_queue;
+	}
+	if (neb_evdp_queue_attach(q, s) != 0) {
+		fprintf(stderr, "failed to attach sys timer source\n");
+		ret = -1;
+		goto exit_del_source;
+	}
+
+	neb_evdp_timer_t t = neb_evdp_timer_create(TIMER_POINTS, TIMER_POINTS);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_detach_source;
+	}
+	neb_evdp_queue_set_timer(q, t);
+
+	for (int i = 0; i < TIMER_POINTS; i++) {
+		neb_evdp_queue_get_abs_timeout_ms(q, (i + 1) * TIMER_INTERVAL_MS, &sched_ts[i]);
+		if (!neb_evdp_timer_new_point(t, &sched_ts[i], timer_cb, (void *)(intptr_t)i)) {
+			fprintf(stderr, "failed to add timer point\n");
+			ret = -1;
+			goto exit_destroy_timer;
+		}
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+	if (failed || fired != TIMER_POINTS)
+		ret = -1;
+
+exit_destroy_timer:
+	neb_evdp_timer_destroy(t);
+exit_detach_source:
+	if (neb_evdp_queue_detach(q, s, 0) != 0)
+		fprintf(stderr, "failed to detach sys timer source\n");
+exit_del_source:
+	neb_evdp_source_del(s);
+exit_destroy_queue:
+	neb_evdp_queue_destroy(q);
+	return ret;
+}
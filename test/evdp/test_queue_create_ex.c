@@ -0,0 +1,131 @@
+
+/*
+ * Create queue with custom conf, and more sources than both the batch size
+ * and the io_uring sq size, all of them should be handled.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define PIPE_COUNT 64
+
+static int pipes[PIPE_COUNT][2];
+static neb_evdp_source_t sources[PIPE_COUNT];
+static int read_count = 0;
+static int timeout = 0;
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	char c;
+	if (read(fd, &c, 1) != 1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	read_count++;
+	if (read_count == PIPE_COUNT)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_REMOVE;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int npipes = 0;
+	neb_evdp_queue_t dq = NULL;
+	neb_evdp_source_t ts = NULL;
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.batch_size = 4;
+	conf.sq_entries = 16;
+	conf.cq_entries = 128;
+	conf.coop_taskrun = 1;
+	conf.single_issuer = 1;
+	dq = neb_evdp_queue_create_ex(&conf);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+
+	for (; npipes < PIPE_COUNT; npipes++) {
+		if (pipe(pipes[npipes]) == -1) {
+			perror("pipe");
+			ret = -1;
+			goto exit_clean;
+		}
+		sources[npipes] = neb_evdp_source_new_ro_fd(pipes[npipes][0], read_handler, hup_handler);
+		if (!sources[npipes]) {
+			fprintf(stderr, "failed to create ro_fd source\n");
+			npipes++;
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_attach(dq, sources[npipes]) != 0) {
+			fprintf(stderr, "failed to attach ro_fd source\n");
+			npipes++;
+			ret = -1;
+			goto exit_clean;
+		}
+		if (write(pipes[npipes][1], "x", 1) != 1) {
+			perror("write");
+			npipes++;
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timeout source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+	if (timeout || read_count != PIPE_COUNT) {
+		fprintf(stderr, "timeout: %d, read count: %d, expect %d\n", timeout, read_count, PIPE_COUNT);
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(dq, ts, 0) != 0)
+			fprintf(stderr, "failed to detach timeout source\n");
+		neb_evdp_source_del(ts);
+	}
+	for (int i = 0; i < npipes; i++) {
+		if (sources[i]) {
+			if (neb_evdp_source_get_queue(sources[i]) && neb_evdp_queue_detach(dq, sources[i], 0) != 0)
+				fprintf(stderr, "failed to detach ro_fd source\n");
+			neb_evdp_source_del(sources[i]);
+		}
+		close(pipes[i][0]);
+		close(pipes[i][1]);
+	}
+	neb_evdp_queue_destroy(dq);
+	return ret;
+}
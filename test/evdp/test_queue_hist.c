@@ -0,0 +1,172 @@
+/*
+ * Run an instrumented queue with a slow sys timer callback and a timer point,
+ * while another thread keeps reading the histograms.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SLOW_CB_COUNT 5
+#define SLOW_CB_USEC 2000
+
+static int slow_cb_count = 0;
+static int timer_cb_count = 0;
+static atomic_bool reader_stop = false;
+static neb_evdp_queue_t q = NULL;
+
+static neb_evdp_cb_ret_t slow_cb(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	usleep(SLOW_CB_USEC);
+	if (++slow_cb_count == SLOW_CB_COUNT)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_timeout_ret_t timer_cb(void *udata _nattr_unused)
+{
+	timer_cb_count++;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static void *reader_run(void *arg)
+{
+	int *ret = arg;
+	static struct neb_evdp_hist h;
+	while (!atomic_load(&reader_stop)) {
+		if (neb_evdp_queue_get_hist(q, NEB_EVDP_HIST_WAIT, &h) != 0) {
+			*ret = -1;
+			break;
+		}
+		usleep(100);
+	}
+	return NULL;
+}
+
+static int check_count(int id, const char *name, uint64_t min, uint64_t max)
+{
+	static struct neb_evdp_hist h;
+	if (neb_evdp_queue_get_hist(q, id, &h) != 0) {
+		fprintf(stderr, "failed to get hist %s\n", name);
+		return -1;
+	}
+	fprintf(stdout, "%s: count %llu, p50 %llu, p99 %llu, max %llu\n", name, (unsigned long long)h.count,
+	        (unsigned long long)neb_evdp_hist_percentile(&h, 50), (unsigned long long)neb_evdp_hist_percentile(&h, 99),
+	        (unsigned long long)h.max);
+	if (h.count < min || h.count > max) {
+		fprintf(stderr, "%s: count %llu, expect [%llu, %llu]\n", name, (unsigned long long)h.count,
+		        (unsigned long long)min, (unsigned long long)max);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	neb_evdp_queue_t plain_q = neb_evdp_queue_create(0);
+	if (!plain_q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+	struct neb_evdp_hist h;
+	int ret = neb_evdp_queue_get_hist(plain_q, NEB_EVDP_HIST_WAIT, &h);
+	neb_evdp_queue_destroy(plain_q);
+	if (ret == 0) {
+		fprintf(stderr, "hist should not be available for not instrumented queue\n");
+		return -1;
+	}
+
+	ret = 0;
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.instrument = 1;
+	q = neb_evdp_queue_create_ex(&conf);
+	if (!q) {
+		fprintf(stderr, "failed to create instrumented evdp queue\n");
+		return -1;
+	}
+
+	neb_evdp_source_t s = neb_evdp_source_new_itimer_ms(0, 5, slow_cb);
+	if (!s) {
+		fprintf(stderr, "failed to create sys timer source\n");
+		ret = -1;
+		goto exit_destroy_queue;
+	}
+	if (neb_evdp_queue_attach(q, s) != 0) {
+		fprintf(stderr, "failed to attach sys timer source\n");
+		ret = -1;
+		goto exit_del_source;
+	}
+
+	neb_evdp_timer_t t = neb_evdp_timer_create(1, 1);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_detach_source;
+	}
+	neb_evdp_queue_set_timer(q, t);
+	struct timespec ts;
+	neb_evdp_queue_update_cur_ts(q);
+	neb_evdp_queue_get_abs_timeout_ms(q, 1, &ts);
+	if (!neb_evdp_timer_new_point(t, &ts, timer_cb, NULL)) {
+		fprintf(stderr, "failed to add timer point\n");
+		ret = -1;
+		goto exit_destroy_timer;
+	}
+
+	int reader_ret = 0;
+	pthread_t reader;
+	if (pthread_create(&reader, NULL, reader_run, &reader_ret) != 0) {
+		perror("pthread_create");
+		ret = -1;
+		goto exit_destroy_timer;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	atomic_store(&reader_stop, true);
+	pthread_join(reader, NULL);
+	if (reader_ret != 0) {
+		fprintf(stderr, "failed to read hist in another thread\n");
+		ret = -1;
+	}
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	if (check_count(NEB_EVDP_HIST_CB_SYS_TIMER, "cb_sys_timer", SLOW_CB_COUNT, SLOW_CB_COUNT) != 0 ||
+	    check_count(NEB_EVDP_HIST_CB_TIMER, "cb_timer", timer_cb_count, timer_cb_count) != 0 ||
+	    check_count(NEB_EVDP_HIST_TIMER_LAG, "timer_lag", timer_cb_count, timer_cb_count) != 0 ||
+	    check_count(NEB_EVDP_HIST_WAIT, "wait", stats.rounds, stats.rounds) != 0 ||
+	    check_count(NEB_EVDP_HIST_EVENTS, "events", stats.rounds, stats.rounds) != 0 ||
+	    check_count(NEB_EVDP_HIST_FLUSH, "flush", stats.rounds, stats.rounds) != 0)
+		ret = -1;
+	if (timer_cb_count != 1) {
+		fprintf(stderr, "timer point called %d times\n", timer_cb_count);
+		ret = -1;
+	}
+
+	if (neb_evdp_queue_get_hist(q, NEB_EVDP_HIST_CB_SYS_TIMER, &h) == 0 &&
+	    neb_evdp_hist_percentile(&h, 50) < SLOW_CB_USEC * 1000) {
+		fprintf(stderr, "slow callback is not recorded\n");
+		ret = -1;
+	}
+
+exit_destroy_timer:
+	neb_evdp_timer_destroy(t);
+exit_detach_source:
+	if (neb_evdp_queue_detach(q, s, 0) != 0)
+		fprintf(stderr, "failed to detach sys timer source\n");
+exit_del_source:
+	neb_evdp_source_del(s);
+exit_destroy_queue:
+	neb_evdp_queue_destroy(q);
+	return ret;
+}
@@ -0,0 +1,176 @@
+/*
+ * Make many low priority pipes and one high priority pipe readable in the
+ * same round. The high one should be served first, and low ones should be
+ * spread to later rounds by the budget.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define LOW_COUNT 8
+#define LOW_BUDGET 2
+#define HIGH_ID LOW_COUNT
+
+static int handled = 0;
+static int first_id = -1;
+static int low_in_round = 0;
+static int max_low_in_round = 0;
+static int timeout = 0;
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata, const void *context _nattr_unused)
+{
+	int id = (int)(intptr_t)udata;
+	if (first_id < 0)
+		first_id = id;
+	if (id != HIGH_ID)
+		low_in_round++;
+
+	char c;
+	if (read(fd, &c, 1) == -1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	handled++;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t batch_handler(void *udata _nattr_unused)
+{
+	if (low_in_round > max_low_in_round)
+		max_low_in_round = low_in_round;
+	low_in_round = 0;
+	if (handled == LOW_COUNT + 1)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+int main(void)
+{
+	int ret = 0;
+	int fds[LOW_COUNT + 1][2];
+	neb_evdp_source_t ds[LOW_COUNT + 1] = NEB_STRUCT_INITIALIZER;
+	neb_evdp_source_t ts = NULL;
+
+	for (int i = 0; i <= LOW_COUNT; i++) {
+		if (pipe(fds[i]) == -1) {
+			perror("pipe");
+			for (int j = 0; j < i; j++) {
+				close(fds[j][0]);
+				close(fds[j][1]);
+			}
+			return -1;
+		}
+	}
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.batch_size = 2 * (LOW_COUNT + 1);
+	conf.prio_budget[NEB_EVDP_PRIO_LOW] = LOW_BUDGET;
+	neb_evdp_queue_t q = neb_evdp_queue_create_ex(&conf);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+	neb_evdp_queue_set_batch_handler(q, batch_handler);
+
+	// the high one is attached and written at last, so it is the last one in kernel order
+	for (int i = 0; i <= LOW_COUNT; i++) {
+		ds[i] = neb_evdp_source_new_ro_fd(fds[i][0], read_handler, hup_handler);
+		if (!ds[i]) {
+			fprintf(stderr, "failed to create ro_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		neb_evdp_source_set_udata(ds[i], (void *)(intptr_t)i);
+		if (neb_evdp_source_set_priority(ds[i], i == HIGH_ID ? NEB_EVDP_PRIO_HIGH : NEB_EVDP_PRIO_LOW) != 0) {
+			fprintf(stderr, "failed to set priority\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_attach(q, ds[i]) != 0) {
+			fprintf(stderr, "failed to attach ro_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (write(fds[i][1], "x", 1) != 1) {
+			perror("write");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+	if (neb_evdp_source_set_priority(ds[0], NEB_EVDP_PRIO_MAX) == 0) {
+		fprintf(stderr, "invalid priority is accepted\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create itimer source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(q, ts) != 0) {
+		fprintf(stderr, "failed to attach itimer source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	fprintf(stdout, "rounds: %llu, first: %d, max low in round: %d, deferred: %llu\n",
+	        (unsigned long long)stats.rounds, first_id, max_low_in_round, (unsigned long long)stats.prio_deferred);
+	if (timeout || first_id != HIGH_ID) {
+		fprintf(stderr, "high priority source is not served first, timeout: %d\n", timeout);
+		ret = -1;
+	}
+	if (max_low_in_round > LOW_BUDGET || stats.prio_deferred == 0) {
+		fprintf(stderr, "low priority budget is not respected\n");
+		ret = -1;
+	}
+
+exit_clean:
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(q, ts, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ts);
+	}
+	for (int i = 0; i <= LOW_COUNT; i++) {
+		if (ds[i]) {
+			if (neb_evdp_source_get_queue(ds[i]) && neb_evdp_queue_detach(q, ds[i], 1) != 0)
+				fprintf(stderr, "failed to detach ro_fd source\n");
+			neb_evdp_source_del(ds[i]);
+		}
+	}
+	if (q)
+		neb_evdp_queue_destroy(q);
+exit_close:
+	for (int i = 0; i <= LOW_COUNT; i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	return ret;
+}
@@ -0,0 +1,227 @@
+/*
+ * Make many pipes readable and many timer points expired at the same time,
+ * with a small round budget. They should be spread over rounds, and none of
+ * them should be lost.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+
+#define PIPE_COUNT 16
+#define POINT_COUNT 20
+#define ROUND_EVENTS 4
+#define ROUND_TIMERS 5
+
+static neb_evdp_queue_t q = NULL;
+static int read_count = 0;
+static int fire_count = 0;
+static uint64_t last_round = 0;
+static int in_round = 0;
+static int max_in_round = 0;
+static int timeout = 0;
+
+static void count_in_round(void)
+{
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	if (stats.rounds != last_round) {
+		last_round = stats.rounds;
+		in_round = 0;
+	}
+	in_round++;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	count_in_round();
+	if (in_round > max_in_round)
+		max_in_round = in_round;
+
+	char c;
+	if (read(fd, &c, 1) == -1) {
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	read_count++;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_timeout_ret_t point_handler(void *udata _nattr_unused)
+{
+	count_in_round();
+	if (in_round > max_in_round)
+		max_in_round = in_round;
+	fire_count++;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static neb_evdp_cb_ret_t tick_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	if (read_count == PIPE_COUNT && fire_count == POINT_COUNT)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static int test_round_budget(int use_wheel)
+{
+	int ret = 0;
+	int fds[PIPE_COUNT][2];
+	neb_evdp_source_t ds[PIPE_COUNT] = NEB_STRUCT_INITIALIZER;
+	neb_evdp_source_t ticker = NULL, ts = NULL;
+	neb_evdp_timer_t t = NULL;
+
+	read_count = 0;
+	fire_count = 0;
+	last_round = 0;
+	in_round = 0;
+	max_in_round = 0;
+
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		if (pipe(fds[i]) == -1) {
+			perror("pipe");
+			for (int j = 0; j < i; j++) {
+				close(fds[j][0]);
+				close(fds[j][1]);
+			}
+			return -1;
+		}
+	}
+
+	struct neb_evdp_queue_conf conf = NEB_STRUCT_INITIALIZER;
+	conf.batch_size = 2 * PIPE_COUNT;
+	conf.round_events = ROUND_EVENTS;
+	conf.round_timers = ROUND_TIMERS;
+	q = neb_evdp_queue_create_ex(&conf);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	if (use_wheel)
+		t = neb_evdp_timer_create_wheel(0, POINT_COUNT);
+	else
+		t = neb_evdp_timer_create(POINT_COUNT, POINT_COUNT);
+	if (!t) {
+		fprintf(stderr, "failed to create evdp timer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	neb_evdp_queue_set_timer(q, t);
+	struct timespec abs_ts = { .tv_sec = 0, .tv_nsec = 1000000 }; // already expired
+	for (int i = 0; i < POINT_COUNT; i++) {
+		if (!neb_evdp_timer_new_point(t, &abs_ts, point_handler, NULL)) {
+			fprintf(stderr, "failed to add timer point\n");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		ds[i] = neb_evdp_source_new_ro_fd(fds[i][0], read_handler, hup_handler);
+		if (!ds[i]) {
+			fprintf(stderr, "failed to create ro_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (neb_evdp_queue_attach(q, ds[i]) != 0) {
+			fprintf(stderr, "failed to attach ro_fd source\n");
+			ret = -1;
+			goto exit_clean;
+		}
+		if (write(fds[i][1], "x", 1) != 1) {
+			perror("write");
+			ret = -1;
+			goto exit_clean;
+		}
+	}
+
+	ticker = neb_evdp_source_new_itimer_ms(1, 1, tick_handler);
+	ts = neb_evdp_source_new_itimer_s(2, 5, timeout_handler);
+	if (!ticker || !ts) {
+		fprintf(stderr, "failed to create itimer source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_queue_attach(q, ticker) != 0 || neb_evdp_queue_attach(q, ts) != 0) {
+		fprintf(stderr, "failed to attach itimer source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	struct neb_evdp_queue_stats stats;
+	neb_evdp_queue_get_stats(q, &stats);
+	fprintf(stdout, "wheel: %d, rounds: %llu, carried events: %llu, max callbacks in round: %d\n",
+	        use_wheel, (unsigned long long)stats.rounds, (unsigned long long)stats.carried_events, max_in_round);
+	if (timeout || read_count != PIPE_COUNT || fire_count != POINT_COUNT) {
+		fprintf(stderr, "events or timers lost, read: %d, fired: %d\n", read_count, fire_count);
+		ret = -1;
+	}
+	// the tick handler and events may share a round with timer points
+	if (max_in_round > ROUND_EVENTS + ROUND_TIMERS || stats.carried_events == 0) {
+		fprintf(stderr, "round budget is not respected\n");
+		ret = -1;
+	}
+
+exit_clean:
+	if (ticker) {
+		if (neb_evdp_source_get_queue(ticker) && neb_evdp_queue_detach(q, ticker, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ticker);
+	}
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(q, ts, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ts);
+	}
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		if (ds[i]) {
+			if (neb_evdp_source_get_queue(ds[i]) && neb_evdp_queue_detach(q, ds[i], 1) != 0)
+				fprintf(stderr, "failed to detach ro_fd source\n");
+			neb_evdp_source_del(ds[i]);
+		}
+	}
+	if (t)
+		neb_evdp_timer_destroy(t);
+	if (q)
+		neb_evdp_queue_destroy(q);
+	q = NULL;
+exit_close:
+	for (int i = 0; i < PIPE_COUNT; i++) {
+		close(fds[i][0]);
+		close(fds[i][1]);
+	}
+	return ret;
+}
+
+int main(void)
+{
+	int ret = 0;
+	if (test_round_budget(0) != 0)
+		ret = -1;
+	if (test_round_budget(1) != 0)
+		ret = -1;
+	return ret;
+}
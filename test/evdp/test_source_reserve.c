@@ -0,0 +1,140 @@
+/*
+ * Churn sources after reserving, and delete sources created by another
+ * thread, the freed blocks should be reused without any error. Then delete
+ * sources created by other threads for many rounds, so the thread cache of
+ * the main thread is flushed to the depot, where the producers refill from.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define SOURCE_COUNT 1024
+#define CHURN_ROUNDS 8
+#define PRODUCER_ROUNDS 32
+
+static neb_evdp_source_t sources[SOURCE_COUNT];
+
+static neb_evdp_cb_ret_t hup_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata)
+{
+	int *count = udata;
+	if (++(*count) == 2)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static int create_sources(void)
+{
+	for (int i = 0; i < SOURCE_COUNT; i++) {
+		switch (i % 3) {
+		case 0:
+			sources[i] = neb_evdp_source_new_os_fd(STDIN_FILENO, hup_handler);
+			break;
+		case 1:
+			sources[i] = neb_evdp_source_new_et_fd(STDIN_FILENO, hup_handler, NULL, hup_handler);
+			break;
+		default:
+			sources[i] = neb_evdp_source_new_itimer_ms(i, 1000, timeout_handler);
+			break;
+		}
+		if (!sources[i]) {
+			fprintf(stderr, "failed to create source %d\n", i);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void del_sources(void)
+{
+	for (int i = 0; i < SOURCE_COUNT; i++) {
+		if (sources[i]) {
+			neb_evdp_source_del(sources[i]);
+			sources[i] = NULL;
+		}
+	}
+}
+
+static void *thread_create(void *arg)
+{
+	int *ret = arg;
+	*ret = create_sources();
+	return NULL;
+}
+
+int main(void)
+{
+	if (neb_evdp_source_reserve(SOURCE_COUNT) != 0) {
+		fprintf(stderr, "failed to reserve sources\n");
+		return -1;
+	}
+
+	for (int i = 0; i < CHURN_ROUNDS; i++) {
+		if (create_sources() != 0) {
+			del_sources();
+			return -1;
+		}
+		del_sources();
+	}
+
+	for (int i = 0; i < PRODUCER_ROUNDS; i++) {
+		pthread_t t;
+		int tret = -1;
+		if (pthread_create(&t, NULL, thread_create, &tret) != 0) {
+			perror("pthread_create");
+			return -1;
+		}
+		pthread_join(t, NULL);
+		del_sources(); // freed to the main thread cache, and flushed to the depot
+		if (tret != 0)
+			return -1;
+	}
+
+	int ret = 0;
+	neb_evdp_queue_t dq = neb_evdp_queue_create(0);
+	if (!dq) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		return -1;
+	}
+	int count = 0;
+	neb_evdp_source_t ts = neb_evdp_source_new_itimer_ms(1, 10, timeout_handler);
+	if (!ts) {
+		fprintf(stderr, "failed to create timer source\n");
+		ret = -1;
+		goto exit_destroy;
+	}
+	neb_evdp_source_set_udata(ts, &count);
+	if (neb_evdp_queue_attach(dq, ts) != 0) {
+		fprintf(stderr, "failed to attach timer source\n");
+		ret = -1;
+		goto exit_del;
+	}
+	if (neb_evdp_queue_run(dq) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+	if (count != 2) {
+		fprintf(stderr, "timer count %d, expect 2\n", count);
+		ret = -1;
+	}
+	if (neb_evdp_queue_detach(dq, ts, 0) != 0) {
+		fprintf(stderr, "failed to detach timer source\n");
+		ret = -1;
+	}
+
+exit_del:
+	neb_evdp_source_del(ts);
+exit_destroy:
+	neb_evdp_queue_destroy(dq);
+	return ret;
+}
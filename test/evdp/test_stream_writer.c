@@ -0,0 +1,247 @@
+/*
+ * Write many small records through a stream writer on a socketpair with a
+ * small send buffer. The records should be coalesced into much fewer send
+ * calls, the writer should stop at the high watermark and resume on drain,
+ * and the peer should receive all bytes in order.
+ */
+
+#include <nebase/cdefs.h>
+#include <nebase/evdp/core.h>
+#include <nebase/evdp/io_base.h>
+#include <nebase/evdp/sys_timer.h>
+#include <nebase/evdp/stream.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define RECORD_SIZE 100
+#define TOTAL_SIZE (1024 * 1024)
+#define HIGH_WATERMARK (64 * 1024)
+#define LOW_WATERMARK (16 * 1024)
+
+static neb_evdp_stream_t st = NULL;
+static size_t produced = 0;
+static size_t received = 0;
+static int writes = 0;
+static int drains = 0;
+static int corrupted = 0;
+static int timeout = 0;
+
+static unsigned char pattern_at(size_t off)
+{
+	return (unsigned char)(off % 251);
+}
+
+/**
+ * \return 0 if stopped by the high watermark or all produced
+ */
+static int produce(void)
+{
+	while (produced < TOTAL_SIZE) {
+		unsigned char rec[RECORD_SIZE];
+		size_t n = TOTAL_SIZE - produced;
+		if (n > RECORD_SIZE)
+			n = RECORD_SIZE;
+		for (size_t i = 0; i < n; i++)
+			rec[i] = pattern_at(produced + i);
+
+		int ret = neb_evdp_stream_write(st, rec, n);
+		if (ret < 0) {
+			fprintf(stderr, "failed to write to stream\n");
+			return -1;
+		}
+		writes++;
+		produced += n;
+		if (ret == 1)
+			break;
+	}
+	return 0;
+}
+
+static neb_evdp_cb_ret_t on_drain(neb_evdp_stream_t s _nattr_unused, void *udata _nattr_unused)
+{
+	drains++;
+	if (neb_evdp_stream_get_queued(st) > LOW_WATERMARK) {
+		fprintf(stderr, "drained with %zu bytes queued\n", neb_evdp_stream_get_queued(st));
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (produce() != 0)
+		return NEB_EVDP_CB_BREAK_ERR;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t on_error(neb_evdp_stream_t s _nattr_unused, void *udata _nattr_unused)
+{
+	fprintf(stderr, "unexpected stream error %d\n", neb_evdp_stream_get_error(st));
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t read_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	unsigned char buf[4096];
+	ssize_t nr = read(fd, buf, sizeof(buf));
+	if (nr == -1) {
+		if (errno == EAGAIN)
+			return NEB_EVDP_CB_CONTINUE;
+		perror("read");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	if (nr == 0) {
+		fprintf(stderr, "unexpected close\n");
+		return NEB_EVDP_CB_BREAK_ERR;
+	}
+	for (ssize_t i = 0; i < nr; i++) {
+		if (buf[i] != pattern_at(received + i))
+			corrupted = 1;
+	}
+	received += nr;
+	if (received == TOTAL_SIZE)
+		return NEB_EVDP_CB_BREAK_EXP;
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+static neb_evdp_cb_ret_t hup_handler(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	fprintf(stderr, "unexpected hup on fd %d\n", fd);
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t timeout_handler(unsigned int ident _nattr_unused, long overrun _nattr_unused, void *udata _nattr_unused)
+{
+	timeout = 1;
+	return NEB_EVDP_CB_BREAK_ERR;
+}
+
+static neb_evdp_cb_ret_t dummy_write_handler(int fd _nattr_unused, void *udata _nattr_unused, const void *context _nattr_unused)
+{
+	return NEB_EVDP_CB_CONTINUE;
+}
+
+int main(void)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+	for (int i = 0; i < 2; i++) {
+		int flags = fcntl(sv[i], F_GETFL);
+		if (flags == -1 || fcntl(sv[i], F_SETFL, flags | O_NONBLOCK) == -1) {
+			perror("fcntl");
+			close(sv[0]);
+			close(sv[1]);
+			return -1;
+		}
+	}
+	int sndbuf = 4096;
+	if (setsockopt(sv[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == -1)
+		perror("setsockopt");
+
+	int ret = 0;
+	neb_evdp_queue_t q = NULL;
+	neb_evdp_source_t ws = NULL, rs = NULL, ts = NULL;
+
+	q = neb_evdp_queue_create(0);
+	if (!q) {
+		fprintf(stderr, "failed to create evdp queue\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	ws = neb_evdp_source_new_os_fd(sv[0], hup_handler);
+	rs = neb_evdp_source_new_ro_fd(sv[1], read_handler, hup_handler);
+	ts = neb_evdp_source_new_itimer_s(1, 5, timeout_handler);
+	if (!ws || !rs || !ts) {
+		fprintf(stderr, "failed to create sources\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	struct neb_evdp_stream_conf conf = {
+		.chunk_size = 1024,
+		.high_watermark = HIGH_WATERMARK,
+		.low_watermark = LOW_WATERMARK,
+		.on_drain = on_drain,
+		.on_error = on_error,
+	};
+	st = neb_evdp_stream_create(ws, &conf, NULL);
+	if (!st) {
+		fprintf(stderr, "failed to create stream writer\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (neb_evdp_source_os_fd_next_write(ws, dummy_write_handler) == 0) {
+		fprintf(stderr, "write handler is accepted for bound source\n");
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_attach(q, ws) != 0 || neb_evdp_queue_attach(q, rs) != 0 || neb_evdp_queue_attach(q, ts) != 0) {
+		fprintf(stderr, "failed to attach sources\n");
+		ret = -1;
+		goto exit_clean;
+	}
+	if (produce() != 0) {
+		ret = -1;
+		goto exit_clean;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "failed to run queue\n");
+		ret = -1;
+	}
+
+	struct neb_evdp_stream_stats stats;
+	neb_evdp_stream_get_stats(st, &stats);
+	fprintf(stdout, "writes: %d, flushes: %llu, blocked: %llu, high reached: %llu, drains: %d, queued max: %zu\n",
+	        writes, (unsigned long long)stats.flushes, (unsigned long long)stats.blocked,
+	        (unsigned long long)stats.high_reached, drains, stats.queued_max);
+	if (timeout || corrupted || received != TOTAL_SIZE || stats.bytes_written != TOTAL_SIZE || stats.queued != 0) {
+		fprintf(stderr, "data lost or corrupted, received: %zu, timeout: %d\n", received, timeout);
+		ret = -1;
+	}
+	if (stats.flushes >= (uint64_t)writes || stats.high_reached == 0 || drains == 0) {
+		fprintf(stderr, "writes are not coalesced or watermarks are not applied\n");
+		ret = -1;
+	}
+
+	// write after the peer closed should fail
+	if (neb_evdp_queue_detach(q, rs, 0) != 0)
+		fprintf(stderr, "failed to detach ro_fd source\n");
+	close(sv[1]);
+	sv[1] = -1;
+	if (neb_evdp_stream_write(st, "x", 1) != 0 || neb_evdp_stream_flush(st) == 0 ||
+	    neb_evdp_stream_get_error(st) != EPIPE || neb_evdp_stream_write(st, "x", 1) == 0) {
+		fprintf(stderr, "write error is not reported\n");
+		ret = -1;
+	}
+
+exit_clean:
+	if (st)
+		neb_evdp_stream_destroy(st);
+	if (ts) {
+		if (neb_evdp_source_get_queue(ts) && neb_evdp_queue_detach(q, ts, 0) != 0)
+			fprintf(stderr, "failed to detach itimer source\n");
+		neb_evdp_source_del(ts);
+	}
+	if (rs) {
+		if (neb_evdp_source_get_queue(rs) && neb_evdp_queue_detach(q, rs, 1) != 0)
+			fprintf(stderr, "failed to detach ro_fd source\n");
+		neb_evdp_source_del(rs);
+	}
+	if (ws) {
+		if (neb_evdp_source_get_queue(ws) && neb_evdp_queue_detach(q, ws, 1) != 0)
+			fprintf(stderr, "failed to detach os_fd source\n");
+		neb_evdp_source_del(ws);
+	}
+	if (q)
+		neb_evdp_queue_destroy(q);
+exit_close:
+	close(sv[0]);
+	if (sv[1] >= 0)
+		close(sv[1]);
+	return ret;
+}
@@ -0,0 +1,207 @@
+
+#include <nebase/evdp/core.h>
+#include <nebase/events.h>
+#include <nebase/time.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define POINT_COUNT 1000
+
+static neb_evdp_queue_t q = NULL;
+static neb_evdp_timer_t t = NULL;
+
+struct point_data {
+	neb_evdp_timer_point p;
+	struct timespec abs_ts;
+	int fired;
+	int too_early;
+};
+
+static struct point_data points[POINT_COUNT];
+static int fired_count = 0;
+
+static neb_evdp_timeout_ret_t point_cb(void *udata)
+{
+	struct point_data *d = udata;
+	struct timespec now;
+	if (neb_time_gettime_fast(&now) != 0)
+		thread_events |= T_E_QUIT;
+	if (neb_timespeccmp(&now, &d->abs_ts, <))
+		d->too_early = 1;
+	d->fired += 1;
+	fired_count += 1;
+
+	int idx = d - points;
+	if (idx % 4 == 0) {
+		d->p = NULL;
+		return NEB_EVDP_TIMEOUT_FREE;
+	} else {
+		return NEB_EVDP_TIMEOUT_KEEP;
+	}
+}
+
+static neb_evdp_timeout_ret_t quit_cb(void *udata _nattr_unused)
+{
+	thread_events |= T_E_QUIT;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+/*
+ * cascade case: a level 1 point expires before the next level 0 point, which
+ * is added in the previous 256 ticks, and the wait should stop at the cascade
+ */
+#define CASCADE_SLACK_MS 10 // coarse clock and scheduling
+
+static struct timespec cascade_ts;
+static int64_t cascade_late_ms = -1;
+
+static neb_evdp_timeout_ret_t cascade_cb(void *udata _nattr_unused)
+{
+	struct timespec now;
+	if (neb_time_gettime_fast(&now) != 0)
+		thread_events |= T_E_QUIT;
+	neb_timespecsub(&now, &cascade_ts, &now);
+	cascade_late_ms = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static neb_evdp_timeout_ret_t add_later_cb(void *udata _nattr_unused)
+{
+	struct timespec ts = cascade_ts;
+	ts.tv_nsec += 100 * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec += 1;
+		ts.tv_nsec -= 1000000000;
+	}
+	if (!neb_evdp_timer_new_point(t, &ts, quit_cb, NULL))
+		thread_events |= T_E_QUIT;
+	return NEB_EVDP_TIMEOUT_FREE;
+}
+
+static int test_cascade(void)
+{
+	neb_evdp_queue_update_cur_ts(q);
+	struct timespec now;
+	neb_evdp_queue_get_cur_ts(q, &now);
+	// the default tick is 1ms, put it at tick 10 of a level 1 slot, 266ms later at least
+	int64_t tick = (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	tick = (((tick >> 8) + 2) << 8) + 10;
+	cascade_ts.tv_sec = tick / 1000;
+	cascade_ts.tv_nsec = (tick % 1000) * 1000000;
+	struct timespec add_ts = cascade_ts;
+	if (add_ts.tv_nsec >= 40 * 1000000) {
+		add_ts.tv_nsec -= 40 * 1000000;
+	} else {
+		add_ts.tv_sec -= 1;
+		add_ts.tv_nsec += 1000000000 - 40 * 1000000;
+	}
+
+	if (!neb_evdp_timer_new_point(t, &cascade_ts, cascade_cb, NULL) ||
+	    !neb_evdp_timer_new_point(t, &add_ts, add_later_cb, NULL)) {
+		fprintf(stderr, "failed to create cascade timer points\n");
+		return -1;
+	}
+
+	thread_events = 0;
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "Failed to run queue\n");
+		return -1;
+	}
+
+	if (cascade_late_ms < 0 || cascade_late_ms > 1 + CASCADE_SLACK_MS) {
+		fprintf(stderr, "cascaded point fired %lldms late\n", (long long)cascade_late_ms);
+		return -1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	q = neb_evdp_queue_create(0);
+	t = neb_evdp_timer_create_wheel(0, POINT_COUNT);
+	if (!q || !t) {
+		fprintf(stderr, "failed to create queue or timer\n");
+		return -1;
+	}
+	neb_evdp_queue_set_timer(q, t);
+	neb_evdp_queue_update_cur_ts(q);
+
+	for (int i = 0; i < POINT_COUNT; i++) {
+		struct point_data *d = &points[i];
+		// spread over the first two levels
+		neb_evdp_queue_get_abs_timeout_ms(q, 1 + (i * 7) % 400, &d->abs_ts);
+		d->p = neb_evdp_timer_new_point(t, &d->abs_ts, point_cb, d);
+		if (!d->p) {
+			fprintf(stderr, "failed to create timer point %d\n", i);
+			return -1;
+		}
+	}
+
+	int expected = 0;
+	for (int i = 0; i < POINT_COUNT; i++) {
+		struct point_data *d = &points[i];
+		switch (i % 3) {
+		case 0: // delete
+			neb_evdp_timer_del_point(t, d->p);
+			d->p = NULL;
+			break;
+		case 1: // reset to a later time
+			neb_evdp_queue_get_abs_timeout_ms(q, 300 + i % 100, &d->abs_ts);
+			if (neb_evdp_timer_point_reset(t, d->p, &d->abs_ts) != 0) {
+				fprintf(stderr, "failed to reset timer point %d\n", i);
+				return -1;
+			}
+			expected++;
+			break;
+		default:
+			expected++;
+			break;
+		}
+	}
+
+	struct timespec ts;
+	neb_evdp_queue_get_abs_timeout_ms(q, 500, &ts);
+	if (!neb_evdp_timer_new_point(t, &ts, quit_cb, NULL)) {
+		fprintf(stderr, "failed to create quit timer point\n");
+		return -1;
+	}
+
+	if (neb_evdp_queue_run(q) != 0) {
+		fprintf(stderr, "Failed to run queue\n");
+		exit(-1);
+	}
+
+	int ret = 0;
+	if (fired_count != expected) {
+		fprintf(stderr, "fired count should be %d, but not %d\n", expected, fired_count);
+		ret = -1;
+	}
+	for (int i = 0; i < POINT_COUNT; i++) {
+		struct point_data *d = &points[i];
+		if (i % 3 == 0) {
+			if (d->fired) {
+				fprintf(stderr, "deleted point %d fired\n", i);
+				ret = -1;
+			}
+			continue;
+		}
+		if (d->fired != 1) {
+			fprintf(stderr, "point %d fired %d times\n", i, d->fired);
+			ret = -1;
+		}
+		if (d->too_early) {
+			fprintf(stderr, "point %d fired too early\n", i);
+			ret = -1;
+		}
+		if (d->p) // kept ones
+			neb_evdp_timer_del_point(t, d->p);
+	}
+
+	if (test_cascade() != 0)
+		ret = -1;
+
+	neb_evdp_queue_destroy(q);
+	neb_evdp_timer_destroy(t);
+	return ret;
+}
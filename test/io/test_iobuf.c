@@ -0,0 +1,233 @@
+/*
+ * Build chained buffers across small blocks, then slice, split, move and
+ * receive into them. Data should keep in order, and blocks should be shared
+ * instead of copied. Block data should be 16 bytes aligned for any block size.
+ */
+
+#include <nebase/iobuf.h>
+#include <nebase/sock/inet.h>
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#define BLOCK_SIZE 16
+#define DATA_SIZE 100
+
+static char data[DATA_SIZE];
+
+static int check_content(neb_iobuf_t b, const char *expect, size_t len, const char *what)
+{
+	char buf[DATA_SIZE * 2];
+	if (neb_iobuf_len(b) != len) {
+		fprintf(stderr, "%s: len %zu, expect %zu\n", what, neb_iobuf_len(b), len);
+		return -1;
+	}
+	if (neb_iobuf_copyout(b, 0, buf, sizeof(buf)) != len || memcmp(buf, expect, len) != 0) {
+		fprintf(stderr, "%s: content mismatch\n", what);
+		return -1;
+	}
+
+	struct iovec iov[DATA_SIZE];
+	int iovcnt = neb_iobuf_export_iov(b, iov, DATA_SIZE);
+	size_t off = 0;
+	for (int i = 0; i < iovcnt; i++) {
+		if (memcmp(iov[i].iov_base, expect + off, iov[i].iov_len) != 0) {
+			fprintf(stderr, "%s: iov %d mismatch\n", what, i);
+			return -1;
+		}
+		off += iov[i].iov_len;
+	}
+	if (off != len) {
+		fprintf(stderr, "%s: iov len %zu, expect %zu\n", what, off, len);
+		return -1;
+	}
+	return 0;
+}
+
+static int blocks_used(neb_iobuf_pool_t p)
+{
+	struct neb_iobuf_pool_stats stats;
+	neb_iobuf_pool_get_stats(p, &stats);
+	return stats.blocks_used;
+}
+
+static int test_build(neb_iobuf_pool_t p)
+{
+	int ret = -1;
+	neb_iobuf_t b = neb_iobuf_new(p);
+	neb_iobuf_t s = NULL, t = NULL;
+	if (!b)
+		return -1;
+
+	// append in small pieces, then prepend the head back
+	for (int off = 10; off < DATA_SIZE; off += 7) {
+		size_t n = DATA_SIZE - off < 7 ? DATA_SIZE - off : 7;
+		if (neb_iobuf_append(b, data + off, n) != 0)
+			goto exit_del;
+	}
+	if (neb_iobuf_prepend(b, data + 5, 5) != 0 || neb_iobuf_prepend(b, data, 5) != 0)
+		goto exit_del;
+	if (check_content(b, data, DATA_SIZE, "append and prepend") != 0)
+		goto exit_del;
+
+	int used = blocks_used(p);
+	s = neb_iobuf_slice(b, 20, 50);
+	if (!s || check_content(s, data + 20, 50, "slice") != 0)
+		goto exit_del;
+	if (blocks_used(p) != used) {
+		fprintf(stderr, "slice should share blocks\n");
+		goto exit_del;
+	}
+	// the shared block should not be written by append
+	if (neb_iobuf_append(s, "x", 1) != 0 || check_content(b, data, DATA_SIZE, "after slice append") != 0)
+		goto exit_del;
+	neb_iobuf_truncate(s, 50);
+
+	t = neb_iobuf_split(b, 33);
+	if (!t || check_content(b, data, 33, "split head") != 0 || check_content(t, data + 33, DATA_SIZE - 33, "split tail") != 0)
+		goto exit_del;
+	if (neb_iobuf_append_buf(b, t) != 0 || neb_iobuf_len(t) != 0 || check_content(b, data, DATA_SIZE, "append buf") != 0)
+		goto exit_del;
+
+	neb_iobuf_consume(b, 40);
+	neb_iobuf_truncate(b, 30);
+	if (check_content(b, data + 40, 30, "consume and truncate") != 0)
+		goto exit_del;
+	if (neb_iobuf_prepend_buf(b, s) != 0 || neb_iobuf_len(s) != 0)
+		goto exit_del;
+	char expect[80];
+	memcpy(expect, data + 20, 50);
+	memcpy(expect + 50, data + 40, 30);
+	if (check_content(b, expect, 80, "prepend buf") != 0)
+		goto exit_del;
+
+	const char *h = neb_iobuf_pullup(b, BLOCK_SIZE);
+	if (!h || memcmp(h, expect, BLOCK_SIZE) != 0 || check_content(b, expect, 80, "pullup") != 0) {
+		fprintf(stderr, "pullup failed\n");
+		goto exit_del;
+	}
+	if (neb_iobuf_pullup(b, BLOCK_SIZE + 1)) {
+		fprintf(stderr, "pullup larger than block size should fail\n");
+		goto exit_del;
+	}
+
+	ret = 0;
+exit_del:
+	if (t)
+		neb_iobuf_del(t);
+	if (s)
+		neb_iobuf_del(s);
+	neb_iobuf_del(b);
+	return ret;
+}
+
+static int test_recv(neb_iobuf_pool_t p)
+{
+	int sv[2];
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) == -1) {
+		perror("socketpair");
+		return -1;
+	}
+
+	int ret = -1;
+	neb_iobuf_t b = neb_iobuf_new(p);
+	if (!b)
+		goto exit_close;
+	if (neb_iobuf_append(b, data, 3) != 0)
+		goto exit_del;
+	if (write(sv[0], data + 3, DATA_SIZE - 3) != DATA_SIZE - 3) {
+		perror("write");
+		goto exit_del;
+	}
+
+	struct neb_sock_msghdr m = {
+		.msg_peer = NULL,
+	};
+	ssize_t nr = neb_sock_inet_recvmsg_iobuf(sv[1], &m, b, DATA_SIZE * 2);
+	if (nr != DATA_SIZE - 3) {
+		fprintf(stderr, "recv %zd bytes, expect %d\n", nr, DATA_SIZE - 3);
+		goto exit_del;
+	}
+	if (check_content(b, data, DATA_SIZE, "recv") != 0)
+		goto exit_del;
+	ret = 0;
+
+exit_del:
+	neb_iobuf_del(b);
+exit_close:
+	close(sv[0]);
+	close(sv[1]);
+	return ret;
+}
+
+static int test_align(void)
+{
+	neb_iobuf_pool_t p = neb_iobuf_pool_create(13, 3);
+	if (!p)
+		return -1;
+	int ret = -1;
+	neb_iobuf_t b = neb_iobuf_new(p);
+	if (!b)
+		goto exit_destroy;
+
+	struct iovec iov[16];
+	int n = neb_iobuf_reserve(b, DATA_SIZE, iov, 16);
+	if (n <= 0)
+		goto exit_del;
+	ret = 0;
+	for (int i = 0; i < n; i++) {
+		if ((uintptr_t)iov[i].iov_base % 16) {
+			fprintf(stderr, "block %d at %p is not aligned\n", i, iov[i].iov_base);
+			ret = -1;
+		}
+	}
+	neb_iobuf_commit(b, 0);
+
+exit_del:
+	neb_iobuf_del(b);
+exit_destroy:
+	neb_iobuf_pool_destroy(p);
+	return ret;
+}
+
+int main(void)
+{
+	for (int i = 0; i < DATA_SIZE; i++)
+		data[i] = (char)i;
+
+	neb_iobuf_pool_t p = neb_iobuf_pool_create(BLOCK_SIZE, 4);
+	if (!p) {
+		fprintf(stderr, "failed to create iobuf pool\n");
+		return -1;
+	}
+
+	int ret = 0;
+	if (test_build(p) != 0)
+		ret = -1;
+	if (test_recv(p) != 0)
+		ret = -1;
+	if (test_align() != 0)
+		ret = -1;
+	if (blocks_used(p) != 0) {
+		fprintf(stderr, "%d blocks leaked\n", blocks_used(p));
+		ret = -1;
+	}
+
+	// blocks should keep valid after the pool destroyed
+	neb_iobuf_t b = neb_iobuf_new(p);
+	if (!b || neb_iobuf_append(b, data, DATA_SIZE) != 0) {
+		fprintf(stderr, "failed to append data\n");
+		ret = -1;
+	}
+	neb_iobuf_pool_destroy(p);
+	if (b) {
+		if (check_content(b, data, DATA_SIZE, "after pool destroy") != 0)
+			ret = -1;
+		neb_iobuf_del(b);
+	}
+
+	return ret;
+}
@@ -0,0 +1,110 @@
+/*
+ * Check all checksum implementations supported by this cpu against the
+ * generic one, with random data, lengths and alignments. Run with "bench" to
+ * also print the throughput of each across packet sizes.
+ */
+
+#include <nebase/sock/csum.h>
+#include <nebase/random.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#define FUZZ_ROUNDS 20000
+#define FUZZ_MAX_LEN 4096
+#define BENCH_BYTES (64 * 1024 * 1024)
+
+static unsigned char buf[FUZZ_MAX_LEN + 16];
+
+static int check_known(void)
+{
+	// the example in RFC 1071 section 3
+	static const unsigned char data[] = {0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7};
+	uint16_t expect = (uint16_t)~0xddf2;
+	uint16_t sum = neb_sock_csum(data, sizeof(data));
+	if (ntohs(sum) != expect) {
+		fprintf(stderr, "%s: got %#x, expect %#x\n", neb_sock_csum_impl_name(neb_sock_csum_get_impl()),
+		        ntohs(sum), expect);
+		return -1;
+	}
+	return 0;
+}
+
+static int fuzz(int impl)
+{
+	for (int i = 0; i < FUZZ_ROUNDS; i++) {
+		int off = neb_random_uniform(16);
+		int len = neb_random_uniform(FUZZ_MAX_LEN + 1);
+		switch (i % 4) {
+		case 0: // carries in every word
+			memset(buf, 0xff, sizeof(buf));
+			break;
+		case 1:
+			memset(buf, 0, sizeof(buf));
+			break;
+		default:
+			neb_random_buf(buf, sizeof(buf));
+			break;
+		}
+
+		if (neb_sock_csum_set_impl(NEB_SOCK_CSUM_IMPL_GENERIC) != 0)
+			return -1;
+		uint16_t expect = neb_sock_csum(buf + off, len);
+		if (neb_sock_csum_set_impl(impl) != 0)
+			return -1;
+		uint16_t sum = neb_sock_csum(buf + off, len);
+		if (sum != expect) {
+			fprintf(stderr, "%s: off %d len %d: got %#x, expect %#x\n",
+			        neb_sock_csum_impl_name(impl), off, len, sum, expect);
+			return -1;
+		}
+	}
+	return check_known();
+}
+
+static void bench(int impl)
+{
+	static const int sizes[] = {20, 64, 576, 1500, 4096};
+	if (neb_sock_csum_set_impl(impl) != 0)
+		return;
+
+	fprintf(stdout, "%-8s", neb_sock_csum_impl_name(impl));
+	for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+		int n = BENCH_BYTES / sizes[i];
+		volatile uint16_t sink = 0;
+		struct timespec s, e;
+		clock_gettime(CLOCK_MONOTONIC, &s);
+		for (int j = 0; j < n; j++)
+			sink += neb_sock_csum(buf + (j & 1), sizes[i]);
+		clock_gettime(CLOCK_MONOTONIC, &e);
+		double t = (double)(e.tv_sec - s.tv_sec) + (double)(e.tv_nsec - s.tv_nsec) / 1e9;
+		fprintf(stdout, " %d: %.2f GB/s", sizes[i], (double)n * sizes[i] / t / 1e9);
+	}
+	fprintf(stdout, "\n");
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	int do_bench = argc > 1 && strcmp(argv[1], "bench") == 0;
+	int selected = neb_sock_csum_get_impl();
+	fprintf(stdout, "selected: %s\n", neb_sock_csum_impl_name(selected));
+
+	for (int impl = NEB_SOCK_CSUM_IMPL_GENERIC; impl < NEB_SOCK_CSUM_IMPL_MAX; impl++) {
+		if (neb_sock_csum_set_impl(impl) != 0) {
+			if (impl == selected) {
+				fprintf(stderr, "the selected impl is not supported\n");
+				ret = -1;
+			}
+			continue;
+		}
+		if (fuzz(impl) != 0)
+			ret = -1;
+		else if (do_bench)
+			bench(impl);
+	}
+
+	return ret;
+}
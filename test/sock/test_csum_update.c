@@ -0,0 +1,191 @@
+/*
+ * Stamp random TTLs, ports and addresses into IPv4/UDP and IPv6/UDP/ICMPv6
+ * packet templates, update the checksums incrementally, and compare them with
+ * fully recomputed ones. Filled checksums are also verified over the pseudo
+ * headers independently.
+ */
+
+#include <nebase/sock/csum.h>
+#include <nebase/random.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/icmp6.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+
+#define ROUNDS 10000
+#define PAYLOAD_SIZE 37
+
+struct pkt4 {
+	struct ip ip;
+	struct udphdr udp;
+	unsigned char payload[PAYLOAD_SIZE];
+};
+
+struct pkt6 {
+	struct ip6_hdr ip6;
+	union {
+		struct udphdr udp;
+		struct icmp6_hdr icmp6;
+	};
+	unsigned char payload[PAYLOAD_SIZE];
+};
+
+static uint16_t l4_sum6(const struct pkt6 *p, uint8_t proto, int l4len)
+{
+	unsigned char buf[40 + sizeof(struct pkt6)] = {0};
+	memcpy(buf, &p->ip6.ip6_src, 16);
+	memcpy(buf + 16, &p->ip6.ip6_dst, 16);
+	uint32_t len = htonl(l4len);
+	memcpy(buf + 32, &len, 4);
+	buf[39] = proto;
+	memcpy(buf + 40, &p->udp, l4len);
+	return neb_sock_csum(buf, 40 + l4len);
+}
+
+static uint16_t l4_sum4(const struct pkt4 *p, int l4len)
+{
+	unsigned char buf[12 + sizeof(struct pkt4)] = {0};
+	memcpy(buf, &p->ip.ip_src, 4);
+	memcpy(buf + 4, &p->ip.ip_dst, 4);
+	buf[9] = IPPROTO_UDP;
+	uint16_t len = htons(l4len);
+	memcpy(buf + 10, &len, 2);
+	memcpy(buf + 12, &p->udp, l4len);
+	return neb_sock_csum(buf, 12 + l4len);
+}
+
+static int test_ipv4(void)
+{
+	const int l4len = sizeof(struct udphdr) + PAYLOAD_SIZE;
+	struct pkt4 t, full;
+	memset(&t, 0, sizeof(t));
+	t.ip.ip_v = IPVERSION;
+	t.ip.ip_hl = sizeof(struct ip) >> 2;
+	t.ip.ip_len = htons(sizeof(t));
+	t.ip.ip_ttl = 64;
+	t.ip.ip_p = IPPROTO_UDP;
+	t.ip.ip_src.s_addr = htonl(0xc0a80001);
+	t.ip.ip_dst.s_addr = htonl(0xc0a80002);
+	t.udp.uh_sport = htons(33434);
+	t.udp.uh_dport = htons(53);
+	t.udp.uh_ulen = htons(l4len);
+	neb_random_buf(t.payload, sizeof(t.payload));
+	neb_sock_csum_ip4_fill(&t.ip);
+	neb_sock_csum_udp4_fill(&t.ip, &t.udp, l4len);
+
+	if (neb_sock_csum(&t.ip, sizeof(t.ip)) != 0 || l4_sum4(&t, l4len) != 0) {
+		fprintf(stderr, "ipv4: invalid filled checksum\n");
+		return -1;
+	}
+
+	for (int i = 0; i < ROUNDS; i++) {
+		struct pkt4 p = t;
+
+		// ttl shares the 16-bit word with protocol
+		uint16_t w;
+		memcpy(&w, &p.ip.ip_ttl, 2);
+		p.ip.ip_ttl = 1 + neb_random_uniform(255);
+		uint16_t nw;
+		memcpy(&nw, &p.ip.ip_ttl, 2);
+		p.ip.ip_sum = neb_sock_csum_update16(p.ip.ip_sum, w, nw);
+
+		uint16_t sport = htons(neb_random_uniform(UINT16_MAX));
+		p.udp.uh_sum = neb_sock_csum_update16(p.udp.uh_sum, p.udp.uh_sport, sport);
+		p.udp.uh_sport = sport;
+
+		struct in_addr dst = {.s_addr = neb_random_uint32()};
+		p.ip.ip_sum = neb_sock_csum_update32(p.ip.ip_sum, p.ip.ip_dst.s_addr, dst.s_addr);
+		p.udp.uh_sum = neb_sock_csum_update32(p.udp.uh_sum, p.ip.ip_dst.s_addr, dst.s_addr);
+		p.ip.ip_dst = dst;
+		if (p.udp.uh_sum == 0)
+			p.udp.uh_sum = 0xffff;
+
+		full = p;
+		neb_sock_csum_ip4_fill(&full.ip);
+		neb_sock_csum_udp4_fill(&full.ip, &full.udp, l4len);
+		if (p.ip.ip_sum != full.ip.ip_sum || p.udp.uh_sum != full.udp.uh_sum) {
+			fprintf(stderr, "ipv4: updated %#x/%#x, recomputed %#x/%#x\n",
+			        p.ip.ip_sum, p.udp.uh_sum, full.ip.ip_sum, full.udp.uh_sum);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static int test_ipv6(uint8_t proto)
+{
+	const int l4len = sizeof(struct udphdr) + PAYLOAD_SIZE;
+	struct pkt6 t, full;
+	memset(&t, 0, sizeof(t));
+	t.ip6.ip6_vfc = 6 << 4;
+	t.ip6.ip6_plen = htons(l4len);
+	t.ip6.ip6_nxt = proto;
+	t.ip6.ip6_hlim = 64;
+	inet_pton(AF_INET6, "2001:db8::1", &t.ip6.ip6_src);
+	inet_pton(AF_INET6, "2001:db8::2", &t.ip6.ip6_dst);
+	neb_random_buf(t.payload, sizeof(t.payload));
+	if (proto == IPPROTO_UDP) {
+		t.udp.uh_sport = htons(33434);
+		t.udp.uh_dport = htons(53);
+		t.udp.uh_ulen = htons(l4len);
+		neb_sock_csum_udp6_fill(&t.ip6, &t.udp, l4len);
+	} else {
+		t.icmp6.icmp6_type = ICMP6_ECHO_REQUEST;
+		t.icmp6.icmp6_id = htons(1);
+		neb_sock_csum_icmp6_fill(&t.ip6, &t.icmp6, l4len);
+	}
+	if (l4_sum6(&t, proto, l4len) != 0) {
+		fprintf(stderr, "ipv6 %u: invalid filled checksum\n", proto);
+		return -1;
+	}
+
+	for (int i = 0; i < ROUNDS; i++) {
+		struct pkt6 p = t;
+		uint16_t *sum = proto == IPPROTO_UDP ? &p.udp.uh_sum : &p.icmp6.icmp6_cksum;
+
+		struct in6_addr dst;
+		neb_random_buf(&dst, sizeof(dst));
+		*sum = neb_sock_csum_update_in6(*sum, &p.ip6.ip6_dst, &dst);
+		p.ip6.ip6_dst = dst;
+
+		uint16_t id = htons(neb_random_uniform(UINT16_MAX));
+		if (proto == IPPROTO_UDP) {
+			*sum = neb_sock_csum_update16(*sum, p.udp.uh_sport, id);
+			p.udp.uh_sport = id;
+			if (*sum == 0)
+				*sum = 0xffff;
+		} else {
+			*sum = neb_sock_csum_update16(*sum, p.icmp6.icmp6_seq, id);
+			p.icmp6.icmp6_seq = id;
+		}
+
+		full = p;
+		if (proto == IPPROTO_UDP)
+			neb_sock_csum_udp6_fill(&full.ip6, &full.udp, l4len);
+		else
+			neb_sock_csum_icmp6_fill(&full.ip6, &full.icmp6, l4len);
+		uint16_t expect = proto == IPPROTO_UDP ? full.udp.uh_sum : full.icmp6.icmp6_cksum;
+		if (*sum != expect) {
+			fprintf(stderr, "ipv6 %u: updated %#x, recomputed %#x\n", proto, *sum, expect);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int ret = 0;
+	if (test_ipv4() != 0)
+		ret = -1;
+	if (test_ipv6(IPPROTO_UDP) != 0)
+		ret = -1;
+	if (test_ipv6(IPPROTO_ICMPV6) != 0)
+		ret = -1;
+	return ret;
+}
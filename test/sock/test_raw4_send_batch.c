@@ -0,0 +1,189 @@
+/*
+ * Send icmp echo requests to localhost one by one and in batches, compare the
+ * send rates, then check that all batched requests are accepted and replied.
+ */
+
+#include <nebase/sock/raw.h>
+#include <nebase/sock/csum.h>
+#include <nebase/random.h>
+#include <nebase/endian.h>
+
+#include <stdio.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/ip.h>
+#include <netinet/ip_icmp.h>
+#include <arpa/inet.h>
+
+#define PKT_SIZE 64
+#define BATCH_SIZE 32
+#define BENCH_COUNT 10000
+
+static struct in_addr loopback_addr = {.s_addr = neb_const_htobe32(INADDR_LOOPBACK)};
+
+static u_char bufs[BATCH_SIZE][PKT_SIZE];
+static struct neb_sock_icmp4_pkt pkts[BATCH_SIZE];
+static uint16_t echo_id = 0;
+
+static void fill_pkts(uint16_t seq_base)
+{
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		struct icmp *ih = (struct icmp *)bufs[i];
+		ih->icmp_type = ICMP_ECHO;
+		ih->icmp_code = 0;
+		ih->icmp_id = echo_id;
+		ih->icmp_seq = htons(seq_base + i);
+		neb_sock_csum_icmp4_fill(ih, PKT_SIZE);
+
+		pkts[i].data = bufs[i];
+		pkts[i].len = PKT_SIZE;
+		pkts[i].dst = loopback_addr;
+		pkts[i].src.s_addr = INADDR_ANY;
+		pkts[i].result.len = 0;
+		pkts[i].result.err = 0;
+	}
+}
+
+static int wait_writable(int fd)
+{
+	struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+	if (poll(&pfd, 1, 1000) != 1) {
+		fprintf(stderr, "socket is not writable\n");
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * \return the number of failed packets, -1 if error
+ */
+static int send_all(int fd, struct neb_sock_icmp4_pkt *p, int count)
+{
+	int failed = 0;
+	while (count > 0) {
+		int n = neb_sock_raw_icmp4_send_batch(fd, p, count);
+		if (n < 0) {
+			fprintf(stderr, "failed to send batch\n");
+			return -1;
+		}
+		for (int i = 0; i < n; i++) {
+			if (p[i].result.len != (ssize_t)p[i].len) {
+				fprintf(stderr, "packet %d: len %zd, err %d\n", i, p[i].result.len, p[i].result.err);
+				failed++;
+			}
+		}
+		p += n;
+		count -= n;
+		if (count > 0 && wait_writable(fd) != 0)
+			return -1;
+	}
+	return failed;
+}
+
+static double elapsed(const struct timespec *s, const struct timespec *e)
+{
+	return (double)(e->tv_sec - s->tv_sec) + (double)(e->tv_nsec - s->tv_nsec) / 1e9;
+}
+
+static int bench(int fd)
+{
+	struct timespec s, e;
+	int sent = 0;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &s) == -1)
+		return -1;
+	while (sent < BENCH_COUNT) {
+		const struct neb_sock_icmp4_pkt *p = &pkts[sent % BATCH_SIZE];
+		ssize_t nw = neb_sock_raw_icmp4_send(fd, p->data, p->len, &p->dst, &p->src);
+		if (nw == -1) {
+			if (errno != EAGAIN && errno != ENOBUFS) {
+				perror("send");
+				return -1;
+			}
+			if (wait_writable(fd) != 0)
+				return -1;
+			continue;
+		}
+		sent++;
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &e) == -1)
+		return -1;
+	double single = elapsed(&s, &e);
+
+	if (clock_gettime(CLOCK_MONOTONIC, &s) == -1)
+		return -1;
+	for (sent = 0; sent < BENCH_COUNT; sent += BATCH_SIZE) {
+		if (send_all(fd, pkts, BATCH_SIZE) != 0)
+			return -1;
+	}
+	if (clock_gettime(CLOCK_MONOTONIC, &e) == -1)
+		return -1;
+	double batched = elapsed(&s, &e);
+
+	fprintf(stdout, "single: %.0f pkt/s, batched: %.0f pkt/s\n",
+	        BENCH_COUNT / single, sent / batched);
+	return 0;
+}
+
+static int recv_replies(int fd, uint16_t seq_base)
+{
+	char seen[BATCH_SIZE] = {0};
+	int count = 0;
+
+	// drain replies of the benchmark
+	u_char buf[1024];
+	while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+		;
+
+	fill_pkts(seq_base);
+	if (send_all(fd, pkts, BATCH_SIZE) != 0)
+		return -1;
+
+	while (count < BATCH_SIZE) {
+		struct pollfd pfd = {.fd = fd, .events = POLLIN};
+		if (poll(&pfd, 1, 1000) != 1) {
+			fprintf(stderr, "only %d replies received\n", count);
+			return -1;
+		}
+		ssize_t nr = recv(fd, buf, sizeof(buf), 0);
+		if (nr == -1) {
+			perror("recv");
+			return -1;
+		}
+		const struct ip *iphdr = (const struct ip *)buf;
+		size_t iphdr_len = iphdr->ip_hl << 2;
+		if ((size_t)nr < iphdr_len + ICMP_MINLEN)
+			continue;
+		const struct icmp *ih = (const struct icmp *)(buf + iphdr_len);
+		if (ih->icmp_type != ICMP_ECHOREPLY || ih->icmp_id != echo_id)
+			continue;
+		uint16_t i = ntohs(ih->icmp_seq) - seq_base;
+		if (i >= BATCH_SIZE || seen[i])
+			continue;
+		seen[i] = 1;
+		count++;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	int fd = neb_sock_raw_icmp4_new();
+	if (fd < 0) {
+		fprintf(stderr, "failed to create raw socket\n");
+		return -1;
+	}
+
+	int ret = 0;
+	echo_id = neb_random_uniform(UINT16_MAX);
+	fill_pkts(0);
+	if (bench(fd) != 0)
+		ret = -1;
+	if (ret == 0 && recv_replies(fd, 1000) != 0)
+		ret = -1;
+
+	close(fd);
+	return ret;
+}
@@ -0,0 +1,195 @@
+/*
+ * Send many datagrams to a local UDP socket, then receive them in batches.
+ * All of them should be received in order, with the peer address and the
+ * receive timestamp set. Over IPv6 with IPV6_RECVPKTINFO, the ifindex should
+ * also be set, the IPv6 case is skipped if the loopback has no ::1.
+ */
+
+#include <nebase/sock/inet.h>
+#include <nebase/endian.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <netinet/in.h>
+
+#define MSG_COUNT 20
+#define BATCH_SIZE 8
+#define MSG_SIZE 32
+
+static in_port_t addr_port(const struct sockaddr_storage *addr)
+{
+	if (addr->ss_family == AF_INET6)
+		return ((const struct sockaddr_in6 *)addr)->sin6_port;
+	return ((const struct sockaddr_in *)addr)->sin_port;
+}
+
+/**
+ * \return 1 if skipped
+ */
+static int test_family(int family)
+{
+	int ret = 0;
+	int rfd = -1, sfd = -1;
+	neb_sock_mmsg_ctx_t ctx = NULL;
+
+	rfd = neb_sock_inet_new(family, SOCK_DGRAM, 0);
+	sfd = neb_sock_inet_new(family, SOCK_DGRAM, 0);
+	if (rfd == -1 || sfd == -1) {
+		if (family == AF_INET6) {
+			ret = 1;
+			goto exit_close;
+		}
+		fprintf(stderr, "failed to create udp sockets\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	struct sockaddr_storage addr;
+	memset(&addr, 0, sizeof(addr));
+	socklen_t addrlen;
+	if (family == AF_INET6) {
+		struct sockaddr_in6 *a = (struct sockaddr_in6 *)&addr;
+		a->sin6_family = AF_INET6;
+		a->sin6_addr = in6addr_loopback;
+		addrlen = sizeof(struct sockaddr_in6);
+		int on = 1;
+		if (setsockopt(rfd, IPPROTO_IPV6, IPV6_RECVPKTINFO, &on, sizeof(on)) == -1) {
+			perror("setsockopt(IPV6_RECVPKTINFO)");
+			ret = -1;
+			goto exit_close;
+		}
+	} else {
+		struct sockaddr_in *a = (struct sockaddr_in *)&addr;
+		a->sin_family = AF_INET;
+		a->sin_addr.s_addr = neb_const_htobe32(INADDR_LOOPBACK);
+		addrlen = sizeof(struct sockaddr_in);
+	}
+	const socklen_t salen = addrlen;
+	if (bind(rfd, (struct sockaddr *)&addr, salen) == -1) {
+		if (family == AF_INET6 && errno == EADDRNOTAVAIL) {
+			ret = 1;
+			goto exit_close;
+		}
+		perror("bind");
+		ret = -1;
+		goto exit_close;
+	}
+	if (getsockname(rfd, (struct sockaddr *)&addr, &addrlen) == -1) {
+		perror("getsockname");
+		ret = -1;
+		goto exit_close;
+	}
+	struct sockaddr_storage saddr = addr;
+	if (family == AF_INET6)
+		((struct sockaddr_in6 *)&saddr)->sin6_port = 0;
+	else
+		((struct sockaddr_in *)&saddr)->sin_port = 0;
+	addrlen = salen;
+	if (bind(sfd, (struct sockaddr *)&saddr, salen) == -1 ||
+	    getsockname(sfd, (struct sockaddr *)&saddr, &addrlen) == -1) {
+		perror("bind");
+		ret = -1;
+		goto exit_close;
+	}
+	if (neb_sock_inet_enable_recv_time(rfd) != 0) {
+		fprintf(stderr, "failed to enable recv time\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	ctx = neb_sock_inet_mmsg_ctx_create(BATCH_SIZE, 0);
+	if (!ctx) {
+		fprintf(stderr, "failed to create mmsg ctx\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	char bufs[BATCH_SIZE][MSG_SIZE];
+	struct iovec iovs[BATCH_SIZE];
+	struct neb_sock_mmsghdr msgs[BATCH_SIZE];
+	memset(msgs, 0, sizeof(msgs));
+	for (int i = 0; i < BATCH_SIZE; i++) {
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = MSG_SIZE;
+		msgs[i].msg_iov = &iovs[i];
+		msgs[i].msg_iovlen = 1;
+	}
+
+	if (neb_sock_inet_recvmmsg(rfd, ctx, msgs, BATCH_SIZE) != 0) {
+		fprintf(stderr, "should get nothing before send\n");
+		ret = -1;
+		goto exit_close;
+	}
+
+	for (int i = 0; i < MSG_COUNT; i++) {
+		char msg[MSG_SIZE];
+		int len = snprintf(msg, sizeof(msg), "msg %d", i);
+		if (sendto(sfd, msg, len, 0, (struct sockaddr *)&addr, salen) != len) {
+			perror("sendto");
+			ret = -1;
+			goto exit_close;
+		}
+	}
+
+	int received = 0, batches = 0;
+	while (received < MSG_COUNT) {
+		int n = neb_sock_inet_recvmmsg(rfd, ctx, msgs, BATCH_SIZE);
+		if (n <= 0) {
+			fprintf(stderr, "failed to recv, ret %d after %d msgs\n", n, received);
+			ret = -1;
+			goto exit_close;
+		}
+		batches++;
+		for (int i = 0; i < n; i++, received++) {
+			char expect[MSG_SIZE];
+			int len = snprintf(expect, sizeof(expect), "msg %d", received);
+			const struct sockaddr_storage *peer = &msgs[i].msg_peer;
+			if (msgs[i].msg_len != (size_t)len || memcmp(bufs[i], expect, len) != 0) {
+				fprintf(stderr, "msg %d mismatch\n", received);
+				ret = -1;
+			}
+			if (peer->ss_family != family || addr_port(peer) != addr_port(&saddr)) {
+				fprintf(stderr, "msg %d has invalid peer address\n", received);
+				ret = -1;
+			}
+			if (!msgs[i].msg_ts.tv_sec) {
+				fprintf(stderr, "msg %d has no timestamp\n", received);
+				ret = -1;
+			}
+			if (family == AF_INET6 && !msgs[i].msg_ifindex) {
+				fprintf(stderr, "msg %d has no ifindex\n", received);
+				ret = -1;
+			}
+		}
+	}
+	fprintf(stdout, "family %d: received %d msgs in %d batches\n", family, received, batches);
+
+exit_close:
+	if (ctx)
+		neb_sock_inet_mmsg_ctx_destroy(ctx);
+	if (rfd >= 0)
+		close(rfd);
+	if (sfd >= 0)
+		close(sfd);
+	return ret;
+}
+
+int main(void)
+{
+	int ret = 0;
+	if (test_family(AF_INET) != 0)
+		ret = -1;
+	switch (test_family(AF_INET6)) {
+	case 0:
+		break;
+	case 1:
+		fprintf(stdout, "no IPv6 loopback, skipped\n");
+		break;
+	default:
+		ret = -1;
+		break;
+	}
+	return ret;
+}
@@ -0,0 +1,290 @@
+/*
+ * Search random texts for random pattern sets by the automaton, in one pass
+ * and in random chunks, and compare all matches with the naive search. Sets
+ * with 1, a few and many distinct first bytes are used to cover all the
+ * prefilters. Run with "bench" to also compare the throughput with
+ * Boyer-Moore passes.
+ */
+
+#include <nebase/str/ac.h>
+#include <nebase/str/bm.h>
+#include <nebase/random.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PATTERN_COUNT 200
+#define PATTERN_MAX_LEN 8
+#define TEXT_SIZE (16 * 1024)
+#define MAX_MATCHES (TEXT_SIZE * 64)
+
+#define BENCH_PATTERN_COUNT 5000
+#define BENCH_BM_COUNT 50
+#define BENCH_TEXT_SIZE (4 * 1024 * 1024)
+
+struct match {
+	int64_t offset;
+	int id;
+};
+
+struct matches {
+	struct match *m;
+	int count;
+	int stop_after; // 0 for not stop
+};
+
+static u_char patterns[PATTERN_COUNT][PATTERN_MAX_LEN];
+static int pattern_lens[PATTERN_COUNT];
+static u_char text[TEXT_SIZE];
+
+static int on_match(int id, int64_t offset, void *udata)
+{
+	struct matches *ms = udata;
+	if (ms->count == MAX_MATCHES)
+		return 1;
+	ms->m[ms->count].offset = offset;
+	ms->m[ms->count].id = id;
+	ms->count++;
+	return ms->stop_after && ms->count == ms->stop_after;
+}
+
+static int match_cmp(const void *a, const void *b)
+{
+	const struct match *x = a, *y = b;
+	if (x->offset != y->offset)
+		return x->offset < y->offset ? -1 : 1;
+	return x->id - y->id;
+}
+
+static void naive_search(struct matches *ms)
+{
+	ms->count = 0;
+	for (int64_t i = 0; i < TEXT_SIZE; i++) {
+		for (int j = 0; j < PATTERN_COUNT; j++) {
+			if (i + pattern_lens[j] <= TEXT_SIZE && memcmp(text + i, patterns[j], pattern_lens[j]) == 0)
+				on_match(j, i, ms);
+		}
+	}
+}
+
+static int compare(struct matches *expect, struct matches *got, const char *what)
+{
+	qsort(got->m, got->count, sizeof(struct match), match_cmp);
+	if (got->count != expect->count) {
+		fprintf(stderr, "%s: %d matches, expect %d\n", what, got->count, expect->count);
+		return -1;
+	}
+	for (int i = 0; i < got->count; i++) {
+		if (match_cmp(&got->m[i], &expect->m[i]) != 0) {
+			fprintf(stderr, "%s: match %d is (%d, %lld), expect (%d, %lld)\n", what, i,
+			        got->m[i].id, (long long)got->m[i].offset,
+			        expect->m[i].id, (long long)expect->m[i].offset);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/**
+ * \param[in] nfirst the number of distinct first bytes
+ * \param[in] asize the alphabet size of others
+ */
+static int test_set(int nfirst, int asize, struct matches *expect, struct matches *got)
+{
+	int ret = -1;
+	neb_str_ac_t a = neb_str_ac_create();
+	if (!a)
+		return -1;
+
+	for (int i = 0; i < PATTERN_COUNT; i++) {
+		if (i > 0 && neb_random_uniform(10) == 0) { // duplicated patterns with different ids
+			memcpy(patterns[i], patterns[i - 1], PATTERN_MAX_LEN);
+			pattern_lens[i] = pattern_lens[i - 1];
+		} else {
+			pattern_lens[i] = 1 + neb_random_uniform(PATTERN_MAX_LEN);
+			patterns[i][0] = 'a' + neb_random_uniform(nfirst);
+			for (int j = 1; j < pattern_lens[i]; j++)
+				patterns[i][j] = 'a' + neb_random_uniform(asize);
+		}
+		if (neb_str_ac_add(a, patterns[i], pattern_lens[i], i) != 0) {
+			fprintf(stderr, "failed to add pattern\n");
+			goto exit_destroy;
+		}
+	}
+	if (neb_str_ac_search(a, text, TEXT_SIZE, on_match, got) != -1) {
+		fprintf(stderr, "search should fail before compile\n");
+		goto exit_destroy;
+	}
+	if (neb_str_ac_compile(a) != 0) {
+		fprintf(stderr, "failed to compile\n");
+		goto exit_destroy;
+	}
+
+	for (int i = 0; i < TEXT_SIZE; i++) {
+		// some noise out of the alphabet to go back to root
+		if (neb_random_uniform(8) == 0)
+			text[i] = neb_random_uniform(256);
+		else
+			text[i] = 'a' + neb_random_uniform(asize > nfirst ? asize : nfirst);
+	}
+	naive_search(expect);
+	qsort(expect->m, expect->count, sizeof(struct match), match_cmp);
+
+	char what[64];
+	snprintf(what, sizeof(what), "nfirst %d one pass", nfirst);
+	got->count = 0;
+	if (neb_str_ac_search(a, text, TEXT_SIZE, on_match, got) != 0 || compare(expect, got, what) != 0)
+		goto exit_destroy;
+
+	snprintf(what, sizeof(what), "nfirst %d stream", nfirst);
+	got->count = 0;
+	struct neb_str_ac_stream s;
+	neb_str_ac_stream_init(&s);
+	for (int64_t off = 0; off < TEXT_SIZE; ) {
+		int64_t len = 1 + neb_random_uniform(64);
+		if (off + len > TEXT_SIZE)
+			len = TEXT_SIZE - off;
+		if (neb_str_ac_stream_search(a, &s, text + off, len, on_match, got) != 0)
+			goto exit_destroy;
+		off += len;
+	}
+	if (s.offset != TEXT_SIZE || compare(expect, got, what) != 0)
+		goto exit_destroy;
+
+	// stop at each match, then resume from where it stopped, other matches
+	// ending at the same byte are skipped
+	static char ends[TEXT_SIZE + 1];
+	memset(ends, 0, sizeof(ends));
+	int end_count = 0;
+	for (int i = 0; i < expect->count; i++) {
+		int64_t end = expect->m[i].offset + pattern_lens[expect->m[i].id];
+		if (!ends[end]) {
+			ends[end] = 1;
+			end_count++;
+		}
+	}
+	got->count = 0;
+	neb_str_ac_stream_init(&s);
+	for (;;) {
+		got->stop_after = got->count + 1;
+		int r = neb_str_ac_stream_search(a, &s, text + s.offset, TEXT_SIZE - s.offset, on_match, got);
+		if (r != 1)
+			break;
+		const struct match *m = &got->m[got->count - 1];
+		if (m->offset + pattern_lens[m->id] != s.offset) {
+			fprintf(stderr, "nfirst %d: stopped at %lld after match (%d, %lld)\n", nfirst,
+			        (long long)s.offset, m->id, (long long)m->offset);
+			got->stop_after = 0;
+			goto exit_destroy;
+		}
+	}
+	got->stop_after = 0;
+	if (s.offset != TEXT_SIZE || got->count != end_count) {
+		fprintf(stderr, "nfirst %d: %d stops, expect %d\n", nfirst, got->count, end_count);
+		goto exit_destroy;
+	}
+
+	ret = 0;
+exit_destroy:
+	neb_str_ac_destroy(a);
+	return ret;
+}
+
+static double elapsed(const struct timespec *s, const struct timespec *e)
+{
+	return (double)(e->tv_sec - s->tv_sec) + (double)(e->tv_nsec - s->tv_nsec) / 1e9;
+}
+
+static int count_match(int id _nattr_unused, int64_t offset _nattr_unused, void *udata)
+{
+	(*(int *)udata)++;
+	return 0;
+}
+
+static int bench(void)
+{
+	int ret = -1;
+	u_char *t = malloc(BENCH_TEXT_SIZE);
+	u_char (*ps)[16] = malloc(BENCH_PATTERN_COUNT * 16);
+	neb_str_ac_t a = neb_str_ac_create();
+	if (!t || !ps || !a)
+		goto exit_free;
+
+	neb_random_buf(t, BENCH_TEXT_SIZE);
+	neb_random_buf(ps, BENCH_PATTERN_COUNT * 16);
+	for (int i = 0; i < BENCH_PATTERN_COUNT; i++) {
+		if (neb_str_ac_add(a, ps[i], 8 + i % 9, i) != 0)
+			goto exit_free;
+	}
+	if (neb_str_ac_compile(a) != 0)
+		goto exit_free;
+
+	struct timespec s, e;
+	int count = 0;
+	clock_gettime(CLOCK_MONOTONIC, &s);
+	neb_str_ac_search(a, t, BENCH_TEXT_SIZE, count_match, &count);
+	clock_gettime(CLOCK_MONOTONIC, &e);
+	double ac_time = elapsed(&s, &e);
+
+	clock_gettime(CLOCK_MONOTONIC, &s);
+	for (int i = 0; i < BENCH_BM_COUNT; i++) {
+		neb_str_bm_ctx_t c = neb_str_bm_ctx_create(ps[i], 8 + i % 9);
+		if (!c)
+			goto exit_free;
+		for (const u_char *p = t, *end = t + BENCH_TEXT_SIZE; p < end; p++) {
+			p = neb_str_bm_ctx_search(c, p, end - p);
+			if (!p)
+				break;
+			count++;
+		}
+		neb_str_bm_ctx_destroy(c);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &e);
+	double bm_time = elapsed(&s, &e) * BENCH_PATTERN_COUNT / BENCH_BM_COUNT;
+
+	fprintf(stdout, "%d patterns over %d MB: ac %.3fs, bm passes %.3fs (estimated), %d matches\n",
+	        BENCH_PATTERN_COUNT, BENCH_TEXT_SIZE / (1024 * 1024), ac_time, bm_time, count);
+	ret = 0;
+
+exit_free:
+	if (a)
+		neb_str_ac_destroy(a);
+	free(ps);
+	free(t);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret = 0;
+	struct matches expect = {.m = malloc(sizeof(struct match) * MAX_MATCHES)};
+	struct matches got = {.m = malloc(sizeof(struct match) * MAX_MATCHES)};
+	if (!expect.m || !got.m) {
+		perror("malloc");
+		return -1;
+	}
+
+	// the last one has dense states other than the root
+	static const int sets[][2] = {{1, 4}, {3, 4}, {26, 4}, {2, 26}};
+	for (size_t i = 0; i < sizeof(sets) / sizeof(sets[0]); i++) {
+		if (test_set(sets[i][0], sets[i][1], &expect, &got) != 0)
+			ret = -1;
+	}
+
+	neb_str_ac_t a = neb_str_ac_create();
+	if (!a || neb_str_ac_add(a, (const u_char *)"", 0, 0) == 0) {
+		fprintf(stderr, "empty pattern should not be accepted\n");
+		ret = -1;
+	}
+	if (a)
+		neb_str_ac_destroy(a);
+
+	if (argc > 1 && strcmp(argv[1], "bench") == 0 && bench() != 0)
+		ret = -1;
+
+	free(expect.m);
+	free(got.m);
+	return ret;
+}
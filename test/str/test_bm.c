@@ -0,0 +1,285 @@
+/*
+ * Search random texts by Boyer-Moore contexts and one shot searches with
+ * pattern lengths covering all shift table widths, the short pattern path and
+ * the thread local cache, and texts that make the rare byte prefilter fall
+ * back, then search in random chunks by streams. All should find the same
+ * matches as the naive search. Run with "bench" to also compare the time of
+ * all paths.
+ */
+
+#include <nebase/str/bm.h>
+#include <nebase/random.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#define TEXT_SIZE (256 * 1024)
+#define ROUNDS 200
+
+#define BENCH_TEXT_SIZE (1024 * 1024)
+#define BENCH_CALLS 20
+
+static u_char *text;
+
+static const u_char *naive_search(const u_char *p, int pl, const u_char *t, int64_t tl)
+{
+	for (int64_t i = 0; i + pl <= tl; i++) {
+		if (memcmp(t + i, p, pl) == 0)
+			return t + i;
+	}
+	return NULL;
+}
+
+/**
+ * \param[in] asize alphabet size of the text and the pattern
+ */
+static void fill_random(u_char *buf, size_t len, int asize)
+{
+	for (size_t i = 0; i < len; i++)
+		buf[i] = asize == 256 ? neb_random_uniform(256) : 'a' + neb_random_uniform(asize);
+}
+
+static int check_ctx(const u_char *p, int pl, int64_t tl, const char *what)
+{
+	neb_str_bm_ctx_t c = neb_str_bm_ctx_create(p, pl);
+	if (!c) {
+		fprintf(stderr, "%s: failed to create ctx\n", what);
+		return -1;
+	}
+
+	int ret = 0;
+	const u_char *t = text, *end = text + tl;
+	for (;;) {
+		const u_char *expect = naive_search(p, pl, t, end - t);
+		const u_char *got = neb_str_bm_ctx_search(c, t, end - t);
+		const u_char *got_once = neb_str_bm_search(p, pl, t, end - t);
+		if (got != expect || got_once != expect) {
+			fprintf(stderr, "%s: pl %d: got %td and %td, expect %td\n", what, pl,
+			        got ? got - text : -1, got_once ? got_once - text : -1, expect ? expect - text : -1);
+			ret = -1;
+			break;
+		}
+		if (!got)
+			break;
+		t = got + 1;
+	}
+
+	neb_str_bm_ctx_destroy(c);
+	return ret;
+}
+
+static int check_stream(const u_char *p, int pl, int64_t tl)
+{
+	neb_str_bm_ctx_t c = neb_str_bm_ctx_create(p, pl);
+	if (!c)
+		return -1;
+	neb_str_bm_stream_t s = neb_str_bm_stream_create(c);
+	if (!s) {
+		neb_str_bm_ctx_destroy(c);
+		return -1;
+	}
+
+	int ret = -1;
+	const u_char *expect = text;
+	for (int64_t off = 0; off < tl; ) {
+		int64_t len = 1 + neb_random_uniform(pl * 2);
+		if (off + len > tl)
+			len = tl - off;
+		const u_char *chunk = text + off;
+		while (len > 0) {
+			int64_t consumed;
+			int64_t found = neb_str_bm_stream_search(s, chunk, len, &consumed);
+			chunk += consumed;
+			len -= consumed;
+			off += consumed;
+			if (found == -1)
+				break;
+			expect = naive_search(p, pl, expect, text + tl - expect);
+			if (!expect || found != expect - text) {
+				fprintf(stderr, "stream: pl %d: got %lld, expect %td\n", pl, (long long)found,
+				        expect ? expect - text : -1);
+				goto exit_destroy;
+			}
+			expect += pl; // not overlapped
+		}
+	}
+	if (naive_search(p, pl, expect, text + tl - expect)) {
+		fprintf(stderr, "stream: pl %d: match at %td is missing\n", pl,
+		        naive_search(p, pl, expect, text + tl - expect) - text);
+		goto exit_destroy;
+	}
+	if (neb_str_bm_stream_offset(s) != tl) {
+		fprintf(stderr, "stream: offset %lld, expect %lld\n", (long long)neb_str_bm_stream_offset(s), (long long)tl);
+		goto exit_destroy;
+	}
+	ret = 0;
+
+exit_destroy:
+	neb_str_bm_stream_destroy(s);
+	neb_str_bm_ctx_destroy(c);
+	return ret;
+}
+
+static double elapsed(const struct timespec *s, const struct timespec *e)
+{
+	return (double)(e->tv_sec - s->tv_sec) + (double)(e->tv_nsec - s->tv_nsec) / 1e9;
+}
+
+// the start of the text changes in each call, as memmem may be pure
+#define BENCH(label, expr)                                              \
+	do {                                                                \
+		struct timespec s_, e_;                                         \
+		clock_gettime(CLOCK_MONOTONIC, &s_);                            \
+		for (int i_ = 0; i_ < BENCH_CALLS; i_++) {                      \
+			if (expr)                                                   \
+				found++;                                                \
+		}                                                               \
+		clock_gettime(CLOCK_MONOTONIC, &e_);                            \
+		fprintf(stdout, "  %-24s %8.1f MB/s\n", label,                   \
+		        (double)BENCH_TEXT_SIZE * BENCH_CALLS / elapsed(&s_, &e_) / 1e6); \
+	} while (0)
+
+static const u_char *uncached_search(const u_char *p, int pl, const u_char *t, int64_t tl)
+{
+	neb_str_bm_ctx_t c = neb_str_bm_ctx_create(p, pl);
+	if (!c)
+		return NULL;
+	const u_char *r = neb_str_bm_ctx_search(c, t, tl);
+	neb_str_bm_ctx_destroy(c);
+	return r;
+}
+
+static int bench(void)
+{
+	static const int lens[] = {8, 64, 8192};
+	int found = 0;
+	u_char *t = malloc(BENCH_TEXT_SIZE);
+	u_char *p = malloc(lens[2]);
+	if (!t || !p) {
+		free(t);
+		free(p);
+		return -1;
+	}
+
+	neb_random_buf(t, BENCH_TEXT_SIZE);
+	for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); i++) {
+		int pl = lens[i];
+		neb_random_buf(p, pl);
+		neb_str_bm_ctx_t c = neb_str_bm_ctx_create(p, pl);
+		if (!c)
+			break;
+
+		fprintf(stdout, "pattern length %d:\n", pl);
+		BENCH("memmem", memmem(t + i_, BENCH_TEXT_SIZE - i_, p, pl));
+		BENCH("neb_str_bm_search", neb_str_bm_search(p, pl, t + i_, BENCH_TEXT_SIZE - i_));
+		BENCH("neb_str_bm_ctx_search", neb_str_bm_ctx_search(c, t + i_, BENCH_TEXT_SIZE - i_));
+		BENCH("ctx create and search", uncached_search(p, pl, t + i_, BENCH_TEXT_SIZE - i_));
+
+		neb_str_bm_ctx_destroy(c);
+	}
+
+	// short texts show the setup cost
+	static const u_char pattern[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	const int pl = sizeof(pattern) - 1;
+	const int n = BENCH_TEXT_SIZE / 256;
+	struct timespec s, e;
+	clock_gettime(CLOCK_MONOTONIC, &s);
+	for (int i = 0; i < n; i++) {
+		if (neb_str_bm_search(pattern, pl, t + i * 256, 256))
+			found++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &e);
+	double cached = elapsed(&s, &e);
+	clock_gettime(CLOCK_MONOTONIC, &s);
+	for (int i = 0; i < n; i++) {
+		if (uncached_search(pattern, pl, t + i * 256, 256))
+			found++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &e);
+	fprintf(stdout, "%d searches in 256 bytes: cached %.1f ns, uncached %.1f ns per call, %d found\n",
+	        n, cached * 1e9 / n, elapsed(&s, &e) * 1e9 / n, found);
+
+	free(p);
+	free(t);
+	return 0;
+}
+
+static void *thread_search(void *arg _nattr_unused)
+{
+	// fill the cache, which should be freed at thread exit
+	u_char p[32];
+	for (int i = 0; i < 16; i++) {
+		memset(p, 'a' + i, sizeof(p));
+		if (neb_str_bm_search(p, sizeof(p), text, TEXT_SIZE) != naive_search(p, sizeof(p), text, TEXT_SIZE))
+			return (void *)-1;
+	}
+	return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	text = malloc(TEXT_SIZE);
+	u_char *p = malloc(TEXT_SIZE);
+	if (!text || !p) {
+		perror("malloc");
+		return -1;
+	}
+
+	int ret = 0;
+	for (int i = 0; i < ROUNDS && ret == 0; i++) {
+		static const int asizes[] = {2, 4, 26, 256};
+		int asize = asizes[i % 4];
+		int pl = 1 + neb_random_uniform(i % 8 == 0 ? 600 : 24); // 8 and 16 bits tables
+		int64_t tl = 1 + neb_random_uniform(16 * 1024);
+		fill_random(text, tl, asize);
+		// take the pattern from the text most times
+		if (pl <= tl && neb_random_uniform(4) != 0)
+			memcpy(p, text + neb_random_uniform(tl - pl + 1), pl);
+		else
+			fill_random(p, pl, asize);
+		if (check_ctx(p, pl, tl, "random") != 0 || check_stream(p, pl, tl) != 0)
+			ret = -1;
+	}
+
+	// the prefilter should fall back to BM skip, as all candidates are false
+	memset(text, 'a', TEXT_SIZE);
+	memset(p, 'a', 100);
+	p[0] = 'b';
+	if (check_ctx(p, 100, TEXT_SIZE, "all false") != 0)
+		ret = -1;
+	text[TEXT_SIZE - 100] = 'b';
+	if (check_ctx(p, 100, TEXT_SIZE, "all false but the last") != 0)
+		ret = -1;
+
+	// int tables
+	fill_random(text, TEXT_SIZE, 4);
+	memcpy(p, text + TEXT_SIZE - 70000, 70000);
+	if (check_ctx(p, 70000, TEXT_SIZE, "long pattern") != 0 || check_stream(p, 70000, TEXT_SIZE) != 0)
+		ret = -1;
+
+	// more patterns than the cache size, and each one is searched again
+	fill_random(text, TEXT_SIZE, 2);
+	for (int i = 0; i < 64 && ret == 0; i++) {
+		int pl = 17 + (i % 12) * 3;
+		memcpy(p, text + (i * 977) % (TEXT_SIZE - pl), pl);
+		if (check_ctx(p, pl, TEXT_SIZE, "cached") != 0)
+			ret = -1;
+	}
+
+	pthread_t th;
+	void *th_ret = NULL;
+	if (pthread_create(&th, NULL, thread_search, NULL) != 0 || pthread_join(th, &th_ret) != 0 || th_ret) {
+		fprintf(stderr, "search in thread failed\n");
+		ret = -1;
+	}
+
+	if (ret == 0 && argc > 1 && strcmp(argv[1], "bench") == 0 && bench() != 0)
+		ret = -1;
+
+	free(p);
+	free(text);
+	return ret;
+}
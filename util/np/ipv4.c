@@ -4,6 +4,7 @@
 #include <nebase/sock/raw.h>
 #include <nebase/sock/inet.h>
 #include <nebase/time.h>
+#include <nebase/iobuf.h>
 
 #include "ipv4.h"
 
@@ -11,6 +12,7 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -23,6 +25,20 @@ struct ipv4_data {
 };
 
 static int ipv4_raw_fd = -1;
+static neb_iobuf_pool_t ipv4_pool = NULL;
+static neb_iobuf_t ipv4_buf = NULL; // cleared after each packet
+
+static void ipv4_buf_free(void)
+{
+	if (ipv4_buf) {
+		neb_iobuf_del(ipv4_buf);
+		ipv4_buf = NULL;
+	}
+	if (ipv4_pool) {
+		neb_iobuf_pool_destroy(ipv4_pool);
+		ipv4_pool = NULL;
+	}
+}
 
 static int on_remove(neb_evdp_source_t s)
 {
@@ -30,6 +46,7 @@ static int on_remove(neb_evdp_source_t s)
 		close(ipv4_raw_fd);
 		ipv4_raw_fd = -1;
 	}
+	ipv4_buf_free();
 	neb_evdp_source_del(s);
 	return 0;
 }
@@ -65,54 +82,53 @@ static int parse_cmsg(int level, int type, const u_char *data, size_t len _nattr
 
 static neb_evdp_cb_ret_t on_recv(int fd, void *udata _nattr_unused, const void *context _nattr_unused)
 {
-	static char buf[UINT16_MAX];
-
 	struct ipv4_data d = NEB_STRUCT_INITIALIZER;
 	d.peer_addr.sin_family = AF_INET;
 
-	struct iovec iov = {.iov_base = buf, .iov_len = sizeof(buf)};
-
 	struct neb_sock_msghdr m = {
 		.msg_peer = (struct sockaddr *)&d.peer_addr,
-		.msg_iov = &iov,
-		.msg_iovlen = 1,
 		.msg_control_cb = parse_cmsg,
 		.msg_udata = &d,
 	};
 
-	ssize_t nr = neb_sock_inet_recvmsg(fd, &m);
+	neb_iobuf_t b = ipv4_buf;
+	neb_evdp_cb_ret_t ret = NEB_EVDP_CB_CONTINUE;
+	// max IPv4 packet size, as the MTU of loopback is 65536, unused blocks are handed back
+	ssize_t nr = neb_sock_inet_recvmsg_iobuf(fd, &m, b, UINT16_MAX);
 	if (nr == -1) {
 		fprintf(stderr, "failed to recv icmp packet\n");
-		return NEB_EVDP_CB_BREAK_ERR;
+		ret = NEB_EVDP_CB_BREAK_ERR;
+		goto exit_clear;
 	}
 	size_t left = nr;
 
-	if (left < (int)sizeof(struct ip)) {
+	const struct ip *iphdr = neb_iobuf_pullup(b, sizeof(struct ip));
+	if (!iphdr) {
 		fprintf(stderr, "Invalid IPv4 msg: no valid header\n");
-		return NEB_EVDP_CB_CONTINUE;
+		goto exit_clear;
 	}
-	struct ip *iphdr = (struct ip *)buf;
 	size_t pktlen = neb_sock_raw4_get_pktlen(iphdr);
 	if (pktlen > left) {
 		fprintf(stderr, "Invalid IPv4 msg: pkt len %zu is larger than read size %zu\n", pktlen, left);
-		return NEB_EVDP_CB_CONTINUE;
+		goto exit_clear;
 	}
 	size_t iphdr_len = iphdr->ip_hl << 2;
 	if (iphdr_len > left) {
 		fprintf(stderr, "Invalid IPv4 msg: hdr len %zu is larger than read size %zu\n", iphdr_len, left);
-		return NEB_EVDP_CB_CONTINUE;
+		goto exit_clear;
 	}
 	d.local_addr.sin_family = AF_INET;
 	d.local_addr.sin_addr.s_addr = iphdr->ip_dst.s_addr;
 
+	neb_iobuf_consume(b, iphdr_len);
 	left -= iphdr_len;
-	if (left < (int)sizeof(struct icmp)) {
+	const struct icmp *icmphdr = neb_iobuf_pullup(b, sizeof(struct icmp));
+	if (!icmphdr) {
 		fprintf(stderr, "Invalid ICMP msg: no valid header\n");
-		return NEB_EVDP_CB_CONTINUE;
+		goto exit_clear;
 	}
-	struct icmp *icmphdr = (struct icmp *)(buf + iphdr_len);
 	if (icmphdr->icmp_type != ICMP_ECHOREPLY)
-		return NEB_EVDP_CB_CONTINUE;
+		goto exit_clear;
 
 	// handle d
 
@@ -123,19 +139,36 @@ static neb_evdp_cb_ret_t on_recv(int fd, void *udata _nattr_unused, const void *
 	fprintf(stdout, "%llds %ldns %s <- %s, ifindex %u, size %zu\n",
 		neb_time_sec_ll(d.ts.tv_sec), neb_time_nsec_l(d.ts.tv_nsec),
 		local_addr_s, peer_addr_s, d.ifindex, left);
-	return NEB_EVDP_CB_CONTINUE;
+
+exit_clear:
+	neb_iobuf_clear(b);
+	return ret;
 }
 
 int np_ipv4_init(neb_evdp_queue_t q)
 {
+	ipv4_pool = neb_iobuf_pool_create(0, 0);
+	if (!ipv4_pool) {
+		fprintf(stderr, "failed to create iobuf pool\n");
+		return -1;
+	}
+	ipv4_buf = neb_iobuf_new(ipv4_pool);
+	if (!ipv4_buf) {
+		fprintf(stderr, "failed to get iobuf\n");
+		ipv4_buf_free();
+		return -1;
+	}
+
 	ipv4_raw_fd = neb_sock_raw_icmp4_new();
 	if (ipv4_raw_fd == -1) {
 		perror("failed to create ICMP raw socket\n");
+		ipv4_buf_free();
 		return -1;
 	}
 	if (neb_sock_inet_enable_recv_time(ipv4_raw_fd) != 0) {
 		fprintf(stderr, "failed to enable the receive of timestamp\n");
 		close(ipv4_raw_fd);
+		ipv4_buf_free();
 		return -1;
 	}
 
@@ -143,6 +176,7 @@ int np_ipv4_init(neb_evdp_queue_t q)
 	if (!s) {
 		fprintf(stderr, "failed to create evdp source\n");
 		close(ipv4_raw_fd);
+		ipv4_buf_free();
 		return -1;
 	}
 	neb_evdp_source_set_on_remove(s, on_remove);
@@ -150,6 +184,7 @@ int np_ipv4_init(neb_evdp_queue_t q)
 		fprintf(stderr, "failed to attach evdp source to queue\n");
 		neb_evdp_source_del(s);
 		close(ipv4_raw_fd);
+		ipv4_buf_free();
 		return -1;
 	}
 